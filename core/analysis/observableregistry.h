@@ -0,0 +1,364 @@
+#ifndef OBSERVABLEREGISTRY_H
+#define OBSERVABLEREGISTRY_H
+
+#include "../common.h"
+#include "../wavefunction.h"
+#include "../representation/representation.h"
+#include "../utility/blitztricks.h"
+
+#include <vector>
+#include <string>
+
+/*
+ * Registry of observables which are evaluated in-situ during propagation.
+ *
+ * All registered observables are evaluated in one fused pass over the local
+ * wavefunction data, and the partial sums of all observables are reduced
+ * across procs with a single MPI call. The results are appended to a
+ * time series buffer, which can be read from python with GetTimes() and
+ * GetValues(), instead of calling GetNorm(), InnerProduct() etc. on every
+ * yield from Problem.Advance.
+ *
+ * Supported observables
+ * - Norm: sqrt(<psi|psi>), as returned by Wavefunction::GetNorm()
+ * - Diagonal expectation values: <psi|V|psi> where V is an array of the
+ *   same shape as the local wavefunction data (potential, dipole or
+ *   acceleration evaluated on the grid). Requires an orthogonal basis
+ *   in all ranks.
+ * - Projections: <phi|psi> on a stored wavefunction phi
+ *
+ * For non-orthogonal ranks, S psi is calculated once into a temporary
+ * buffer of psi before the fused pass. The weights of orthogonal ranks
+ * are precomputed in SetupStep() and applied in the fused pass.
+ */
+template<int Rank>
+class ObservableRegistry
+{
+public:
+	typedef boost::shared_ptr< ObservableRegistry<Rank> > Ptr;
+	typedef typename Wavefunction<Rank>::Ptr WavefunctionPtr;
+	typedef blitz::Array<cplx, Rank> DataArray;
+
+private:
+	enum ObservableType
+	{
+		ObservableNorm,
+		ObservableDiagonal,
+		ObservableProjection
+	};
+
+	struct Observable
+	{
+		std::string Name;
+		ObservableType Type;
+		DataArray Values;          //Diagonal values of V, or the data of phi
+	};
+
+	std::vector<Observable> Observables;
+	int Interval;
+	int StepCount;
+
+	blitz::Array<double, Rank> Weights;  //Product of the weights of orthogonal ranks
+	bool HasNonOrthogonalRanks;
+	bool IsSetup;
+
+	std::vector<double> Times;
+	std::vector<cplx> Values;
+
+	void AddObservable(const std::string &name, ObservableType type, DataArray values)
+	{
+		if (IsSetup)
+		{
+			throw std::runtime_error("Observables must be added before SetupStep()");
+		}
+		Observable obs;
+		obs.Name = name;
+		obs.Type = type;
+		obs.Values.reference(values);
+		Observables.push_back(obs);
+	}
+
+	void CheckShape(const std::string &name, const DataArray &values, const DataArray &data)
+	{
+		for (int rank=0; rank<Rank; rank++)
+		{
+			if (values.extent(rank) != data.extent(rank))
+			{
+				cout << "Observable " << name << " has shape " << values.shape() << ", but psi has shape " << data.shape() << endl;
+				throw std::runtime_error("Invalid shape of observable");
+			}
+		}
+		if (!values.isStorageContiguous() || !data.isStorageContiguous())
+		{
+			throw std::runtime_error("Observables and psi must be stored contiguously");
+		}
+	}
+
+	/*
+	 * Calculates S psi for the non-orthogonal ranks into the (unlocked) buffer
+	 * bufferName of psi. The active buffer of psi is unchanged on return
+	 */
+	void MultiplyOverlap(Wavefunction<Rank> &psi, int bufferName)
+	{
+		int activeBufferName = psi.GetActiveBufferName();
+		psi.GetData(bufferName) = psi.GetData();
+		psi.SetActiveBuffer(bufferName);
+		psi.GetRepresentation()->MultiplyOverlap(psi);
+		psi.SetActiveBuffer(activeBufferName);
+	}
+
+public:
+	ObservableRegistry() : Interval(1), StepCount(0), HasNonOrthogonalRanks(false), IsSetup(false) {}
+
+	void ApplyConfigSection(const ConfigSection &config)
+	{
+		if (config.HasValue("interval"))
+		{
+			config.Get("interval", Interval);
+		}
+		if (Interval < 1)
+		{
+			cout << "Invalid observable interval " << Interval << endl;
+			throw std::runtime_error("Observable interval must be at least 1");
+		}
+	}
+
+	void SetInterval(int interval)
+	{
+		Interval = interval;
+	}
+
+	int GetInterval()
+	{
+		return Interval;
+	}
+
+	void AddNorm(const std::string &name)
+	{
+		AddObservable(name, ObservableNorm, DataArray());
+	}
+
+	void AddDiagonalExpectationValue(const std::string &name, DataArray values)
+	{
+		AddObservable(name, ObservableDiagonal, values);
+	}
+
+	void AddProjection(const std::string &name, WavefunctionPtr phi)
+	{
+		//Reference the active buffer of phi, phi should not be changed after this
+		AddObservable(name, ObservableProjection, phi->GetData());
+	}
+
+	int GetObservableCount()
+	{
+		return Observables.size();
+	}
+
+	std::string GetObservableName(int index)
+	{
+		if (index < 0 || index >= (int)Observables.size())
+		{
+			throw std::runtime_error("Invalid observable index");
+		}
+		return Observables[index].Name;
+	}
+
+	/*
+	 * Precomputes the integration weights for psi, and checks
+	 * that all registered observables are compatible with psi
+	 */
+	void SetupStep(Wavefunction<Rank> &psi)
+	{
+		typename Representation<Rank>::Ptr repr = psi.GetRepresentation();
+		DataArray data = psi.GetData();
+
+		HasNonOrthogonalRanks = false;
+		Weights.resize(data.shape());
+		Weights = 1.0;
+		for (int rank=0; rank<Rank; rank++)
+		{
+			if (repr->IsOrthogonalBasis(rank))
+			{
+				blitz::Array<double, 1> weights = repr->GetLocalWeights(rank);
+				blitz::Array<double, 3> weights3d = MapToRank3(Weights, rank, 1);
+				weights3d *= weights(blitz::tensor::j) + 0*blitz::tensor::k;
+			}
+			else
+			{
+				HasNonOrthogonalRanks = true;
+			}
+		}
+
+		for (size_t i=0; i<Observables.size(); i++)
+		{
+			Observable &obs = Observables[i];
+			if (obs.Type == ObservableNorm)
+			{
+				continue;
+			}
+			CheckShape(obs.Name, obs.Values, data);
+			if (obs.Type == ObservableDiagonal && HasNonOrthogonalRanks)
+			{
+				cout << "Observable " << obs.Name << " requires an orthogonal basis in all ranks" << endl;
+				throw std::runtime_error("Diagonal expectation values are not supported for non-orthogonal basises");
+			}
+		}
+
+		IsSetup = true;
+	}
+
+	/*
+	 * Called every timestep. Evaluates the observables every Interval steps
+	 */
+	void AdvanceStep(Wavefunction<Rank> &psi, double t)
+	{
+		if (StepCount++ % Interval == 0)
+		{
+			Evaluate(psi, t);
+		}
+	}
+
+	/*
+	 * Evaluates all observables on psi in a single pass and appends
+	 * the results to the time series
+	 */
+	void Evaluate(Wavefunction<Rank> &psi, double t)
+	{
+		if (!IsSetup)
+		{
+			SetupStep(psi);
+		}
+
+		DataArray data = psi.GetData();
+		int count = Observables.size();
+		size_t size = data.size();
+
+		//Calculate S psi once for all observables
+		int overlapBufferName = -1;
+		const cplx* overlapPtr = data.data();
+		if (HasNonOrthogonalRanks)
+		{
+			overlapBufferName = psi.GetAvailableDataBufferName(data.shape());
+			if (overlapBufferName == -1)
+			{
+				overlapBufferName = psi.AllocateData(data.shape());
+			}
+			MultiplyOverlap(psi, overlapBufferName);
+			psi.LockBuffer(overlapBufferName);
+			overlapPtr = psi.GetData(overlapBufferName).data();
+		}
+
+		const cplx* psiPtr = data.data();
+		const double* weightPtr = Weights.data();
+		std::vector<const cplx*> valuePtr(count);
+		std::vector<ObservableType> types(count);
+		for (int i=0; i<count; i++)
+		{
+			valuePtr[i] = Observables[i].Values.data();
+			types[i] = Observables[i].Type;
+		}
+
+		blitz::Array<cplx, 1> localSum(count);
+		localSum = 0;
+
+		#pragma omp parallel
+		{
+			std::vector<cplx> partialSum(count, cplx(0.0));
+
+			#pragma omp for schedule(static)
+			for (long j=0; j<(long)size; j++)
+			{
+				cplx weighted = weightPtr[j] * overlapPtr[j];
+				cplx density = conj(psiPtr[j]) * weighted;
+				for (int i=0; i<count; i++)
+				{
+					switch (types[i])
+					{
+					case ObservableNorm:
+						partialSum[i] += density;
+						break;
+					case ObservableDiagonal:
+						partialSum[i] += valuePtr[i][j] * density;
+						break;
+					case ObservableProjection:
+						partialSum[i] += conj(valuePtr[i][j]) * weighted;
+						break;
+					}
+				}
+			}
+
+			#pragma omp critical
+			{
+				for (int i=0; i<count; i++)
+				{
+					localSum(i) += partialSum[i];
+				}
+			}
+		}
+
+		if (overlapBufferName != -1)
+		{
+			psi.UnLockBuffer(overlapBufferName);
+		}
+
+		blitz::Array<cplx, 1> globalSum(count);
+		psi.GetRepresentation()->GetDistributedModel()->GetGlobalSum(localSum, globalSum);
+
+		Times.push_back(t);
+		for (int i=0; i<count; i++)
+		{
+			cplx value = globalSum(i);
+			if (Observables[i].Type == ObservableNorm)
+			{
+				value = sqrt(value.real());
+			}
+			Values.push_back(value);
+		}
+	}
+
+	int GetSampleCount()
+	{
+		return Times.size();
+	}
+
+	/*
+	 * Returns the times at which the observables have been evaluated
+	 */
+	blitz::Array<double, 1> GetTimes()
+	{
+		blitz::Array<double, 1> times(Times.size());
+		for (size_t i=0; i<Times.size(); i++)
+		{
+			times(i) = Times[i];
+		}
+		return times;
+	}
+
+	/*
+	 * Returns the time series as a (sample, observable) array
+	 */
+	blitz::Array<cplx, 2> GetValues()
+	{
+		int count = Observables.size();
+		int sampleCount = Times.size();
+		blitz::Array<cplx, 2> values(sampleCount, count);
+		for (int i=0; i<sampleCount; i++)
+		{
+			for (int j=0; j<count; j++)
+			{
+				values(i, j) = Values[i*count + j];
+			}
+		}
+		return values;
+	}
+
+	void ClearValues()
+	{
+		Times.clear();
+		Values.clear();
+		StepCount = 0;
+	}
+};
+
+#endif
+
@@ -0,0 +1,221 @@
+#include "radialproductprojection.h"
+#include "../utility/blitzblas.h"
+#include "../utility/gilrelease.h"
+
+using namespace blitz;
+
+/*
+ * Creates a C-ordered view of the contiguous (rows x cols) matrix starting at data.
+ * The view does not reference count the underlying memory, and can therefore safely
+ * be created from inside a parallel region
+ */
+inline RadialProductProjector::MatrixType MapMatrix(cplx* data, int rows, int cols)
+{
+	return RadialProductProjector::MatrixType(data, shape(rows, cols), neverDeleteData);
+}
+
+void RadialProductProjector::SetRadialStates(int particle, int l, MatrixType states)
+{
+	if (particle < 0 || particle > 1)
+	{
+		cout << "Invalid particle " << particle << ", must be 0 or 1" << endl;
+		throw std::runtime_error("Invalid particle index");
+	}
+
+	if (Cache[particle].size() <= (size_t)l)
+	{
+		Cache[particle].resize(l+1);
+	}
+
+	RadialStates &cur = Cache[particle][l];
+	int radialCount = states.extent(0);
+	int stateCount = states.extent(1);
+
+	cur.States.resize(radialCount, stateCount);
+	cur.StatesConj.resize(radialCount, stateCount);
+	cur.StatesTrans.resize(stateCount, radialCount);
+	cur.StatesConjTrans.resize(stateCount, radialCount);
+
+	cur.States = states;
+	cur.StatesConj = conj(states);
+	cur.StatesTrans = states(tensor::j, tensor::i);
+	cur.StatesConjTrans = conj(states(tensor::j, tensor::i));
+}
+
+bool RadialProductProjector::HasRadialStates(int particle, int l) const
+{
+	if (particle < 0 || particle > 1 || l < 0 || Cache[particle].size() <= (size_t)l)
+	{
+		return false;
+	}
+	return !Cache[particle][l].IsEmpty();
+}
+
+void RadialProductProjector::ClearRadialStates()
+{
+	Cache[0].clear();
+	Cache[1].clear();
+}
+
+const RadialProductProjector::RadialStates& RadialProductProjector::GetRadialStates(int particle, int l) const
+{
+	if (!HasRadialStates(particle, l))
+	{
+		cout << "No radial states set for particle " << particle << ", l = " << l << endl;
+		throw std::runtime_error("Radial states not set");
+	}
+	return Cache[particle][l];
+}
+
+void RadialProductProjector::CheckPsi(const TensorType &psiData, const IndexVector &angularIndices, int radialCount) const
+{
+	if (psiData.extent(1) != radialCount || psiData.extent(2) != radialCount)
+	{
+		cout << "Radial extent of psi " << psiData.shape() << " does not match radial states (" << radialCount << ")" << endl;
+		throw std::runtime_error("Invalid shape of psi");
+	}
+	if (psiData.stride(2) != 1 || psiData.stride(1) != psiData.extent(2))
+	{
+		throw std::runtime_error("psi must be a contiguous C-ordered array");
+	}
+	for (int i0=0; i0<angularIndices.extent(0); i0++)
+	{
+		if (angularIndices(i0) < 0 || angularIndices(i0) >= psiData.extent(0))
+		{
+			cout << "Angular index " << angularIndices(i0) << " out of range [0, " << psiData.extent(0) << ")" << endl;
+			throw std::runtime_error("Invalid angular index");
+		}
+	}
+}
+
+RadialProductProjector::TensorType RadialProductProjector::CalculateProjection(int l1, int l2, TensorType psiData, IndexVector angularIndices) const
+{
+	int count1 = GetRadialStates(0, l1).States.extent(1);
+	int count2 = GetRadialStates(1, l2).States.extent(1);
+
+	TensorType proj(angularIndices.extent(0), count1, count2);
+	CalculateProjection(l1, l2, psiData, angularIndices, proj);
+	return proj;
+}
+
+void RadialProductProjector::CalculateProjection(int l1, int l2, TensorType psiData, IndexVector angularIndices, TensorType proj) const
+{
+	ReleaseGIL releaseGIL;
+	const RadialStates &V1 = GetRadialStates(0, l1);
+	const RadialStates &V2 = GetRadialStates(1, l2);
+
+	int count0 = angularIndices.extent(0);
+	int count1 = V1.States.extent(1);
+	int count2 = V2.States.extent(1);
+	int rcount = V1.States.extent(0);
+
+	CheckPsi(psiData, angularIndices, rcount);
+	if (V2.States.extent(0) != rcount)
+	{
+		throw std::runtime_error("Radial states for particle 0 and 1 have different radial extent");
+	}
+	if (proj.extent(0) != count0 || proj.extent(1) != count1 || proj.extent(2) != count2 || proj.stride(2) != 1 || proj.stride(1) != count2)
+	{
+		throw std::runtime_error("Invalid shape of projection array");
+	}
+
+	/*
+	 * Choose the multiplication order requiring the fewest flops
+	 *   (V1^H * Psi) * conj(V2) : count1 * rcount * (rcount + count2)
+	 *   V1^H * (Psi * conj(V2)) : count2 * rcount * (rcount + count1)
+	 */
+	bool leftFirst = count1 < count2;
+	int tempRows = leftFirst ? count1 : rcount;
+	int tempCols = leftFirst ? rcount : count2;
+
+	cplx* psiPtr = psiData.data();
+	cplx* projPtr = proj.data();
+	int psiBlockSize = rcount * rcount;
+	int projBlockSize = count1 * count2;
+
+	#pragma omp parallel
+	{
+		cplx* tempData = new cplx[tempRows * tempCols];
+		MatrixType temp = MapMatrix(tempData, tempRows, tempCols);
+
+		#pragma omp for schedule(dynamic)
+		for (int i0=0; i0<count0; i0++)
+		{
+			MatrixType psiSlice = MapMatrix(psiPtr + angularIndices(i0) * psiBlockSize, rcount, rcount);
+			MatrixType projSlice = MapMatrix(projPtr + i0 * projBlockSize, count1, count2);
+
+			if (leftFirst)
+			{
+				MatrixMatrixMultiply(V1.StatesConjTrans, psiSlice, temp);
+				MatrixMatrixMultiply(temp, V2.StatesConj, projSlice);
+			}
+			else
+			{
+				MatrixMatrixMultiply(psiSlice, V2.StatesConj, temp);
+				MatrixMatrixMultiply(V1.StatesConjTrans, temp, projSlice);
+			}
+		}
+
+		delete[] tempData;
+	}
+}
+
+blitz::Array<double, 2> RadialProductProjector::CalculatePopulation(int l1, int l2, TensorType psiData, IndexVector angularIndices) const
+{
+	ReleaseGIL releaseGIL;
+	TensorType proj = CalculateProjection(l1, l2, psiData, angularIndices);
+
+	blitz::Array<double, 2> pop(proj.extent(1), proj.extent(2));
+	pop = 0;
+	for (int i0=0; i0<proj.extent(0); i0++)
+	{
+		pop += sqr(abs(proj(i0, Range::all(), Range::all())));
+	}
+	return pop;
+}
+
+void RadialProductProjector::RemoveProjection(int l1, int l2, TensorType psiData, IndexVector angularIndices, TensorType outputPsi) const
+{
+	ReleaseGIL releaseGIL;
+	const RadialStates &V1 = GetRadialStates(0, l1);
+	const RadialStates &V2 = GetRadialStates(1, l2);
+
+	int count0 = angularIndices.extent(0);
+	int count1 = V1.States.extent(1);
+	int count2 = V2.States.extent(1);
+	int rcount = V1.States.extent(0);
+
+	CheckPsi(outputPsi, angularIndices, rcount);
+
+	//Calculate projection
+	TensorType proj = CalculateProjection(l1, l2, psiData, angularIndices);
+
+	cplx* outputPtr = outputPsi.data();
+	cplx* projPtr = proj.data();
+	int psiBlockSize = rcount * rcount;
+	int projBlockSize = count1 * count2;
+
+	#pragma omp parallel
+	{
+		cplx* tempData = new cplx[rcount * count2];
+		cplx* blockData = new cplx[rcount * rcount];
+		MatrixType temp = MapMatrix(tempData, rcount, count2);
+		MatrixType block = MapMatrix(blockData, rcount, rcount);
+
+		#pragma omp for schedule(dynamic)
+		for (int i0=0; i0<count0; i0++)
+		{
+			MatrixType psiSlice = MapMatrix(outputPtr + angularIndices(i0) * psiBlockSize, rcount, rcount);
+			MatrixType projSlice = MapMatrix(projPtr + i0 * projBlockSize, count1, count2);
+
+			//psi -= V1 * proj * V2^T
+			MatrixMatrixMultiply(V1.States, projSlice, temp);
+			MatrixMatrixMultiply(temp, V2.StatesTrans, block);
+			psiSlice -= block;
+		}
+
+		delete[] tempData;
+		delete[] blockData;
+	}
+}
+
@@ -0,0 +1,95 @@
+#ifndef RADIALPRODUCTPROJECTION_H
+#define RADIALPRODUCTPROJECTION_H
+
+#include "../common.h"
+
+#include <vector>
+
+/*
+ * Projection of a two particle wavefunction psi(angular, r1, r2) on products
+ * of single particle radial states
+ *
+ *     proj(i0, i1, i2) = <V1_i1(r1) V2_i2(r2) | psi(angIdx(i0), r1, r2)>
+ *                      = (V1^H * Psi_i0 * conj(V2))(i1, i2)
+ *
+ * where Psi_i0 is the (r1, r2) block of psi for the angular index angIdx(i0).
+ * Each angular block is computed as two matrix-matrix products (ZGEMM).
+ *
+ * The single particle states for each particle and each l are registered with
+ * SetRadialStates, and the conjugated/transposed projector matrices are cached
+ * until they are replaced or ClearRadialStates() is called, so that repeated
+ * projections (i.e. on many checkpoints or many energies) only pay for the
+ * matrix products.
+ *
+ * Remarks:
+ * - No symmetrization is made on either psi or the radial functions
+ * - Integration weights are assumed to have been applied to psi on beforehand
+ * - The angular indices are local indices, i.e. psi may be distributed
+ *   along the angular rank, but not along the radial ranks.
+ * - The projections release the GIL, so python threads (e.g. the chunk
+ *   prefetch of DatasetChunkReader) run while they compute.
+ */
+class RadialProductProjector
+{
+public:
+	typedef boost::shared_ptr<RadialProductProjector> Ptr;
+	typedef blitz::Array<cplx, 2> MatrixType;
+	typedef blitz::Array<cplx, 3> TensorType;
+	typedef blitz::Array<int, 1> IndexVector;
+
+private:
+	/*
+	 * Cached projector matrices for one l of one particle.
+	 * All matrices are stored contiguously in C-order, as required
+	 * by MatrixMatrixMultiply
+	 */
+	struct RadialStates
+	{
+		MatrixType States;          // (r, i)  V
+		MatrixType StatesTrans;     // (i, r)  V^T
+		MatrixType StatesConj;      // (r, i)  conj(V)
+		MatrixType StatesConjTrans; // (i, r)  V^H
+
+		bool IsEmpty() const { return States.size() == 0; }
+	};
+
+	std::vector< std::vector<RadialStates> > Cache;
+
+	const RadialStates& GetRadialStates(int particle, int l) const;
+	void CheckPsi(const TensorType &psiData, const IndexVector &angularIndices, int radialCount) const;
+
+public:
+	RadialProductProjector() : Cache(2) {}
+
+	/*
+	 * Registers the radial states V(r, i) for the given particle (0 or 1) and
+	 * angular momentum l. Previously cached states for (particle, l) are replaced.
+	 */
+	void SetRadialStates(int particle, int l, MatrixType states);
+	bool HasRadialStates(int particle, int l) const;
+	void ClearRadialStates();
+
+	/*
+	 * Returns the 3D array proj(i0, i1, i2) described above
+	 */
+	TensorType CalculateProjection(int l1, int l2, TensorType psiData, IndexVector angularIndices) const;
+	void CalculateProjection(int l1, int l2, TensorType psiData, IndexVector angularIndices, TensorType proj) const;
+
+	/*
+	 * Returns the population |proj(i0, i1, i2)|^2 summed over i0
+	 */
+	blitz::Array<double, 2> CalculatePopulation(int l1, int l2, TensorType psiData, IndexVector angularIndices) const;
+
+	/*
+	 * Removes the projection of psi on the radial product states. The projection is
+	 * calculated from psiData, and is removed from outputPsi
+	 *
+	 *     outputPsi_i0 -= V1 * proj_i0 * V2^T
+	 *
+	 * integration weights should be multiplied to psiData, but not to outputPsi.
+	 */
+	void RemoveProjection(int l1, int l2, TensorType psiData, IndexVector angularIndices, TensorType outputPsi) const;
+};
+
+#endif
+
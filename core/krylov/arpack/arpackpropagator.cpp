@@ -3,6 +3,7 @@
 #include <core/wavefunction.h>
 #include <core/utility/fortran.h>
 #include <core/utility/blitztricks.h>
+#include <core/mpi/communicator.h>
 
 #include "../krylovcommon.h"
 #include "arpack++/pcaupp.h"
@@ -161,7 +162,7 @@ void ArpackPropagator<Rank>::Solve(object callback, Wavefunction<Rank> &psi, Wav
 		if (UseParpack)
 		{
 			pcaupp(
-				MPI_COMM_WORLD, 
+				BaseCommunicator::Get(), 
 				iterationAction,             // Which action to take after this call (ido)
 				matrixType,                  // What type of problem s this (bmat)
 				matrixSize,                  // Size of matrix (matrixSize)x(matrixSize) (n)
@@ -268,7 +269,7 @@ void ArpackPropagator<Rank>::Solve(object callback, Wavefunction<Rank> &psi, Wav
 	if (UseParpack)
 	{
 		pceupp( 
-			MPI_COMM_WORLD, 
+			BaseCommunicator::Get(), 
 			findEigenvectors,           // (rvec)
 			'A',                        // 
 			Eigenvalues.data(),         // (d)
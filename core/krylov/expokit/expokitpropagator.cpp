@@ -70,23 +70,27 @@ void ExpokitPropagator<Rank>::AdvanceStep(object callback, typename Wavefunction
 	int wspSize = Workspace.size();
 	int iwspSize = IntegerWorkspace.size();
 
-	expokit::zgexpv( 
-		&n, 
-		&m, 
-		&this->TimeStep, 
-		in, 
-		out, 
-		&Tolerance, 
-		&MatrixNorm, 
-		Workspace.data(), 
-		&wspSize, 
-		IntegerWorkspace.data(), 
-		&iwspSize, 
-		MultiplyHamiltonian<Rank>, 
-		this, 
-		&trace, 
-		&flag
-	);
+	{
+		//The python callback takes the GIL back in MultiplyHamiltonian
+		ReleaseGIL releaseGIL;
+		expokit::zgexpv( 
+			&n, 
+			&m, 
+			&this->TimeStep, 
+			in, 
+			out, 
+			&Tolerance, 
+			&MatrixNorm, 
+			Workspace.data(), 
+			&wspSize, 
+			IntegerWorkspace.data(), 
+			&iwspSize, 
+			MultiplyHamiltonian<Rank>, 
+			this, 
+			&trace, 
+			&flag
+		);
+	}
 
 	if (flag != 0)
 	{
@@ -6,6 +6,8 @@
 #include <fstream>
 #include <sstream>
 #include <map>
+#include <vector>
+#include <algorithm>
 
 #include <core/common.h>
 #include <core/mpi/mpitraits.h>
@@ -24,6 +26,21 @@ using namespace piram;
 
 /*
  * Main GMRES-class
+ *
+ * If RecycleSize > 0, a deflation subspace is kept between calls to
+ * SolveVector (GCRO-DR, Parks et al. SIAM J. Sci. Comput. 28, 1651 (2006)).
+ * After each solve, the RecycleSize harmonic Ritz vectors U of smallest
+ * magnitude are extracted from the Krylov subspace, together with C = A U,
+ * where C is orthonormal. The next solve first removes the component of
+ * the residual in range(C), and then runs Arnoldi on (I - C C^H) A, such
+ * that the eigenvalues of A closest to zero, which slow down GMRES, are
+ * deflated. This is useful when a sequence of nearly identical systems
+ * are solved, as in inverse iterations or implicit time steps.
+ *
+ * If the operator has changed since the previous solve, C = A U is
+ * recalculated at the beginning of the next solve (RecycleSize operator
+ * applications). If RecycleFixedOperator is set, the operator is assumed
+ * to be the same in all solves, and this is skipped.
  */
 template <class T>
 class GMRES
@@ -47,6 +64,10 @@ public:
 	double Tolerance;
 
 	bool PerformDoubleOrthogonalization;
+
+	//Size of the deflation subspace kept between solves (0 to disable)
+	int RecycleSize;
+	bool RecycleFixedOperator;
 	
 	//Options
 	MPI_Comm CommBase;
@@ -68,6 +89,9 @@ public:
 		//"Arpack-default", perhaps the best accuracy we may hope for(?)
 		Tolerance = std::pow(std::numeric_limits<NormType>::epsilon(), 2.0/3.0);
 		PerformDoubleOrthogonalization = true;
+
+		RecycleSize = 0;
+		RecycleFixedOperator = false;
 	}
 
 private:
@@ -100,7 +124,17 @@ private:
 	VectorType Overlap;
 	VectorType Overlap2;
 	VectorType Overlap3;
+	//Recycled subspace, A RecycleU = RecycleC, RecycleC^H RecycleC = I
+	MatrixType RecycleU;
+	MatrixType RecycleC;
+	MatrixType RecycleTempU;
+	MatrixType RecycleTempC;
+	MatrixType RecycleProjection;   //RecycleC^H A v_j, stored as (j, i)
+	VectorType RecycleCoefficients; //Component of the solution in RecycleU
+	VectorType RecycleOverlap;
+	VectorType RecycleOverlap2;
 	//Scalars
+	int CurrentRecycleSize;
 	int CurrentArnoldiStep;
 	bool IsConverged;
 	bool HappyBreakdown;
@@ -122,6 +156,16 @@ private:
 	void PerformOrthogonalization(T originalNorm, T residualNorm);
 	void RecreateArnoldiFactorization();
 
+	int GetMaxArnoldiStep()
+	{
+		return BasisSize - 1 - CurrentRecycleSize;
+	}
+
+	void UpdateRecycleOperator();
+	void ProjectInitialResidual();
+	void ProjectRecycleSpace(int column, bool accumulate);
+	void UpdateRecycleSpace();
+
 	//Independent methods
 	
 	T CalculateGlobalNorm(VectorType &vector)
@@ -173,6 +217,20 @@ public:
 		Timers = TimerMap();
 	}
 
+	/*
+	 * Discards the recycled subspace, i.e. the next solve starts from
+	 * scratch
+	 */
+	void ResetRecycleSpace()
+	{
+		CurrentRecycleSize = 0;
+	}
+
+	int GetRecycleSpaceSize()
+	{
+		return CurrentRecycleSize;
+	}
+
 	double GetResidualNorm()
 	{
 		return real(CalculateGlobalNorm(Residual));
@@ -201,6 +259,10 @@ double GMRES<T>::EstimateMemoryUsage(int matrixSize, int basisSize)
 {
 	double largeSize = matrixSize * (basisSize + 3.0);
 	double smallSize = basisSize * (3*basisSize + 7.0);
+	if (RecycleSize > 0)
+	{
+		largeSize += matrixSize * (4.0*RecycleSize + 1.0);
+	}
 	return (largeSize + smallSize) * sizeof(T) / (1024.0*1024.0);
 }
 
@@ -235,8 +297,15 @@ void GMRES<T>::Setup()
 		Integration = typename IntegrationFunctor<T, NormType>::Ptr(new BLASIntegrationFunctor<T, NormType>(DisableMPI, CommBase));
 	}
 
-	//Allocate workspace-memory
-	ArnoldiVectors.resize(BasisSize, MatrixSize);
+	if (RecycleSize < 0 || (RecycleSize > 0 && RecycleSize >= BasisSize - 1))
+	{
+		cout << "GMRES: Invalid recycle size " << RecycleSize << " for basis size " << BasisSize << endl;
+		throw std::runtime_error("GMRES recycle size must be smaller than the basis size - 1");
+	}
+
+	//Allocate workspace-memory. When recycling, the last Arnoldi vector
+	//is kept as well, as it is needed to update the recycled subspace
+	ArnoldiVectors.resize(RecycleSize > 0 ? BasisSize+1 : BasisSize, MatrixSize);
 	Residual.resize(MatrixSize);
 	TempVector.resize(MatrixSize);
 	HessenbergMatrix.resize(BasisSize, BasisSize+1);
@@ -248,6 +317,20 @@ void GMRES<T>::Setup()
 	Overlap2.resize(BasisSize);
 	Overlap3.resize(BasisSize);
 
+	if (RecycleSize > 0)
+	{
+		RecycleU.resize(RecycleSize, MatrixSize);
+		RecycleC.resize(RecycleSize, MatrixSize);
+		RecycleTempU.resize(RecycleSize, MatrixSize);
+		RecycleTempC.resize(RecycleSize, MatrixSize);
+		RecycleProjection.resize(BasisSize, RecycleSize);
+		RecycleCoefficients.resize(RecycleSize);
+		RecycleOverlap.resize(BasisSize+1);
+		RecycleOverlap2.resize(BasisSize+1);
+		RecycleProjection = 0;
+	}
+	CurrentRecycleSize = 0;
+
 	ResetStatistics();
 
 	//Reset arnoldi factorization
@@ -277,11 +360,13 @@ void GMRES<T>::PerformInitialArnoldiStep()
 
 	//Apply operator
 	MultiplyOperator(v0, Residual);
+	ProjectRecycleSpace(0, false);
 
 	//Update Hessenberg Matrix
 	T alpha = CalculateGlobalInnerProduct(v0, Residual);
 	blas.AddVector(v0, -alpha, Residual);
 	HessenbergMatrix(0,0) = alpha;
+	ProjectRecycleSpace(0, true);
 
 	T beta = CalculateGlobalNorm(Residual);
 	if (std::abs(beta) < Tolerance)
@@ -314,6 +399,7 @@ void GMRES<T>::PerformArnoldiStep()
 	Timers["Arnoldi Step"].Stop();
 	MultiplyOperator(currentArnoldiVector, Residual);
 	Timers["Arnoldi Step"].Start();
+	ProjectRecycleSpace(j+1, false);
 	T origNorm = CalculateGlobalNorm(Residual);
 
 	//Perform Gram Schmidt to remove components of Residual 
@@ -336,6 +422,7 @@ void GMRES<T>::PerformArnoldiStep()
 		PerformOrthogonalization(origNorm, residualNorm);
 		Timers["Arnoldi Step"].Start();
 	}
+	ProjectRecycleSpace(j+1, true);
 
 	//Update the Hessenberg Matrix
 	HessenbergMatrix(j+1, blitz::Range(0, j+1)) = currentOverlap;
@@ -423,7 +510,7 @@ template<class T>
 void GMRES<T>::RecreateArnoldiFactorization()
 {
 	//Make sure we have a BasisSize-step arnoldi iteration
-	while (CurrentArnoldiStep < BasisSize-1 && !HappyBreakdown)
+	while (CurrentArnoldiStep < GetMaxArnoldiStep() && !HappyBreakdown)
 	{
 		PerformArnoldiStep();
 	}
@@ -435,7 +522,26 @@ void GMRES<T>::SolveVector(VectorType rightHandSide, VectorType solution)
 {
 	Timers["Total"].Start();
 	Residual = rightHandSide;
+
+	//Remove the part of the residual which is in the range of the
+	//recycled subspace
+	if (CurrentRecycleSize > 0)
+	{
+		UpdateRecycleOperator();
+		ProjectInitialResidual();
+	}
+
 	double inputNorm = std::abs(CalculateGlobalNorm(Residual));
+	if (CurrentRecycleSize > 0 && inputNorm < Tolerance)
+	{
+		//The recycled subspace already contains the solution
+		MatrixType recycleU(RecycleU(blitz::Range(0, CurrentRecycleSize-1), blitz::Range::all()));
+		VectorType coefficients(RecycleCoefficients(blitz::Range(0, CurrentRecycleSize-1)));
+		blas.MultiplyMatrixVector(recycleU, coefficients, solution);
+		ErrorEstimate = inputNorm;
+		Timers["Total"].Stop();
+		return;
+	}
 	blas.ScaleVector(Residual, 1.0/inputNorm);
 
 	/*
@@ -460,7 +566,7 @@ void GMRES<T>::SolveVector(VectorType rightHandSide, VectorType solution)
 	ErrorEstimate = HessenbergMatrix(CurrentArnoldiStep, CurrentArnoldiStep+1) ;
 	ErrorEstimateList(CurrentArnoldiStep) = ErrorEstimate;
 
-	while (CurrentArnoldiStep < BasisSize-1 && !HappyBreakdown && (std::abs(ErrorEstimate)>Tolerance))
+	while (CurrentArnoldiStep < GetMaxArnoldiStep() && !HappyBreakdown && (std::abs(ErrorEstimate)>Tolerance))
 	{
 		PerformArnoldiStep();
 
@@ -501,9 +607,340 @@ void GMRES<T>::SolveVector(VectorType rightHandSide, VectorType solution)
 	//}
 	blas.MultiplyMatrixVector(currentArnoldiMatrix, x, solution);
 
+	if (CurrentRecycleSize > 0)
+	{
+		//solution += U (C^H r0 - B y), where B = C^H A V
+		int k = CurrentRecycleSize;
+		MatrixType recycleU(RecycleU(blitz::Range(0, k-1), blitz::Range::all()));
+		MatrixType projection(RecycleProjection(blitz::Range(0, CurrentArnoldiStep), blitz::Range(0, k-1)));
+		VectorType coefficients(RecycleCoefficients(blitz::Range(0, k-1)));
+		blas.MultiplyMatrixVector(MatrixTranspose::None, projection, -1.0, x, 1.0, coefficients);
+		blas.MultiplyMatrixVector(MatrixTranspose::None, recycleU, 1.0, coefficients, 1.0, solution);
+	}
+
+	if (RecycleSize > 0)
+	{
+		UpdateRecycleSpace();
+	}
+
 	Timers["Total"].Stop();
 }
 
+
+/*
+ * Recalculates C = A U for a new operator, and orthonormalizes C by 
+ * Gram-Schmidt, applying the same transformation to U.
+ */
+template<class T>
+void GMRES<T>::UpdateRecycleOperator()
+{
+	if (RecycleFixedOperator)
+	{
+		return;
+	}
+
+	for (int i=0; i<CurrentRecycleSize; i++)
+	{
+		VectorType u(RecycleU(i, blitz::Range::all()));
+		VectorType c(RecycleC(i, blitz::Range::all()));
+		MultiplyOperator(u, c);
+	}
+
+	Timers["Recycle"].Start();
+	int k = CurrentRecycleSize;
+	for (int i=0; i<k; i++)
+	{
+		VectorType u(RecycleU(i, blitz::Range::all()));
+		VectorType c(RecycleC(i, blitz::Range::all()));
+		if (i > 0)
+		{
+			MatrixType prevU(RecycleU(blitz::Range(0, i-1), blitz::Range::all()));
+			MatrixType prevC(RecycleC(blitz::Range(0, i-1), blitz::Range::all()));
+			VectorType overlap(RecycleOverlap(blitz::Range(0, i-1)));
+			VectorType overlap2(RecycleOverlap2(blitz::Range(0, i-1)));
+			for (int pass=0; pass<2; pass++)
+			{
+				Integration->InnerProduct(prevC, c, overlap, overlap2);
+				blas.MultiplyMatrixVector(MatrixTranspose::None, prevC, -1.0, overlap, 1.0, c);
+				blas.MultiplyMatrixVector(MatrixTranspose::None, prevU, -1.0, overlap, 1.0, u);
+			}
+		}
+
+		T norm = CalculateGlobalNorm(c);
+		if (std::abs(norm) < Tolerance)
+		{
+			//A U has become (numerically) rank deficient, keep the first i vectors
+			CurrentRecycleSize = i;
+			break;
+		}
+		blas.ScaleVector(c, 1.0/norm);
+		blas.ScaleVector(u, 1.0/norm);
+	}
+	Timers["Recycle"].Stop();
+}
+
+
+/*
+ * Residual -= C C^H Residual, the solution in range(U) is U C^H Residual
+ */
+template<class T>
+void GMRES<T>::ProjectInitialResidual()
+{
+	int k = CurrentRecycleSize;
+	MatrixType recycleC(RecycleC(blitz::Range(0, k-1), blitz::Range::all()));
+	VectorType coefficients(RecycleCoefficients(blitz::Range(0, k-1)));
+	VectorType overlap(RecycleOverlap(blitz::Range(0, k-1)));
+
+	Integration->InnerProduct(recycleC, Residual, coefficients, overlap);
+	blas.MultiplyMatrixVector(MatrixTranspose::None, recycleC, -1.0, coefficients, 1.0, Residual);
+}
+
+
+/*
+ * Removes the component in range(C) from the new Arnoldi vector in
+ * Residual, and stores the coefficients in column of RecycleProjection. 
+ * Called before (accumulate = false) and after (accumulate = true) the
+ * orthogonalization against the Arnoldi vectors.
+ */
+template<class T>
+void GMRES<T>::ProjectRecycleSpace(int column, bool accumulate)
+{
+	int k = CurrentRecycleSize;
+	if (k == 0)
+	{
+		return;
+	}
+
+	Timers["Recycle"].Start();
+	MatrixType recycleC(RecycleC(blitz::Range(0, k-1), blitz::Range::all()));
+	VectorType overlap(RecycleOverlap(blitz::Range(0, k-1)));
+	VectorType overlap2(RecycleOverlap2(blitz::Range(0, k-1)));
+	Integration->InnerProduct(recycleC, Residual, overlap, overlap2);
+	blas.MultiplyMatrixVector(MatrixTranspose::None, recycleC, -1.0, overlap, 1.0, Residual);
+
+	VectorType projection(RecycleProjection(column, blitz::Range(0, k-1)));
+	if (accumulate)
+	{
+		projection += overlap;
+	}
+	else
+	{
+		projection = overlap;
+	}
+	Timers["Recycle"].Stop();
+}
+
+
+/*
+ * Replaces the recycled subspace with the RecycleSize harmonic Ritz
+ * vectors of smallest magnitude from the space spanned by the previous
+ * recycled subspace and the Arnoldi vectors of the last solve.
+ *
+ * With Vh = [U V_p], W = [C V_p+1] and A Vh = W G, the harmonic Ritz 
+ * vectors are Vh z, with
+ *   G^H G z = theta G^H W^H Vh z
+ * For the k smallest |theta|, collected in P, the new subspace is
+ *   G P = Q R,  C = W Q,  U = Vh P R^-1
+ */
+template<class T>
+void GMRES<T>::UpdateRecycleSpace()
+{
+	int k = RecycleSize;
+	int kc = CurrentRecycleSize;
+	int p = CurrentArnoldiStep + 1;
+	int N = kc + p;
+	if (N < k)
+	{
+		return;
+	}
+
+	Timers["Recycle"].Start();
+	blitz::Range all = blitz::Range::all();
+
+	//The last Arnoldi vector is the normalized residual of the last step
+	VectorType lastVector(ArnoldiVectors(p, all));
+	T beta = HessenbergMatrix(p-1, p);
+	if (std::abs(beta) > 0)
+	{
+		blas.CopyVector(Residual, lastVector);
+		blas.ScaleVector(lastVector, 1.0/beta);
+	}
+	else
+	{
+		lastVector = 0;
+	}
+	MatrixType arnoldiP(ArnoldiVectors(blitz::Range(0, p-1), all));
+	MatrixType arnoldiP1(ArnoldiVectors(blitz::Range(0, p), all));
+
+	//Small matrices are stored as (col, row)
+	MatrixType G(N, N+1);
+	G = 0;
+	for (int i=0; i<kc; i++)
+	{
+		G(i, i) = 1;
+		for (int j=0; j<p; j++)
+		{
+			G(kc+j, i) = RecycleProjection(j, i);
+		}
+	}
+	for (int j=0; j<p; j++)
+	{
+		for (int i=0; i<=p; i++)
+		{
+			G(kc+j, kc+i) = HessenbergMatrix(j, i);
+		}
+	}
+
+	//W^H Vh
+	MatrixType WV(N, N+1);
+	WV = 0;
+	for (int j=0; j<kc; j++)
+	{
+		VectorType u(RecycleU(j, all));
+		MatrixType recycleC(RecycleC(blitz::Range(0, kc-1), all));
+		VectorType overlapC(WV(j, blitz::Range(0, kc-1)));
+		VectorType overlapV(WV(j, blitz::Range(kc, N)));
+		VectorType tempC(RecycleOverlap(blitz::Range(0, kc-1)));
+		VectorType tempV(RecycleOverlap2(blitz::Range(0, p)));
+		Integration->InnerProduct(recycleC, u, overlapC, tempC);
+		Integration->InnerProduct(arnoldiP1, u, overlapV, tempV);
+	}
+	for (int j=0; j<p; j++)
+	{
+		WV(kc+j, kc+j) = 1;
+	}
+
+	//Reduce to a standard eigenvalue problem M z = theta z, M = (G^H W^H Vh)^-1 G^H G
+	MatrixType M(N, N);
+	MatrixType R(N, N);
+	for (int j=0; j<N; j++)
+	{
+		for (int i=0; i<N; i++)
+		{
+			T sumL = 0;
+			T sumR = 0;
+			for (int l=0; l<=N; l++)
+			{
+				sumL += conj(G(i, l)) * G(j, l);
+				sumR += conj(G(i, l)) * WV(j, l);
+			}
+			M(j, i) = sumL;
+			R(j, i) = sumR;
+		}
+	}
+	IntVectorType pivot(N);
+	if (lapack.CalculateLUFactorization(R, pivot) != 0)
+	{
+		cout << "GMRES: Could not update recycled subspace, keeping the previous" << endl;
+		Timers["Recycle"].Stop();
+		return;
+	}
+	lapack.SolveGeneralFactored(lapack.TransposeNone, R, pivot, M);
+
+	VectorType theta(N);
+	MatrixType leftVectors(1, 1);
+	MatrixType rightVectors(N, N);
+	lapack.CalculateEigenvectorFactorization(false, true, M, theta, leftVectors, rightVectors);
+
+	std::vector< std::pair<double, int> > order(N);
+	for (int i=0; i<N; i++)
+	{
+		order[i] = std::make_pair(std::abs(theta(i)), i);
+	}
+	std::sort(order.begin(), order.end());
+
+	MatrixType P(k, N);
+	for (int i=0; i<k; i++)
+	{
+		P(i, all) = rightVectors(order[i].second, all);
+	}
+
+	//Y = Vh P
+	for (int i=0; i<k; i++)
+	{
+		VectorType y(RecycleTempU(i, all));
+		VectorType pArnoldi(P(i, blitz::Range(kc, N-1)));
+		blas.MultiplyMatrixVector(arnoldiP, pArnoldi, y);
+		if (kc > 0)
+		{
+			MatrixType recycleU(RecycleU(blitz::Range(0, kc-1), all));
+			VectorType pRecycle(P(i, blitz::Range(0, kc-1)));
+			blas.MultiplyMatrixVector(MatrixTranspose::None, recycleU, 1.0, pRecycle, 1.0, y);
+		}
+	}
+
+	//G P = Q R by Gram-Schmidt (twice)
+	MatrixType Q(k, N+1);
+	MatrixType QR(k, k);
+	QR = 0;
+	for (int i=0; i<k; i++)
+	{
+		for (int l=0; l<=N; l++)
+		{
+			T sum = 0;
+			for (int j=0; j<N; j++)
+			{
+				sum += G(j, l) * P(i, j);
+			}
+			Q(i, l) = sum;
+		}
+		for (int pass=0; pass<2; pass++)
+		{
+			for (int j=0; j<i; j++)
+			{
+				T overlap = 0;
+				for (int l=0; l<=N; l++)
+				{
+					overlap += conj(Q(j, l)) * Q(i, l);
+				}
+				Q(i, all) -= overlap * Q(j, all);
+				QR(i, j) += overlap;
+			}
+		}
+		double norm = 0;
+		for (int l=0; l<=N; l++)
+		{
+			norm += std::norm(Q(i, l));
+		}
+		norm = std::sqrt(norm);
+		Q(i, all) /= norm;
+		QR(i, i) = norm;
+	}
+
+	//C = W Q, U = Y R^-1
+	for (int i=0; i<k; i++)
+	{
+		VectorType c(RecycleTempC(i, all));
+		VectorType qArnoldi(Q(i, blitz::Range(kc, N)));
+		blas.MultiplyMatrixVector(arnoldiP1, qArnoldi, c);
+		if (kc > 0)
+		{
+			MatrixType recycleC(RecycleC(blitz::Range(0, kc-1), all));
+			VectorType qRecycle(Q(i, blitz::Range(0, kc-1)));
+			blas.MultiplyMatrixVector(MatrixTranspose::None, recycleC, 1.0, qRecycle, 1.0, c);
+		}
+
+		VectorType u(RecycleTempU(i, all));
+		for (int j=0; j<i; j++)
+		{
+			VectorType prevU(RecycleTempU(j, all));
+			blas.AddVector(prevU, -QR(i, j), u);
+		}
+		blas.ScaleVector(u, 1.0/QR(i, i));
+	}
+
+	MatrixType swap;
+	swap.reference(RecycleU);
+	RecycleU.reference(RecycleTempU);
+	RecycleTempU.reference(swap);
+	swap.reference(RecycleC);
+	RecycleC.reference(RecycleTempC);
+	RecycleTempC.reference(swap);
+	CurrentRecycleSize = k;
+
+	Timers["Recycle"].Stop();
+}
+
 template<class T>
 void GMRES<T>::PrintStatistics()
 {
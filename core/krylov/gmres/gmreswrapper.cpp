@@ -67,6 +67,16 @@ void GmresWrapper<Rank>::ApplyConfigSection(const ConfigSection &config)
 		cout << "Using doubleorth = " << performDoubleOrthogonalization << endl;
 		Solver.PerformDoubleOrthogonalization = performDoubleOrthogonalization;
 	}
+
+	//Size of the subspace recycled between solves (GCRO-DR)
+	if (config.HasValue("krylov_recycle_size"))
+	{
+		config.Get("krylov_recycle_size", Solver.RecycleSize);
+	}
+	if (config.HasValue("krylov_recycle_fixed_operator"))
+	{
+		config.Get("krylov_recycle_fixed_operator", Solver.RecycleFixedOperator);
+	}
 }
 
 
@@ -75,6 +85,7 @@ void GmresWrapper<Rank>::Setup(const typename Wavefunction<Rank>::Ptr psi)
 {
 	Solver.MatrixSize = psi->GetData().size();
     Solver.DisableMPI = psi->GetRepresentation()->GetDistributedModel()->IsSingleProc();
+	Solver.CommBase = psi->GetRepresentation()->GetDistributedModel()->GetComm();
 	Solver.MatrixOperator = typename PypropOperatorFunctor<Rank>::Ptr( new PypropOperatorFunctor<Rank>(this) );
 	Solver.Setup();
 }
@@ -86,6 +86,29 @@ public:
 		return Solver.GetHessenbergMatrix();
 	}
 
+	/*
+	 * Discards the recycled subspace, e.g. when the next right hand 
+	 * sides are unrelated to the previous ones
+	 */
+	void ResetRecycleSpace()
+	{
+		Solver.ResetRecycleSpace();
+	}
+
+	int GetRecycleSpaceSize()
+	{
+		return Solver.GetRecycleSpaceSize();
+	}
+
+	/*
+	 * If the operator does not change between solves (e.g. shift-invert
+	 * with a fixed shift), A U is not recomputed before each solve
+	 */
+	void SetRecycleFixedOperator(bool fixedOperator)
+	{
+		Solver.RecycleFixedOperator = fixedOperator;
+	}
+
 };
 
 } // Namespace
@@ -25,6 +25,9 @@ BOOST_PYTHON_MODULE(libgmres)
         .def("GetErrorEstimate", &krylov::GmresWrapper<1>::GetErrorEstimate)
         .def("GetErrorEstimateList", &krylov::GmresWrapper<1>::GetErrorEstimateList)
         .def("GetHessenbergMatrix", &krylov::GmresWrapper<1>::GetHessenbergMatrix)
+        .def("ResetRecycleSpace", &krylov::GmresWrapper<1>::ResetRecycleSpace)
+        .def("GetRecycleSpaceSize", &krylov::GmresWrapper<1>::GetRecycleSpaceSize)
+        .def("SetRecycleFixedOperator", &krylov::GmresWrapper<1>::SetRecycleFixedOperator)
         .def("SetupResidual", &PypropKrylovWrapper::SetupResidual)
     ;
 
@@ -41,6 +44,9 @@ BOOST_PYTHON_MODULE(libgmres)
         .def("GetErrorEstimate", &krylov::GmresWrapper<2>::GetErrorEstimate)
         .def("GetErrorEstimateList", &krylov::GmresWrapper<2>::GetErrorEstimateList)
         .def("GetHessenbergMatrix", &krylov::GmresWrapper<2>::GetHessenbergMatrix)
+        .def("ResetRecycleSpace", &krylov::GmresWrapper<2>::ResetRecycleSpace)
+        .def("GetRecycleSpaceSize", &krylov::GmresWrapper<2>::GetRecycleSpaceSize)
+        .def("SetRecycleFixedOperator", &krylov::GmresWrapper<2>::SetRecycleFixedOperator)
         .def("SetupResidual", &PypropKrylovWrapper::SetupResidual)
     ;
 
@@ -57,6 +63,9 @@ BOOST_PYTHON_MODULE(libgmres)
         .def("GetErrorEstimate", &krylov::GmresWrapper<3>::GetErrorEstimate)
         .def("GetErrorEstimateList", &krylov::GmresWrapper<3>::GetErrorEstimateList)
         .def("GetHessenbergMatrix", &krylov::GmresWrapper<3>::GetHessenbergMatrix)
+        .def("ResetRecycleSpace", &krylov::GmresWrapper<3>::ResetRecycleSpace)
+        .def("GetRecycleSpaceSize", &krylov::GmresWrapper<3>::GetRecycleSpaceSize)
+        .def("SetRecycleFixedOperator", &krylov::GmresWrapper<3>::SetRecycleFixedOperator)
         .def("SetupResidual", &PypropKrylovWrapper::SetupResidual)
     ;
 
@@ -73,6 +82,9 @@ BOOST_PYTHON_MODULE(libgmres)
         .def("GetErrorEstimate", &krylov::GmresWrapper<4>::GetErrorEstimate)
         .def("GetErrorEstimateList", &krylov::GmresWrapper<4>::GetErrorEstimateList)
         .def("GetHessenbergMatrix", &krylov::GmresWrapper<4>::GetHessenbergMatrix)
+        .def("ResetRecycleSpace", &krylov::GmresWrapper<4>::ResetRecycleSpace)
+        .def("GetRecycleSpaceSize", &krylov::GmresWrapper<4>::GetRecycleSpaceSize)
+        .def("SetRecycleFixedOperator", &krylov::GmresWrapper<4>::SetRecycleFixedOperator)
         .def("SetupResidual", &PypropKrylovWrapper::SetupResidual)
     ;
 
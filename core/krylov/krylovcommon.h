@@ -3,6 +3,7 @@
 
 #include <core/common.h>
 #include <core/utility/boostpythonhack.h>
+#include <core/utility/gilrelease.h>
 #include "krylovbase.h"
 
 namespace krylov
@@ -47,7 +48,10 @@ void MultiplyHamiltonian(void *data, cplx *inBuffer, cplx *outBuffer)
 	tempPsi->SetData(outData);
 
 	//Perform Hamilton-Wavefunction multiplication
-	propagator->MultiplyCallback(psi, tempPsi, propagator->TimeStep, propagator->CurTime);
+	{
+		AcquireGIL acquireGIL;
+		propagator->MultiplyCallback(psi, tempPsi, propagator->TimeStep, propagator->CurTime);
+	}
 
 	//Restore the databuffers of psi and tempPsi
 	psi->SetData(psiOrigData);
@@ -0,0 +1,708 @@
+#ifndef LOBPCG_H
+#define LOBPCG_H
+
+#include <limits>
+#include <iostream>
+#include <map>
+#include <algorithm>
+
+#include <core/common.h>
+#include <core/mpi/mpitraits.h>
+#include <core/utility/blitzlapack.h>
+#include <core/utility/timer.h>
+
+#include <random/uniform.h>
+
+#include "../piram/piram/blitzblas.h"
+#include "../piram/piram/functors.h"
+
+
+namespace lobpcg
+{
+using namespace blitz::linalg;
+
+using namespace piram;
+
+/*
+ * Block eigensolver for the lowest eigenvalues of the hermitian
+ * (generalized) eigenvalue problem
+ *
+ *   A x = lambda B x
+ *
+ * by the locally optimal block preconditioned conjugate gradient method
+ * (LOBPCG, Knyazev, SIAM J. Sci. Comput. 23, 517 (2001)).
+ *
+ * Every iteration performs a Rayleigh-Ritz step in the subspace spanned
+ * by the current Ritz vectors X, the preconditioned residuals
+ * W = T (A X - B X Lambda) and the previous search directions P. The
+ * basis [X W P] is kept B-orthonormal by Gram-Schmidt, and vectors which
+ * are numerically dependent on the previous ones are dropped. This avoids
+ * the ill-conditioned Gram matrices of the original formulation as the
+ * iteration converges.
+ *
+ * Converged Ritz vectors are soft locked: They are kept in X, but no new
+ * directions are added for them, such that an iteration costs one
+ * operator application for each unconverged vector in the block.
+ *
+ * B is the identity unless OverlapOperator is set, and T is the identity
+ * unless Preconditioner is set. A good preconditioner is (A - sigma B)^-1
+ * for some sigma below the lowest eigenvalue, solved approximately.
+ */
+template <class T>
+class LOBPCG
+{
+public:
+	//Helper types
+	typedef double NormType;
+	typedef blitz::Array<T, 1> VectorType;
+	typedef blitz::Array<NormType, 1> NormVectorType;
+	typedef blitz::Array<int, 1> IntVectorType;
+	typedef blitz::Array<T, 2> MatrixType;
+	typedef blitz::linalg::LAPACK<T> LAPACK;
+	typedef blitz::linalg::BLAS<T> BLAS;
+
+	typedef std::map< std::string, Timer > TimerMap;
+
+	//Parameters
+	int MatrixSize;
+	int EigenvalueCount;
+	int BlockSize;
+	int MaxIterationCount;
+	double Tolerance;
+	double DropTolerance;
+
+	//Options
+	MPI_Comm CommBase;
+	bool DisableMPI;
+
+	//Operator classes, must implement operator()(VectorType &in, VectorType &out)
+	typename OperatorFunctor<T>::Ptr MatrixOperator;
+	typename OperatorFunctor<T>::Ptr OverlapOperator;
+	typename OperatorFunctor<T>::Ptr Preconditioner;
+
+	//Constructor
+	LOBPCG()
+	{
+		//Default Params
+		EigenvalueCount = 1;
+		BlockSize = 0;
+		MaxIterationCount = 100;
+		Tolerance = 1e-8;
+		DropTolerance = 1e-8;
+		CommBase = MPI_COMM_WORLD;
+		DisableMPI = false;
+	}
+
+private:
+	LAPACK lapack;
+	BLAS blas;
+
+	int ProcId;
+	int ProcCount;
+
+	typename IntegrationFunctor<T, NormType>::Ptr Integration;
+
+	//Iteration variables
+	/*
+	 * As in GMRES, the vectors are stored in the rows of the matrices,
+	 * i.e. M(i, j) is element j of vector i, such that each vector is
+	 * contiguous in memory, and a set of vectors can be passed to BLAS
+	 * as a col-major matrix with the vectors as columns.
+	 *
+	 * The projected matrix is stored in LAPACK layout, M(col, row).
+	 */
+	//Large matrices/vectors (~ size of MatrixSize)
+	MatrixType Basis;             //[X W P], B-orthonormal
+	MatrixType BasisA;            //A [X W P]
+	MatrixType BasisB;            //B [X W P], references Basis if B = I
+	MatrixType Directions;        //P
+	MatrixType DirectionsA;       //A P
+	MatrixType DirectionsB;       //B P
+	MatrixType TempBlock;
+	VectorType TempVector;
+	//Small matrices/vectors (~ size of BlockSize)
+	MatrixType RitzMatrix;
+	NormVectorType RitzValues;
+	NormVectorType ResidualNorms;
+	IntVectorType ActiveIndices;
+	VectorType Overlap;
+	VectorType Overlap2;
+	//Scalars
+	bool UseOverlap;
+	bool HasDirections;
+	int ActiveCount;
+	int ConvergedCount;
+
+	//Statistics
+	int OperatorCount;
+	int IterationCount;
+	int DroppedVectorCount;
+	TimerMap Timers;
+
+	//Private methods
+	void MultiplyOperator(VectorType &in, VectorType &out);
+	void ApplyOperators(int first, int count);
+	void SetupInitialBlock(VectorType &initialVector);
+	int Orthonormalize(int first, int count);
+	void PerformRayleighRitz(int basisSize);
+	void UpdateRitzVectors(int basisSize);
+	void CalculateResiduals();
+	void CopyVectors(MatrixType &src, int srcIndex, MatrixType &dst, int dstIndex);
+
+	VectorType GetVector(MatrixType &matrix, int index)
+	{
+		return matrix(index, blitz::Range::all());
+	}
+
+	MatrixType GetVectors(MatrixType &matrix, int first, int count)
+	{
+		return matrix(blitz::Range(first, first+count-1), blitz::Range::all());
+	}
+
+	NormType CalculateOverlapNorm(VectorType &x, VectorType &bx)
+	{
+		return std::sqrt(std::max(real(Integration->InnerProduct(x, bx)), 0.0));
+	}
+
+public:
+	double EstimateMemoryUsage(int matrixSize, int blockSize, bool useOverlap);
+	void Setup();
+	void Solve(VectorType initialVector);
+	void PrintStatistics();
+
+	int GetBlockSize()
+	{
+		return BlockSize;
+	}
+
+	int GetOperatorCount()
+	{
+		return OperatorCount;
+	}
+
+	int GetIterationCount()
+	{
+		return IterationCount;
+	}
+
+	/*
+	 * Returns the number of the EigenvalueCount lowest eigenvalues
+	 * which are converged
+	 */
+	int GetConvergedEigenvalueCount()
+	{
+		return ConvergedCount;
+	}
+
+	void ResetStatistics()
+	{
+		OperatorCount = 0;
+		IterationCount = 0;
+		DroppedVectorCount = 0;
+
+		Timers = TimerMap();
+	}
+
+	/*
+	 * Returns the EigenvalueCount lowest Ritz values
+	 */
+	NormVectorType GetEigenvalues()
+	{
+		NormVectorType eigenvalues(EigenvalueCount);
+		eigenvalues = RitzValues(blitz::Range(0, EigenvalueCount-1));
+		return eigenvalues;
+	}
+
+	/*
+	 * Returns the 2-norm of the residual A x - lambda B x for the
+	 * EigenvalueCount lowest Ritz pairs
+	 */
+	NormVectorType GetResidualNorms()
+	{
+		NormVectorType residualNorms(EigenvalueCount);
+		residualNorms = ResidualNorms(blitz::Range(0, EigenvalueCount-1));
+		return residualNorms;
+	}
+
+	/*
+	 * Returns (the local part of) Ritz vector i, normalized
+	 * in the B inner product
+	 */
+	VectorType GetEigenvector(int index)
+	{
+		if (index < 0 || index >= EigenvalueCount)
+		{
+			cout << "Invalid eigenvector index " << index << ", eigenvalue count is " << EigenvalueCount << endl;
+			throw std::runtime_error("Invalid eigenvector index");
+		}
+		VectorType eigenvector(MatrixSize);
+		eigenvector = Basis(index, blitz::Range::all());
+		return eigenvector;
+	}
+};
+
+template <class T>
+double LOBPCG<T>::EstimateMemoryUsage(int matrixSize, int blockSize, bool useOverlap)
+{
+	double vectorCount = useOverlap ? 3*3 + 3 : 2*3 + 2;
+	double largeSize = matrixSize * (vectorCount * blockSize + blockSize + 1.0);
+	return largeSize * sizeof(T) / (1024.0*1024.0);
+}
+
+
+template <class T>
+void LOBPCG<T>::Setup()
+{
+	//Setup MPI
+	if (!DisableMPI)
+	{
+		MPI_Comm_rank(CommBase, &ProcId);
+		MPI_Comm_size(CommBase, &ProcCount);
+	}
+	else
+	{
+		ProcId = 0;
+		ProcCount = 1;
+	}
+
+	if (BlockSize <= 0)
+	{
+		BlockSize = EigenvalueCount;
+	}
+	if (EigenvalueCount <= 0 || BlockSize < EigenvalueCount)
+	{
+		cout << "LOBPCG: Invalid block size " << BlockSize << " for eigenvalue count " << EigenvalueCount << endl;
+		throw std::runtime_error("LOBPCG block size must be at least the eigenvalue count");
+	}
+
+	//The Gram-Schmidt process works on the unweighted vectors,
+	//the weights are taken care of by OverlapOperator
+	Integration = typename IntegrationFunctor<T, NormType>::Ptr(new BLASIntegrationFunctor<T, NormType>(DisableMPI, CommBase));
+	UseOverlap = OverlapOperator != 0;
+
+	//Allocate workspace-memory
+	int m = BlockSize;
+	Basis.resize(3*m, MatrixSize);
+	BasisA.resize(3*m, MatrixSize);
+	Directions.resize(m, MatrixSize);
+	DirectionsA.resize(m, MatrixSize);
+	if (UseOverlap)
+	{
+		BasisB.resize(3*m, MatrixSize);
+		DirectionsB.resize(m, MatrixSize);
+	}
+	else
+	{
+		BasisB.reference(Basis);
+		DirectionsB.reference(Directions);
+	}
+	TempBlock.resize(m, MatrixSize);
+	TempVector.resize(MatrixSize);
+
+	RitzMatrix.resize(3*m, 3*m);
+	RitzValues.resize(3*m);
+	ResidualNorms.resize(m);
+	ActiveIndices.resize(m);
+	Overlap.resize(3*m);
+	Overlap2.resize(3*m);
+
+	RitzValues = 0;
+	ResidualNorms = 0;
+	ConvergedCount = 0;
+
+	ResetStatistics();
+}
+
+
+template <class T>
+void LOBPCG<T>::MultiplyOperator(VectorType &in, VectorType &out)
+{
+	Timers["Operator"].Start();
+
+	//Update statistics
+	OperatorCount++;
+
+	//Perform matrix-vector multiplication
+	(*MatrixOperator)(in, out);
+
+	Timers["Operator"].Stop();
+}
+
+
+/*
+ * Calculates A s and B s for the vectors s in Basis[first:first+count]
+ */
+template <class T>
+void LOBPCG<T>::ApplyOperators(int first, int count)
+{
+	for (int i=first; i<first+count; i++)
+	{
+		VectorType v(GetVector(Basis, i));
+		VectorType av(GetVector(BasisA, i));
+		MultiplyOperator(v, av);
+
+		if (UseOverlap)
+		{
+			Timers["Overlap"].Start();
+			VectorType bv(GetVector(BasisB, i));
+			(*OverlapOperator)(v, bv);
+			Timers["Overlap"].Stop();
+		}
+	}
+}
+
+
+template <class T>
+void LOBPCG<T>::CopyVectors(MatrixType &src, int srcIndex, MatrixType &dst, int dstIndex)
+{
+	VectorType srcVector(GetVector(src, srcIndex));
+	VectorType dstVector(GetVector(dst, dstIndex));
+	blas.CopyVector(srcVector, dstVector);
+}
+
+
+/*
+ * The first vector of the initial block is the initial vector given to
+ * Solve(), the rest are random
+ */
+template <class T>
+void LOBPCG<T>::SetupInitialBlock(VectorType &initialVector)
+{
+	using namespace ranlib;
+
+	int first = 0;
+	if (real(Integration->InnerProduct(initialVector, initialVector)) > 0)
+	{
+		VectorType v(GetVector(Basis, 0));
+		blas.CopyVector(initialVector, v);
+		first = 1;
+	}
+
+	UniformClosed<double> rand;
+	for (int i=first; i<BlockSize; i++)
+	{
+		for (int j=0; j<MatrixSize; j++)
+		{
+			Basis(i, j) = rand.getUniform() - 0.5;
+		}
+	}
+}
+
+
+/*
+ * B-orthonormalizes the vectors Basis[first:first+count] against
+ * Basis[0:first] and each other, updating A s and B s accordingly.
+ * Vectors which are dependent on the previous ones (to DropTolerance) are
+ * removed, and the remaining vectors are moved down.
+ *
+ * Returns the new size of the basis
+ */
+template <class T>
+int LOBPCG<T>::Orthonormalize(int first, int count)
+{
+	Timers["Orthonormalize"].Start();
+
+	int size = first;
+	for (int i=first; i<first+count; i++)
+	{
+		if (i != size)
+		{
+			CopyVectors(Basis, i, Basis, size);
+			CopyVectors(BasisA, i, BasisA, size);
+			if (UseOverlap)
+			{
+				CopyVectors(BasisB, i, BasisB, size);
+			}
+		}
+
+		VectorType v(GetVector(Basis, size));
+		VectorType av(GetVector(BasisA, size));
+		VectorType bv(GetVector(BasisB, size));
+
+		NormType originalNorm = CalculateOverlapNorm(v, bv);
+		NormType norm = originalNorm;
+
+		//Classical Gram-Schmidt, repeated once
+		for (int pass=0; pass<2 && size>0 && norm>0; pass++)
+		{
+			MatrixType previous(GetVectors(Basis, 0, size));
+			MatrixType previousA(GetVectors(BasisA, 0, size));
+			MatrixType previousB(GetVectors(BasisB, 0, size));
+			VectorType overlap(Overlap(blitz::Range(0, size-1)));
+			VectorType overlap2(Overlap2(blitz::Range(0, size-1)));
+
+			//overlap(j) = <s_j | B v>
+			Integration->InnerProduct(previous, bv, overlap, overlap2);
+
+			blas.MultiplyMatrixVector(MatrixTranspose::None, previous, -1.0, overlap, 1.0, v);
+			blas.MultiplyMatrixVector(MatrixTranspose::None, previousA, -1.0, overlap, 1.0, av);
+			if (UseOverlap)
+			{
+				blas.MultiplyMatrixVector(MatrixTranspose::None, previousB, -1.0, overlap, 1.0, bv);
+			}
+
+			norm = CalculateOverlapNorm(v, bv);
+		}
+
+		if (norm == 0 || norm < DropTolerance * originalNorm)
+		{
+			DroppedVectorCount++;
+			continue;
+		}
+
+		blas.ScaleVector(v, 1.0/norm);
+		blas.ScaleVector(av, 1.0/norm);
+		if (UseOverlap)
+		{
+			blas.ScaleVector(bv, 1.0/norm);
+		}
+		size++;
+	}
+
+	Timers["Orthonormalize"].Stop();
+
+	return size;
+}
+
+
+/*
+ * Solves the projected eigenvalue problem S^H A S c = lambda c. The
+ * eigenvalues are stored in ascending order in RitzValues, and
+ * eigenvector k in RitzMatrix(k, :)
+ */
+template <class T>
+void LOBPCG<T>::PerformRayleighRitz(int basisSize)
+{
+	Timers["RayleighRitz"].Start();
+
+	MatrixType basis(GetVectors(Basis, 0, basisSize));
+	MatrixType ritzMatrix(RitzMatrix(blitz::Range(0, basisSize-1), blitz::Range(0, basisSize-1)));
+	NormVectorType ritzValues(RitzValues(blitz::Range(0, basisSize-1)));
+	VectorType overlap2(Overlap2(blitz::Range(0, basisSize-1)));
+
+	//Column j of the projected matrix is S^H A s_j
+	for (int j=0; j<basisSize; j++)
+	{
+		VectorType av(GetVector(BasisA, j));
+		VectorType column(ritzMatrix(j, blitz::Range::all()));
+		Integration->InnerProduct(basis, av, column, overlap2);
+	}
+
+	//Remove the antihermitian part caused by round off errors
+	for (int j=0; j<basisSize; j++)
+	{
+		ritzMatrix(j, j) = real(ritzMatrix(j, j));
+		for (int i=0; i<j; i++)
+		{
+			T value = 0.5 * (ritzMatrix(j, i) + conj(ritzMatrix(i, j)));
+			ritzMatrix(j, i) = value;
+			ritzMatrix(i, j) = conj(value);
+		}
+	}
+
+	int info = lapack.CalculateEigenvectorFactorizationHermitian(true, LAPACK::HermitianUpper, ritzMatrix, ritzValues);
+	if (info != 0)
+	{
+		cout << "LOBPCG: Rayleigh-Ritz failed for basis size " << basisSize << ", info = " << info << endl;
+		throw std::runtime_error("LOBPCG: Could not diagonalize the projected matrix");
+	}
+
+	Timers["RayleighRitz"].Stop();
+}
+
+
+/*
+ * Calculates the new search directions P = [W P] c_WP and Ritz vectors
+ * X = X c_X + P from the eigenvectors of the projected matrix
+ */
+template <class T>
+void LOBPCG<T>::UpdateRitzVectors(int basisSize)
+{
+	Timers["UpdateRitzVectors"].Start();
+
+	int m = BlockSize;
+	int directionCount = basisSize - m;
+	HasDirections = directionCount > 0;
+
+	MatrixType* basisList[3] = {&Basis, &BasisA, &BasisB};
+	MatrixType* directionList[3] = {&Directions, &DirectionsA, &DirectionsB};
+	int listSize = UseOverlap ? 3 : 2;
+
+	for (int l=0; l<listSize; l++)
+	{
+		MatrixType &basis = *basisList[l];
+		MatrixType &directions = *directionList[l];
+		MatrixType blockX(GetVectors(basis, 0, m));
+
+		for (int k=0; k<m; k++)
+		{
+			VectorType direction(GetVector(directions, k));
+			VectorType newX(GetVector(TempBlock, k));
+
+			if (HasDirections)
+			{
+				MatrixType blockWP(GetVectors(basis, m, directionCount));
+				VectorType coeffsWP(RitzMatrix(k, blitz::Range(m, basisSize-1)));
+				blas.MultiplyMatrixVector(MatrixTranspose::None, blockWP, 1.0, coeffsWP, 0.0, direction);
+				blas.CopyVector(direction, newX);
+			}
+			else
+			{
+				newX = 0;
+			}
+
+			VectorType coeffsX(RitzMatrix(k, blitz::Range(0, m-1)));
+			blas.MultiplyMatrixVector(MatrixTranspose::None, blockX, 1.0, coeffsX, 1.0, newX);
+		}
+
+		blockX = TempBlock;
+	}
+
+	Timers["UpdateRitzVectors"].Stop();
+}
+
+
+/*
+ * Stores the residuals A x - lambda B x of the unconverged Ritz vectors
+ * in Basis[m:m+ActiveCount], and updates ConvergedCount
+ */
+template <class T>
+void LOBPCG<T>::CalculateResiduals()
+{
+	int m = BlockSize;
+	ActiveCount = 0;
+	ConvergedCount = 0;
+	bool leadingConverged = true;
+
+	for (int k=0; k<m; k++)
+	{
+		VectorType residual(GetVector(Basis, m + ActiveCount));
+		VectorType ax(GetVector(BasisA, k));
+		VectorType bx(GetVector(BasisB, k));
+		NormType lambda = RitzValues(k);
+
+		blas.CopyVector(ax, residual);
+		blas.AddVector(bx, -lambda, residual);
+		ResidualNorms(k) = Integration->Norm(residual);
+
+		bool converged = ResidualNorms(k) < Tolerance * std::max(std::abs(lambda), 1.0);
+		if (k < EigenvalueCount)
+		{
+			leadingConverged = leadingConverged && converged;
+			if (leadingConverged)
+			{
+				ConvergedCount++;
+			}
+		}
+		if (!converged)
+		{
+			ActiveIndices(ActiveCount++) = k;
+		}
+	}
+}
+
+
+template <class T>
+void LOBPCG<T>::Solve(VectorType initialVector)
+{
+	if (MatrixOperator == 0)
+	{
+		throw std::runtime_error("LOBPCG: MatrixOperator is not set");
+	}
+
+	ResetStatistics();
+	Timers["Total"].Start();
+
+	int m = BlockSize;
+
+	//Rayleigh-Ritz in the initial block
+	SetupInitialBlock(initialVector);
+	ApplyOperators(0, m);
+	int basisSize = Orthonormalize(0, m);
+	if (basisSize < m)
+	{
+		cout << "LOBPCG: The initial block has rank " << basisSize << " < " << m << endl;
+		throw std::runtime_error("LOBPCG: Rank deficient initial block");
+	}
+	PerformRayleighRitz(basisSize);
+	UpdateRitzVectors(basisSize);
+
+	while (true)
+	{
+		CalculateResiduals();
+		if (ConvergedCount == EigenvalueCount || IterationCount >= MaxIterationCount)
+		{
+			break;
+		}
+		IterationCount++;
+
+		//W = T R for the unconverged Ritz vectors
+		if (Preconditioner != 0)
+		{
+			Timers["Preconditioner"].Start();
+			for (int i=0; i<ActiveCount; i++)
+			{
+				VectorType w(GetVector(Basis, m + i));
+				blas.CopyVector(w, TempVector);
+				(*Preconditioner)(TempVector, w);
+			}
+			Timers["Preconditioner"].Stop();
+		}
+		ApplyOperators(m, ActiveCount);
+
+		//P for the unconverged Ritz vectors
+		int directionCount = 0;
+		if (HasDirections)
+		{
+			for (int i=0; i<ActiveCount; i++)
+			{
+				int k = ActiveIndices(i);
+				int row = m + ActiveCount + directionCount++;
+				CopyVectors(Directions, k, Basis, row);
+				CopyVectors(DirectionsA, k, BasisA, row);
+				if (UseOverlap)
+				{
+					CopyVectors(DirectionsB, k, BasisB, row);
+				}
+			}
+		}
+
+		basisSize = Orthonormalize(m, ActiveCount + directionCount);
+		PerformRayleighRitz(basisSize);
+		UpdateRitzVectors(basisSize);
+	}
+
+	Timers["Total"].Stop();
+
+	if (ConvergedCount < EigenvalueCount && ProcId == 0)
+	{
+		cout << "LOBPCG: Only " << ConvergedCount << " of " << EigenvalueCount
+			<< " eigenvalues converged in " << IterationCount << " iterations" << endl;
+	}
+}
+
+
+template<class T>
+void LOBPCG<T>::PrintStatistics()
+{
+	if (ProcId == 0)
+	{
+		cout << "    OpCount      = " << OperatorCount << endl;
+		cout << "    Iterations   = " << IterationCount << endl;
+		cout << "    Converged    = " << ConvergedCount << " of " << EigenvalueCount << endl;
+		cout << "    DroppedCount = " << DroppedVectorCount << endl;
+		cout << endl;
+		cout << "Timers: " << endl;
+
+		for (TimerMap::iterator p=Timers.begin(); p!=Timers.end(); ++p)
+		{
+			cout << "    " << p->first << " = " << (double)p->second << endl;
+		}
+	}
+}
+
+} //Namespace
+
+
+#endif
+
@@ -0,0 +1,142 @@
+#include "lobpcgwrapper.h"
+
+#include <core/wavefunction.h>
+#include <core/representation/representation.h>
+#include <core/mpi/distributedmodel.h>
+#include <core/utility/blitztricks.h>
+
+#include "../pypropfunctor.h"
+
+namespace krylov
+{
+
+using namespace boost::python;
+
+/* Implementation of LobpcgWrapper */
+template<int Rank>
+void LobpcgWrapper<Rank>::ApplyCallback(object &callback, blitz::Array<cplx, 1> &input, blitz::Array<cplx, 1> &output)
+{
+	if (Psi == 0)
+	{
+		throw std::runtime_error("Psi is 0");
+	}
+	if (TempPsi == 0)
+	{
+		throw std::runtime_error("TempPsi is 0");
+	}
+
+	//Map the 1d vectors to a a blitz array of correct shape
+	DataVector shape = Psi->GetData().shape();
+	DataVector stride = Psi->GetData().stride();
+	DataArray inData(input.data(), shape, stride, blitz::neverDeleteData);
+	DataArray outData(output.data(), shape, stride, blitz::neverDeleteData);
+	outData = 0;
+
+	//Set psi and tempPsi to point to correct vectorsbuffers
+	DataArray oldData = Psi->GetData();
+	DataArray oldTempData = TempPsi->GetData();
+	Psi->SetData(inData);
+	TempPsi->SetData(outData);
+
+	callback(Psi, TempPsi);
+
+	//Restore the former buffers
+	Psi->SetData(oldData);
+	TempPsi->SetData(oldTempData);
+}
+
+
+template<int Rank>
+void LobpcgWrapper<Rank>::ApplyOperator(blitz::Array<cplx, 1> &input, blitz::Array<cplx, 1> &output)
+{
+	ApplyCallback(OperatorCallback, input, output);
+}
+
+
+template<int Rank>
+void LobpcgWrapper<Rank>::ApplyConfigSection(const ConfigSection &config)
+{
+	config.Get("krylov_eigenvalue_count", Solver.EigenvalueCount);
+
+	if (config.HasValue("krylov_block_size"))
+	{
+		config.Get("krylov_block_size", Solver.BlockSize);
+	}
+	if (config.HasValue("krylov_max_iteration_count"))
+	{
+		config.Get("krylov_max_iteration_count", Solver.MaxIterationCount);
+	}
+	if (config.HasValue("krylov_tolerance"))
+	{
+		config.Get("krylov_tolerance", Solver.Tolerance);
+	}
+	if (config.HasValue("krylov_drop_tolerance"))
+	{
+		config.Get("krylov_drop_tolerance", Solver.DropTolerance);
+	}
+}
+
+
+/*
+ * The overlap and preconditioner callbacks are only used if
+ * useOverlap and usePreconditioner are set
+ */
+template<int Rank>
+void LobpcgWrapper<Rank>::Setup(const typename Wavefunction<Rank>::Ptr psi, bool useOverlap, bool usePreconditioner)
+{
+	Solver.MatrixSize = psi->GetData().size();
+	Solver.DisableMPI = psi->GetRepresentation()->GetDistributedModel()->IsSingleProc();
+	Solver.CommBase = psi->GetRepresentation()->GetDistributedModel()->GetComm();
+	Solver.MatrixOperator = typename PypropOperatorFunctor<Rank>::Ptr( new PypropOperatorFunctor<Rank>(this) );
+
+	Solver.OverlapOperator = typename LobpcgCallbackFunctor<Rank>::Ptr();
+	if (useOverlap)
+	{
+		Solver.OverlapOperator = typename LobpcgCallbackFunctor<Rank>::Ptr( new LobpcgCallbackFunctor<Rank>(this, &OverlapCallback) );
+	}
+	Solver.Preconditioner = typename LobpcgCallbackFunctor<Rank>::Ptr();
+	if (usePreconditioner)
+	{
+		Solver.Preconditioner = typename LobpcgCallbackFunctor<Rank>::Ptr( new LobpcgCallbackFunctor<Rank>(this, &PreconditionerCallback) );
+	}
+
+	Solver.Setup();
+}
+
+
+/*
+ * Finds the lowest eigenvalues, starting from psi. tempPsi is used as a
+ * temporary buffer by the callbacks
+ */
+template<int Rank>
+void LobpcgWrapper<Rank>::Solve(object callback, object overlapCallback, object preconditionerCallback, typename Wavefunction<Rank>::Ptr psi, typename Wavefunction<Rank>::Ptr tempPsi)
+{
+	//The callback-functions uses these variables
+	this->Psi = psi;
+	this->TempPsi = tempPsi;
+	this->OperatorCallback = callback;
+	this->OverlapCallback = overlapCallback;
+	this->PreconditionerCallback = preconditionerCallback;
+
+	//Copy the initial vector, as psi is used by the callbacks
+	typename Wavefunction<Rank>::DataArray data = psi->GetData();
+	blitz::Array<cplx, 1> initialVector(data.size());
+	initialVector = MapToRank1(data);
+
+	Solver.Solve(initialVector);
+
+	//Zero the pointers to avoid mishaps
+	this->Psi = typename Wavefunction<Rank>::Ptr();
+	this->TempPsi = typename Wavefunction<Rank>::Ptr();
+	this->OperatorCallback = object();
+	this->OverlapCallback = object();
+	this->PreconditionerCallback = object();
+}
+
+template class LobpcgWrapper<1>;
+template class LobpcgWrapper<2>;
+template class LobpcgWrapper<3>;
+template class LobpcgWrapper<4>;
+
+} //Namespace
+
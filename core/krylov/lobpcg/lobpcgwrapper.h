@@ -0,0 +1,133 @@
+#ifndef LOBPCGWRAPPER_H
+#define LOBPCGWRAPPER_H
+
+#include <core/common.h>
+#include <core/wavefunction.h>
+#include <core/utility/boostpythonhack.h>
+
+#include "lobpcg.h"
+#include "../pypropfunctor.h"
+
+namespace krylov
+{
+
+template<int Rank> class LobpcgWrapper;
+
+/*
+ * Forwards the overlap and preconditioner operators to the python
+ * callbacks of LobpcgWrapper
+ */
+template<int Rank>
+class LobpcgCallbackFunctor : public piram::OperatorFunctor<cplx>
+{
+public:
+	typedef boost::shared_ptr< LobpcgCallbackFunctor > Ptr;
+
+	LobpcgCallbackFunctor(LobpcgWrapper<Rank> *solver, object *callback) : Solver(solver), Callback(callback) {}
+
+	virtual void operator()(blitz::Array<cplx, 1> &in, blitz::Array<cplx, 1> &out)
+	{
+		Solver->ApplyCallback(*Callback, in, out);
+	}
+
+private:
+	LobpcgWrapper<Rank>* Solver;
+	object* Callback;
+};
+
+/*
+ * Wrapper of lobpcg::LOBPCG for the lowest eigenstates of the
+ * Hamiltonian. The Hamiltonian, overlap and preconditioner are given as
+ * python callbacks (srcPsi, dstPsi), see pyprop/solver/LobpcgSolver.py
+ */
+template<int Rank>
+class LobpcgWrapper : public PypropKrylovWrapper
+{
+public:
+	typedef blitz::TinyVector<int, Rank> DataVector;
+	typedef blitz::Array<cplx, Rank> DataArray;
+
+private:
+	lobpcg::LOBPCG<cplx> Solver;
+
+	//Temporary member variables
+	typename Wavefunction<Rank>::Ptr Psi;
+	typename Wavefunction<Rank>::Ptr TempPsi;
+	object OperatorCallback;
+	object OverlapCallback;
+	object PreconditionerCallback;
+
+public:
+	LobpcgWrapper() {}
+	virtual ~LobpcgWrapper() {}
+
+	void ApplyConfigSection(const ConfigSection &config);
+	void Setup(const typename Wavefunction<Rank>::Ptr psi, bool useOverlap, bool usePreconditioner);
+	void Solve(object callback, object overlapCallback, object preconditionerCallback, typename Wavefunction<Rank>::Ptr psi, typename Wavefunction<Rank>::Ptr tempPsi);
+
+	void ApplyCallback(object &callback, blitz::Array<cplx, 1> &input, blitz::Array<cplx, 1> &output);
+	void ApplyOperator(blitz::Array<cplx, 1> &input, blitz::Array<cplx, 1> &output);
+
+	/*
+	 * Returns the krylov_eigenvalue_count lowest eigenvalues
+	 */
+	blitz::Array<double, 1> GetEigenvalues()
+	{
+		return Solver.GetEigenvalues();
+	}
+
+	/*
+	 * Returns (the local part of) an eigenvector as a 1d array,
+	 * normalized with the overlap matrix
+	 */
+	blitz::Array<cplx, 1> GetEigenvector(int eigenvectorIndex)
+	{
+		return Solver.GetEigenvector(eigenvectorIndex);
+	}
+
+	blitz::Array<double, 1> GetResidualNorms()
+	{
+		return Solver.GetResidualNorms();
+	}
+
+	/*
+	 * Returns the number of the lowest eigenvalues which are converged
+	 */
+	int GetConvergedEigenvalueCount()
+	{
+		return Solver.GetConvergedEigenvalueCount();
+	}
+
+	double EstimateMemoryUsage(int matrixSize, int blockSize, bool useOverlap)
+	{
+		return Solver.EstimateMemoryUsage(matrixSize, blockSize, useOverlap);
+	}
+
+	int GetBlockSize()
+	{
+		return Solver.GetBlockSize();
+	}
+
+	/*
+	 * Returns the number of Hamiltonian-vector operations performed
+	 */
+	int GetOperatorCount()
+	{
+		return Solver.GetOperatorCount();
+	}
+
+	int GetIterationCount()
+	{
+		return Solver.GetIterationCount();
+	}
+
+	void PrintStatistics()
+	{
+		Solver.PrintStatistics();
+	}
+};
+
+} // Namespace
+
+#endif
+
@@ -0,0 +1,88 @@
+
+// Boost Includes ==============================================================
+#include <boost/python.hpp>
+#include <boost/cstdint.hpp>
+
+// Includes ====================================================================
+#include <lobpcgwrapper.h>
+
+// Using =======================================================================
+using namespace boost::python;
+
+// Module ======================================================================
+BOOST_PYTHON_MODULE(liblobpcg)
+{
+    class_< krylov::LobpcgWrapper<1>, boost::noncopyable >("krylov_LobpcgWrapper_1", init<  >())
+        .def("ApplyConfigSection", &krylov::LobpcgWrapper<1>::ApplyConfigSection)
+        .def("Setup", &krylov::LobpcgWrapper<1>::Setup)
+        .def("Solve", &krylov::LobpcgWrapper<1>::Solve)
+        .def("ApplyCallback", &krylov::LobpcgWrapper<1>::ApplyCallback)
+        .def("ApplyOperator", &krylov::LobpcgWrapper<1>::ApplyOperator)
+        .def("GetEigenvalues", &krylov::LobpcgWrapper<1>::GetEigenvalues)
+        .def("GetEigenvector", &krylov::LobpcgWrapper<1>::GetEigenvector)
+        .def("GetResidualNorms", &krylov::LobpcgWrapper<1>::GetResidualNorms)
+        .def("GetConvergedEigenvalueCount", &krylov::LobpcgWrapper<1>::GetConvergedEigenvalueCount)
+        .def("EstimateMemoryUsage", &krylov::LobpcgWrapper<1>::EstimateMemoryUsage)
+        .def("GetBlockSize", &krylov::LobpcgWrapper<1>::GetBlockSize)
+        .def("GetOperatorCount", &krylov::LobpcgWrapper<1>::GetOperatorCount)
+        .def("GetIterationCount", &krylov::LobpcgWrapper<1>::GetIterationCount)
+        .def("PrintStatistics", &krylov::LobpcgWrapper<1>::PrintStatistics)
+        .def("SetupResidual", &PypropKrylovWrapper::SetupResidual)
+    ;
+
+    class_< krylov::LobpcgWrapper<2>, boost::noncopyable >("krylov_LobpcgWrapper_2", init<  >())
+        .def("ApplyConfigSection", &krylov::LobpcgWrapper<2>::ApplyConfigSection)
+        .def("Setup", &krylov::LobpcgWrapper<2>::Setup)
+        .def("Solve", &krylov::LobpcgWrapper<2>::Solve)
+        .def("ApplyCallback", &krylov::LobpcgWrapper<2>::ApplyCallback)
+        .def("ApplyOperator", &krylov::LobpcgWrapper<2>::ApplyOperator)
+        .def("GetEigenvalues", &krylov::LobpcgWrapper<2>::GetEigenvalues)
+        .def("GetEigenvector", &krylov::LobpcgWrapper<2>::GetEigenvector)
+        .def("GetResidualNorms", &krylov::LobpcgWrapper<2>::GetResidualNorms)
+        .def("GetConvergedEigenvalueCount", &krylov::LobpcgWrapper<2>::GetConvergedEigenvalueCount)
+        .def("EstimateMemoryUsage", &krylov::LobpcgWrapper<2>::EstimateMemoryUsage)
+        .def("GetBlockSize", &krylov::LobpcgWrapper<2>::GetBlockSize)
+        .def("GetOperatorCount", &krylov::LobpcgWrapper<2>::GetOperatorCount)
+        .def("GetIterationCount", &krylov::LobpcgWrapper<2>::GetIterationCount)
+        .def("PrintStatistics", &krylov::LobpcgWrapper<2>::PrintStatistics)
+        .def("SetupResidual", &PypropKrylovWrapper::SetupResidual)
+    ;
+
+    class_< krylov::LobpcgWrapper<3>, boost::noncopyable >("krylov_LobpcgWrapper_3", init<  >())
+        .def("ApplyConfigSection", &krylov::LobpcgWrapper<3>::ApplyConfigSection)
+        .def("Setup", &krylov::LobpcgWrapper<3>::Setup)
+        .def("Solve", &krylov::LobpcgWrapper<3>::Solve)
+        .def("ApplyCallback", &krylov::LobpcgWrapper<3>::ApplyCallback)
+        .def("ApplyOperator", &krylov::LobpcgWrapper<3>::ApplyOperator)
+        .def("GetEigenvalues", &krylov::LobpcgWrapper<3>::GetEigenvalues)
+        .def("GetEigenvector", &krylov::LobpcgWrapper<3>::GetEigenvector)
+        .def("GetResidualNorms", &krylov::LobpcgWrapper<3>::GetResidualNorms)
+        .def("GetConvergedEigenvalueCount", &krylov::LobpcgWrapper<3>::GetConvergedEigenvalueCount)
+        .def("EstimateMemoryUsage", &krylov::LobpcgWrapper<3>::EstimateMemoryUsage)
+        .def("GetBlockSize", &krylov::LobpcgWrapper<3>::GetBlockSize)
+        .def("GetOperatorCount", &krylov::LobpcgWrapper<3>::GetOperatorCount)
+        .def("GetIterationCount", &krylov::LobpcgWrapper<3>::GetIterationCount)
+        .def("PrintStatistics", &krylov::LobpcgWrapper<3>::PrintStatistics)
+        .def("SetupResidual", &PypropKrylovWrapper::SetupResidual)
+    ;
+
+    class_< krylov::LobpcgWrapper<4>, boost::noncopyable >("krylov_LobpcgWrapper_4", init<  >())
+        .def("ApplyConfigSection", &krylov::LobpcgWrapper<4>::ApplyConfigSection)
+        .def("Setup", &krylov::LobpcgWrapper<4>::Setup)
+        .def("Solve", &krylov::LobpcgWrapper<4>::Solve)
+        .def("ApplyCallback", &krylov::LobpcgWrapper<4>::ApplyCallback)
+        .def("ApplyOperator", &krylov::LobpcgWrapper<4>::ApplyOperator)
+        .def("GetEigenvalues", &krylov::LobpcgWrapper<4>::GetEigenvalues)
+        .def("GetEigenvector", &krylov::LobpcgWrapper<4>::GetEigenvector)
+        .def("GetResidualNorms", &krylov::LobpcgWrapper<4>::GetResidualNorms)
+        .def("GetConvergedEigenvalueCount", &krylov::LobpcgWrapper<4>::GetConvergedEigenvalueCount)
+        .def("EstimateMemoryUsage", &krylov::LobpcgWrapper<4>::EstimateMemoryUsage)
+        .def("GetBlockSize", &krylov::LobpcgWrapper<4>::GetBlockSize)
+        .def("GetOperatorCount", &krylov::LobpcgWrapper<4>::GetOperatorCount)
+        .def("GetIterationCount", &krylov::LobpcgWrapper<4>::GetIterationCount)
+        .def("PrintStatistics", &krylov::LobpcgWrapper<4>::PrintStatistics)
+        .def("SetupResidual", &PypropKrylovWrapper::SetupResidual)
+    ;
+
+}
+
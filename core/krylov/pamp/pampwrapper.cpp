@@ -5,6 +5,7 @@
 #include <core/mpi/distributedmodel.h>
 #include <core/utility/fortran.h>
 #include <core/utility/blitztricks.h>
+#include <core/utility/gilrelease.h>
 
 #include "../pypropfunctor.h"
 
@@ -39,7 +40,15 @@ void PampWrapper<Rank>::ApplyOperator(blitz::Array<cplx, 1> &input, blitz::Array
 	Psi->SetData(inData);
 	TempPsi->SetData(outData);
 
-	Callback(Psi, TempPsi, TimeStep, CurTime);
+	if (Hamiltonian)
+	{
+		Hamiltonian->Multiply(Psi, TempPsi, CurTime);
+	}
+	else
+	{
+		AcquireGIL acquireGIL;
+		Callback(Psi, TempPsi, TimeStep, CurTime);
+	}
 
 	//Restore the former buffers
 	Psi->SetData(oldData);
@@ -75,6 +84,7 @@ void PampWrapper<Rank>::Setup(const typename Wavefunction<Rank>::Ptr psi)
 {
 	Propagator.MatrixSize = psi->GetData().size();
     Propagator.DisableMPI = psi->GetRepresentation()->GetDistributedModel()->IsSingleProc();
+	Propagator.CommBase = psi->GetRepresentation()->GetDistributedModel()->GetComm();
 	Propagator.MatrixOperator = typename PypropOperatorFunctor<Rank>::Ptr( new PypropOperatorFunctor<Rank>(this) );
 	Propagator.Setup();
 }
@@ -99,7 +109,11 @@ void PampWrapper<Rank>::AdvanceStep(object callback, typename Wavefunction<Rank>
 
 	typename Wavefunction<Rank>::DataArray vector = psi->GetData();
 	blitz::Array<cplx, 1> vector1d = MapToRank1(vector);
-	Propagator.PropagateVector(vector1d, dt);
+	{
+		//The python callback takes the GIL back in ApplyOperator
+		ReleaseGIL releaseGIL;
+		Propagator.PropagateVector(vector1d, dt);
+	}
 
 	//Zero the pointers to avoid mishaps
 	this->Psi = typename Wavefunction<Rank>::Ptr();
@@ -3,6 +3,7 @@
 
 #include <core/common.h>
 #include <core/wavefunction.h>
+#include <core/tensorpotential/hamiltonianoperator.h>
 #include <core/utility/boostpythonhack.h>
 
 #include "pamp/pamp.h"
@@ -27,6 +28,7 @@ private:
 	typename Wavefunction<Rank>::Ptr Psi;
 	typename Wavefunction<Rank>::Ptr TempPsi;
 	object Callback;
+	typename HamiltonianOperator<Rank>::Ptr Hamiltonian;
 
 	//test
 	//blitz::Array<cplx, 2> M;
@@ -41,6 +43,20 @@ public:
 
 	void ApplyOperator(blitz::Array<cplx, 1> &input, blitz::Array<cplx, 1> &output);
 
+	/*
+	 * Use a C++ HamiltonianOperator for the matrix-vector products instead
+	 * of the python callback passed to AdvanceStep
+	 */
+	void SetHamiltonianOperator(typename HamiltonianOperator<Rank>::Ptr hamiltonian)
+	{
+		Hamiltonian = hamiltonian;
+	}
+
+	void ClearHamiltonianOperator()
+	{
+		Hamiltonian = typename HamiltonianOperator<Rank>::Ptr();
+	}
+
 	/*
 	 * Returns the _converged_ eigenvectors, a N by M matrix, where
 	 * N == GetEigenvalueCount(), and M is the size of the wavefunction
@@ -97,6 +97,7 @@ void PiramSolver<Rank>::Setup(const typename Wavefunction<Rank>::Ptr psi)
 {
 	Solver.MatrixSize = psi->GetData().size();
     Solver.DisableMPI = psi->GetRepresentation()->GetDistributedModel()->IsSingleProc();
+	Solver.CommBase = psi->GetRepresentation()->GetDistributedModel()->GetComm();
 
 	Solver.SetupResidual = typename PypropSetupResidualFunctor<Rank>::Ptr( new PypropSetupResidualFunctor<Rank>(this) );
 	Solver.MatrixOperator = typename PypropOperatorFunctor<Rank>::Ptr( new PypropOperatorFunctor<Rank>(this) );
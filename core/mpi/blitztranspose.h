@@ -4,10 +4,14 @@
 #include "../common.h"
 #include "../utility/blitzutils.h"
 #include "blitzmpi.h"
+#include "partition.h"
+#include "communicator.h"
 
 #include <mpi.h>
 #include <vector>
 
+template<int Rank> class TransposeChunkAction;
+
 template<int DataRank>
 class ArrayTranspose
 {
@@ -31,7 +35,7 @@ private:
 	ProcVectorComm GroupComm;
 	ProcVector GroupRank;
 
-	//MPI_COMM_WORLD Rank and Size
+	//Rank and Size in BaseCommunicator
 	int WorldRank;
 	int WorldSize;
 	
@@ -45,8 +49,14 @@ public:
 		return CartesianShape;
 	}
 
+	int GetCartesianCoord(int procRank)
+	{
+		return CartesianCoord(procRank);
+	}
+
 	void Transpose(const DataVector fullShape, DataArray inData, const ProcVector inDistr, DataArray outData, const ProcVector outDistr);
 	void Transpose(const DataVector fullShape, const ProcVector fullDistr, DataArray inData, int inDistr, DataArray outData, int outDistr, int procRank);
+	void TransposePipelined(const DataVector fullShape, const ProcVector fullDistr, DataArray inData, int inDistr, DataArray outData, int outDistr, int procRank, int chunkRank, int chunkCount, TransposeChunkAction<DataRank> &action, bool actionBeforeSend);
 
 	/*
 	 * Creates a local shape which matches a given shape of the virtual global array for a given distribution
@@ -63,7 +73,7 @@ public:
 		for (int i=0; i<ProcRank; i++)
 		{
 			int rank = distrib(i);
-			distrShape(rank) = CreateDistributedShape(fullShape(rank), i, groupRank(i));
+			distrShape(rank) = CreateDistributedShape(fullShape(rank), i, groupRank(i), rank);
 		}
 		return distrShape;
 	}
@@ -122,6 +132,35 @@ public:
 		return distrShape;
 	}
 
+	/*
+	 * As above, but if a cost-weighted partition is registered for the 
+	 * wavefunction rank dataRank (see partition.h), it is used instead 
+	 * of the equal count partition.
+	 */
+	int CreateDistributedShape(int fullShape, int procRank, int groupRank, int dataRank)
+	{
+		if (dataRank >= 0 && RankPartition::HasWeights(dataRank, fullShape))
+		{
+			return RankPartition::GetLocalSize(dataRank, CartesianShape(procRank), groupRank);
+		}
+		return CreateDistributedShape(fullShape, procRank, groupRank);
+	}
+
+	int GetLocalStartIndex(int fullShape, int procRank, int groupRank, int dataRank)
+	{
+		if (dataRank >= 0 && RankPartition::HasWeights(dataRank, fullShape))
+		{
+			return RankPartition::GetLocalStartIndex(dataRank, CartesianShape(procRank), groupRank);
+		}
+		return GetLocalStartIndex(fullShape, procRank, groupRank);
+	}
+
+	blitz::Range GetLocalRange(int globalSize, int procRank, int groupRank, int dataRank)
+	{
+		int startIndex = GetLocalStartIndex(globalSize, procRank, groupRank, dataRank);
+		int distribShape = CreateDistributedShape(globalSize, procRank, groupRank, dataRank);
+		return blitz::Range(startIndex, startIndex + distribShape - 1);	
+	}
 
 	int GetLocalStartIndex(int fullShape, int procRank, int groupRank)
 	{
@@ -252,6 +291,44 @@ public:
 		return GroupComm(rank);
 	}
 
+private:
+	/*
+	 * Local index range of chunk along chunkRank in TransposePipelined, on the proc groupRank 
+	 * of the chunked side. If otherSide is set, the range is given in the indices of the local 
+	 * array on the other side of the transpose, which is full along chunkRank if chunkRank
+	 * is distributed on the chunked side
+	 */
+	blitz::Range GetChunkRange(const DataVector &fullShape, int chunkedDistr, const DataArray &chunkedData, int procRank, int groupRank, int chunkRank, int chunkCount, int chunk, bool otherSide)
+	{
+		int chunkSize = chunkedData.extent(chunkRank);
+		int chunkOffset = 0;
+		if (chunkRank == chunkedDistr)
+		{
+			chunkSize = CreateDistributedShape(fullShape(chunkRank), procRank, groupRank, chunkRank);
+			if (otherSide)
+			{
+				chunkOffset = GetLocalStartIndex(fullShape(chunkRank), procRank, groupRank, chunkRank);
+			}
+		}
+		int start = (long)chunk * chunkSize / chunkCount;
+		int end = (long)(chunk+1) * chunkSize / chunkCount;
+		return blitz::Range(chunkOffset + start, chunkOffset + end - 1);
+	}
+
+	DataArray GetView(DataArray data, int rank1, const blitz::Range &range1, int rank2, const blitz::Range &range2)
+	{
+		DataVector lbound(0);
+		DataVector ubound(data.shape());
+		ubound -= 1;
+		lbound(rank1) = range1.first();
+		ubound(rank1) = range1.last();
+		//range2 is a subset of range1 if rank1 == rank2
+		lbound(rank2) = range2.first();
+		ubound(rank2) = range2.last();
+		blitz::RectDomain<DataRank> domain(lbound, ubound);
+		return data(domain);
+	}
+
 };
 
 template<int DataRank>
@@ -267,8 +344,8 @@ ArrayTranspose<DataRank>::ArrayTranspose(int procRank) : ProcRank(procRank)
 	GroupComm = 0;
 	GroupRank = 0;
 
-	MPI_Comm_rank(MPI_COMM_WORLD, &WorldRank);
-	MPI_Comm_size(MPI_COMM_WORLD, &WorldSize);
+	MPI_Comm_rank(BaseCommunicator::Get(), &WorldRank);
+	MPI_Comm_size(BaseCommunicator::Get(), &WorldSize);
 
 	ProcVector periods;
 	periods.resize(ProcRank);
@@ -287,7 +364,7 @@ ArrayTranspose<DataRank>::ArrayTranspose(int procRank) : ProcRank(procRank)
 #endif
 
 	//Create cartesian communicator
-	MPI_Cart_create(MPI_COMM_WORLD, ProcRank, CartesianShape.data(), periods.data(), 0, &CartesianComm);
+	MPI_Cart_create(BaseCommunicator::Get(), ProcRank, CartesianShape.data(), periods.data(), 0, &CartesianComm);
 	//Get rank and coord from cartesian comm
 	MPI_Comm_rank(CartesianComm, &CartesianRank);
 	MPI_Cart_coords(CartesianComm, CartesianRank, ProcRank, CartesianCoord.data());
@@ -377,7 +454,7 @@ Transpose(const DataVector fullShape, const ProcVector fullDistr, DataArray inDa
 	DataVector inPaddedShape = CreatePaddedShape(fullShape, fullDistr);
 
 	//Local (distributed) sizes
-	int outSizeDistr = CreateDistributedShape(outSizeFull, procRank);
+	int outSizeDistr = CreateDistributedShape(outSizeFull, procRank, curProc, outDistr);
 	DataVector inDistrShape = inData.shape() ;//  CreateDistributedShape(inPaddedShape, fullDistr);
 
 	//Temporary (padded) sizes
@@ -431,11 +508,11 @@ Transpose(const DataVector fullShape, const ProcVector fullDistr, DataArray inDa
 		int toProc = (i + curProc) % Np;
 		int fromProc = (Np - i + curProc) % Np;
 
-		int toProcStart = GetLocalStartIndex(outSizeFull, procRank, toProc);
-		int toProcSize =  CreateDistributedShape(outSizeFull, procRank, toProc);
+		int toProcStart = GetLocalStartIndex(outSizeFull, procRank, toProc, outDistr);
+		int toProcSize =  CreateDistributedShape(outSizeFull, procRank, toProc, outDistr);
 		
-		int fromProcStart = GetLocalStartIndex(inSizeFull, procRank, fromProc);
-		int fromProcSize = CreateDistributedShape(inSizeFull, procRank, fromProc);
+		int fromProcStart = GetLocalStartIndex(inSizeFull, procRank, fromProc, inDistr);
+		int fromProcSize = CreateDistributedShape(inSizeFull, procRank, fromProc, inDistr);
 
 
 		//read
@@ -489,5 +566,122 @@ Transpose(const DataVector fullShape, const ProcVector fullDistr, DataArray inDa
 
 }
 
-#endif
+/*
+ * As Transpose, but the exchange is split into chunkCount chunks along chunkRank,
+ * such that computation on one chunk overlaps the communication of the others.
+ *
+ * If actionBeforeSend is set, action.ProcessChunk() is called for each chunk of 
+ * inData before it is sent, otherwise it is called on each chunk of outData as 
+ * soon as it has been received from all procs. All receives are posted first,
+ * and all sends are posted without waiting, so the remaining chunks are in flight 
+ * while a chunk is processed.
+ *
+ * The chunks are ranges of the local extent of chunkRank on the side where
+ * action is called (inData if actionBeforeSend, otherwise outData). chunkRank 
+ * can not be the rank which is made local on that side (outDistr for inData, 
+ * inDistr for outData), as the action usually works along that rank.
+ */
+template<int DataRank>
+void ArrayTranspose<DataRank>::
+TransposePipelined(const DataVector fullShape, const ProcVector fullDistr, DataArray inData, int inDistr, DataArray outData, int outDistr, int procRank, int chunkRank, int chunkCount, TransposeChunkAction<DataRank> &action, bool actionBeforeSend)
+{
+	int Np = CartesianShape(procRank);
+	int curProc = GroupRank(procRank);
+
+	int inSizeFull = fullShape(inDistr);
+	int outSizeFull = fullShape(outDistr);
+
+	//Check array sizes
+	DataVector outputShape = inData.shape();
+	outputShape(inDistr) = inSizeFull;
+	outputShape(outDistr) = CreateDistributedShape(outSizeFull, procRank, curProc, outDistr);
+	if (outputShape != outData.shape())
+	{
+		throw std::runtime_error("Invalid shape of output data. Got " + ToString(outData.shape()) + ", expected " + ToString(outputShape));
+	}
+	if (chunkRank == (actionBeforeSend ? outDistr : inDistr) || chunkCount < 1)
+	{
+		cout << "Invalid chunk rank " << chunkRank << " (" << chunkCount << " chunks) transposing " << inDistr << " -> " << outDistr << endl;
+		throw std::runtime_error("Invalid chunks for pipelined transpose");
+	}
+
+	int chunkedDistr = actionBeforeSend ? inDistr : outDistr;
+	DataArray chunkedData = actionBeforeSend ? inData : outData;
+
+	//Post all receives
+	std::vector<MPI_Request> recvRequests(chunkCount*Np, MPI_REQUEST_NULL);
+	std::vector<MPI_Request> sendRequests(chunkCount*Np, MPI_REQUEST_NULL);
+	for (int chunk=0; chunk<chunkCount; chunk++)
+	{
+		for (int i=0; i<Np; i++)
+		{
+			int fromProc = (Np - i + curProc) % Np;
+			blitz::Range fromRange = GetLocalRange(inSizeFull, procRank, fromProc, inDistr);
+			blitz::Range chunkRange = actionBeforeSend 
+				? GetChunkRange(fullShape, chunkedDistr, chunkedData, procRank, fromProc, chunkRank, chunkCount, chunk, true)
+				: GetChunkRange(fullShape, chunkedDistr, chunkedData, procRank, curProc, chunkRank, chunkCount, chunk, false);
+			if (fromRange.length() <= 0 || chunkRange.length() <= 0 || outData.size() == 0)
+			{
+				continue;
+			}
+
+			DataArray recvView = GetView(outData, inDistr, fromRange, chunkRank, chunkRange);
+			BlitzMPI<cplx, DataRank> recvMPI(recvView);
+			recvRequests[chunk*Np + i] = recvMPI.IRecv(recvView, fromProc, chunk, GroupComm(procRank));
+		}
+	}
+
+	//Process (if before send) and send the chunks
+	for (int chunk=0; chunk<chunkCount; chunk++)
+	{
+		if (actionBeforeSend)
+		{
+			blitz::Range chunkRange = GetChunkRange(fullShape, chunkedDistr, chunkedData, procRank, curProc, chunkRank, chunkCount, chunk, false);
+			if (chunkRange.length() > 0 && inData.size() > 0)
+			{
+				DataArray chunkView = GetView(inData, chunkRank, chunkRange, chunkRank, chunkRange);
+				action.ProcessChunk(chunkView);
+			}
+		}
+
+		for (int i=0; i<Np; i++)
+		{
+			int toProc = (i + curProc) % Np;
+			blitz::Range toRange = GetLocalRange(outSizeFull, procRank, toProc, outDistr);
+			blitz::Range chunkRange = actionBeforeSend 
+				? GetChunkRange(fullShape, chunkedDistr, chunkedData, procRank, curProc, chunkRank, chunkCount, chunk, false)
+				: GetChunkRange(fullShape, chunkedDistr, chunkedData, procRank, toProc, chunkRank, chunkCount, chunk, true);
+			if (toRange.length() <= 0 || chunkRange.length() <= 0 || inData.size() == 0)
+			{
+				continue;
+			}
+
+			DataArray sendView = GetView(inData, outDistr, toRange, chunkRank, chunkRange);
+			BlitzMPI<cplx, DataRank> sendMPI(sendView);
+			sendRequests[chunk*Np + i] = sendMPI.ISend(sendView, toProc, chunk, GroupComm(procRank));
+		}
+	}
 
+	//Process the chunks as they arrive
+	if (!actionBeforeSend)
+	{
+		for (int chunk=0; chunk<chunkCount; chunk++)
+		{
+			std::vector<MPI_Status> status(Np);
+			MPI_Waitall(Np, &recvRequests[chunk*Np], &status[0]);
+
+			blitz::Range chunkRange = GetChunkRange(fullShape, chunkedDistr, chunkedData, procRank, curProc, chunkRank, chunkCount, chunk, false);
+			if (chunkRange.length() > 0 && outData.size() > 0)
+			{
+				DataArray chunkView = GetView(outData, chunkRank, chunkRange, chunkRank, chunkRange);
+				action.ProcessChunk(chunkView);
+			}
+		}
+	}
+
+	std::vector<MPI_Status> status(chunkCount*Np);
+	MPI_Waitall(chunkCount*Np, &recvRequests[0], &status[0]);
+	MPI_Waitall(chunkCount*Np, &sendRequests[0], &status[0]);
+}
+
+#endif
@@ -0,0 +1,105 @@
+#include "communicator.h"
+
+MPI_Comm BaseCommunicator::Comm = MPI_COMM_WORLD;
+int BaseCommunicator::Color = -1;
+
+MPI_Comm BaseCommunicator::Get()
+{
+	return Comm;
+}
+
+#ifndef SINGLEPROC
+
+void BaseCommunicator::Split(int color)
+{
+	if (color < 0)
+	{
+		cout << "Invalid communicator color " << color << endl;
+		throw std::runtime_error("Communicator color must be non-negative");
+	}
+
+	Reset();
+
+	int worldRank;
+	MPI_Comm_rank(MPI_COMM_WORLD, &worldRank);
+	MPI_Comm_split(MPI_COMM_WORLD, color, worldRank, &Comm);
+	Color = color;
+}
+
+void BaseCommunicator::Reset()
+{
+	if (IsSplit())
+	{
+		MPI_Comm_free(&Comm);
+		Comm = MPI_COMM_WORLD;
+		Color = -1;
+	}
+}
+
+int BaseCommunicator::GetProcId()
+{
+	int procId;
+	MPI_Comm_rank(Comm, &procId);
+	return procId;
+}
+
+int BaseCommunicator::GetProcCount()
+{
+	int procCount;
+	MPI_Comm_size(Comm, &procCount);
+	return procCount;
+}
+
+int BaseCommunicator::GetWorldProcId()
+{
+	int procId;
+	MPI_Comm_rank(MPI_COMM_WORLD, &procId);
+	return procId;
+}
+
+int BaseCommunicator::GetWorldProcCount()
+{
+	int procCount;
+	MPI_Comm_size(MPI_COMM_WORLD, &procCount);
+	return procCount;
+}
+
+void BaseCommunicator::Barrier()
+{
+	MPI_Barrier(Comm);
+}
+
+void BaseCommunicator::WorldBarrier()
+{
+	MPI_Barrier(MPI_COMM_WORLD);
+}
+
+#else
+
+/*
+ * Without MPI there is only one proc, which is in every group
+ */
+void BaseCommunicator::Split(int color)
+{
+	if (color < 0)
+	{
+		cout << "Invalid communicator color " << color << endl;
+		throw std::runtime_error("Communicator color must be non-negative");
+	}
+	Color = color;
+}
+
+void BaseCommunicator::Reset()
+{
+	Color = -1;
+}
+
+int BaseCommunicator::GetProcId() { return 0; }
+int BaseCommunicator::GetProcCount() { return 1; }
+int BaseCommunicator::GetWorldProcId() { return 0; }
+int BaseCommunicator::GetWorldProcCount() { return 1; }
+void BaseCommunicator::Barrier() {}
+void BaseCommunicator::WorldBarrier() {}
+
+#endif
+
@@ -0,0 +1,58 @@
+#ifndef COMMUNICATOR_H
+#define COMMUNICATOR_H
+
+#include "../common.h"
+
+#include <mpi.h>
+
+/*
+ * The communicator used by pyprop in place of MPI_COMM_WORLD.
+ *
+ * By default this is MPI_COMM_WORLD. Split() divides the procs into
+ * independent groups (e.g. one per energy window in SpectrumSlicing), and
+ * every distributed model, transpose and krylov solver created afterwards
+ * only communicates within the group of the calling proc, such that each
+ * group can run its own Problem concurrently.
+ *
+ * The communicator must be split on all procs before any wavefunction is
+ * created, and must not be changed while a wavefunction exists.
+ */
+class BaseCommunicator
+{
+public:
+	static MPI_Comm Get();
+
+	/*
+	 * Splits MPI_COMM_WORLD into groups of procs with the same color.
+	 * Procs are ordered by their world rank within each group.
+	 * Must be called collectively by all procs.
+	 */
+	static void Split(int color);
+
+	/*
+	 * Goes back to MPI_COMM_WORLD. Must be called collectively
+	 * by all procs
+	 */
+	static void Reset();
+
+	static bool IsSplit() { return Color != -1; }
+	static int GetColor() { return Color; }
+
+	//Rank and size in the current communicator
+	static int GetProcId();
+	static int GetProcCount();
+
+	//Rank and size in MPI_COMM_WORLD
+	static int GetWorldProcId();
+	static int GetWorldProcCount();
+
+	static void Barrier();
+	static void WorldBarrier();
+
+private:
+	static MPI_Comm Comm;
+	static int Color;
+};
+
+#endif
+
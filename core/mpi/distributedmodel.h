@@ -4,12 +4,26 @@
 #include "../common.h"
 #include "../wavefunction.h"
 #include "distribution.h"
+#include "partition.h"
+#include "communicator.h"
 
 #include <mpi.h>
 
 //Forward declaration of arraytranspose
 template<int Rank> class ArrayTranspose;
 
+/*
+ * Computation on a chunk of the wavefunction, which is overlapped with the
+ * communication of the other chunks in ChangeDistributionPipelined
+ */
+template<int Rank>
+class TransposeChunkAction
+{
+public:
+	virtual ~TransposeChunkAction() {}
+	virtual void ProcessChunk(blitz::Array<cplx, Rank> &chunk) = 0;
+};
+
 template<int Rank>
 class DistributedModel
 {
@@ -95,6 +109,31 @@ public:
 		return array(GetLocalIndexRange(array.extent(0), rank));
 	}
 
+	/*
+	 * Cost-weighted partitioning of a distributed rank, see partition.h.
+	 * The weights are shared by all distributed models in this process,
+	 * and must be set before the wavefunction is created.
+	 */
+	void SetPartitionWeights(int rank, blitz::Array<double, 1> weights)
+	{
+		RankPartition::SetWeights(rank, weights);
+	}
+
+	void ClearPartitionWeights(int rank)
+	{
+		RankPartition::ClearWeights(rank);
+	}
+
+	bool HasPartitionWeights(int rank, int globalSize)
+	{
+		return RankPartition::HasWeights(rank, globalSize);
+	}
+
+	blitz::Array<double, 1> GetPartitionWeights(int rank)
+	{
+		return RankPartition::GetWeights(rank);
+	}
+
 	static void ForceSingleProc()
 	{
 		MPIDisabled = true;
@@ -118,8 +157,18 @@ public:
 
 	bool IsDistributedRank(int rank);
 	void ChangeDistribution(Wavefunction<Rank> &psi, const Distribution::DataArray &newDistrib, int destBufferName);
+	void ChangeDistributionPipelined(Wavefunction<Rank> &psi, const Distribution::DataArray &newDistrib, int destBufferName, int chunkRank, int chunkCount, TransposeChunkAction<Rank> &action, bool actionBeforeSend);
+	blitz::TinyVector<int, Rank> CreateDistributedShape(const blitz::TinyVector<int, Rank> &fullShape, const Distribution::DataArray &distrib);
 
+	/*
+	 * Communicator of all procs sharing the wavefunction, which is
+	 * MPI_COMM_WORLD unless BaseCommunicator has been split
+	 */
+	MPI_Comm GetComm();
 	MPI_Comm GetGroupCommRank(int rank);
+	int GetGroupCommRankHandle(int rank);
+	int GetGroupProcId(int rank);
+	int GetGroupProcCount(int rank);
 
 	static void InitMPI(int argc, char* argv[]);
 	static void FinalizeMPI();
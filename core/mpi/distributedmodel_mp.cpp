@@ -49,8 +49,8 @@ void DistributedModel<Rank>::SetupMPI()
 	}
 	else
 	{
-		MPI_Comm_rank(MPI_COMM_WORLD, &this->ProcId);
-		MPI_Comm_size(MPI_COMM_WORLD, &this->ProcCount);
+		MPI_Comm_rank(BaseCommunicator::Get(), &this->ProcId);
+		MPI_Comm_size(BaseCommunicator::Get(), &this->ProcCount);
 		#ifdef PYPROP_DEBUG
 			std::cout << "Proc " << (1+ProcId) << "/" << ProcCount << std::endl;
 		#endif
@@ -133,6 +133,12 @@ bool DistributedModel<Rank>::IsDistributedRank(int rank)
 	return false;
 }
 
+template<int Rank>
+MPI_Comm DistributedModel<Rank>::GetComm()
+{
+	return BaseCommunicator::Get();
+}
+
 /*
  * Get MPI communicator group for a wavefunction rank (rank)
  */
@@ -160,6 +166,52 @@ MPI_Comm DistributedModel<Rank>::GetGroupCommRank(int rank)
 	return Transpose->GetGroupCommRank(procRank);
 }
 
+/*
+ * Fortran handle of the communicator group for a wavefunction rank, 
+ * which is passed to the generated distributed tensor potential kernels
+ */
+template<int Rank>
+int DistributedModel<Rank>::GetGroupCommRankHandle(int rank)
+{
+	if (!IsDistributedRank(rank))
+	{
+		return MPI_Comm_c2f(MPI_COMM_SELF);
+	}
+	return MPI_Comm_c2f(GetGroupCommRank(rank));
+}
+
+/*
+ * Id of this proc within the communicator group of a wavefunction rank,
+ * i.e. the coordinate of this proc along the proc grid dimension over
+ * which rank is distributed
+ */
+template<int Rank>
+int DistributedModel<Rank>::GetGroupProcId(int rank)
+{
+	if (!IsDistributedRank(rank))
+	{
+		return 0;
+	}
+	int procId;
+	MPI_Comm_rank(GetGroupCommRank(rank), &procId);
+	return procId;
+}
+
+/*
+ * Number of procs in the communicator group of a wavefunction rank
+ */
+template<int Rank>
+int DistributedModel<Rank>::GetGroupProcCount(int rank)
+{
+	if (!IsDistributedRank(rank))
+	{
+		return 1;
+	}
+	int procCount;
+	MPI_Comm_size(GetGroupCommRank(rank), &procCount);
+	return procCount;
+}
+
 
 /* Performs the necessary communication with the other processes to change the distribution
  * of the wavefunction
@@ -193,6 +245,68 @@ void DistributedModel<1>::ChangeDistribution(Wavefunction<1> &psi, const Distrib
 	     << "Most likely, you are calling ChangeDistribution on a SubDistribution. " << endl;
 }
 
+/* 
+ * As ChangeDistribution, but the transpose is split into chunkCount chunks along chunkRank, 
+ * and action is called on each chunk before it is sent (actionBeforeSend), or after it
+ * is received, overlapping the computation with the communication of the other chunks. 
+ * See ArrayTranspose::TransposePipelined
+ */
+template<int Rank>
+void DistributedModel<Rank>::ChangeDistributionPipelined(Wavefunction<Rank> &psi, const Distribution::DataArray &newDistrib, int destBufferName, int chunkRank, int chunkCount, TransposeChunkAction<Rank> &action, bool actionBeforeSend)
+{
+	if (IsSingleProc())
+	{
+		throw std::runtime_error("Error! Should not call ChangeDistributionPipelined if we are singleproc.");
+	}
+
+	Distribution::DataArray distrib(CurrentDistribution->GetDistribution());
+	int procRank = -1;
+	for (int i=0; i<CurrentDistribution->GetProcRank(); i++)
+	{
+		if (distrib(i) != newDistrib(i))
+		{
+			if (procRank != -1)
+			{
+				throw std::runtime_error("Currently only supporting changing one rank pr. call to transpose");
+			}
+			procRank = i;
+		}
+	}
+	if (procRank == -1)
+	{
+		cout << "Warning: Nothing to do transforming " << distrib << " to " << newDistrib << endl;
+		return;
+	}
+
+	typename Wavefunction<Rank>::DataArray src(psi.GetData());
+	typename Wavefunction<Rank>::DataArray dst(psi.GetData(destBufferName));
+	typename Wavefunction<Rank>::IndexVector fullShape(psi.GetRepresentation()->GetFullShape());
+
+	Transpose->TransposePipelined(fullShape, distrib, src, distrib(procRank), dst, newDistrib(procRank), procRank, chunkRank, chunkCount, action, actionBeforeSend);
+
+	psi.SetActiveBuffer(destBufferName);
+	CurrentDistribution->SetDistribution(newDistrib);
+}
+
+template<>
+void DistributedModel<1>::ChangeDistributionPipelined(Wavefunction<1> &psi, const Distribution::DataArray &newDistrib, int destBufferName, int chunkRank, int chunkCount, TransposeChunkAction<1> &action, bool actionBeforeSend)
+{
+	throw std::runtime_error("ChangeDistributionPipelined can not be called on a 1D DistributedModel");
+}
+
+/*
+ * Returns the local shape of an array of shape fullShape with the distribution distrib
+ */
+template<int Rank>
+blitz::TinyVector<int, Rank> DistributedModel<Rank>::CreateDistributedShape(const blitz::TinyVector<int, Rank> &fullShape, const Distribution::DataArray &distrib)
+{
+	if (IsSingleProc())
+	{
+		return fullShape;
+	}
+	return Transpose->CreateDistributedShape(fullShape, distrib);
+}
+
 /**
  * Returns the index in the virtual super wavefunction
  * on which this proc starts (on the rank currentRank)
@@ -210,7 +324,7 @@ int DistributedModel<Rank>::GetLocalStartIndex(int globalSize, int currentRank)
 	{
 		if (distrib(i) == currentRank)
 		{
-			return Transpose->GetLocalStartIndex(globalSize, i);
+			return Transpose->GetLocalStartIndex(globalSize, i, Transpose->GetCartesianCoord(i), currentRank);
 		}
 	}
 	return 0;
@@ -233,7 +347,7 @@ blitz::Range DistributedModel<Rank>::GetLocalIndexRange(int globalSize, int curr
 	{
 		if (distrib(i) == currentRank)
 		{
-			return Transpose->GetLocalRange(globalSize, i);
+			return Transpose->GetLocalRange(globalSize, i, Transpose->GetCartesianCoord(i), currentRank);
 		}
 	}
 	return blitz::Range(0, globalSize-1);
@@ -256,7 +370,7 @@ int DistributedModel<Rank>::GetLocalStartIndex(int globalSize, int currentRank,
 	{
 		if (distrib(i) == currentRank)
 		{
-			return Transpose->GetLocalStartIndex(globalSize, i, procId);
+			return Transpose->GetLocalStartIndex(globalSize, i, procId, currentRank);
 		}
 	}
 	return 0;
@@ -279,7 +393,7 @@ blitz::Range DistributedModel<Rank>::GetLocalIndexRange(int globalSize, int curr
 	{
 		if (distrib(i) == currentRank)
 		{
-			return Transpose->GetLocalRange(globalSize, i, procId);
+			return Transpose->GetLocalRange(globalSize, i, procId, currentRank);
 		}
 	}
 	return blitz::Range(0, globalSize-1);
@@ -296,7 +410,7 @@ double DistributedModel<Rank>::GetGlobalSum(double localValue)
 	}
 
 	double globalValue = 0;
-	MPI_Allreduce(&localValue, &globalValue, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+	MPI_Allreduce(&localValue, &globalValue, 1, MPI_DOUBLE, MPI_SUM, BaseCommunicator::Get());
 	return globalValue;
 }
 
@@ -309,7 +423,7 @@ cplx DistributedModel<Rank>::GetGlobalSum(cplx localValue)
 	}
 
 	cplx globalValue = 0;
-	MPI_Allreduce(&localValue, &globalValue, 2, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+	MPI_Allreduce(&localValue, &globalValue, 2, MPI_DOUBLE, MPI_SUM, BaseCommunicator::Get());
 	return globalValue;
 }
 
@@ -323,7 +437,7 @@ void DistributedModel<Rank>::GetGlobalSum(blitz::Array<cplx, 1> &in, blitz::Arra
 	else
 	{
 		MPITraits<cplx> traits;
-		MPI_Allreduce(in.data(), out.data(), in.extent(0)*traits.Length(), traits.Type(), MPI_SUM, MPI_COMM_WORLD);
+		MPI_Allreduce(in.data(), out.data(), in.extent(0)*traits.Length(), traits.Type(), MPI_SUM, BaseCommunicator::Get());
 	}
 }
 
@@ -332,7 +446,7 @@ void DistributedModel<Rank>::GlobalBarrier()
 {
 	if (!IsSingleProc())
 	{
-		MPI_Barrier(MPI_COMM_WORLD);
+		MPI_Barrier(BaseCommunicator::Get());
 	}
 }
 
@@ -82,6 +82,18 @@ void DistributedModel<1>::ChangeDistribution(Wavefunction<1> &psi, const Distrib
 	     << "Most likely, you are calling ChangeDistribution on a SubDistribution. " << endl;
 }
 
+template<int Rank>
+void DistributedModel<Rank>::ChangeDistributionPipelined(Wavefunction<Rank> &psi, const Distribution::DataArray &newDistrib, int destBufferName, int chunkRank, int chunkCount, TransposeChunkAction<Rank> &action, bool actionBeforeSend)
+{
+	throw std::runtime_error("Error! Should not call ChangeDistributionPipelined if we are singleproc.");
+}
+
+template<int Rank>
+blitz::TinyVector<int, Rank> DistributedModel<Rank>::CreateDistributedShape(const blitz::TinyVector<int, Rank> &fullShape, const Distribution::DataArray &distrib)
+{
+	return fullShape;
+}
+
 /**
  * Returns the index in the virtual super wavefunction
  * on which this proc starts (on the rank currentRank)
@@ -123,6 +135,30 @@ blitz::Range DistributedModel<Rank>::GetLocalIndexRange(int globalSize, int curr
 }
 
 
+template<int Rank>
+MPI_Comm DistributedModel<Rank>::GetComm()
+{
+	return BaseCommunicator::Get();
+}
+
+template<int Rank>
+int DistributedModel<Rank>::GetGroupCommRankHandle(int rank)
+{
+	return 0;
+}
+
+template<int Rank>
+int DistributedModel<Rank>::GetGroupProcId(int rank)
+{
+	return 0;
+}
+
+template<int Rank>
+int DistributedModel<Rank>::GetGroupProcCount(int rank)
+{
+	return 1;
+}
+
 template<int Rank>
 double DistributedModel<Rank>::GetGlobalSum(double localValue)
 {
@@ -0,0 +1,104 @@
+#include "partition.h"
+
+std::map<int, RankPartition::Entry> RankPartition::Partitions;
+
+void RankPartition::SetWeights(int rank, const blitz::Array<double, 1> &weights)
+{
+	double total = 0;
+	for (int i=0; i<weights.extent(0); i++)
+	{
+		if (weights(i) < 0)
+		{
+			cout << "Partition weight " << i << " of rank " << rank << " is negative (" << weights(i) << ")" << endl;
+			throw std::runtime_error("Partition weights must be non-negative");
+		}
+		total += weights(i);
+	}
+	if (total <= 0)
+	{
+		throw std::runtime_error("Partition weights must have a positive sum");
+	}
+
+	Entry &entry = Partitions[rank];
+	entry.Weights.resize(weights.shape());
+	entry.Weights = weights;
+	entry.Boundaries.clear();
+}
+
+void RankPartition::ClearWeights(int rank)
+{
+	Partitions.erase(rank);
+}
+
+bool RankPartition::HasWeights(int rank, int globalSize)
+{
+	std::map<int, Entry>::iterator it = Partitions.find(rank);
+	return it != Partitions.end() && it->second.Weights.extent(0) == globalSize;
+}
+
+blitz::Array<double, 1> RankPartition::GetWeights(int rank)
+{
+	std::map<int, Entry>::iterator it = Partitions.find(rank);
+	if (it == Partitions.end())
+	{
+		return blitz::Array<double, 1>();
+	}
+	return it->second.Weights.copy();
+}
+
+/*
+ * Splits the rank into procCount contiguous blocks. Boundary p is placed at
+ * the index where the cumulative cost is closest to p * total / procCount.
+ * The returned list has procCount+1 entries, block p is [b[p], b[p+1])
+ */
+const RankPartition::BoundaryList& RankPartition::GetBoundaries(int rank, int procCount)
+{
+	Entry &entry = Partitions[rank];
+	std::map<int, BoundaryList>::iterator it = entry.Boundaries.find(procCount);
+	if (it != entry.Boundaries.end())
+	{
+		return it->second;
+	}
+
+	int size = entry.Weights.extent(0);
+	std::vector<double> prefix(size+1, 0.0);
+	for (int i=0; i<size; i++)
+	{
+		prefix[i+1] = prefix[i] + entry.Weights(i);
+	}
+	double total = prefix[size];
+
+	BoundaryList boundaries(procCount+1, size);
+	boundaries[0] = 0;
+	int index = 0;
+	for (int p=1; p<procCount; p++)
+	{
+		double target = p * total / procCount;
+		while (index < size && prefix[index] < target)
+		{
+			index++;
+		}
+		int boundary = index;
+		if (boundary > boundaries[p-1] && target - prefix[boundary-1] < prefix[boundary] - target)
+		{
+			boundary--;
+		}
+		boundaries[p] = boundary;
+		index = boundary;
+	}
+
+	entry.Boundaries[procCount] = boundaries;
+	return entry.Boundaries[procCount];
+}
+
+int RankPartition::GetLocalStartIndex(int rank, int procCount, int groupRank)
+{
+	return GetBoundaries(rank, procCount)[groupRank];
+}
+
+int RankPartition::GetLocalSize(int rank, int procCount, int groupRank)
+{
+	const BoundaryList &boundaries = GetBoundaries(rank, procCount);
+	return boundaries[groupRank+1] - boundaries[groupRank];
+}
+
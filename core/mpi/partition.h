@@ -0,0 +1,66 @@
+#ifndef PARTITION_H
+#define PARTITION_H
+
+#include "../common.h"
+
+#include <map>
+#include <vector>
+
+/*
+ * Cost-weighted partitioning of distributed ranks.
+ *
+ * By default, a distributed rank of size N is split into blocks of equal
+ * count on the procs (see CreateDistributedShape() in blitztranspose.h).
+ * If a cost vector w of length N is registered for a rank with SetWeights(),
+ * the rank is instead split into contiguous blocks of approximately equal
+ * cost, i.e. proc p gets the indices i for which the cumulative cost
+ * sum(w[0:i]) falls in [p, p+1) * sum(w) / procCount.
+ *
+ * The weights are kept for the whole process, and are used by everything
+ * calculating local index ranges of that rank through ArrayTranspose and
+ * DistributedModel (transposes, GetLocalStartIndex/GetLocalIndexRange, and
+ * through those the SimpD tensor kernels, GeometryInfo basis pairs and HDF
+ * slab I/O). Weights only apply to arrays where the rank has exactly N
+ * elements, other sizes use the equal count partition.
+ *
+ * The weights must be set on all procs before any wavefunction is
+ * created, and must not be changed while a wavefunction exists.
+ */
+class RankPartition
+{
+public:
+	/*
+	 * Registers the cost vector for a wavefunction rank
+	 */
+	static void SetWeights(int rank, const blitz::Array<double, 1> &weights);
+	static void ClearWeights(int rank);
+
+	/*
+	 * Returns true if a cost vector of length globalSize is registered for rank
+	 */
+	static bool HasWeights(int rank, int globalSize);
+	static blitz::Array<double, 1> GetWeights(int rank);
+
+	/*
+	 * Start index and size of the block of groupRank when a rank with
+	 * registered weights is distributed on procCount procs
+	 */
+	static int GetLocalStartIndex(int rank, int procCount, int groupRank);
+	static int GetLocalSize(int rank, int procCount, int groupRank);
+
+private:
+	typedef std::vector<int> BoundaryList;
+
+	struct Entry
+	{
+		blitz::Array<double, 1> Weights;
+		std::map<int, BoundaryList> Boundaries;   //Keyed by procCount
+	};
+
+	static std::map<int, Entry> Partitions;
+
+	static const BoundaryList& GetBoundaries(int rank, int procCount);
+};
+
+#endif
+
@@ -2,6 +2,7 @@
 
 #include <core/wavefunction.h>
 #include <core/utility/fortran.h>
+#include <core/utility/gilrelease.h>
 
 namespace ODE
 {
@@ -49,8 +50,16 @@ void MultiplyHamiltonian(double *t, cplx *inBuffer, cplx *outBuffer, void *data)
 	tempPsi->SetData(outData);
 
 	//Perform Hamilton-Wavefunction multiplication
-	object callback = propagator->MultiplyCallback;
-	callback(psi, tempPsi, *t);
+	if (propagator->Hamiltonian)
+	{
+		propagator->Hamiltonian->Multiply(psi, tempPsi, *t);
+	}
+	else
+	{
+		AcquireGIL acquireGIL;
+		object callback = propagator->MultiplyCallback;
+		callback(psi, tempPsi, *t);
+	}
 
 	//Restore the databuffers of psi and tempPsi
 	psi->SetData(psiOrigData);
@@ -144,7 +153,11 @@ void OdeWrapper<Rank>::AdvanceStep(object callback, typename Wavefunction<Rank>:
 
 	double tout = this->OutputTime + timeStep;
 
-	cOde(MultiplyHamiltonian<Rank>, this, n, in, this->OutputTime, tout, this->RelativeError, this->AbsoluteError, this->Flag, this->Work.data(), this->Iwork.data());
+	{
+		//The python callback takes the GIL back in MultiplyHamiltonian
+		ReleaseGIL releaseGIL;
+		cOde(MultiplyHamiltonian<Rank>, this, n, in, this->OutputTime, tout, this->RelativeError, this->AbsoluteError, this->Flag, this->Work.data(), this->Iwork.data());
+	}
 
 	if (this->Flag != 2)
 	{
@@ -3,6 +3,7 @@
 
 #include <core/common.h>
 #include <core/wavefunction.h>
+#include <core/tensorpotential/hamiltonianoperator.h>
 
 #include <core/utility/boostpythonhack.h>
 
@@ -21,6 +22,7 @@ public:
 	typename Wavefunction<Rank>::Ptr Psi;
 	typename Wavefunction<Rank>::Ptr TempPsi;
 	object MultiplyCallback;
+	typename HamiltonianOperator<Rank>::Ptr Hamiltonian;
 	bool ImTime;
 
 private:
@@ -37,6 +39,20 @@ public:
 	void Setup(const Wavefunction<Rank> &psi);
 	void AdvanceStep(object callback, typename Wavefunction<Rank>::Ptr psi, typename Wavefunction<Rank>::Ptr tempPsi, cplx dt, double t);
 
+	/*
+	 * Use a C++ HamiltonianOperator for the matrix-vector products instead
+	 * of the python callback passed to AdvanceStep
+	 */
+	void SetHamiltonianOperator(typename HamiltonianOperator<Rank>::Ptr hamiltonian)
+	{
+		Hamiltonian = hamiltonian;
+	}
+
+	void ClearHamiltonianOperator()
+	{
+		Hamiltonian = typename HamiltonianOperator<Rank>::Ptr();
+	}
+
 	double GetPropagatedTime()
 	{
 		return OutputTime;
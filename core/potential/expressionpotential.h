@@ -0,0 +1,309 @@
+#ifndef EXPRESSIONPOTENTIAL_H
+#define EXPRESSIONPOTENTIAL_H
+
+#include "../common.h"
+#include "../wavefunction.h"
+#include "../representation/representation.h"
+#include "../utility/expressionevaluator.h"
+#include "staticpotential.h"
+
+#include <vector>
+#include <sstream>
+
+/*
+ * A potential given by an expression in the grid coordinates, e.g.
+ *   potential_expression = "-Z/sqrt(r^2 + a^2) * f"
+ * which is compiled once by ExpressionEvaluator, and evaluated natively
+ * over the local grid, instead of calling a python function in every
+ * grid point.
+ *
+ * The coordinate names default to x0, x1, ..., and may be changed with
+ * SetCoordinateName before SetExpression. All other identifiers are
+ * parameters, which are set with SetParameter. The parameter "t" is set
+ * to the current time in the evaluator methods, such that time dependent
+ * parameters (e.g. the value f of a time function) can be bound before
+ * every step.
+ *
+ * Expressions and parameters are real. The potential is the real value of
+ * the expression, which is applied to the complex wavefunction.
+ *
+ * The grid is evaluated in blocks of ExpressionEvaluator::BlockSize
+ * points.
+ *
+ * The interface of ApplyPotential, MultiplyPotential, UpdateStaticPotential
+ * and CalculateExpectationValue is the same as DynamicPotentialEvaluator,
+ * so an ExpressionPotential can be used as the Evaluator of a
+ * DynamicPotentialWrapper.
+ */
+template<int Rank>
+class ExpressionPotential
+{
+public:
+	typedef shared_ptr< ExpressionPotential<Rank> > Ptr;
+
+	ExpressionPotential()
+	{
+		for (int i=0; i<Rank; i++)
+		{
+			std::ostringstream name;
+			name << "x" << i;
+			CoordinateNames.push_back(name.str());
+		}
+	}
+
+	void SetCoordinateName(int rank, const std::string &name)
+	{
+		if (rank < 0 || rank >= Rank)
+		{
+			cout << "Invalid rank " << rank << " for coordinate " << name << endl;
+			throw std::runtime_error("Invalid coordinate rank");
+		}
+		CoordinateNames[rank] = name;
+	}
+
+	std::string GetCoordinateName(int rank)
+	{
+		return CoordinateNames[rank];
+	}
+
+	void SetExpression(const std::string &expression)
+	{
+		Evaluator.Compile(expression, CoordinateNames);
+	}
+
+	std::string GetExpression()
+	{
+		return Evaluator.GetExpression();
+	}
+
+	int GetParameterCount() { return Evaluator.GetParameterCount(); }
+	std::string GetParameterName(int index) { return Evaluator.GetParameterName(index); }
+	bool HasParameter(const std::string &name) { return Evaluator.HasParameter(name); }
+	void SetParameter(const std::string &name, double value) { Evaluator.SetParameter(name, value); }
+	double GetParameter(const std::string &name) { return Evaluator.GetParameter(name); }
+	void PrintBytecode() { Evaluator.PrintBytecode(); }
+
+	/*
+	 * Evaluates the potential at time curTime in the local grid points of psi.
+	 * result must have the same shape as psi
+	 */
+	void EvaluateOnGrid(const Wavefunction<Rank> &psi, const double curTime, blitz::Array<double, Rank> result)
+	{
+		if (result.shape() != psi.Data.shape() || !result.isStorageContiguous())
+		{
+			throw std::runtime_error("result must be contiguous and have the same shape as psi");
+		}
+		EvaluateBlocks(psi, curTime, StoreValue(result.data()));
+	}
+
+	/*
+	 * Sets psi to the (real) value of the expression in every local grid
+	 * point, e.g. for initial states
+	 */
+	void SetWavefunction(Wavefunction<Rank> &psi)
+	{
+		Evaluate(psi, 0.0, psi.GetData(), AssignValue());
+	}
+
+	/*
+	 * Evaluator interface
+	 */
+
+	void ApplyPotential(Wavefunction<Rank> &psi, const cplx &timeStep, const double &curTime)
+	{
+		Evaluate(psi, curTime, psi.GetData(), ApplyExpValue(timeStep));
+	}
+
+	void MultiplyPotential(Wavefunction<Rank> &srcPsi, Wavefunction<Rank> &dstPsi, const cplx &timeStep, const double &curTime)
+	{
+		blitz::Array<cplx, Rank> src(srcPsi.GetData());
+		blitz::Array<cplx, Rank> dst(dstPsi.GetData());
+		if (!src.isStorageContiguous() || !dst.isStorageContiguous())
+		{
+			throw std::runtime_error("ExpressionPotential requires contiguous wavefunctions");
+		}
+		Evaluate(srcPsi, curTime, dst, MultiplyValue(src.data()));
+	}
+
+	void UpdateStaticPotential(StaticPotential<Rank> &potential, const Wavefunction<Rank> &psi, const cplx &timeStep, const double &curTime, typename StaticPotential<Rank>::StorageModel storage)
+	{
+		if (potential.UseStorageExpValue())
+		{
+			blitz::Array<cplx, Rank> potentialDataExp( potential.GetPotentialDataExp() );
+			Evaluate(psi, curTime, potentialDataExp, AssignExpValue(timeStep));
+		}
+		if (potential.UseStorageValue())
+		{
+			blitz::Array<cplx, Rank> potentialData( potential.GetPotentialData() );
+			Evaluate(psi, curTime, potentialData, AssignValue());
+		}
+	}
+
+	double CalculateExpectationValue(const Wavefunction<Rank> &psi, const cplx &timeStep, const double curTime)
+	{
+		blitz::Array<double, Rank> potential(psi.Data.shape());
+		EvaluateOnGrid(psi, curTime, potential);
+
+		typename Representation<Rank>::Ptr repr = psi.GetRepresentation();
+		blitz::TinyVector< blitz::Array<double, 1>, Rank > weights;
+		for (int i=0; i<Rank; i++)
+		{
+			weights(i).reference(repr->GetLocalWeights(i));
+		}
+
+		blitz::Array<cplx, Rank> data(psi.Data);
+		typename blitz::Array<cplx, Rank>::iterator it = data.begin();
+		double* value = potential.data();
+		double expValue = 0;
+		for (int linearCount=0; linearCount<data.size(); linearCount++)
+		{
+			double weight = 1;
+			for (int i=0; i<Rank; i++)
+			{
+				weight *= weights(i)(it.position()(i));
+			}
+			expValue += weight * std::norm(*it) * value[linearCount];
+			it++;
+		}
+		return expValue;
+	}
+
+private:
+	std::vector<std::string> CoordinateNames;
+	ExpressionEvaluator Evaluator;
+
+	/*
+	 * Actions applied to the destination array with the evaluated value
+	 * of the potential in each point
+	 */
+	struct AssignValue
+	{
+		void operator()(cplx &dst, long index, double value) const { dst = value; }
+	};
+
+	struct AssignExpValue
+	{
+		cplx TimeStep;
+		AssignExpValue(const cplx &timeStep) : TimeStep(timeStep) {}
+		void operator()(cplx &dst, long index, double value) const { dst = exp( - I * value * TimeStep ); }
+	};
+
+	struct ApplyExpValue
+	{
+		cplx TimeStep;
+		ApplyExpValue(const cplx &timeStep) : TimeStep(timeStep) {}
+		void operator()(cplx &dst, long index, double value) const { dst *= exp( - I * value * TimeStep ); }
+	};
+
+	struct MultiplyValue
+	{
+		const cplx* Source;
+		MultiplyValue(const cplx* source) : Source(source) {}
+		void operator()(cplx &dst, long index, double value) const { dst += value * Source[index]; }
+	};
+
+	struct StoreValue
+	{
+		double* Result;
+		StoreValue(double* result) : Result(result) {}
+		void operator()(long index, double value) const { Result[index] = value; }
+	};
+
+	template<class Action>
+	struct ApplyToArray
+	{
+		cplx* Data;
+		Action DataAction;
+		ApplyToArray(cplx* data, const Action &action) : Data(data), DataAction(action) {}
+		void operator()(long index, double value) const { DataAction(Data[index], index, value); }
+	};
+
+	template<class Action>
+	void Evaluate(const Wavefunction<Rank> &psi, const double curTime, blitz::Array<cplx, Rank> dst, const Action &action)
+	{
+		if (dst.shape() != psi.Data.shape() || !dst.isStorageContiguous())
+		{
+			cout << "Invalid destination of shape " << dst.shape() << " for wavefunction of shape " << psi.Data.shape() << endl;
+			throw std::runtime_error("ExpressionPotential destination must be contiguous and have the same shape as psi");
+		}
+		EvaluateBlocks(psi, curTime, ApplyToArray<Action>(dst.data(), action));
+	}
+
+	/*
+	 * Evaluates the expression in all local grid points of psi, in row major
+	 * order, and calls store(linearIndex, value) for each point.
+	 */
+	template<class Store>
+	void EvaluateBlocks(const Wavefunction<Rank> &psi, const double curTime, const Store &store)
+	{
+		if (Evaluator.HasParameter("t"))
+		{
+			Evaluator.SetParameter("t", curTime);
+		}
+		Evaluator.ValidateParameters();
+
+		typename Representation<Rank>::Ptr repr = psi.GetRepresentation();
+		blitz::TinyVector< blitz::Array<double, 1>, Rank > grid;
+		blitz::TinyVector<int, Rank> shape = psi.Data.shape();
+		for (int i=0; i<Rank; i++)
+		{
+			grid(i).reference(repr->GetLocalGrid(i));
+		}
+
+		const int blockSize = ExpressionEvaluator::BlockSize;
+		const long pointCount = psi.Data.size();
+		const long blockCount = (pointCount + blockSize - 1) / blockSize;
+		const int workspaceSize = Evaluator.GetWorkspaceSize();
+
+		#pragma omp parallel
+		{
+			std::vector<double> coords(Rank * blockSize);
+			std::vector<double> values(blockSize);
+			std::vector<double> workspace(workspaceSize);
+			const double* variables[Rank];
+			for (int i=0; i<Rank; i++)
+			{
+				variables[i] = &coords[i*blockSize];
+			}
+
+			#pragma omp for schedule(static)
+			for (long block=0; block<blockCount; block++)
+			{
+				long start = block * blockSize;
+				int count = (int)std::min<long>(blockSize, pointCount - start);
+
+				//Multi index of the first point in the block
+				blitz::TinyVector<int, Rank> index;
+				long linearIndex = start;
+				for (int i=Rank-1; i>=0; i--)
+				{
+					index(i) = linearIndex % shape(i);
+					linearIndex /= shape(i);
+				}
+
+				for (int j=0; j<count; j++)
+				{
+					for (int i=0; i<Rank; i++)
+					{
+						coords[i*blockSize + j] = grid(i)(index(i));
+					}
+					for (int i=Rank-1; i>=0; i--)
+					{
+						if (++index(i) < shape(i)) break;
+						index(i) = 0;
+					}
+				}
+
+				Evaluator.EvaluateBlock(count, variables, &values[0], &workspace[0]);
+
+				for (int j=0; j<count; j++)
+				{
+					store(start + j, values[j]);
+				}
+			}
+		}
+	}
+};
+
+#endif
+
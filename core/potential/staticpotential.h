@@ -4,6 +4,7 @@
 #include "../common.h"
 #include "../wavefunction.h"
 #include "../utility/blitzblas.h"
+#include "../utility/memoryarena.h"
 
 template<int Rank>
 class StaticPotential
@@ -22,6 +23,8 @@ private:
 	StorageModel Storage;
 	blitz::Array<cplx, Rank> PotentialData;
 	blitz::Array<cplx, Rank> PotentialDataExp;
+	MemoryArena::BlockPtr PotentialBlock;
+	MemoryArena::BlockPtr PotentialExpBlock;
 
 public:
 	StaticPotential() {}
@@ -53,11 +56,11 @@ public:
 
 		if (UseStorageValue())
 		{
-			PotentialData.resize(psi.Data.shape());
+			AllocateArenaArray(PotentialData, psi.Data.shape(), PotentialBlock);
 		}
 		if (UseStorageExpValue())
 		{
-			PotentialDataExp.resize(psi.Data.shape());
+			AllocateArenaArray(PotentialDataExp, psi.Data.shape(), PotentialExpBlock);
 		}
 
 	}
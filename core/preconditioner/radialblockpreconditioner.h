@@ -0,0 +1,739 @@
+#ifndef RADIALBLOCKPRECONDITIONER_H
+#define RADIALBLOCKPRECONDITIONER_H
+
+#include "../common.h"
+#include "../wavefunction.h"
+#include "../representation/representation.h"
+#include "../utility/blitzblas.h"
+#include "../utility/blitzlapack.h"
+
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cstring>
+
+/*
+ * Block diagonal preconditioner for systems
+ *
+ *     (a H + b S) x = y
+ *
+ * where the first (angular) rank is kept diagonal, and the remaining
+ * (radial) ranks of every angular index form one block, which is solved
+ * exactly or approximately. This is the C++ replacement for the Ifpack
+ * and SuperLU radial preconditioners, and does not depend on Epetra.
+ *
+ * The block matrix is the sum of the tensor potentials added with
+ * AddTensorPotential, each multiplied by a scaling (i.e. a for the
+ * hamiltonian terms and b for the overlap). The potentials must be
+ * diagonal in the first rank, such that PotentialData(i, ...) is the
+ * block of local angular index i. The matrix elements of the radial ranks
+ * are given by SetRankEntries (see BlockSparsePotential) before each
+ * potential is added.
+ *
+ * Methods:
+ * - "banded": Every block is assembled as a banded matrix in the
+ *   flattened radial index, and LU factorized (zgbtrf). This is exact
+ *   for the given potentials.
+ * - "tensor": Only for two radial ranks. Every block A is approximated
+ *   by the nearest Kronecker sum X (x) S2 + S1 (x) Y, where S1 and S2
+ *   are the overlap matrices given by SetOverlapMatrix, which is
+ *   inverted by fast diagonalization:
+ *       A^-1 ~= (V1 (x) V2) D^-1 ((S1 V1)^-1 (x) (S2 V2)^-1)
+ *   with S_i^-1 X_i = V_i L_i V_i^-1 and D = L1 (+) L2. This needs
+ *   O(n1^2 + n2^2) memory per block instead of O(n1 n2 band), and is
+ *   exact for separable blocks (kinetic energy, centrifugal and
+ *   nuclear potentials), while the electron-electron coupling is only
+ *   kept in its separable part.
+ *
+ * Blocks with identical potential data (e.g. repeated l-values, which
+ * differ only in quantum numbers which do not enter the radial
+ * potentials) share one factorization.
+ *
+ * The radial ranks can not be distributed, the angular rank can.
+ */
+template<int Rank>
+class RadialBlockPreconditioner
+{
+public:
+	typedef shared_ptr< RadialBlockPreconditioner<Rank> > Ptr;
+	typedef blitz::Array<cplx, Rank> DataArray;
+	typedef blitz::Array<cplx, 2> MatrixType;
+	typedef blitz::Array<cplx, 1> VectorType;
+	typedef blitz::Array<int, 1> IntVectorType;
+	typedef blitz::linalg::LAPACK<cplx> LAPACK;
+
+	enum MethodType
+	{
+		MethodBanded,
+		MethodTensor
+	};
+
+private:
+	struct Entry
+	{
+		int Row;
+		int Col;
+		int PotentialIndex;
+		bool Conjugate;
+	};
+
+	struct Term
+	{
+		DataArray Potential;
+		cplx Scaling;
+		std::vector< std::vector<Entry> > Entries;
+	};
+
+	struct Factorization
+	{
+		//The first angular index with this block
+		int AngularIndex;
+
+		//banded
+		MatrixType Matrix;
+		IntVectorType Pivots;
+
+		//tensor, all stored as ordinary row major matrices
+		MatrixType LeftVectors;          //V1
+		MatrixType LeftInverse;          //(S1 V1)^-1
+		MatrixType RightVectorsT;        //V2^T
+		MatrixType RightInverseT;        //((S2 V2)^-1)^T
+		MatrixType InverseEigenvalues;   //1 / (l1_i + l2_j)
+	};
+
+	MethodType Method;
+	std::vector< std::vector<Entry> > Entries;
+	std::vector<Term> Terms;
+	std::vector<MatrixType> Overlap;
+
+	std::vector<Factorization> Factorizations;
+	std::vector<int> FactorizationIndex;
+	blitz::TinyVector<int, Rank> BlockShape;
+	int BlockSize;
+	int BandCount;
+
+public:
+	RadialBlockPreconditioner() : Method(MethodBanded), Entries(Rank), Overlap(Rank), BlockSize(0), BandCount(0)
+	{
+		if (Rank < 2)
+		{
+			throw std::runtime_error("Radial block preconditioner requires at least two ranks");
+		}
+	}
+
+	void SetMethod(const std::string &method)
+	{
+		if (method == "banded")
+		{
+			Method = MethodBanded;
+		}
+		else if (method == "tensor")
+		{
+			if (Rank != 3)
+			{
+				throw std::runtime_error("The tensor method requires exactly two radial ranks");
+			}
+			Method = MethodTensor;
+		}
+		else
+		{
+			cout << "Unknown radial block preconditioner method " << method << endl;
+			throw std::runtime_error("Unknown radial block preconditioner method (use banded or tensor)");
+		}
+	}
+
+	std::string GetMethod()
+	{
+		return Method == MethodBanded ? "banded" : "tensor";
+	}
+
+	/*
+	 * Sets the matrix elements of rank (> 0) as an array of
+	 * (row, col, potentialIndex, conjugate) for the potentials
+	 * added after this call.
+	 */
+	void SetRankEntries(int rank, blitz::Array<int, 2> entries)
+	{
+		if (rank <= 0 || rank >= Rank)
+		{
+			cout << "Invalid rank " << rank << " for radial block preconditioner entries" << endl;
+			throw std::runtime_error("Invalid rank for radial block preconditioner entries");
+		}
+		if (entries.extent(1) != 4)
+		{
+			throw std::runtime_error("Radial block preconditioner entries must have shape (count, 4)");
+		}
+
+		std::vector<Entry> &rankEntries = Entries[rank];
+		rankEntries.resize(entries.extent(0));
+		for (int i=0; i<entries.extent(0); i++)
+		{
+			rankEntries[i].Row = entries(i, 0);
+			rankEntries[i].Col = entries(i, 1);
+			rankEntries[i].PotentialIndex = entries(i, 2);
+			rankEntries[i].Conjugate = entries(i, 3) != 0;
+		}
+	}
+
+	/*
+	 * Adds scaling * potential to the blocks. potential is referenced,
+	 * not copied, until Setup is called.
+	 */
+	void AddTensorPotential(DataArray potential, cplx scaling)
+	{
+		if (!potential.isStorageContiguous())
+		{
+			throw std::runtime_error("Radial block preconditioner requires contiguous potential data");
+		}
+		for (int rank=1; rank<Rank; rank++)
+		{
+			if (Entries[rank].empty())
+			{
+				cout << "No entries set for rank " << rank << endl;
+				throw std::runtime_error("SetRankEntries must be called for all radial ranks before AddTensorPotential");
+			}
+			for (int i=0; i<(int)Entries[rank].size(); i++)
+			{
+				if (Entries[rank][i].PotentialIndex >= potential.extent(rank))
+				{
+					cout << "Entry " << i << " of rank " << rank << " is outside potential of shape " << potential.shape() << endl;
+					throw std::runtime_error("Invalid potential index in radial block preconditioner entries");
+				}
+			}
+		}
+
+		Term term;
+		term.Potential.reference(potential);
+		term.Scaling = scaling;
+		term.Entries = Entries;
+		Terms.push_back(term);
+	}
+
+	/*
+	 * Sets the (dense) overlap matrix of a radial rank, required by the
+	 * tensor method. Orthogonal ranks should be given the identity.
+	 */
+	void SetOverlapMatrix(int rank, MatrixType overlap)
+	{
+		if (rank <= 0 || rank >= Rank)
+		{
+			cout << "Invalid rank " << rank << " for overlap matrix" << endl;
+			throw std::runtime_error("Invalid rank for radial block preconditioner overlap matrix");
+		}
+		Overlap[rank].resize(overlap.shape());
+		Overlap[rank] = overlap;
+	}
+
+	/*
+	 * Assembles and factorizes the blocks of the local angular indices of psi.
+	 * The potentials are released afterwards
+	 */
+	void Setup(typename Wavefunction<Rank>::Ptr psi)
+	{
+		typename Representation<Rank>::Ptr repr = psi->GetRepresentation();
+		DataArray data = psi->GetData();
+
+		if (Terms.empty())
+		{
+			throw std::runtime_error("No potentials added to radial block preconditioner");
+		}
+		for (int rank=1; rank<Rank; rank++)
+		{
+			if (repr->GetDistributedModel()->IsDistributedRank(rank))
+			{
+				throw std::runtime_error("Radial ranks can not be distributed in the radial block preconditioner");
+			}
+		}
+		for (int i=0; i<(int)Terms.size(); i++)
+		{
+			if (Terms[i].Potential.extent(0) != data.extent(0))
+			{
+				cout << "Potential " << i << " has shape " << Terms[i].Potential.shape() << ", wavefunction " << data.shape() << endl;
+				throw std::runtime_error("Potentials must be diagonal in the angular rank");
+			}
+		}
+
+		BlockShape = data.shape();
+		BlockShape(0) = 1;
+		BlockSize = blitz::product(BlockShape);
+		BandCount = CalculateBandCount();
+
+		FindUniqueBlocks(data.extent(0));
+
+		int factorizationCount = Factorizations.size();
+		int errorCount = 0;
+		#pragma omp parallel
+		{
+			LAPACK lapack;
+			#pragma omp for schedule(dynamic) reduction(+:errorCount)
+			for (int i=0; i<factorizationCount; i++)
+			{
+				Factorization &fact = Factorizations[i];
+				bool success;
+				if (Method == MethodBanded)
+				{
+					success = SetupBanded(lapack, fact.AngularIndex, fact);
+				}
+				else
+				{
+					success = SetupTensor(lapack, fact.AngularIndex, fact);
+				}
+				if (!success)
+				{
+					errorCount++;
+				}
+			}
+		}
+		if (errorCount > 0)
+		{
+			cout << "Could not factorize " << errorCount << " of " << factorizationCount << " radial blocks" << endl;
+			throw std::runtime_error("Radial block preconditioner factorization failed");
+		}
+
+		Terms.clear();
+	}
+
+	/*
+	 * Solves the block system in-place in psi
+	 */
+	void Solve(typename Wavefunction<Rank>::Ptr psi)
+	{
+		DataArray data = psi->GetData();
+		if (!data.isStorageContiguous() || data.extent(0) != (int)FactorizationIndex.size())
+		{
+			cout << "Invalid wavefunction of shape " << data.shape() << " for " << FactorizationIndex.size() << " radial blocks" << endl;
+			throw std::runtime_error("Invalid wavefunction for radial block preconditioner");
+		}
+
+		cplx* dataPtr = data.data();
+		int blockCount = FactorizationIndex.size();
+		int blockStride = data.stride(0);
+		#pragma omp parallel
+		{
+			LAPACK lapack;
+			MatrixType temp1, temp2;
+			#pragma omp for schedule(dynamic)
+			for (int i=0; i<blockCount; i++)
+			{
+				const Factorization &fact = Factorizations[FactorizationIndex[i]];
+				if (Method == MethodBanded)
+				{
+					SolveBanded(lapack, fact, dataPtr + i*blockStride);
+				}
+				else
+				{
+					SolveTensor(fact, dataPtr + i*blockStride, temp1, temp2);
+				}
+			}
+		}
+	}
+
+	int GetBlockCount()
+	{
+		return FactorizationIndex.size();
+	}
+
+	int GetFactorizationCount()
+	{
+		return Factorizations.size();
+	}
+
+	/*
+	 * Number of sub- and superdiagonals of the banded blocks
+	 */
+	int GetBandCount()
+	{
+		return BandCount;
+	}
+
+	/*
+	 * Memory used by the factorizations in MB
+	 */
+	double GetMemoryUsage()
+	{
+		double size = 0;
+		for (int i=0; i<(int)Factorizations.size(); i++)
+		{
+			const Factorization &fact = Factorizations[i];
+			size += fact.Matrix.size() + fact.LeftVectors.size() + fact.LeftInverse.size()
+				+ fact.RightVectorsT.size() + fact.RightInverseT.size() + fact.InverseEigenvalues.size();
+		}
+		return size * sizeof(cplx) / (1024.0*1024.0);
+	}
+
+private:
+	/*
+	 * Largest offset from the diagonal in the flattened block index
+	 */
+	int CalculateBandCount()
+	{
+		if (Method != MethodBanded)
+		{
+			return 0;
+		}
+
+		int subDiagonals = 0;
+		int superDiagonals = 0;
+		for (int i=0; i<(int)Terms.size(); i++)
+		{
+			int maxOffset = 0;
+			int minOffset = 0;
+			int stride = 1;
+			for (int rank=Rank-1; rank>0; rank--)
+			{
+				const std::vector<Entry> &entries = Terms[i].Entries[rank];
+				int rankMax = entries[0].Row - entries[0].Col;
+				int rankMin = rankMax;
+				for (int j=1; j<(int)entries.size(); j++)
+				{
+					rankMax = std::max(rankMax, entries[j].Row - entries[j].Col);
+					rankMin = std::min(rankMin, entries[j].Row - entries[j].Col);
+				}
+				maxOffset += rankMax * stride;
+				minOffset += rankMin * stride;
+				stride *= BlockShape(rank);
+			}
+			subDiagonals = std::max(subDiagonals, maxOffset);
+			superDiagonals = std::max(superDiagonals, -minOffset);
+		}
+		return std::max(subDiagonals, superDiagonals);
+	}
+
+	/*
+	 * Groups the angular indices with identical blocks, such that
+	 * FactorizationIndex(i) is the factorization of angular index i
+	 */
+	void FindUniqueBlocks(int angularCount)
+	{
+		FactorizationIndex.resize(angularCount);
+		Factorizations.clear();
+
+		//The block of an angular index is given by the potential slices of all terms
+		std::map<size_t, std::vector<int> > hashIndices;
+		for (int angularIndex=0; angularIndex<angularCount; angularIndex++)
+		{
+			size_t hash = 0;
+			for (int t=0; t<(int)Terms.size(); t++)
+			{
+				const cplx* slice = GetPotentialSlice(t, angularIndex);
+				long sliceSize = Terms[t].Potential.stride(0);
+				const unsigned char* bytes = reinterpret_cast<const unsigned char*>(slice);
+				for (long j=0; j<sliceSize*(long)sizeof(cplx); j++)
+				{
+					hash = hash * 1099511628211ul + bytes[j];
+				}
+			}
+
+			int factorization = -1;
+			std::vector<int> &candidates = hashIndices[hash];
+			for (int j=0; j<(int)candidates.size() && factorization == -1; j++)
+			{
+				if (IsEqualBlock(candidates[j], angularIndex))
+				{
+					factorization = FactorizationIndex[candidates[j]];
+				}
+			}
+			if (factorization == -1)
+			{
+				factorization = Factorizations.size();
+				Factorizations.push_back(Factorization());
+				Factorizations.back().AngularIndex = angularIndex;
+				candidates.push_back(angularIndex);
+			}
+			FactorizationIndex[angularIndex] = factorization;
+		}
+	}
+
+	bool IsEqualBlock(int angularIndex1, int angularIndex2)
+	{
+		for (int t=0; t<(int)Terms.size(); t++)
+		{
+			long sliceSize = Terms[t].Potential.stride(0);
+			if (std::memcmp(GetPotentialSlice(t, angularIndex1), GetPotentialSlice(t, angularIndex2), sliceSize*sizeof(cplx)) != 0)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	const cplx* GetPotentialSlice(int term, int angularIndex)
+	{
+		return Terms[term].Potential.data() + angularIndex * Terms[term].Potential.stride(0);
+	}
+
+	/*
+	 * Calls visitor(row, col, value) for all elements of one term in the block
+	 * of an angular index, where row and col are flattened radial indices
+	 */
+	template<class Visitor>
+	void VisitBlock(const Term &term, int rank, const cplx* potential, int row, int col, bool conjugate, Visitor &visitor)
+	{
+		const std::vector<Entry> &entries = term.Entries[rank];
+		int potentialStride = term.Potential.stride(rank);
+		int blockStride = 1;
+		for (int r=rank+1; r<Rank; r++)
+		{
+			blockStride *= BlockShape(r);
+		}
+
+		for (int i=0; i<(int)entries.size(); i++)
+		{
+			const Entry &entry = entries[i];
+			const cplx* entryPotential = potential + entry.PotentialIndex * potentialStride;
+			int entryRow = row + entry.Row * blockStride;
+			int entryCol = col + entry.Col * blockStride;
+			bool entryConjugate = conjugate != entry.Conjugate;
+			if (rank == Rank-1)
+			{
+				cplx value = entryConjugate ? conj(*entryPotential) : *entryPotential;
+				visitor(entryRow, entryCol, term.Scaling * value);
+			}
+			else
+			{
+				VisitBlock(term, rank+1, entryPotential, entryRow, entryCol, entryConjugate, visitor);
+			}
+		}
+	}
+
+	/*
+	 * Adds elements to a lapack banded matrix with BandCount sub- and superdiagonals
+	 */
+	struct AddBanded
+	{
+		cplx* Data;
+		int LeadingDimension;
+		int Bands;
+		AddBanded(cplx* data, int leadingDimension, int bands) : Data(data), LeadingDimension(leadingDimension), Bands(bands) {}
+		void operator()(int row, int col, cplx value) const
+		{
+			Data[col*LeadingDimension + 2*Bands + row - col] += value;
+		}
+	};
+
+	bool SetupBanded(LAPACK &lapack, int angularIndex, Factorization &fact)
+	{
+		int k = BandCount;
+		fact.Matrix.resize(BlockSize, 3*k + 1);
+		fact.Pivots.resize(BlockSize);
+		fact.Matrix = 0;
+
+		AddBanded visitor(fact.Matrix.data(), fact.Matrix.stride(0), k);
+		for (int t=0; t<(int)Terms.size(); t++)
+		{
+			VisitBlock(Terms[t], 1, GetPotentialSlice(t, angularIndex), 0, 0, false, visitor);
+		}
+
+		return lapack.CalculateLUFactorizationBanded(fact.Matrix, fact.Pivots) == 0;
+	}
+
+	void SolveBanded(LAPACK &lapack, const Factorization &fact, cplx* blockData)
+	{
+		//Views without reference counting of the shared factorization
+		MatrixType matrix(const_cast<cplx*>(fact.Matrix.data()), fact.Matrix.shape(), blitz::neverDeleteData);
+		IntVectorType pivots(const_cast<int*>(fact.Pivots.data()), fact.Pivots.shape(), blitz::neverDeleteData);
+		VectorType rhs(blockData, blitz::shape(BlockSize), blitz::neverDeleteData);
+		lapack.SolveBandedFactored(matrix, pivots, rhs);
+	}
+
+	/*
+	 * Matrices in the tensor method are built in LAPACK (column major)
+	 * layout, i.e. matrix(col, row)
+	 */
+	bool SetupTensor(LAPACK &lapack, int angularIndex, Factorization &fact)
+	{
+		int n1 = BlockShape(1);
+		int n2 = BlockShape(2);
+		for (int rank=1; rank<Rank; rank++)
+		{
+			if (Overlap[rank].extent(0) != BlockShape(rank) || Overlap[rank].extent(1) != BlockShape(rank))
+			{
+				cout << "Overlap matrix of rank " << rank << " has shape " << Overlap[rank].shape() << ", expected " << BlockShape(rank) << endl;
+				return false;
+			}
+		}
+		const MatrixType &S1 = Overlap[1];
+		const MatrixType &S2 = Overlap[2];
+
+		/*
+		 * Nearest Kronecker sum X (x) S2 + S1 (x) Y to the block A, the residual
+		 * is (I - P1) A (I - P2) where P_i projects on S_i:
+		 *   X = <A, S2>_2 / |S2|^2,  Y = <S1, A>_1 / |S1|^2 - a S2,  a = <S1, A, S2> / |S1|^2 |S2|^2
+		 */
+		MatrixType X(n1, n1);
+		MatrixType Y(n2, n2);
+		X = 0;
+		Y = 0;
+		cplx a = 0;
+		for (int t=0; t<(int)Terms.size(); t++)
+		{
+			const Term &term = Terms[t];
+			const cplx* potential = GetPotentialSlice(t, angularIndex);
+			const std::vector<Entry> &entries1 = term.Entries[1];
+			const std::vector<Entry> &entries2 = term.Entries[2];
+			int stride1 = term.Potential.stride(1);
+			int stride2 = term.Potential.stride(2);
+			for (int i=0; i<(int)entries1.size(); i++)
+			{
+				const Entry &e1 = entries1[i];
+				cplx s1 = conj(S1(e1.Row, e1.Col));
+				for (int j=0; j<(int)entries2.size(); j++)
+				{
+					const Entry &e2 = entries2[j];
+					cplx value = potential[e1.PotentialIndex*stride1 + e2.PotentialIndex*stride2];
+					if (e1.Conjugate != e2.Conjugate)
+					{
+						value = conj(value);
+					}
+					value *= term.Scaling;
+					cplx s2 = conj(S2(e2.Row, e2.Col));
+					X(e1.Col, e1.Row) += value * s2;
+					Y(e2.Col, e2.Row) += s1 * value;
+					a += s1 * value * s2;
+				}
+			}
+		}
+		double norm1 = GetSquaredNorm(S1);
+		double norm2 = GetSquaredNorm(S2);
+		X /= norm2;
+		Y /= norm1;
+		a /= norm1 * norm2;
+		for (int i=0; i<n2; i++)
+		{
+			for (int j=0; j<n2; j++)
+			{
+				Y(j, i) -= a * S2(i, j);
+			}
+		}
+
+		VectorType eigenvalues1(n1);
+		VectorType eigenvalues2(n2);
+		MatrixType vectors1, inverse1, vectors2, inverse2;
+		if (!DiagonalizeFactor(lapack, S1, X, eigenvalues1, vectors1, inverse1) ||
+		    !DiagonalizeFactor(lapack, S2, Y, eigenvalues2, vectors2, inverse2))
+		{
+			return false;
+		}
+
+		//LAPACK layout is the transpose of the row major layout used in Solve
+		fact.LeftVectors.resize(n1, n1);
+		fact.LeftInverse.resize(n1, n1);
+		fact.RightVectorsT.resize(n2, n2);
+		fact.RightInverseT.resize(n2, n2);
+		fact.LeftVectors = vectors1.transpose(1, 0);
+		fact.LeftInverse = inverse1.transpose(1, 0);
+		fact.RightVectorsT = vectors2;
+		fact.RightInverseT = inverse2;
+
+		fact.InverseEigenvalues.resize(n1, n2);
+		for (int i=0; i<n1; i++)
+		{
+			for (int j=0; j<n2; j++)
+			{
+				cplx denominator = eigenvalues1(i) + eigenvalues2(j);
+				if (std::abs(denominator) == 0)
+				{
+					cout << "Singular tensor approximation of radial block " << angularIndex << endl;
+					return false;
+				}
+				fact.InverseEigenvalues(i, j) = 1.0 / denominator;
+			}
+		}
+		return true;
+	}
+
+	double GetSquaredNorm(const MatrixType &matrix)
+	{
+		double norm = 0;
+		for (int i=0; i<matrix.extent(0); i++)
+		{
+			for (int j=0; j<matrix.extent(1); j++)
+			{
+				norm += std::norm(matrix(i, j));
+			}
+		}
+		return norm;
+	}
+
+	/*
+	 * Eigendecomposition of S^-1 M = V L V^-1, also returns (S V)^-1.
+	 * All matrices in LAPACK layout. M is destroyed
+	 */
+	bool DiagonalizeFactor(LAPACK &lapack, const MatrixType &S, MatrixType &M, VectorType &eigenvalues, MatrixType &vectors, MatrixType &inverse)
+	{
+		int n = S.extent(0);
+		//S is shared between the threads, and is copied element by element
+		//to avoid reference counting
+		MatrixType factoredS(n, n);
+		for (int i=0; i<n; i++)
+		{
+			for (int j=0; j<n; j++)
+			{
+				factoredS(j, i) = S(i, j);
+			}
+		}
+		IntVectorType pivots(n);
+		if (lapack.CalculateLUFactorization(factoredS, pivots) != 0)
+		{
+			return false;
+		}
+		lapack.SolveGeneralFactored(lapack.TransposeNone, factoredS, pivots, M);
+
+		MatrixType leftVectors(1, 1);
+		vectors.resize(n, n);
+		if (lapack.CalculateEigenvectorFactorization(false, true, M, eigenvalues, leftVectors, vectors) != 0)
+		{
+			return false;
+		}
+
+		//(S V)^-1, in LAPACK layout inverse(j, i) = sum_m S(i, m) V(m, j)
+		inverse.resize(n, n);
+		for (int j=0; j<n; j++)
+		{
+			for (int i=0; i<n; i++)
+			{
+				cplx sum = 0;
+				for (int m=0; m<n; m++)
+				{
+					sum += S(i, m) * vectors(j, m);
+				}
+				inverse(j, i) = sum;
+			}
+		}
+		if (lapack.CalculateLUFactorization(inverse, pivots) != 0)
+		{
+			return false;
+		}
+		return lapack.CalculateMatrixInverse(inverse, pivots) == 0;
+	}
+
+	/*
+	 * B = V1 ((W1 B W2^T) / D) V2^T, where B is the (n1, n2) block
+	 */
+	void SolveTensor(const Factorization &fact, cplx* blockData, MatrixType &temp1, MatrixType &temp2)
+	{
+		int n1 = BlockShape(1);
+		int n2 = BlockShape(2);
+		if (temp1.extent(0) != n1 || temp1.extent(1) != n2)
+		{
+			temp1.resize(n1, n2);
+			temp2.resize(n1, n2);
+		}
+
+		MatrixType block(blockData, blitz::shape(n1, n2), blitz::neverDeleteData);
+		MatrixType leftVectors(const_cast<cplx*>(fact.LeftVectors.data()), fact.LeftVectors.shape(), blitz::neverDeleteData);
+		MatrixType leftInverse(const_cast<cplx*>(fact.LeftInverse.data()), fact.LeftInverse.shape(), blitz::neverDeleteData);
+		MatrixType rightVectorsT(const_cast<cplx*>(fact.RightVectorsT.data()), fact.RightVectorsT.shape(), blitz::neverDeleteData);
+		MatrixType rightInverseT(const_cast<cplx*>(fact.RightInverseT.data()), fact.RightInverseT.shape(), blitz::neverDeleteData);
+		MatrixType inverseEigenvalues(const_cast<cplx*>(fact.InverseEigenvalues.data()), fact.InverseEigenvalues.shape(), blitz::neverDeleteData);
+
+		MatrixMatrixMultiply(block, rightInverseT, temp1);
+		MatrixMatrixMultiply(leftInverse, temp1, temp2);
+		temp2 *= inverseEigenvalues;
+		MatrixMatrixMultiply(temp2, rightVectorsT, temp1);
+		MatrixMatrixMultiply(leftVectors, temp1, block);
+	}
+};
+
+#endif
+
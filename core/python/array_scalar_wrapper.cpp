@@ -5,9 +5,7 @@
 #include <iostream>
 
 #include "typedescription.h"
-
-typedef std::complex<double> cplx;
-const cplx I = cplx(0.0, 1.0);
+#include "../common.h"
 
 /* Converter from NumPy Array to blitz::Array */
 template<class T, class Traits=PyArrayTraits<T> > class NumPyScalarToScalar
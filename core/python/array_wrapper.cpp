@@ -1,67 +1,176 @@
-
 #include <Python.h>
 #include <numpy/arrayobject.h>
 #include <blitz/array.h>
 #include <complex>
+#include <boost/type_traits/is_same.hpp>
 
 #include "typedescription.h"
+#include "../utility/memoryarena.h"
+
+/*
+ * Keeps the memory of a blitz::Array alive while a NumPy array is
+ * viewing it. The blitz array holds a reference to its MemoryBlock,
+ * and arrays allocated by the MemoryArena (wavefunction buffers,
+ * static potentials) are not reference counted by blitz, so for these
+ * the arena block is held as well.
+ */
+template<class T, int N> class ArrayOwner
+{
+public:
+	blitz::Array<T, N> Array;
+	MemoryArena::BlockPtr Block;
+
+	ArrayOwner(const blitz::Array<T, N> &array) : Array(array)
+	{
+		Block = MemoryArena::FindBlock(array.data());
+	}
+
+	bool IsOwned()
+	{
+		return Array.getReferenceCount() != -1 || Block;
+	}
+
+#if PY_VERSION_HEX >= 0x02070000
+	static void Destroy(PyObject* capsule)
+	{
+		delete static_cast<ArrayOwner*>(PyCapsule_GetPointer(capsule, 0));
+	}
+#else
+	static void Destroy(void* owner)
+	{
+		delete static_cast<ArrayOwner*>(owner);
+	}
+#endif
+};
 
 /* Converter from blitz::Array to NumPy array */
-/* NB! only pass array which lifetime exceeds the lifetime
-of this function, otherwise the NumPy array's will be freed when reference 
-counter of the blitz::Array reaches zero.
+/* Arrays allocated by the MemoryArena (wavefunction buffers, static
+potentials) are always returned as views (no copy is made). Arrays which
+are otherwise shared (e.g. a member returned by value) are returned as
+writable views as well, as pyprop sets up some C++ objects by writing
+into the arrays returned by their getters (see BSpline.py).
 
-It would be nice to tie up the lifespan of the array memory to both the
-NumPy and blitz:: arrays, but i'm not sure how...
-*/
+For these views, the lifetime of the data is tied to the NumPy array
+through an ArrayOwner stored as its base object, so the view stays valid
+also when the blitz array or wavefunction is destroyed or given a new
+buffer.
 
+Arrays only referenced by the return value (a temporary about to expire),
+or by a member returned by const reference, can not be told apart, and are
+returned as a python owned copy, such that python never writes into const
+data.
+
+Arrays not owning their data (created with neverDeleteData outside the
+MemoryArena) are returned as plain views, and the owner of the data must
+outlive the NumPy array.
+*/
 template<class T, int N, class Traits=PyArrayTraits<T> > class ArrayToNumPy
 {
 public:
 	static PyObject* convert(blitz::Array<T, N> array)
 	{
 		using namespace blitz;
-		
+
 		npy_intp shape[N];
 		npy_intp strides[N];
-		
+
 		PyArray_Descr* type_descr = Traits::GetTypeDescr();
-		
-		//std::cout << "ref: " << array.getReferenceCount() << std::endl;
-		
+
 		for (int i=0;i<N;i++) {
 			shape[i] = array.extent(i);
 			strides[i] = array.stride(i) * sizeof(T);
-			//std::cout << "shape: " << shape[i] << " stride: " << strides[i] << std::endl;
 		}
-		
-		//std::cout << array << std::endl;
-		
+
 		PyObject* wrappedObject = PyArray_NewFromDescr(&PyArray_Type, type_descr, N, shape, strides, array.data(), NPY_WRITEABLE, 0);
-		
-		//If the Array is about to expire (ie it is not stored anywhere but in the return
-		//argument of a function), we return a copy which is to be maintained by python
+		if (wrappedObject == 0)
+		{
+			boost::python::throw_error_already_set();
+		}
+
+		//The reference count before the owner adds its own reference. The
+		//return value and the array argument hold one reference each
 		int refCount = array.getReferenceCount();
-		if (refCount <= 2 && refCount != -1) 
+		ArrayOwner<T, N>* owner = new ArrayOwner<T, N>(array);
+		if (!owner->Block && refCount != -1 && refCount <= 2)
+		{
+			delete owner;
+			PyObject* copyObject = PyArray_FromAny(wrappedObject, Traits::GetTypeDescr(), 0, 0, NPY_ENSURECOPY, 0);
+			Py_DECREF(wrappedObject);
+			if (copyObject == 0)
+			{
+				boost::python::throw_error_already_set();
+			}
+			return copyObject;
+		}
+		if (!owner->IsOwned())
+		{
+			delete owner;
+			return wrappedObject;
+		}
+
+#if PY_VERSION_HEX >= 0x02070000
+		PyObject* base = PyCapsule_New(owner, 0, &ArrayOwner<T, N>::Destroy);
+#else
+		PyObject* base = PyCObject_FromVoidPtr(owner, &ArrayOwner<T, N>::Destroy);
+#endif
+		if (base == 0)
 		{
-			#ifdef PYPROP_DEBUG
-			std::cout << "Returning python-owning copy of array (" << array.getReferenceCount() << ")" << std::endl;
-			#endif
-			
-			//Create a copy of the array (perhaps there is a more elegant way?)
-			PyObject* newObject = PyArray_FromAny(wrappedObject, type_descr, 0, 0, NPY_ENSURECOPY, 0);
-			
-			//dispose of the old arrayObject
+			delete owner;
 			Py_DECREF(wrappedObject);
-			
-			//return the copy of the array
-			wrappedObject = newObject;
+			boost::python::throw_error_already_set();
 		}
-		
+
+		//The NumPy array steals the reference to base
+#if NPY_API_VERSION >= 0x00000007
+		if (PyArray_SetBaseObject((PyArrayObject*)wrappedObject, base) != 0)
+		{
+			Py_DECREF(base);
+			Py_DECREF(wrappedObject);
+			boost::python::throw_error_already_set();
+		}
+#else
+		((PyArrayObject*)wrappedObject)->base = base;
+#endif
+
 		return wrappedObject;
 	}
 };
 
+/*
+ * What to do when a NumPy array passed to C++ can not be referenced
+ * directly (different dtype, misaligned or byteswapped), and a converted
+ * copy must be made. Changes to such a copy are not seen from python,
+ * which is easily missed when a function modifies its argument.
+ * Warn is the default. Set from python with SetArrayCopyPolicy()
+ */
+enum ArrayCopyPolicy
+{
+	ArrayCopyAllow = 0,
+	ArrayCopyWarn = 1,
+	ArrayCopyRaise = 2
+};
+
+inline int &GetArrayCopyPolicyRef()
+{
+	static int policy = ArrayCopyWarn;
+	return policy;
+}
+
+inline int GetArrayCopyPolicy()
+{
+	return GetArrayCopyPolicyRef();
+}
+
+inline void SetArrayCopyPolicy(int policy)
+{
+	if (policy < ArrayCopyAllow || policy > ArrayCopyRaise)
+	{
+		std::cout << "Invalid array copy policy " << policy << std::endl;
+		throw std::runtime_error("Invalid array copy policy");
+	}
+	GetArrayCopyPolicyRef() = policy;
+}
+
 /* Converter from NumPy Array to blitz::Array */
 template<class T, int N, class Traits=PyArrayTraits<T> > class NumPyToArray
 {
@@ -70,63 +179,72 @@ public:
 	{
 		//Register this class as a python type converter
 		boost::python::converter::registry::push_back(
-			&convertible, 
-			&convert, 
+			&convertible,
+			&convert,
 			boost::python::type_id< blitz::Array<T, N> >()
 		);
 	}
-	
+
+	/*
+	 * Returns true if the blitz array can reference the data of arr_obj
+	 */
+	static bool CanReference(PyArrayObject* arr_obj)
+	{
+		PyArray_Descr* from_type = arr_obj->descr;
+		PyArray_Descr* to_type = Traits::GetTypeDescr();
+
+		bool sameType = from_type->type_num == to_type->type_num
+			|| (from_type->kind == to_type->kind && from_type->elsize == to_type->elsize);
+		Py_DECREF(to_type);
+		return sameType && PyArray_ISALIGNED(arr_obj) && PyArray_ISNOTSWAPPED(arr_obj);
+	}
+
 	static void* convertible(PyObject* obj)
 	{
 		if (PyArray_Check(obj))
 		{
 			PyArrayObject* arr_obj = (PyArrayObject*)obj;
-			if (arr_obj->nd == N) 
+			if (arr_obj->nd == N)
 			{
-				PyArray_Descr* from_type = arr_obj->descr;
-				PyArray_Descr* to_type = Traits::GetTypeDescr();
-				
-				if (from_type->type_num == to_type->type_num)
+				if (CanReference(arr_obj))
 				{
 					return obj;
 				}
-	
-				if (from_type->elsize == to_type->elsize)
+
+				//Arrays which must be copied are still convertible, so that
+				//convert() can raise a descriptive error. Converters
+				//reinterpreting the data as another type (Traits::BasicType
+				//!= T) only accept arrays they can reference
+				if (boost::is_same<typename Traits::BasicType, T>::value)
 				{
 					return obj;
 				}
-
-				//std::cout << "Nothing in common. let's try anyway" << std::endl;
-				//return obj;
 			}
 		}
-		
+
 		return 0;
 	}
-	
+
 	static void convert(PyObject* obj, boost::python::converter::rvalue_from_python_stage1_data* data)
 	{
 		using namespace boost::python::converter;
 		using namespace blitz;
-		
+
 		PyArrayObject* arr_obj = (PyArrayObject*) obj;
-		
+
 		void* storage = ((rvalue_from_python_storage< Array<T, N> >*) data)->storage.bytes;
-		
+
 		TinyVector<int,N> shape(0);
 		TinyVector<int,N> strides(0);
-	
+
 		for (int i=0;i<N;i++) {
 			shape[i] = arr_obj->dimensions[i];
 			strides[i] = arr_obj->strides[i] / sizeof(T);
 		}
 
 		long refCount = obj->ob_refcnt;
-	
-		//Find type descriptor for C++ type
-		PyArray_Descr* type_descr = Traits::GetTypeDescr();
 
-		if (arr_obj->descr->type_num == type_descr->type_num || arr_obj->descr->elsize == type_descr->elsize) 
+		if (CanReference(arr_obj))
 		{
 			if (refCount == 1 && (arr_obj->flags & NPY_OWNDATA) != 0 )
 			{
@@ -140,16 +258,40 @@ public:
 		}
 		else
 		{
-			std::cout << "Warning converting from NuPy array to blitz array of different type: creating copy." << std::endl;
+			PyArray_Descr* type_descr = Traits::GetTypeDescr();
+			if (GetArrayCopyPolicy() == ArrayCopyRaise)
+			{
+				PyErr_Format(PyExc_TypeError, "NumPy array of type %c%i can not be passed by reference as %c%i (array copy policy is Raise)",
+					arr_obj->descr->kind, arr_obj->descr->elsize, type_descr->kind, type_descr->elsize);
+				Py_DECREF(type_descr);
+				boost::python::throw_error_already_set();
+			}
+			if (GetArrayCopyPolicy() == ArrayCopyWarn)
+			{
+				if (PyErr_WarnEx(PyExc_RuntimeWarning, "Converting NumPy array to blitz array of different type, alignment or byte order: creating copy", 1) != 0)
+				{
+					Py_DECREF(type_descr);
+					boost::python::throw_error_already_set();
+				}
+			}
+
+			//Let NumPy cast to an aligned contiguous array of the C++ type
+			PyObject* castObject = PyArray_FromAny(obj, type_descr, N, N, NPY_FORCECAST | NPY_ALIGNED | NPY_C_CONTIGUOUS | NPY_ENSURECOPY, 0);
+			if (castObject == 0)
+			{
+				boost::python::throw_error_already_set();
+			}
+			PyArrayObject* cast_obj = (PyArrayObject*) castObject;
+
 			new (storage) Array<T,N>(shape);
-			
-			Array<typename Traits::BasicType, N> inputData((typename Traits::BasicType*)arr_obj->data, shape, strides, neverDeleteData);
+			Array<typename Traits::BasicType, N> inputData((typename Traits::BasicType*)cast_obj->data, shape, neverDeleteData);
 			Array<T, N> *convertedData = (Array<T,N>*)storage;
 			//Make copy of data
 			for (typename Array<T,N>::iterator it=convertedData->begin(); it != convertedData->end(); it++)
 			{
 				*it = inputData(it.position());
 			}
+			Py_DECREF(castObject);
 		}
 		data->convertible = storage;
 	}
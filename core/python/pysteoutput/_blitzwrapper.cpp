@@ -20,14 +20,14 @@ create_array_converter<double, 1>();
 create_array_converter<double, 2>();
 create_array_converter<double, 3>();
 create_array_converter<double, 4>();
-create_array_converter<int, 1>();
-create_array_converter<int, 2>();
-create_array_converter<int, 3>();
-create_array_converter<int, 4>();
 NumPyToArray<int, 1, PyArrayTraits<long> >();
 NumPyToArray<int, 2, PyArrayTraits<long> >();
 NumPyToArray<int, 3, PyArrayTraits<long> >();
 NumPyToArray<int, 4, PyArrayTraits<long> >();
+create_array_converter<int, 1>();
+create_array_converter<int, 2>();
+create_array_converter<int, 3>();
+create_array_converter<int, 4>();
 create_array_converter<std::complex<double>, 1>();
 create_array_converter<std::complex<double>, 2>();
 create_array_converter<std::complex<double>, 3>();
@@ -42,5 +42,7 @@ create_tinyvector_converter<double, 3>();
 create_tinyvector_converter<double, 4>();
 create_range_converter();
 create_array_scalar_converter();
+def("SetArrayCopyPolicy", SetArrayCopyPolicy);
+def("GetArrayCopyPolicy", GetArrayCopyPolicy);
 }
 
@@ -1,6 +1,7 @@
 #include "rungekuttawrapper.h"
 #include <gsl/gsl_errno.h>
 #include <core/wavefunction.h>
+#include <core/utility/gilrelease.h>
 
 namespace RungeKutta
 {
@@ -34,8 +35,16 @@ int MultiplyHamiltonian(double t, const double *inBuffer, double *outBuffer, voi
 	tempPsi->SetData(outData);
 
 	//Perform Hamilton-Wavefunction multiplication
-	object callback = propagator->MultiplyCallback;
-	callback(psi, tempPsi, t);
+	if (propagator->Hamiltonian)
+	{
+		propagator->Hamiltonian->Multiply(psi, tempPsi, t);
+	}
+	else
+	{
+		AcquireGIL acquireGIL;
+		object callback = propagator->MultiplyCallback;
+		callback(psi, tempPsi, t);
+	}
 
 	//Restore the databuffers of psi and tempPsi
 	psi->SetData(psiOrigData);
@@ -118,7 +127,12 @@ void RungeKuttaWrapper<Rank>::AdvanceStep(object callback, typename Wavefunction
 		timeStep = std::real(dt);
 	}
 
-	int status = gsl_odeiv_step_apply(Integrator, t, timeStep, inout, y_err, 0, 0, &sys);
+	int status;
+	{
+		//The python callback takes the GIL back in MultiplyHamiltonian
+		ReleaseGIL releaseGIL;
+		status = gsl_odeiv_step_apply(Integrator, t, timeStep, inout, y_err, 0, 0, &sys);
+	}
 
 	if (status != GSL_SUCCESS)
 	{
@@ -3,6 +3,7 @@
 
 #include <core/common.h>
 #include <core/wavefunction.h>
+#include <core/tensorpotential/hamiltonianoperator.h>
 #include <gsl/gsl_odeiv.h>
 
 #include <core/utility/boostpythonhack.h>
@@ -32,6 +33,7 @@ public:
 	typename Wavefunction<Rank>::Ptr Psi;
 	typename Wavefunction<Rank>::Ptr TempPsi;
 	object MultiplyCallback;
+	typename HamiltonianOperator<Rank>::Ptr Hamiltonian;
 	bool ImTime;
 
 private:
@@ -51,6 +53,20 @@ public:
 	void ApplyConfigSection(const ConfigSection &config);
 	void Setup(typename Wavefunction<Rank>::Ptr psi);
 	void AdvanceStep(object callback, typename Wavefunction<Rank>::Ptr psi, typename Wavefunction<Rank>::Ptr tempPsi, cplx dt, double t);
+
+	/*
+	 * Use a C++ HamiltonianOperator for the matrix-vector products instead
+	 * of the python callback passed to AdvanceStep
+	 */
+	void SetHamiltonianOperator(typename HamiltonianOperator<Rank>::Ptr hamiltonian)
+	{
+		Hamiltonian = hamiltonian;
+	}
+
+	void ClearHamiltonianOperator()
+	{
+		Hamiltonian = typename HamiltonianOperator<Rank>::Ptr();
+	}
 };
 }
 
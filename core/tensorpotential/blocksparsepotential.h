@@ -0,0 +1,560 @@
+#ifndef BLOCKSPARSEPOTENTIAL_H
+#define BLOCKSPARSEPOTENTIAL_H
+
+#include "../common.h"
+#include "../utility/fortran.h"
+#include "hamiltonianoperator.h"
+
+#include <vector>
+#include <algorithm>
+
+extern "C"
+{
+	void FORTRAN_NAME(zgemm)(char* transA, char* transB, int* M, int* N, int* K, cplx* alpha, const cplx* A, int* lda, const cplx* B, int* ldb, cplx* beta, cplx* C, int* ldc);
+	void FORTRAN_NAME(zhbmv)(char* uplo, int* N, int* K, cplx* alpha, const cplx* A, int* lda, const cplx* x, int* incx, cplx* beta, cplx* y, int* incy);
+	void FORTRAN_NAME(zgbmv)(char* trans, int* M, int* N, int* KL, int* KU, cplx* alpha, const cplx* A, int* lda, const cplx* x, int* incx, cplx* beta, cplx* y, int* incy);
+};
+
+/*
+ * Tensor potential with block sparse row (BSR) storage in the first rank.
+ *
+ * This is the same potential as a TensorPotential with "Simp" storage in
+ * the first rank, i.e. PotentialData(i, ...) is the block of the remaining
+ * ranks coupling row angularPairs(i, 0) to column angularPairs(i, 1). The
+ * blocks are however applied block row by block row:
+ *
+ *     dest(row, ...) += scaling * sum_{col} V_{row,col} source(col, ...)
+ *
+ * - Blocks which are identically zero are dropped when the potential is set
+ * - Every block row is written by one iteration of the block row loop, so
+ *   the loop needs no synchronization between block rows
+ * - Within a block row, the blocks are ordered by column, such that
+ *   consecutive blocks read neighbouring source slices
+ *
+ * The blocks are applied with the index pairs of the remaining ranks. For
+ * rank r > 0, SetRankEntries() takes an array of shape (count, 4) where
+ * every row (row, col, potentialIndex, conjugate) gives one matrix element
+ *
+ *     V_r(row, col) = PotentialData(..., potentialIndex, ...)
+ *
+ * which is conjugated if conjugate is 1. Hermitian storages list both
+ * triangles, with conjugate = 1 for the lower. The entries are sorted by
+ * row, such that the innermost rank is a sparse matrix-vector product on
+ * contiguous slices.
+ *
+ * Ranks whose entries have the layout of a BLAS storage are applied with
+ * BLAS instead of looping over the entries (unless SetUseBlas(false)):
+ * - Dense (all pairs, potentialIndex = row * size + col) ranks where all
+ *   later ranks are identities: one zgemm on the (rank, later ranks) slice
+ * - Hermitian banded (zhbmv lower storage, the "Band" storage) in the
+ *   last rank: zhbmv. Only used if the diagonal is real, which is checked
+ *   when the kernels are set up
+ * - General banded (zgbmv storage, the "BandNH" storage) in the last
+ *   rank: zgbmv
+ * BLAS can not conjugate a matrix without transposing it, so conjugated
+ * products are computed as conj(dest) += conj(alpha) V conj(source).
+ *
+ * Only non-distributed wavefunctions are supported.
+ */
+template<int Rank>
+class BlockSparsePotential : public HamiltonianTerm<Rank>
+{
+public:
+	typedef boost::shared_ptr< BlockSparsePotential<Rank> > Ptr;
+	typedef blitz::Array<cplx, Rank> DataArray;
+
+private:
+	struct Entry
+	{
+		int Row;
+		int Col;
+		int PotentialIndex;
+		bool Conjugate;
+
+		bool operator<(const Entry &other) const
+		{
+			return Row < other.Row || (Row == other.Row && Col < other.Col);
+		}
+	};
+
+	struct Block
+	{
+		int Row;
+		int Col;
+		int PotentialIndex;
+
+		bool operator<(const Block &other) const
+		{
+			return Row < other.Row || (Row == other.Row && Col < other.Col);
+		}
+	};
+
+	enum RankKernel
+	{
+		KernelEntries = 0,
+		KernelIdentity = 1,
+		KernelDense = 2,
+		KernelHermitianBanded = 3,
+		KernelBanded = 4
+	};
+
+	/*
+	 * BLAS layout of the entries of a rank. If Conjugate is set, the
+	 * entries are the conjugate of the BLAS matrix
+	 */
+	struct RankLayout
+	{
+		int Kernel;
+		int Size;
+		int SubDiagonals;
+		int LeadingDimension;
+		bool Conjugate;
+		int Columns;
+	};
+
+	DataArray Potential;
+	std::vector<Block> Blocks;
+	std::vector<int> BlockRowStart;
+	std::vector<int> BlockRowIndex;
+	std::vector< std::vector<Entry> > Entries;
+	blitz::TinyVector<int, Rank> DataStride;
+
+	std::vector<RankLayout> Layouts;
+	blitz::TinyVector<int, Rank> LayoutShape;
+	bool LayoutsValid;
+	bool UseBlas;
+	int WorkSize;
+
+	/*
+	 * Returns the BLAS layout of the entries of rank, for a wavefunction
+	 * of extent in that rank
+	 */
+	RankLayout GetEntryLayout(int rank, int extent)
+	{
+		const std::vector<Entry> &entries = Entries[rank];
+		int count = entries.size();
+
+		RankLayout layout;
+		layout.Kernel = KernelEntries;
+		layout.Size = 0;
+		layout.SubDiagonals = 0;
+		layout.LeadingDimension = 0;
+		layout.Conjugate = count > 0 && entries[0].Conjugate;
+		layout.Columns = 1;
+		if (count == 0)
+		{
+			return layout;
+		}
+
+		for (int i=0; i<count; i++)
+		{
+			const Entry &entry = entries[i];
+			layout.Size = std::max(layout.Size, std::max(entry.Row, entry.Col) + 1);
+			layout.SubDiagonals = std::max(layout.SubDiagonals, std::abs(entry.Row - entry.Col));
+			if (i > 0 && !(entries[i-1] < entry))
+			{
+				//Duplicate entries
+				return layout;
+			}
+		}
+		int size = layout.Size;
+		int bands = layout.SubDiagonals;
+
+		bool isIdentity = count == extent && size == extent;
+		bool isDense = count == size * size;
+		for (int i=0; i<count && (isIdentity || isDense); i++)
+		{
+			const Entry &entry = entries[i];
+			isIdentity = isIdentity && entry.Row == i && entry.Col == i && entry.PotentialIndex == 0 && !entry.Conjugate;
+			isDense = isDense && entry.PotentialIndex == entry.Row * size + entry.Col && entry.Conjugate == layout.Conjugate;
+		}
+		if (isIdentity)
+		{
+			layout.Kernel = KernelIdentity;
+			return layout;
+		}
+		if (isDense)
+		{
+			layout.Kernel = KernelDense;
+			layout.LeadingDimension = size;
+			return layout;
+		}
+
+		//Banded storages have size columns of LeadingDimension elements
+		int leadingDimension = Potential.extent(rank) / size;
+		if (bands == 0 || count != size * (2 * bands + 1) - bands * (bands + 1) || leadingDimension * size != Potential.extent(rank))
+		{
+			return layout;
+		}
+		layout.LeadingDimension = leadingDimension;
+
+		//zhbmv: A(i, j) = potential[(i - j) + j * lda] for i >= j, and the
+		//upper triangle is the conjugate of the lower
+		bool isHermitian = leadingDimension >= bands + 1;
+		bool upperConjugate = false;
+		bool foundOffDiagonal = false;
+		for (int i=0; i<count && isHermitian; i++)
+		{
+			const Entry &entry = entries[i];
+			int row = std::max(entry.Row, entry.Col);
+			int col = std::min(entry.Row, entry.Col);
+			isHermitian = entry.PotentialIndex == (row - col) + col * leadingDimension;
+			if (entry.Row == entry.Col)
+			{
+				isHermitian = isHermitian && !entry.Conjugate;
+			}
+			else
+			{
+				bool isUpper = entry.Row < entry.Col;
+				if (!foundOffDiagonal)
+				{
+					upperConjugate = entry.Conjugate == isUpper;
+					foundOffDiagonal = true;
+				}
+				isHermitian = isHermitian && (entry.Conjugate == isUpper) == upperConjugate;
+			}
+		}
+		if (isHermitian)
+		{
+			layout.Kernel = KernelHermitianBanded;
+			layout.Conjugate = !upperConjugate;
+			return layout;
+		}
+
+		//zgbmv: A(i, j) = potential[(ku + i - j) + j * lda]
+		bool isBanded = leadingDimension >= 2 * bands + 1;
+		for (int i=0; i<count && isBanded; i++)
+		{
+			const Entry &entry = entries[i];
+			isBanded = entry.PotentialIndex == (bands + entry.Row - entry.Col) + entry.Col * leadingDimension && entry.Conjugate == layout.Conjugate;
+		}
+		if (isBanded)
+		{
+			layout.Kernel = KernelBanded;
+		}
+		return layout;
+	}
+
+	/*
+	 * Selects the kernel of every rank for wavefunctions of the shape
+	 * of source. BLAS kernels apply the matrix of their rank to all later
+	 * ranks at once, so the later ranks must be identities
+	 */
+	void SetupLayouts(const DataArray &source)
+	{
+		WorkSize = 0;
+		bool identityTail = true;
+		for (int rank=Rank-1; rank>=1; rank--)
+		{
+			RankLayout layout = GetEntryLayout(rank, source.extent(rank));
+			layout.Columns = DataStride[rank];
+
+			bool blas = UseBlas && identityTail && Potential.stride(rank) == 1 && DataStride[Rank-1] == 1;
+			if ((layout.Kernel == KernelHermitianBanded || layout.Kernel == KernelBanded) && rank != Rank-1)
+			{
+				blas = false;
+			}
+			if (layout.Kernel == KernelHermitianBanded && blas)
+			{
+				//zhbmv ignores the imaginary part of the diagonal
+				const cplx* potentialPtr = Potential.data();
+				long vectorCount = Potential.size() / Potential.extent(rank);
+				for (long i=0; i<vectorCount && blas; i++)
+				{
+					for (int j=0; j<layout.Size && blas; j++)
+					{
+						blas = imag(potentialPtr[i * Potential.extent(rank) + j * layout.LeadingDimension]) == 0;
+					}
+				}
+			}
+
+			if (!blas && layout.Kernel >= KernelDense)
+			{
+				layout.Kernel = KernelEntries;
+			}
+			if (layout.Kernel >= KernelDense)
+			{
+				WorkSize = std::max(WorkSize, layout.Size * layout.Columns);
+			}
+			identityTail = identityTail && layout.Kernel == KernelIdentity;
+			Layouts[rank] = layout;
+		}
+
+		LayoutShape = source.shape();
+		LayoutsValid = true;
+	}
+
+	/*
+	 * dest += alpha * V_block source for ranks rank..Rank-1 of one block,
+	 * where rank has a BLAS kernel. work must hold Size * Columns elements
+	 */
+	void ApplyBlas(int rank, const cplx* potential, const cplx* source, cplx* dest, bool conjugate, cplx alpha, cplx* work)
+	{
+		const RankLayout &layout = Layouts[rank];
+		int size = layout.Size;
+		int columns = layout.Columns;
+		int stride = DataStride[rank];
+		int lda = layout.LeadingDimension;
+		int bands = layout.SubDiagonals;
+		int increment = 1;
+		cplx one = 1.0;
+
+		const cplx* x = source;
+		int ldx = stride;
+		cplx scale = alpha;
+		bool conjugateProduct = conjugate != layout.Conjugate;
+		if (conjugateProduct)
+		{
+			for (int i=0; i<size; i++)
+			{
+				for (int j=0; j<columns; j++)
+				{
+					work[i * columns + j] = conj(source[i * stride + j]);
+					dest[i * stride + j] = conj(dest[i * stride + j]);
+				}
+			}
+			x = work;
+			ldx = columns;
+			scale = conj(alpha);
+		}
+
+		if (layout.Kernel == KernelDense)
+		{
+			//dest^T += scale * source^T * V^T in column major
+			char trans = 'N';
+			FORTRAN_NAME(zgemm)(&trans, &trans, &columns, &size, &size, &scale, x, &ldx, potential, &lda, &one, dest, &stride);
+		}
+		else if (layout.Kernel == KernelHermitianBanded)
+		{
+			char uplo = 'L';
+			FORTRAN_NAME(zhbmv)(&uplo, &size, &bands, &scale, potential, &lda, x, &increment, &one, dest, &increment);
+		}
+		else
+		{
+			char trans = 'N';
+			FORTRAN_NAME(zgbmv)(&trans, &size, &size, &bands, &bands, &scale, potential, &lda, x, &increment, &one, dest, &increment);
+		}
+
+		if (conjugateProduct)
+		{
+			for (int i=0; i<size; i++)
+			{
+				for (int j=0; j<columns; j++)
+				{
+					dest[i * stride + j] = conj(dest[i * stride + j]);
+				}
+			}
+		}
+	}
+
+	/*
+	 * dest += alpha * V_block source, for ranks rank..Rank-1 of one block
+	 */
+	void ApplyBlock(int rank, const cplx* potential, const cplx* source, cplx* dest, bool conjugate, cplx alpha, cplx* work)
+	{
+		if (Layouts[rank].Kernel >= KernelDense)
+		{
+			ApplyBlas(rank, potential, source, dest, conjugate, alpha, work);
+			return;
+		}
+
+		const std::vector<Entry> &entries = Entries[rank];
+		int count = entries.size();
+		if (rank == Rank-1)
+		{
+			for (int i=0; i<count; i++)
+			{
+				const Entry &entry = entries[i];
+				cplx value = potential[entry.PotentialIndex];
+				if (conjugate != entry.Conjugate)
+				{
+					value = conj(value);
+				}
+				dest[entry.Row] += alpha * value * source[entry.Col];
+			}
+		}
+		else
+		{
+			int potentialStride = Potential.stride(rank);
+			int dataStride = DataStride[rank];
+			for (int i=0; i<count; i++)
+			{
+				const Entry &entry = entries[i];
+				ApplyBlock(rank+1, potential + entry.PotentialIndex * potentialStride,
+					source + entry.Col * dataStride, dest + entry.Row * dataStride,
+					conjugate != entry.Conjugate, alpha, work);
+			}
+		}
+	}
+
+public:
+	BlockSparsePotential() : Entries(Rank), Layouts(Rank), LayoutsValid(false), UseBlas(true), WorkSize(0)
+	{
+		if (Rank < 2)
+		{
+			throw std::runtime_error("Block sparse potentials require at least two ranks");
+		}
+	}
+
+	/*
+	 * Sets the potential data and the index pairs of the first rank.
+	 * potential is referenced, not copied, and must be kept alive.
+	 * Blocks where all elements of potential are zero are dropped.
+	 */
+	void SetPotential(DataArray potential, blitz::Array<int, 2> angularPairs)
+	{
+		if (angularPairs.extent(0) != potential.extent(0) || angularPairs.extent(1) != 2)
+		{
+			cout << "Angular pairs have shape " << angularPairs.shape() << ", but potential has shape " << potential.shape() << endl;
+			throw std::runtime_error("Invalid shape of angular pairs for block sparse potential");
+		}
+		if (!potential.isStorageContiguous())
+		{
+			throw std::runtime_error("Block sparse potential requires contiguous potential data");
+		}
+		Potential.reference(potential);
+		LayoutsValid = false;
+
+		long blockSize = potential.size() / std::max(1, potential.extent(0));
+		Blocks.clear();
+		for (int i=0; i<potential.extent(0); i++)
+		{
+			const cplx* blockPtr = potential.data() + i * blockSize;
+			bool isZero = true;
+			for (long j=0; j<blockSize && isZero; j++)
+			{
+				isZero = blockPtr[j] == cplx(0);
+			}
+			if (isZero)
+			{
+				continue;
+			}
+
+			Block block;
+			block.Row = angularPairs(i, 0);
+			block.Col = angularPairs(i, 1);
+			block.PotentialIndex = i;
+			Blocks.push_back(block);
+		}
+		std::sort(Blocks.begin(), Blocks.end());
+
+		//Compressed block row index
+		BlockRowStart.clear();
+		BlockRowIndex.clear();
+		for (int i=0; i<(int)Blocks.size(); i++)
+		{
+			if (i == 0 || Blocks[i].Row != Blocks[i-1].Row)
+			{
+				BlockRowStart.push_back(i);
+				BlockRowIndex.push_back(Blocks[i].Row);
+			}
+		}
+		BlockRowStart.push_back(Blocks.size());
+	}
+
+	/*
+	 * Sets the matrix elements of rank (> 0) as an array of
+	 * (row, col, potentialIndex, conjugate)
+	 */
+	void SetRankEntries(int rank, blitz::Array<int, 2> entries)
+	{
+		if (rank <= 0 || rank >= Rank)
+		{
+			cout << "Invalid rank " << rank << " for block sparse potential entries" << endl;
+			throw std::runtime_error("Invalid rank for block sparse potential entries");
+		}
+		if (entries.extent(1) != 4)
+		{
+			throw std::runtime_error("Block sparse potential entries must have shape (count, 4)");
+		}
+
+		std::vector<Entry> &rankEntries = Entries[rank];
+		rankEntries.resize(entries.extent(0));
+		for (int i=0; i<entries.extent(0); i++)
+		{
+			rankEntries[i].Row = entries(i, 0);
+			rankEntries[i].Col = entries(i, 1);
+			rankEntries[i].PotentialIndex = entries(i, 2);
+			rankEntries[i].Conjugate = entries(i, 3) != 0;
+		}
+		std::stable_sort(rankEntries.begin(), rankEntries.end());
+		LayoutsValid = false;
+	}
+
+	/*
+	 * Enables the BLAS kernels (default), or applies all ranks by looping
+	 * over the entries
+	 */
+	void SetUseBlas(bool useBlas)
+	{
+		UseBlas = useBlas;
+		LayoutsValid = false;
+	}
+
+	bool GetUseBlas()
+	{
+		return UseBlas;
+	}
+
+	int GetBlockCount()
+	{
+		return Blocks.size();
+	}
+
+	int GetBlockRowCount()
+	{
+		return BlockRowIndex.size();
+	}
+
+	/*
+	 * dest += scaling * V source
+	 */
+	virtual void Multiply(DataArray &source, DataArray &dest, double scaling)
+	{
+		if (!source.isStorageContiguous() || !dest.isStorageContiguous())
+		{
+			throw std::runtime_error("Block sparse potential requires contiguous wavefunction data");
+		}
+		for (int rank=0; rank<Rank; rank++)
+		{
+			DataStride[rank] = source.stride(rank);
+		}
+		if (!LayoutsValid || LayoutShape != source.shape())
+		{
+			SetupLayouts(source);
+		}
+
+		const cplx* potentialPtr = Potential.data();
+		const cplx* sourcePtr = source.data();
+		cplx* destPtr = dest.data();
+		int potentialStride = Potential.stride(0);
+		int dataStride = DataStride[0];
+		int blockRowCount = BlockRowIndex.size();
+		cplx alpha = scaling;
+
+		#pragma omp parallel
+		{
+			std::vector<cplx> work(std::max(WorkSize, 1));
+
+			#pragma omp for schedule(dynamic, 4)
+			for (int blockRow=0; blockRow<blockRowCount; blockRow++)
+			{
+				cplx* destSlice = destPtr + BlockRowIndex[blockRow] * dataStride;
+				for (int i=BlockRowStart[blockRow]; i<BlockRowStart[blockRow+1]; i++)
+				{
+					const Block &block = Blocks[i];
+					ApplyBlock(1, potentialPtr + block.PotentialIndex * potentialStride,
+						sourcePtr + block.Col * dataStride, destSlice, false, alpha, &work[0]);
+				}
+			}
+		}
+	}
+
+	void MultiplyPotential(DataArray source, DataArray dest, double scaling)
+	{
+		Multiply(source, dest, scaling);
+	}
+};
+
+#endif
+
@@ -0,0 +1,364 @@
+#ifndef FACTOREDPOTENTIAL_H
+#define FACTOREDPOTENTIAL_H
+
+#include "../common.h"
+#include "../wavefunction.h"
+#include "../representation/representation.h"
+#include "../utility/blitztricks.h"
+#include "hamiltonianoperator.h"
+
+#include <vector>
+
+/*
+ * Tensor potential which is a Kronecker product of one factor matrix
+ * per rank,
+ *
+ *     V = c F_0 x F_1 x ... x F_{Rank-1}
+ *
+ * such as the kinetic energy T_r x I or the centrifugal term 1/r^2 x diag(l(l+1)).
+ * Instead of storing V over all basis pairs of all ranks, only the
+ * factors are stored, and V is applied as a chain of rank-local
+ * matrix-vector products.
+ *
+ * Each factor is one of
+ * - Identity: F = 1, nothing is stored
+ * - Diagonal: F(i, i) = Diagonal(i)
+ * - Banded:   F(i, j) = Bands(i, j - i + BandCount) for |i - j| <= BandCount,
+ *             Bands has shape (N, 2*BandCount+1)
+ * - Dense:    F(i, j) = Matrix(i, j)
+ *
+ * Factors are given in global indices. Identity and diagonal factors
+ * can be used on distributed ranks, banded and dense factors require
+ * the rank to be local.
+ */
+template<int Rank>
+class FactoredPotential : public HamiltonianTerm<Rank>
+{
+public:
+	typedef boost::shared_ptr< FactoredPotential<Rank> > Ptr;
+	typedef blitz::Array<cplx, Rank> DataArray;
+
+	enum FactorType
+	{
+		FactorIdentity = 0,
+		FactorDiagonal = 1,
+		FactorBanded = 2,
+		FactorDense = 3
+	};
+
+private:
+	struct Factor
+	{
+		int Type;
+		int BandCount;
+		blitz::Array<cplx, 1> Diagonal;
+		blitz::Array<cplx, 1> LocalDiagonal;
+		blitz::Array<cplx, 2> Matrix;
+	};
+
+	std::vector<Factor> Factors;
+	cplx Coefficient;
+	DataArray Temp1;
+	DataArray Temp2;
+
+	void CheckRank(int rank)
+	{
+		if (rank < 0 || rank >= Rank)
+		{
+			cout << "Invalid factor rank " << rank << " for a potential of rank " << Rank << endl;
+			throw std::runtime_error("Invalid factor rank");
+		}
+	}
+
+	int GetFactorSize(int rank)
+	{
+		Factor &factor = Factors[rank];
+		if (factor.Type == FactorDiagonal)
+		{
+			return factor.Diagonal.extent(0);
+		}
+		return factor.Matrix.extent(0);
+	}
+
+	/*
+	 * out = alpha F_rank in, or out += alpha F_rank in if accumulate is true.
+	 * in and out must be different arrays unless F_rank is diagonal
+	 */
+	void ApplyFactor(int rank, DataArray &in, DataArray &out, cplx alpha, bool accumulate)
+	{
+		Factor &factor = Factors[rank];
+		blitz::Array<cplx, 3> in3 = MapToRank3(in, rank, 1);
+		blitz::Array<cplx, 3> out3 = MapToRank3(out, rank, 1);
+		long preCount = in3.extent(0);
+		long rowCount = in3.extent(1);
+		long postCount = in3.extent(2);
+		const cplx* inPtr = in3.data();
+		cplx* outPtr = out3.data();
+		int bandCount = factor.BandCount;
+
+		//Element access through pointers, blitz::Array::operator() with
+		//long indices resolves to the slicing overloads
+		const cplx* diagonalPtr = factor.LocalDiagonal.data();
+		long diagonalStride = factor.LocalDiagonal.stride(0);
+		const cplx* matrixPtr = factor.Matrix.data();
+		long matrixRowStride = factor.Matrix.stride(0);
+		long matrixColStride = factor.Matrix.stride(1);
+
+		#pragma omp parallel for schedule(static)
+		for (long index=0; index<preCount*rowCount; index++)
+		{
+			long pre = index / rowCount;
+			long row = index % rowCount;
+			cplx* outRow = outPtr + index * postCount;
+			const cplx* inBlock = inPtr + pre * rowCount * postCount;
+
+			if (factor.Type == FactorDiagonal)
+			{
+				//Elementwise, such that in and out may be the same array
+				cplx value = alpha * diagonalPtr[row * diagonalStride];
+				const cplx* inRow = inBlock + row * postCount;
+				if (accumulate)
+				{
+					for (long post=0; post<postCount; post++)
+					{
+						outRow[post] += value * inRow[post];
+					}
+				}
+				else
+				{
+					for (long post=0; post<postCount; post++)
+					{
+						outRow[post] = value * inRow[post];
+					}
+				}
+			}
+			else
+			{
+				if (!accumulate)
+				{
+					for (long post=0; post<postCount; post++)
+					{
+						outRow[post] = 0;
+					}
+				}
+
+				long colStart = 0;
+				long colEnd = rowCount;
+				//Column offset of (row, col) in Matrix, shifted for banded storage
+				long colOffset = 0;
+				if (factor.Type == FactorBanded)
+				{
+					colStart = std::max(0L, row - bandCount);
+					colEnd = std::min(rowCount, row + bandCount + 1);
+					colOffset = bandCount - row;
+				}
+				const cplx* matrixRow = matrixPtr + row * matrixRowStride;
+				for (long col=colStart; col<colEnd; col++)
+				{
+					cplx value = matrixRow[(col + colOffset) * matrixColStride];
+					if (value == cplx(0))
+					{
+						continue;
+					}
+					value *= alpha;
+					const cplx* inRow = inBlock + col * postCount;
+					for (long post=0; post<postCount; post++)
+					{
+						outRow[post] += value * inRow[post];
+					}
+				}
+			}
+		}
+	}
+
+public:
+	FactoredPotential() : Factors(Rank), Coefficient(1.0)
+	{
+		for (int rank=0; rank<Rank; rank++)
+		{
+			Factors[rank].Type = FactorIdentity;
+			Factors[rank].BandCount = 0;
+		}
+	}
+
+	void SetIdentityFactor(int rank)
+	{
+		CheckRank(rank);
+		Factor &factor = Factors[rank];
+		factor.Type = FactorIdentity;
+		factor.BandCount = 0;
+		factor.Diagonal.free();
+		factor.LocalDiagonal.free();
+		factor.Matrix.free();
+	}
+
+	void SetDiagonalFactor(int rank, blitz::Array<cplx, 1> diagonal)
+	{
+		SetIdentityFactor(rank);
+		Factor &factor = Factors[rank];
+		factor.Type = FactorDiagonal;
+		factor.Diagonal.resize(diagonal.shape());
+		factor.Diagonal = diagonal;
+		factor.LocalDiagonal.reference(factor.Diagonal);
+	}
+
+	void SetBandedFactor(int rank, blitz::Array<cplx, 2> bands)
+	{
+		if (bands.extent(1) % 2 != 1)
+		{
+			cout << "Banded factor of rank " << rank << " has " << bands.extent(1) << " diagonals" << endl;
+			throw std::runtime_error("Banded factors must have an odd number of diagonals");
+		}
+		SetIdentityFactor(rank);
+		Factor &factor = Factors[rank];
+		factor.Type = FactorBanded;
+		factor.BandCount = (bands.extent(1) - 1) / 2;
+		factor.Matrix.resize(bands.shape());
+		factor.Matrix = bands;
+	}
+
+	void SetDenseFactor(int rank, blitz::Array<cplx, 2> matrix)
+	{
+		if (matrix.extent(0) != matrix.extent(1))
+		{
+			cout << "Dense factor of rank " << rank << " has shape " << matrix.shape() << endl;
+			throw std::runtime_error("Dense factors must be square");
+		}
+		SetIdentityFactor(rank);
+		Factor &factor = Factors[rank];
+		factor.Type = FactorDense;
+		factor.Matrix.resize(matrix.shape());
+		factor.Matrix = matrix;
+	}
+
+	int GetFactorType(int rank)
+	{
+		CheckRank(rank);
+		return Factors[rank].Type;
+	}
+
+	void SetCoefficient(cplx coefficient)
+	{
+		Coefficient = coefficient;
+	}
+
+	cplx GetCoefficient()
+	{
+		return Coefficient;
+	}
+
+	/*
+	 * Checks the factors against psi, selects the local part of diagonal
+	 * factors on distributed ranks, and allocates the temporary buffers
+	 * for the chain of factors
+	 */
+	void Setup(typename Wavefunction<Rank>::Ptr psi)
+	{
+		typename Representation<Rank>::Ptr repr = psi->GetRepresentation();
+		typename DistributedModel<Rank>::Ptr distr = repr->GetDistributedModel();
+		blitz::TinyVector<int, Rank> fullShape = repr->GetFullShape();
+
+		std::vector<int> activeRanks;
+		for (int rank=0; rank<Rank; rank++)
+		{
+			Factor &factor = Factors[rank];
+			if (factor.Type == FactorIdentity)
+			{
+				continue;
+			}
+			activeRanks.push_back(rank);
+
+			if (GetFactorSize(rank) != fullShape(rank))
+			{
+				cout << "Factor of rank " << rank << " has size " << GetFactorSize(rank) << ", but psi has size " << fullShape(rank) << endl;
+				throw std::runtime_error("Invalid size of potential factor");
+			}
+
+			if (factor.Type == FactorDiagonal)
+			{
+				blitz::Range localRange = distr->GetLocalIndexRange(fullShape(rank), rank);
+				factor.LocalDiagonal.reference(factor.Diagonal(localRange));
+			}
+			else if (distr->IsDistributedRank(rank))
+			{
+				cout << "Rank " << rank << " has a banded or dense factor, but is distributed" << endl;
+				throw std::runtime_error("Banded and dense potential factors are not supported on distributed ranks");
+			}
+		}
+
+		//The first factor is applied from source into Temp1, and the last
+		//is accumulated directly into dest. Diagonal factors in between are
+		//applied in place, while matrix factors need a second buffer
+		if (activeRanks.size() > 1)
+		{
+			Temp1.resize(psi->GetData().shape());
+		}
+		for (int i=1; i<(int)activeRanks.size()-1; i++)
+		{
+			if (Factors[activeRanks[i]].Type != FactorDiagonal)
+			{
+				Temp2.resize(psi->GetData().shape());
+			}
+		}
+	}
+
+	/*
+	 * dest += scaling * V source
+	 */
+	virtual void Multiply(DataArray &source, DataArray &dest, double scaling)
+	{
+		std::vector<int> activeRanks;
+		for (int rank=0; rank<Rank; rank++)
+		{
+			if (Factors[rank].Type != FactorIdentity)
+			{
+				activeRanks.push_back(rank);
+			}
+		}
+
+		cplx alpha = scaling * Coefficient;
+		if (activeRanks.empty())
+		{
+			dest += alpha * source;
+			return;
+		}
+
+		if (Temp1.size() != source.size() && activeRanks.size() > 1)
+		{
+			throw std::runtime_error("FactoredPotential::Setup must be called before Multiply");
+		}
+
+		//Apply all but the last factor into the temp buffers, and
+		//accumulate the last factor into dest
+		DataArray current(source);
+		for (size_t i=0; i<activeRanks.size(); i++)
+		{
+			int rank = activeRanks[i];
+			if (i == activeRanks.size() - 1)
+			{
+				ApplyFactor(rank, current, dest, alpha, true);
+			}
+			else
+			{
+				DataArray &out = (current.data() == Temp1.data()) ? Temp2 : Temp1;
+				if (Factors[rank].Type == FactorDiagonal && current.data() != source.data())
+				{
+					ApplyFactor(rank, current, current, 1.0, false);
+				}
+				else
+				{
+					ApplyFactor(rank, current, out, 1.0, false);
+					current.reference(out);
+				}
+			}
+		}
+	}
+
+	void MultiplyPotential(DataArray source, DataArray dest, double scaling)
+	{
+		Multiply(source, dest, scaling);
+	}
+};
+
+#endif
+
@@ -0,0 +1,8 @@
+#include "hamiltonianoperator.h"
+
+double EvaluateTimeFunction(const object &timeFunction, double t)
+{
+	AcquireGIL acquireGIL;
+	return extract<double>(timeFunction(t));
+}
+
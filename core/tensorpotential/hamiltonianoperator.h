@@ -0,0 +1,269 @@
+#ifndef HAMILTONIANOPERATOR_H
+#define HAMILTONIANOPERATOR_H
+
+#include "../common.h"
+#include "../wavefunction.h"
+#include "../representation/representation.h"
+#include "../utility/gilrelease.h"
+#include "interactionpicturephase.h"
+
+#include <vector>
+#include <limits>
+
+/*
+ * Evaluates a python time function f(t), returning a real scaling factor.
+ * May be called with the GIL released
+ */
+double EvaluateTimeFunction(const object &timeFunction, double t);
+
+/*
+ * A term in a HamiltonianOperator, i.e. a tensor potential bound to its
+ * multiply function and storage arguments.
+ *
+ * Multiply performs dest += scaling * V source
+ *
+ * Implementations for all tensor potential storages are created by
+ * tensorpotentialmultiply_generator.py, and are available from python as
+ * core.TensorPotentialTerm_<storages>(potential, <multiply arguments>)
+ */
+template<int Rank>
+class HamiltonianTerm
+{
+public:
+	typedef boost::shared_ptr< HamiltonianTerm<Rank> > Ptr;
+
+	virtual ~HamiltonianTerm() {}
+	virtual void Multiply(blitz::Array<cplx, Rank> &source, blitz::Array<cplx, Rank> &dest, double scaling) = 0;
+};
+
+
+/*
+ * Composite Hamiltonian assembled from HamiltonianTerms, which can be applied
+ * by the C++ propagators (pAMP, Runge-Kutta, ODE) without calling back into
+ * python for every matrix-vector product.
+ *
+ *     H psi = O ( sum_i f_i(t) V_i ) psi
+ *
+ * where f_i(t) is either a constant or a python time function, and O is the
+ * overlap handling:
+ * - OverlapNone:     O = 1 (orthogonal basises, or the caller handles overlaps)
+ * - OverlapFull:     O = S^-1, as BasisPropagator.MultiplyHamiltonian
+ * - OverlapBalanced: H = S^-1/2 V S^-H/2, as BasisPropagator.MultiplyHamiltonianBalancedOverlap
+ *
+ * Time functions are evaluated once for every distinct t, and cached, such that
+ * a Krylov step only calls python once per time dependent term, and Runge-Kutta
+ * steps once per stage.
+ *
+ * If an InteractionPicturePhase is set, the potentials are applied in the
+ * interaction picture, exp(i E t) V exp(-i E t), as BasisPropagatorInteractionPicture.
+ * exp(-i E t) is applied while copying the source into a preallocated buffer,
+ * in the same pass as the result is cleared, and exp(i E t) in a single pass
+ * over the result.
+ *
+ * Multiply releases the GIL, and only takes it back to evaluate the time
+ * functions.
+ */
+template<int Rank>
+class HamiltonianOperator
+{
+public:
+	typedef boost::shared_ptr< HamiltonianOperator<Rank> > Ptr;
+	typedef typename HamiltonianTerm<Rank>::Ptr TermPtr;
+	typedef blitz::Array<cplx, Rank> DataArray;
+
+	enum OverlapMode
+	{
+		OverlapNone = 0,
+		OverlapFull = 1,
+		OverlapBalanced = 2
+	};
+
+private:
+	struct Term
+	{
+		TermPtr Potential;
+		double Scaling;
+		bool IsTimeDependent;
+		object TimeFunction;
+		double CachedTime;
+	};
+
+	std::vector<Term> Terms;
+	int Overlap;
+	DataArray SourceBackup;
+	DataArray PhaseSource;
+	typename InteractionPicturePhase<Rank>::Ptr Phase;
+	long MultiplyCount;
+
+	double GetScaling(Term &term, double t)
+	{
+		if (term.IsTimeDependent && term.CachedTime != t)
+		{
+			term.Scaling = EvaluateTimeFunction(term.TimeFunction, t);
+			term.CachedTime = t;
+		}
+		return term.Scaling;
+	}
+
+	/*
+	 * dest = sum_i f_i(t) V_i source. dest is cleared first, unless
+	 * cleared is true
+	 */
+	void MultiplyPotentials(DataArray &source, DataArray &dest, double t, bool cleared=false)
+	{
+		if (!cleared)
+		{
+			dest = 0;
+		}
+		for (size_t i=0; i<Terms.size(); i++)
+		{
+			double scaling = GetScaling(Terms[i], t);
+			if (scaling != 0)
+			{
+				Terms[i].Potential->Multiply(source, dest, scaling);
+			}
+		}
+	}
+
+public:
+	HamiltonianOperator() : Overlap(OverlapNone), MultiplyCount(0) {}
+
+	/*
+	 * Adds a time independent term scaling * V
+	 */
+	void AddTerm(TermPtr potential, double scaling)
+	{
+		Term term;
+		term.Potential = potential;
+		term.Scaling = scaling;
+		term.IsTimeDependent = false;
+		term.CachedTime = 0;
+		Terms.push_back(term);
+	}
+
+	/*
+	 * Adds a time dependent term f(t) * V, where f is a python callable
+	 * taking the time as the only argument, and returning a real number
+	 */
+	void AddTimeDependentTerm(TermPtr potential, object timeFunction)
+	{
+		Term term;
+		term.Potential = potential;
+		term.Scaling = 0;
+		term.IsTimeDependent = true;
+		term.TimeFunction = timeFunction;
+		term.CachedTime = std::numeric_limits<double>::quiet_NaN();
+		Terms.push_back(term);
+	}
+
+	void ClearTerms()
+	{
+		Terms.clear();
+	}
+
+	int GetTermCount()
+	{
+		return Terms.size();
+	}
+
+	void SetOverlapMode(int overlap)
+	{
+		if (overlap != OverlapNone && overlap != OverlapFull && overlap != OverlapBalanced)
+		{
+			cout << "Invalid overlap mode " << overlap << endl;
+			throw std::runtime_error("Invalid overlap mode");
+		}
+		Overlap = overlap;
+	}
+
+	int GetOverlapMode()
+	{
+		return Overlap;
+	}
+
+	long GetMultiplyCount()
+	{
+		return MultiplyCount;
+	}
+
+	void SetInteractionPicturePhase(typename InteractionPicturePhase<Rank>::Ptr phase)
+	{
+		Phase = phase;
+	}
+
+	void ClearInteractionPicturePhase()
+	{
+		Phase.reset();
+	}
+
+	/*
+	 * Allocates the temporary buffers needed for balanced overlap
+	 * and interaction picture phases
+	 */
+	void Setup(typename Wavefunction<Rank>::Ptr psi)
+	{
+		if (Overlap == OverlapBalanced)
+		{
+			if (Phase)
+			{
+				throw std::runtime_error("Balanced overlap is not supported in the interaction picture");
+			}
+			SourceBackup.resize(psi->GetData().shape());
+		}
+		if (Phase)
+		{
+			PhaseSource.resize(psi->GetData().shape());
+		}
+	}
+
+	/*
+	 * Calculates destPsi = H srcPsi at time t. The active buffers of srcPsi
+	 * and destPsi are used, which allows the propagators to point them to
+	 * their own work vectors with SetData()
+	 */
+	void Multiply(typename Wavefunction<Rank>::Ptr srcPsi, typename Wavefunction<Rank>::Ptr destPsi, double t)
+	{
+		ReleaseGIL releaseGIL;
+		DataArray source(srcPsi->GetData());
+		DataArray dest(destPsi->GetData());
+		MultiplyCount++;
+
+		if (Overlap == OverlapBalanced)
+		{
+			if (SourceBackup.size() != source.size())
+			{
+				SourceBackup.resize(source.shape());
+			}
+			SourceBackup = source;
+			srcPsi->GetRepresentation()->SolveSqrtOverlap(false, *srcPsi);
+			MultiplyPotentials(source, dest, t);
+			destPsi->GetRepresentation()->SolveSqrtOverlap(true, *destPsi);
+			source = SourceBackup;
+		}
+		else if (Phase)
+		{
+			if (PhaseSource.size() != source.size())
+			{
+				PhaseSource.resize(source.shape());
+			}
+			Phase->MultiplyPhaseAndClear(source, PhaseSource, dest, t);
+			MultiplyPotentials(PhaseSource, dest, t, true);
+			Phase->MultiplyConjugatePhase(dest, t);
+			if (Overlap == OverlapFull)
+			{
+				destPsi->GetRepresentation()->SolveOverlap(*destPsi);
+			}
+		}
+		else
+		{
+			MultiplyPotentials(source, dest, t);
+			if (Overlap == OverlapFull)
+			{
+				destPsi->GetRepresentation()->SolveOverlap(*destPsi);
+			}
+		}
+	}
+};
+
+#endif
+
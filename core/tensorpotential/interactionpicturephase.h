@@ -0,0 +1,364 @@
+#ifndef INTERACTIONPICTUREPHASE_H
+#define INTERACTIONPICTUREPHASE_H
+
+#include "../common.h"
+
+#include <limits>
+#include <algorithm>
+
+/*
+ * Phase factors exp(-i E t) of the interaction picture, where E are the
+ * (diagonal) energies of H0. The interaction picture operator
+ *
+ *     exp(i E t) V exp(-i E t) psi
+ *
+ * is calculated with MultiplyPhase, V and MultiplyConjugatePhase.
+ *
+ * The energies are broadcast to the shape of the local wavefunction data
+ * as in numpy, i.e. every rank of the energies must either have the
+ * extent of psi, or extent 1. The energies, the phases and the increments
+ * are stored in the shape of the energies, which is 2.5 times the size
+ * of psi only when the energies are given for every basis function.
+ *
+ * The phase factors are stored, and advanced between nearby times by
+ * complex multiplication with a cached increment exp(-i E dt), instead
+ * of calling exp() for every element on every matrix-vector product.
+ * A new increment is only calculated when the time step changes, and
+ * the phases are recalculated directly from exp(-i E t) every
+ * MaxIncrementalSteps updates to bound the accumulated round-off error.
+ *
+ * MultiplyPhase and MultiplyConjugatePhase apply the phases in a single
+ * pass without allocating temporaries, and MultiplyPhase can clear the
+ * destination of the potentials in the same pass. They are not fused into
+ * the tensor potential multiply kernels: HamiltonianOperator applies them
+ * once before and after the sum of all potential terms, where a kernel
+ * would apply them once per term, and once per use of a source element in
+ * banded and dense ranks. The two passes cost 0.5-5% of one potential
+ * multiply in kernelbench sized problems.
+ */
+template<int Rank>
+class InteractionPicturePhase
+{
+public:
+	typedef boost::shared_ptr< InteractionPicturePhase<Rank> > Ptr;
+	typedef blitz::Array<cplx, Rank> DataArray;
+
+private:
+	blitz::Array<double, Rank> Energies;
+	DataArray Phase;
+	DataArray Increment;
+
+	double PhaseTime;
+	double IncrementStep;
+	int IncrementalSteps;
+	int MaxIncrementalSteps;
+	long ExpCount;
+
+	bool IsSameStep(double a, double b)
+	{
+		return std::abs(a - b) <= 1e-13 * std::max(std::abs(a), std::abs(b));
+	}
+
+	/*
+	 * Checks that the energies can be broadcast to the shape of data, and
+	 * returns the strides of the phases in the shape of data, which are
+	 * zero along the broadcast ranks
+	 */
+	blitz::TinyVector<long, Rank> GetBroadcastStrides(const DataArray &data)
+	{
+		blitz::TinyVector<long, Rank> strides;
+		for (int rank=0; rank<Rank; rank++)
+		{
+			if (Energies.extent(rank) == data.extent(rank))
+			{
+				strides(rank) = Energies.stride(rank);
+			}
+			else if (Energies.extent(rank) == 1)
+			{
+				strides(rank) = 0;
+			}
+			else
+			{
+				cout << "Interaction picture energies have shape " << Energies.shape() << ", but psi has shape " << data.shape() << endl;
+				throw std::runtime_error("Invalid shape of interaction picture energies");
+			}
+		}
+		if (!data.isStorageContiguous())
+		{
+			throw std::runtime_error("Interaction picture phases require contiguous storage");
+		}
+		return strides;
+	}
+
+	/*
+	 * dest = phase * source, where phase is exp(-i E t), or exp(i E t) if
+	 * Conjugate is true. source and dest may be the same array. If clear
+	 * is not 0, it is an array of the same shape, which is set to zero in
+	 * the same pass
+	 */
+	template<bool Conjugate>
+	void ApplyPhase(const DataArray &source, DataArray &dest, DataArray *clear)
+	{
+		blitz::TinyVector<long, Rank> phaseStride = GetBroadcastStrides(source);
+		for (int rank=0; rank<Rank; rank++)
+		{
+			if (dest.extent(rank) != source.extent(rank))
+			{
+				cout << "Source has shape " << source.shape() << ", but destination has shape " << dest.shape() << endl;
+				throw std::runtime_error("Invalid shape of destination");
+			}
+		}
+		if (!dest.isStorageContiguous())
+		{
+			throw std::runtime_error("Interaction picture phases require contiguous storage");
+		}
+		if (clear != 0)
+		{
+			for (int rank=0; rank<Rank; rank++)
+			{
+				if (clear->extent(rank) != source.extent(rank))
+				{
+					cout << "Source has shape " << source.shape() << ", but the array to clear has shape " << clear->shape() << endl;
+					throw std::runtime_error("Invalid shape of array to clear");
+				}
+			}
+			if (!clear->isStorageContiguous())
+			{
+				throw std::runtime_error("Interaction picture phases require contiguous storage");
+			}
+		}
+
+		const cplx* phasePtr = Phase.data();
+		const cplx* srcPtr = source.data();
+		cplx* dstPtr = dest.data();
+		cplx* clearPtr = clear != 0 ? clear->data() : 0;
+		long size = source.size();
+
+		if (size == Phase.size())
+		{
+			#pragma omp parallel for schedule(static)
+			for (long i=0; i<size; i++)
+			{
+				dstPtr[i] = (Conjugate ? conj(phasePtr[i]) : phasePtr[i]) * srcPtr[i];
+				if (clearPtr != 0)
+				{
+					clearPtr[i] = 0;
+				}
+			}
+			return;
+		}
+
+		//Broadcast energies: loop over the rows of the last rank, and find
+		//the start of each row in the phases from its index in the other ranks
+		if (size == 0)
+		{
+			return;
+		}
+		int rowSize = source.extent(Rank-1);
+		long rowCount = size / rowSize;
+		long phaseRowStride = phaseStride(Rank-1);
+
+		#pragma omp parallel for schedule(static)
+		for (long row=0; row<rowCount; row++)
+		{
+			long phaseOffset = 0;
+			long index = row;
+			for (int rank=Rank-2; rank>=0; rank--)
+			{
+				phaseOffset += (index % source.extent(rank)) * phaseStride(rank);
+				index /= source.extent(rank);
+			}
+
+			const cplx* phaseRow = phasePtr + phaseOffset;
+			const cplx* srcRow = srcPtr + row*rowSize;
+			cplx* dstRow = dstPtr + row*rowSize;
+			for (int i=0; i<rowSize; i++)
+			{
+				cplx phase = phaseRow[i*phaseRowStride];
+				dstRow[i] = (Conjugate ? conj(phase) : phase) * srcRow[i];
+			}
+			if (clearPtr != 0)
+			{
+				std::fill(clearPtr + row*rowSize, clearPtr + (row+1)*rowSize, cplx(0));
+			}
+		}
+	}
+
+	/*
+	 * Phase = exp(-i E t)
+	 */
+	void CalculatePhase(double t)
+	{
+		const double* energyPtr = Energies.data();
+		cplx* phasePtr = Phase.data();
+		long size = Phase.size();
+
+		#pragma omp parallel for schedule(static)
+		for (long i=0; i<size; i++)
+		{
+			double arg = - energyPtr[i] * t;
+			phasePtr[i] = cplx(cos(arg), sin(arg));
+		}
+
+		ExpCount++;
+		IncrementalSteps = 0;
+	}
+
+	/*
+	 * Increment = exp(-i E dt), Phase *= Increment
+	 */
+	void CalculateIncrement(double dt)
+	{
+		const double* energyPtr = Energies.data();
+		cplx* phasePtr = Phase.data();
+		cplx* incrementPtr = Increment.data();
+		long size = Phase.size();
+
+		#pragma omp parallel for schedule(static)
+		for (long i=0; i<size; i++)
+		{
+			double arg = - energyPtr[i] * dt;
+			incrementPtr[i] = cplx(cos(arg), sin(arg));
+			phasePtr[i] *= incrementPtr[i];
+		}
+
+		ExpCount++;
+		IncrementStep = dt;
+		IncrementalSteps++;
+	}
+
+	/*
+	 * Phase *= Increment, or Phase *= conj(Increment) if backward is true
+	 */
+	void ApplyIncrement(bool backward)
+	{
+		cplx* phasePtr = Phase.data();
+		const cplx* incrementPtr = Increment.data();
+		long size = Phase.size();
+
+		if (backward)
+		{
+			#pragma omp parallel for schedule(static)
+			for (long i=0; i<size; i++)
+			{
+				phasePtr[i] *= conj(incrementPtr[i]);
+			}
+		}
+		else
+		{
+			#pragma omp parallel for schedule(static)
+			for (long i=0; i<size; i++)
+			{
+				phasePtr[i] *= incrementPtr[i];
+			}
+		}
+		IncrementalSteps++;
+	}
+
+	/*
+	 * Advances the phases to time t
+	 */
+	void UpdatePhase(double t)
+	{
+		if (t == PhaseTime)
+		{
+			return;
+		}
+
+		double dt = t - PhaseTime;
+		if (PhaseTime != PhaseTime || IncrementalSteps >= MaxIncrementalSteps)
+		{
+			CalculatePhase(t);
+		}
+		else if (IsSameStep(dt, IncrementStep))
+		{
+			ApplyIncrement(false);
+		}
+		else if (IsSameStep(-dt, IncrementStep))
+		{
+			ApplyIncrement(true);
+		}
+		else
+		{
+			CalculateIncrement(dt);
+		}
+		PhaseTime = t;
+	}
+
+public:
+	InteractionPicturePhase() :
+		PhaseTime(std::numeric_limits<double>::quiet_NaN()),
+		IncrementStep(0),
+		IncrementalSteps(0),
+		MaxIncrementalSteps(1000),
+		ExpCount(0)
+	{}
+
+	/*
+	 * Sets the energies of H0. energies must be broadcastable to the shape
+	 * of the local wavefunction data (see above), and is copied.
+	 */
+	void SetEnergies(blitz::Array<double, Rank> energies)
+	{
+		Energies.resize(energies.shape());
+		Energies = energies;
+		Phase.resize(energies.shape());
+		Increment.resize(energies.shape());
+		PhaseTime = std::numeric_limits<double>::quiet_NaN();
+		IncrementStep = 0;
+		IncrementalSteps = 0;
+	}
+
+	void SetMaxIncrementalSteps(int steps)
+	{
+		if (steps < 0)
+		{
+			throw std::runtime_error("MaxIncrementalSteps must be non-negative");
+		}
+		MaxIncrementalSteps = steps;
+	}
+
+	int GetMaxIncrementalSteps()
+	{
+		return MaxIncrementalSteps;
+	}
+
+	/*
+	 * Number of times exp() has been evaluated for all elements
+	 */
+	long GetExpCount()
+	{
+		return ExpCount;
+	}
+
+	/*
+	 * dest = exp(-i E t) source
+	 */
+	void MultiplyPhase(DataArray source, DataArray dest, double t)
+	{
+		UpdatePhase(t);
+		ApplyPhase<false>(source, dest, 0);
+	}
+
+	/*
+	 * dest = exp(-i E t) source, and clear = 0 in the same pass, i.e.
+	 * before the potentials are summed into clear
+	 */
+	void MultiplyPhaseAndClear(DataArray source, DataArray dest, DataArray clear, double t)
+	{
+		UpdatePhase(t);
+		ApplyPhase<false>(source, dest, &clear);
+	}
+
+	/*
+	 * data *= exp(i E t)
+	 */
+	void MultiplyConjugatePhase(DataArray data, double t)
+	{
+		UpdatePhase(t);
+		ApplyPhase<true>(data, data, 0);
+	}
+};
+
+#endif
+
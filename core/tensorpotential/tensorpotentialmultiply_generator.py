@@ -165,7 +165,7 @@ def PrettyPrintC(str):
 	
 	indent = 0
 	for line in lines:
-		if line == "}":
+		if line == "}" or line == "};":
 			indent -= 1
 
 		outStr += "\t" * indent	+ line + "\n"
@@ -766,6 +766,21 @@ class SnippetGeneratorBandedNonHermitianBlas(SnippetGeneratorBase):
 
 class SnippetGeneratorSimpleDistributed(SnippetGeneratorBase):
 	"""
+	Sparse matrix distributed over the group communicator of this rank.
+	The matrix elements are stored on the proc owning their column, and
+	the communication plan is precomputed in SimpleDistributed.py:
+
+	1. Post one recv per neighbour proc, for all rows it contributes to
+	2. Compute all matrix elements with remote rows into sendTemp, where
+	   elements with the same remote row share one slot
+	3. Post one send per neighbour proc
+	4. Compute all matrix elements with local rows directly into dest,
+	   while the messages are in flight
+	5. Wait for the recvs, and add the recieved rows to dest
+
+	With more than one distributed rank (a 2D proc grid), every proc only
+	communicates with the procs sharing its coordinates in the other
+	ranks, and the temp arrays have size 1 in the ranks outside this one.
 	"""
 
 	def __init__(self, systemRank, curRank, innerGenerator):
@@ -774,181 +789,118 @@ class SnippetGeneratorSimpleDistributed(SnippetGeneratorBase):
 	def GetParameterList(self):
 		parameterList = []
 		parameterList += [("globalSize%i" % self.CurRank, "scalar", "integer")]
-		parameterList += [("localMatrixIndex%i" % self.CurRank, "array", 1, "integer")]
 		parameterList += [("globalRow%i" % self.CurRank, "array", 1, "integer")]
 		parameterList += [("globalCol%i" % self.CurRank, "array", 1, "integer")]
-		parameterList += [("sendProc%i" % self.CurRank, "array", 1, "integer")]
-		parameterList += [("recvProcList%i" % self.CurRank, "array", 2, "integer")]
-		parameterList += [("recvLocalRowList%i" % self.CurRank, "array", 2, "integer")]
-		parameterList += [("recvCount%i" % self.CurRank, "array", 1, "integer")]
+		parameterList += [("sendSlot%i" % self.CurRank, "array", 1, "integer")]
+		parameterList += [("sendProcList%i" % self.CurRank, "array", 1, "integer")]
+		parameterList += [("sendOffset%i" % self.CurRank, "array", 1, "integer")]
+		parameterList += [("recvProcList%i" % self.CurRank, "array", 1, "integer")]
+		parameterList += [("recvOffset%i" % self.CurRank, "array", 1, "integer")]
+		parameterList += [("recvLocalRow%i" % self.CurRank, "array", 1, "integer")]
 		parameterList += [("recvTemp%i" % self.CurRank, "array", self.SystemRank, "complex (kind=dbl)")]
 		parameterList += [("sendTemp%i" % self.CurRank, "array", self.SystemRank, "complex (kind=dbl)")]
+		parameterList += [("globalStartIndex%i" % self.CurRank, "scalar", "integer")]
+		parameterList += [("communicator%i" % self.CurRank, "scalar", "integer")]
 		return parameterList
 
 	def GetParameterDeclarationCode(self):
-
-		tempDimension = ["0:destExtent%i-1" % i for i in range(self.CurRank+1, self.SystemRank)]
-		sendTempDim = ["0:1"] + tempDimension 
-		recvTempDim = ["0:recvProcList%iExtent1" % self.CurRank] + tempDimension 
-
 		str = ""
-		str += GetFortranArrayDeclaration("localMatrixIndex%i" % self.CurRank, 1, "integer", "in")
 		str += GetFortranArrayDeclaration("globalRow%i" % self.CurRank, 1, "integer", "in")
 		str += GetFortranArrayDeclaration("globalCol%i" % self.CurRank, 1, "integer", "in")
-		str += GetFortranArrayDeclaration("sendProc%i" % self.CurRank, 1, "integer", "in")
-		str += GetFortranArrayDeclaration("recvProcList%i" % self.CurRank, 2, "integer", "in")
-		str += GetFortranArrayDeclaration("recvLocalRowList%i" % self.CurRank, 2, "integer", "in")
-		str += GetFortranArrayDeclaration("recvCount%i" % self.CurRank, 1, "integer", "in")
+		str += GetFortranArrayDeclaration("sendSlot%i" % self.CurRank, 1, "integer", "in")
+		str += GetFortranArrayDeclaration("sendProcList%i" % self.CurRank, 1, "integer", "in")
+		str += GetFortranArrayDeclaration("sendOffset%i" % self.CurRank, 1, "integer", "in")
+		str += GetFortranArrayDeclaration("recvProcList%i" % self.CurRank, 1, "integer", "in")
+		str += GetFortranArrayDeclaration("recvOffset%i" % self.CurRank, 1, "integer", "in")
+		str += GetFortranArrayDeclaration("recvLocalRow%i" % self.CurRank, 1, "integer", "in")
 		str += GetFortranArrayDeclaration("recvTemp%i" % self.CurRank, self.SystemRank, "complex (kind=dbl)", "inout")
 		str += GetFortranArrayDeclaration("sendTemp%i" % self.CurRank, self.SystemRank, "complex (kind=dbl)", "inout")
 		str += """
-			integer, intent(in) :: globalSize%(rank)i
+			integer, intent(in) :: globalSize%(rank)i, globalStartIndex%(rank)i, communicator%(rank)i
 			integer :: i%(rank)i, row%(rank)i, col%(rank)i
-			
-			!temporary arrays TODO:FIX TEMPS <= FIXED! :D
-			!complex (kind=dbl), dimension(%(recvTempDim)s) :: recvTemp%(rank)i
-			!complex (kind=dbl), dimension(%(sendTempDim)s) :: sendTemp%(rank)i
 			integer :: tempIndex%(rank)i
 			
-			integer :: curSend%(rank)i
-			integer :: recvIdx%(rank)i
-			
-			!Indices to map between local and global index ranges
-			integer :: globalStartIndex%(rank)i !!!!, paddedLocalSize%(rank)i, localSize%(rank)i
-			
 			!MPI variables
-			integer, dimension(0:recvProcList%(rank)iExtent1) :: recvRequest%(rank)i 
-			integer :: error%(rank)i, tag%(rank)i, sendSize%(rank)i 
-			integer :: sendRequest%(rank)i 
-			integer :: waitRecieve%(rank)i, waitSend%(rank)i
-			integer :: procId%(rank)i, procCount%(rank)i, communicator%(rank)i
+			integer, dimension(0:sendProcList%(rank)iExtent0) :: sendRequest%(rank)i 
+			integer, dimension(0:recvProcList%(rank)iExtent0) :: recvRequest%(rank)i 
+			integer :: error%(rank)i, tag%(rank)i, sliceSize%(rank)i 
+			integer :: procIdx%(rank)i, sendProcCount%(rank)i, recvProcCount%(rank)i
 			
 			!Indices for the recieved data
-			integer :: sourceRow%(rank)i
+			integer :: recvIdx%(rank)i, sourceRow%(rank)i
 		""" % \
 			{ \
 				"rank": self.CurRank, \
-				"recvTempDim": self.GetIndexString(recvTempDim), \
-				"sendTempDim": self.GetIndexString(sendTempDim), \
 			}
 		return str
 
 	def GetInitializationCode(self):
 		str = """
-			call MPI_Comm_rank(MPI_COMM_WORLD, procId%(rank)i, error%(rank)i)
-			call MPI_Comm_size(MPI_COMM_WORLD, procCount%(rank)i, error%(rank)i)
-			communicator%(rank)i = MPI_COMM_WORLD
-
-			globalStartIndex%(rank)i = GetLocalStartIndex(globalSize%(rank)i, procCount%(rank)i, procId%(rank)i)
-			!paddedLocalSize%(rank)i = GetPaddedLocalSize(globalSize%(rank)i, procCount%(rank)i)
-			
-			sourceRow%(rank)i = -1
-			sendSize%(rank)i = %(sendSize)s
+			sendProcCount%(rank)i = sendProcList%(rank)iExtent0
+			recvProcCount%(rank)i = recvProcList%(rank)iExtent0
+			sliceSize%(rank)i = %(sliceSize)s
 			tag%(rank)i = 0
-		    tempIndex%(rank)i = 1
-		    curSend%(rank)i = 0
 		""" % \
 			{ \
 				"rank": self.CurRank, \
-				"sendSize": " * ".join(["1"] + ["destExtent%i" %i for i in range(self.CurRank+1, self.SystemRank)])
+				"sliceSize": " * ".join(["1"] + ["destExtent%i" %i for i in range(self.CurRank+1, self.SystemRank)])
 			}
 		return str
 
 	def GetLoopingCodeRecursive(self, conjugate, destName, destIndex, sourceName, sourceIndex, potentialName, potentialIndex):
 		innerRankCount = self.SystemRank - self.CurRank - 1
+		outerTempIndex = ["0"] * self.CurRank
 		str = ""
 		str += """
-			waitRecieve%(rank)i = 0
-			waitSend%(rank)i = 0
-			tempIndex%(rank)i = 1
-
-			!Iterate over all rows of the matrix for the columns stored on proc
-			do i%(rank)i = 0, localMatrixIndex%(rank)iExtent0-1
-			    !----------------------------------------------------------------------------
-			    !                         Calculation
-			    !----------------------------------------------------------------------------
-			
-			     !Perform calculation for this step
-		    	curSend%(rank)i = 0
-			    if (localMatrixIndex%(rank)i(i%(rank)i) .ne. -1) then
-			        col%(rank)i = globalCol%(rank)i(i%(rank)i) - globalStartIndex%(rank)i
-			        row%(rank)i = globalRow%(rank)i(i%(rank)i) - globalStartIndex%(rank)i
-			
-			        if (sendProc%(rank)i(i%(rank)i) .eq. procId%(rank)i) then
-			            %(destInnerLoop)s
-			        else
-						sendTemp%(rank)i(%(allSendTempIndex)s) = 0
-			            %(tempInnerLoop)s
-			            curSend%(rank)i = 1
-			        endif
-			    endif
+			!Post the recvs of all rows contributed by the neighbour procs
+			do procIdx%(rank)i = 0, recvProcCount%(rank)i-1
+				call MPI_Irecv(recvTemp%(rank)i(%(recvOffsetIndex)s), (recvOffset%(rank)i(procIdx%(rank)i+1) - recvOffset%(rank)i(procIdx%(rank)i)) * sliceSize%(rank)i, MPI_DOUBLE_COMPLEX, recvProcList%(rank)i(procIdx%(rank)i), tag%(rank)i, communicator%(rank)i, recvRequest%(rank)i(procIdx%(rank)i), error%(rank)i)
+			enddo
 
-				!----------------------------------------------------------------------------
-				!                         Communication
-				!----------------------------------------------------------------------------
-				
-				! Theese are the sends and recvs from the previous step. wait for them
-				! now instead of in the previous iteration in order to try to overlap computation
-				! and communication
-				
-				!Wait for previous recv
-				do recvIdx%(rank)i = 0, waitRecieve%(rank)i-1
-				    call MPI_Wait(recvRequest%(rank)i(recvIdx%(rank)i), MPI_STATUS_IGNORE, error%(rank)i)
-				    sourceRow%(rank)i = recvLocalRowList%(rank)i(recvIdx%(rank)i, i%(rank)i-1)
-					%(dest)s(%(sourceDestIndex)s) = %(dest)s(%(sourceDestIndex)s) + recvTemp%(rank)i(%(allRecvTempIndex)s)
-				enddo
-				
-				!Wait for previous send
-				if (waitSend%(rank)i .eq. 1) then
-				    call MPI_Wait(sendRequest%(rank)i, MPI_STATUS_IGNORE, error%(rank)i)
+			!Compute the matrix elements of remote rows first, such that the 
+			!sends can be posted before the local computation
+			sendTemp%(rank)i = 0
+			do i%(rank)i = 0, globalRow%(rank)iExtent0-1
+				tempIndex%(rank)i = sendSlot%(rank)i(i%(rank)i)
+				if (tempIndex%(rank)i .ne. -1) then
+					col%(rank)i = globalCol%(rank)i(i%(rank)i) - globalStartIndex%(rank)i
+					%(tempInnerLoop)s
 				endif
-				
-				! Theese are the sends and recvs for the current step. Post them now,
-				! and wait for completion at the next iteration 
-				
-				!Post recvs for this step
-				waitRecieve%(rank)i = recvCount%(rank)i(i%(rank)i)
-				do recvIdx%(rank)i = 0, waitRecieve%(rank)i-1
-				    call MPI_Irecv(recvTemp%(rank)i(%(zeroRecvTempIndex)s), sendSize%(rank)i, MPI_DOUBLE_COMPLEX, recvProcList%(rank)i(recvIdx%(rank)i, i%(rank)i), tag%(rank)i, communicator%(rank)i, recvRequest%(rank)i(recvIdx%(rank)i), error%(rank)i)
-				enddo 
-				
-				!Post send for this step if we have calculated anything
-				waitSend%(rank)i = 0
-				if (curSend%(rank)i .eq. 1) then
-				    call MPI_ISend(sendTemp%(rank)i(%(zeroSendTempIndex)s), sendSize%(rank)i, MPI_DOUBLE_COMPLEX, sendProc%(rank)i(i%(rank)i), tag%(rank)i, communicator%(rank)i, sendRequest%(rank)i, error%(rank)i)
-				    waitSend%(rank)i = 1
+			enddo
+
+			!Post one send per neighbour proc
+			do procIdx%(rank)i = 0, sendProcCount%(rank)i-1
+				call MPI_ISend(sendTemp%(rank)i(%(sendOffsetIndex)s), (sendOffset%(rank)i(procIdx%(rank)i+1) - sendOffset%(rank)i(procIdx%(rank)i)) * sliceSize%(rank)i, MPI_DOUBLE_COMPLEX, sendProcList%(rank)i(procIdx%(rank)i), tag%(rank)i, communicator%(rank)i, sendRequest%(rank)i(procIdx%(rank)i), error%(rank)i)
+			enddo
+
+			!Compute the matrix elements of local rows while the messages are in flight
+			do i%(rank)i = 0, globalRow%(rank)iExtent0-1
+				if (sendSlot%(rank)i(i%(rank)i) .eq. -1) then
+					row%(rank)i = globalRow%(rank)i(i%(rank)i) - globalStartIndex%(rank)i
+					col%(rank)i = globalCol%(rank)i(i%(rank)i) - globalStartIndex%(rank)i
+					%(destInnerLoop)s
 				endif
-				
-				!Use the next tempIndex for the next computation
-				tempIndex%(rank)i = mod(tempIndex%(rank)i+1, 2)
-			enddo 
-			
-			!Wait for last recv
-			do recvIdx%(rank)i = 0, waitRecieve%(rank)i-1
-			    call MPI_Wait(recvRequest%(rank)i(recvIdx%(rank)i), MPI_STATUS_IGNORE, error%(rank)i)
-			    sourceRow%(rank)i = recvLocalRowList%(rank)i(recvIdx%(rank)i, localMatrixIndex%(rank)iExtent0-1)
+			enddo
+
+			!Add the recieved rows
+			call MPI_Waitall(recvProcCount%(rank)i, recvRequest%(rank)i, MPI_STATUSES_IGNORE, error%(rank)i)
+			do recvIdx%(rank)i = 0, recvLocalRow%(rank)iExtent0-1
+				sourceRow%(rank)i = recvLocalRow%(rank)i(recvIdx%(rank)i)
 				%(dest)s(%(sourceDestIndex)s) = %(dest)s(%(sourceDestIndex)s) + recvTemp%(rank)i(%(allRecvTempIndex)s)
 			enddo
-			
-			!Wait for last send
-			if (waitSend%(rank)i .eq. 1) then
-			    call MPI_Wait(sendRequest%(rank)i, MPI_STATUS_IGNORE, error%(rank)i)
-			endif
+
+			call MPI_Waitall(sendProcCount%(rank)i, sendRequest%(rank)i, MPI_STATUSES_IGNORE, error%(rank)i)
 
 		""" % \
 			{ \
 				"rank":self.CurRank, \
 				"destInnerLoop": self.GetInnerLoop(conjugate, destName, destIndex, sourceName, sourceIndex, potentialName, potentialIndex, False), \
 				"tempInnerLoop": self.GetInnerLoop(conjugate, destName, destIndex, sourceName, sourceIndex, potentialName, potentialIndex, True), \
-				"source" : sourceName, \
 				"dest" : destName, 
-				"potential": potentialName, \
 				"sourceDestIndex": self.GetIndexString( destIndex + ["sourceRow%i" % self.CurRank] + [":"] * innerRankCount ), \
-				"destIndex": self.GetIndexString( destIndex + ["row%i" % self.CurRank] + [":"] * innerRankCount ), \
-				"allSendTempIndex": self.GetIndexString( ["tempIndex%i" % self.CurRank] + [":"] * innerRankCount ), \
-				"allRecvTempIndex": self.GetIndexString( ["recvIdx%i" % self.CurRank] + [":"] * innerRankCount ), \
-				"zeroSendTempIndex": self.GetIndexString( ["tempIndex%i" % self.CurRank] + ["0"] * innerRankCount ), \
-				"zeroRecvTempIndex": self.GetIndexString( ["recvIdx%i" % self.CurRank] + ["0"] * innerRankCount ), \
+				"allRecvTempIndex": self.GetIndexString( outerTempIndex + ["recvIdx%i" % self.CurRank] + [":"] * innerRankCount ), \
+				"sendOffsetIndex": self.GetIndexString( outerTempIndex + ["sendOffset%i(procIdx%i)" % (self.CurRank, self.CurRank)] + ["0"] * innerRankCount ), \
+				"recvOffsetIndex": self.GetIndexString( outerTempIndex + ["recvOffset%i(procIdx%i)" % (self.CurRank, self.CurRank)] + ["0"] * innerRankCount ), \
 			}
 
 		return str
@@ -956,9 +908,9 @@ class SnippetGeneratorSimpleDistributed(SnippetGeneratorBase):
 	def GetInnerLoop(self, conjugate, destName, destIndex, sourceName, sourceIndex, potentialName, potentialIndex, useTemp):
 		if useTemp:
 			destName = "sendTemp%i" % self.CurRank
-			subDestIndex = ["tempIndex%i" % self.CurRank]
+			subDestIndex = ["0"] * self.CurRank + ["tempIndex%i" % self.CurRank]
 		else:
-			subDestIndex = ["row%i" % self.CurRank]
+			subDestIndex = destIndex + ["row%i" % self.CurRank]
 		subSourceIndex = sourceIndex + ["col%i" % self.CurRank]
 		subPotentialIndex = potentialIndex + ["i%i" % self.CurRank]
 
@@ -991,6 +943,9 @@ class SnippetGeneratorSimpleDistributed(SnippetGeneratorBase):
 
 class SnippetGeneratorBandedDistributed(SnippetGeneratorBase):
 	"""
+	Banded matrix distributed over the group communicator of this rank.
+	As for SnippetGeneratorSimpleDistributed, the temp arrays have size 1
+	in the ranks outside this one.
 	"""
 
 	def __init__(self, systemRank, curRank, innerGenerator):
@@ -1002,6 +957,7 @@ class SnippetGeneratorBandedDistributed(SnippetGeneratorBase):
 		parameterList += [("bands%i" % self.CurRank, "scalar", "integer")]
 		parameterList += [("recvTemp%i" % self.CurRank, "array", self.SystemRank, "complex (kind=dbl)")]
 		parameterList += [("sendTemp%i" % self.CurRank, "array", self.SystemRank, "complex (kind=dbl)")]
+		parameterList += [("communicator%i" % self.CurRank, "scalar", "integer")]
 		return parameterList
 
 	def GetParameterDeclarationCode(self):
@@ -1014,7 +970,7 @@ class SnippetGeneratorBandedDistributed(SnippetGeneratorBase):
 		str += GetFortranArrayDeclaration("recvTemp%i" % self.CurRank, self.SystemRank, "complex (kind=dbl)", "inout")
 		str += GetFortranArrayDeclaration("sendTemp%i" % self.CurRank, self.SystemRank, "complex (kind=dbl)", "inout")
 		str += """
-			integer, intent(in) :: globalSize%(rank)i, bands%(rank)i
+			integer, intent(in) :: globalSize%(rank)i, bands%(rank)i, communicator%(rank)i
 			integer :: i%(rank)i, row%(rank)i, col%(rank)i
 			
 			!temporary arrays TODO:FIX TEMPS <= FIXED :D
@@ -1036,7 +992,7 @@ class SnippetGeneratorBandedDistributed(SnippetGeneratorBase):
 			integer :: error%(rank)i, tag%(rank)i, sendSize%(rank)i 
 			integer :: recvRequest%(rank)i, sendRequest%(rank)i 
 			integer :: waitRecieve%(rank)i, waitSend%(rank)i
-			integer :: procId%(rank)i, procCount%(rank)i, communicator%(rank)i
+			integer :: procId%(rank)i, procCount%(rank)i
 		
 		 	!Indices for the recieved data
 		  	integer :: sourceRow%(rank)i, sourceGlobalStartIndex%(rank)i, sourceGlobalRow%(rank)i
@@ -1050,9 +1006,8 @@ class SnippetGeneratorBandedDistributed(SnippetGeneratorBase):
 
 	def GetInitializationCode(self):
 		str = """
-			call MPI_Comm_rank(MPI_COMM_WORLD, procId%(rank)i, error%(rank)i)
-			call MPI_Comm_size(MPI_COMM_WORLD, procCount%(rank)i, error%(rank)i)
-			communicator%(rank)i = MPI_COMM_WORLD
+			call MPI_Comm_rank(communicator%(rank)i, procId%(rank)i, error%(rank)i)
+			call MPI_Comm_size(communicator%(rank)i, procCount%(rank)i, error%(rank)i)
 
 			localSize%(rank)i = sourceExtent%(rank)i
 			globalStartIndex%(rank)i = GetLocalStartIndex(globalSize%(rank)i, procCount%(rank)i, procId%(rank)i)
@@ -1070,6 +1025,7 @@ class SnippetGeneratorBandedDistributed(SnippetGeneratorBase):
 
 	def GetLoopingCodeRecursive(self, conjugate, destName, destIndex, sourceName, sourceIndex, potentialName, potentialIndex):
 		innerRankCount = self.SystemRank - self.CurRank - 1
+		outerTempIndex = ["0"] * self.CurRank
 		str = ""
 		#If this is the innermost loop, we can optimize it by calling blas
 		str += """
@@ -1139,7 +1095,7 @@ class SnippetGeneratorBandedDistributed(SnippetGeneratorBase):
 				sourceProc%(rank)i = procId%(rank)i - deltaProc%(rank)i
 				
 				!Check if we're to recieve some data this interation
-				waitRecieve%(rank)i = %(rank)i
+				waitRecieve%(rank)i = 0
 				sourceGlobalStartIndex%(rank)i = GetLocalStartIndex(globalSize%(rank)i, procCount%(rank)i, sourceProc%(rank)i)
 				sourceGlobalRow%(rank)i = row%(rank)i + sourceGlobalStartIndex%(rank)i
 				if (0.le.sourceGlobalRow%(rank)i.and.sourceGlobalRow%(rank)i.lt.globalSize%(rank)i.and.0.le.sourceProc%(rank)i.and.sourceProc%(rank)i.lt.procCount%(rank)i.and.deltaProc%(rank)i.ne.0) then
@@ -1188,16 +1144,16 @@ class SnippetGeneratorBandedDistributed(SnippetGeneratorBase):
 				"potential": potentialName, \
 				"sourceDestIndex": self.GetIndexString( destIndex + ["sourceRow%i" % self.CurRank] + [":"] * innerRankCount ), \
 				"destIndex": self.GetIndexString( destIndex + ["row%i" % self.CurRank] + [":"] * innerRankCount ), \
-				"allSendTempIndex": self.GetIndexString( ["tempIndex%i" % self.CurRank] + [":"] * innerRankCount ), \
-				"allRecvTempIndex": self.GetIndexString( ["0"] + [":"] * innerRankCount ), \
-				"zeroSendTempIndex": self.GetIndexString( ["tempIndex%i" % self.CurRank] + ["0"] * innerRankCount ), \
+				"allSendTempIndex": self.GetIndexString( outerTempIndex + ["tempIndex%i" % self.CurRank] + [":"] * innerRankCount ), \
+				"allRecvTempIndex": self.GetIndexString( outerTempIndex + ["0"] + [":"] * innerRankCount ), \
+				"zeroSendTempIndex": self.GetIndexString( outerTempIndex + ["tempIndex%i" % self.CurRank] + ["0"] * innerRankCount ), \
 			}
 
 		return str
 
 	def GetInnerLoop(self, conjugate, destName, destIndex, sourceName, sourceIndex, potentialName, potentialIndex):
 		destName = "sendTemp%i" % self.CurRank
-		subDestIndex = ["tempIndex%i" % self.CurRank]
+		subDestIndex = ["0"] * self.CurRank + ["tempIndex%i" % self.CurRank]
 		subSourceIndex = sourceIndex + ["col%i" % self.CurRank]
 		subPotentialIndex = potentialIndex + ["i%i" % self.CurRank]
 
@@ -1488,6 +1444,7 @@ class TensorPotentialMultiplyGenerator(object):
 		void %(cMethodName)s(%(cParameterString)s)
 		{
 			%(wrapperBody)s
+			ReleaseGIL releaseGIL;
 			%(fortranMethodName)s(%(callString)s);
 		}
 		""" % locals()
@@ -1519,12 +1476,106 @@ class TensorPotentialMultiplyGenerator(object):
 	def GetBoostPythonCode(self):
 		return 'def("%(name)s", %(namespace)s::%(name)s_Wrapper);\n' % {"name": self.GetMethodName(), "namespace": "TensorPotential"}
 
+	def GetTermClassName(self):
+		signature = "_".join(self.StorageNameList)
+		return "TensorPotentialTerm_%s" % signature
+
+	def GetTermCode(self):
+		"""
+		Creates a HamiltonianTerm which binds the potential and the storage
+		specific arguments to the multiply function, so that the potential
+		can be applied from C++ (HamiltonianOperator) without going through
+		python for every matrix-vector product. The arrays are referenced,
+		not copied.
+		"""
+		systemRank = self.SystemRank
+		#potential, scaling, source and dest are the first four parameters
+		parameterList = self.GetParameterList()
+		boundParameterList = [parameterList[0]] + parameterList[4:]
+
+		memberDeclarations = ""
+		constructorParameters = []
+		constructorBody = ""
+		for param in boundParameterList:
+			paramName = param[0]
+			paramType = param[1]
+			if paramType == "array":
+				cType = "Array< %s, %i >" % (TypeMapFortranToC[param[3]], param[2])
+				constructorBody += "%s.reference(%s_);\n" % (paramName, paramName)
+			else:
+				cType = TypeMapFortranToC[param[2]]
+				constructorBody += "%s = %s_;\n" % (paramName, paramName)
+			memberDeclarations += "%s %s;\n" % (cType, paramName)
+			constructorParameters += ["%s %s_" % (cType, paramName)]
+		constructorParameterString = ", ".join(constructorParameters)
+		constructorArgumentString = ", ".join(["%s_" % param[0] for param in boundParameterList])
+
+		callString = ", ".join(["potential", "scaling", "source", "dest"] + [param[0] for param in boundParameterList[1:]])
+
+		className = self.GetTermClassName()
+		wrapperName = self.GetMethodName() + "_Wrapper"
+		str = """
+		class %(className)s : public HamiltonianTerm< %(systemRank)i >
+		{
+		public:
+			%(memberDeclarations)s
+			%(className)s(%(constructorParameterString)s)
+			{
+				%(constructorBody)s
+			}
+
+			virtual void Multiply(Array< cplx, %(systemRank)i > &source, Array< cplx, %(systemRank)i > &dest, double scaling)
+			{
+				%(wrapperName)s(%(callString)s);
+			}
+		};
+
+		HamiltonianTerm< %(systemRank)i >::Ptr Create%(className)s(%(constructorParameterString)s)
+		{
+			return HamiltonianTerm< %(systemRank)i >::Ptr(new %(className)s(%(constructorArgumentString)s));
+		}
+		""" % locals()
+
+		return PrettyPrintC(str)
+
+	def GetTermBoostPythonCode(self):
+		return 'def("%(name)s", %(namespace)s::Create%(name)s);\n' % {"name": self.GetTermClassName(), "namespace": "TensorPotential"}
+
+	def GetBenchmarkCode(self):
+		"""
+		Calls the wrapper if storage matches this storage combination, with
+		the arguments taken from the members of args by name. The storage
+		specific parameter <name><rank> is passed as args.<name>[rank]
+		"""
+		callList = []
+		for param in self.GetParameterList():
+			paramName = param[0]
+			baseName = paramName.rstrip("0123456789")
+			if baseName == paramName:
+				callList += ["args.%s" % paramName]
+			else:
+				callList += ["args.%s[%s]" % (baseName, paramName[len(baseName):])]
+		callString = ", ".join(callList)
+
+		signature = "_".join(self.StorageNameList)
+		wrapperName = self.GetMethodName() + "_Wrapper"
+		str = """
+		if (storage == "%(signature)s")
+		{
+			%(wrapperName)s(%(callString)s);
+			return true;
+		}
+		""" % locals()
+		return str
+
 def GetAllPermutations(systemRank, curRank):
 	if curRank == systemRank:
 		yield ()
 	else:
 		for key in snippetGeneratorMap.keys():
-			if (key != "Distr" and key != "SimpD") or curRank == 0:
+			#Distributed storages are allowed in the two outermost ranks,
+			#giving 1D and 2D proc grids
+			if (key != "Distr" and key != "SimpD") or curRank <= 1:
 				if (key == "Ident" or key == "Band" or key == "BandNH" or key == "Dense" or key == "Distr") or systemRank < 4:
 					for subperm in GetAllPermutations(systemRank, curRank+1):
 						yield (key,) +  subperm
@@ -1665,7 +1716,9 @@ def PrintWrapperCode():
 
 	#include "../common.h"
 	#include "../utility/fortran.h"
+	#include "../utility/gilrelease.h"
 	#include "tensorpotentialmultiply_wrapper.h"
+	#include "hamiltonianoperator.h"
 
 	namespace TensorPotential
 	{
@@ -1677,6 +1730,9 @@ def PrintWrapperCode():
 	for generator in generatorPermutationList :
 		str += generator.GetWrapperCode()
 
+	for generator in generatorPermutationList :
+		str += generator.GetTermCode()
+
 	str += """
 	void export_tensorpotentialmultiply()
 	{
@@ -1684,7 +1740,7 @@ def PrintWrapperCode():
 	}
 
 	} //namespace
-	""" % {"exportCode": "".join([g.GetBoostPythonCode() for g in generatorPermutationList]) }
+	""" % {"exportCode": "".join([g.GetBoostPythonCode() + g.GetTermBoostPythonCode() for g in generatorPermutationList]) }
 
 	print PrettyPrintC(str)
 
@@ -1713,6 +1769,46 @@ def PrintWrapperHeader():
 
 	print PrettyPrintC(str)
 
+def PrintBenchmarkCode(systemRank):
+	"""
+	Prints the list of all storage combinations of systemRank, and a function
+	calling the multiply routine of a combination by name. Used by the kernel
+	benchmarks in core/tests/benchmark/kernels
+	"""
+	generatorList = [g for g in generatorPermutationList if g.SystemRank == systemRank]
+	storageList = ", ".join(['"%s"' % "_".join(g.StorageNameList) for g in generatorList])
+
+	str = """
+	#ifndef TENSORPOTENTIALMULTIPLY_BENCHMARK_H
+	#define TENSORPOTENTIALMULTIPLY_BENCHMARK_H
+
+	#include <core/common.h>
+	#include <core/tensorpotential/tensorpotentialmultiply_wrapper.h>
+
+	namespace TensorPotential
+	{
+
+	const char* const BenchmarkStorageList[] = { %(storageList)s };
+	const int BenchmarkStorageCount = %(storageCount)i;
+
+	template<class ArgumentType>
+	bool BenchmarkMultiply(const std::string &storage, ArgumentType &args)
+	{
+	""" % {"storageList": storageList, "storageCount": len(generatorList)}
+
+	for generator in generatorList:
+		str += generator.GetBenchmarkCode()
+
+	str += """
+		return false;
+	}
+
+	}
+	#endif
+	"""
+
+	print PrettyPrintC(str)
+
 generatorPermutationList = []
 for systemRank in range(1,4+1):
 	for perm in GetAllPermutations(systemRank, 0):
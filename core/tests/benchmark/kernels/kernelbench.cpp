@@ -0,0 +1,1014 @@
+/*
+ * Benchmark suite for the core numerical kernels.
+ *
+ * Usage: mpirun -np <procs> ./kernelbench [output.csv] [peak GFLOP/s] [size scaling]
+ *
+ * Each kernel is timed in isolation on synthetic data of a size typical for
+ * production runs, and the result is reported as GB/s and GFLOP/s together
+ * with the fraction of the STREAM triad bandwidth and the roofline bound
+ * that is attained. The results of proc 0 are written as CSV to output.csv
+ * (default kernelbench.csv) in order to track regressions between commits.
+ *
+ * Bytes and flops are the minimal theoretical counts for one call, not
+ * hardware counter values. For FFTs the usual 5 N log2(N) estimate is used.
+ */
+
+#include <core/common.h>
+#include <core/utility/blitzblas.h>
+#include <core/utility/blitzlapack.h>
+#include <core/utility/blitztricks.h>
+#include <core/transform/fouriertransform.h>
+#include <core/transform/spherical/shtools.h>
+#include <core/transform/reducedspherical/reducedsphericaltools.h>
+#include <core/representation/overlapmatrix.h>
+#include <core/mpi/blitztranspose.h>
+#include <core/tensorpotential/tensorpotentialmultiply_wrapper.h>
+#include <core/tensorpotential/blocksparsepotential.h>
+#include "tensorpotentialmultiply_benchmark.h"
+#include <core/krylov/pamp/pamp/pamp.h>
+
+#include "roofline.h"
+
+using namespace blitz;
+using namespace Roofline;
+
+/*
+ * Helpers
+ */
+template<int Rank>
+std::string ShapeString(const TinyVector<int, Rank> &shape)
+{
+	std::string str = "";
+	for (int i=0; i<Rank; i++)
+	{
+		if (i > 0) str += "x";
+		str += ToString(shape(i));
+	}
+	return str;
+}
+
+template<int Rank>
+void FillRandom(Array<cplx, Rank> &data)
+{
+	cplx* ptr = data.data();
+	for (int i=0; i<data.size(); i++)
+	{
+		ptr[i] = cplx(std::rand() / (double)RAND_MAX, std::rand() / (double)RAND_MAX);
+	}
+}
+
+const double BytesPerComplex = sizeof(cplx);
+
+/*
+ * Positive definite banded matrix, used both as overlap matrix and
+ * as a model of the b-spline hamiltonian
+ */
+class BenchmarkOverlapEvaluator : public OverlapMatrixEvaluator
+{
+public:
+	BenchmarkOverlapEvaluator(int superDiagonals) : SuperDiagonals(superDiagonals) {}
+	virtual ~BenchmarkOverlapEvaluator() {}
+
+	virtual double operator()(int row, int col) const
+	{
+		int distance = std::abs(row - col);
+		if (distance > SuperDiagonals)
+		{
+			return 0;
+		}
+		return distance == 0 ? 1.0 : 0.1 / (distance + 1.0);
+	}
+
+private:
+	int SuperDiagonals;
+};
+
+/*
+ * Banded hermitian matrix in the blas (zhbmv) storage used by
+ * MatrixVectorMultiplyHermitianBanded
+ */
+Array<cplx, 2> CreateHermitianBandedBlas(int size, int superDiagonals)
+{
+	Array<cplx, 2> matrix(size, superDiagonals+1);
+	matrix = 0;
+	for (int i=0; i<size; i++)
+	{
+		matrix(i, 0) = 2.0;
+		for (int j=1; j<=superDiagonals && i+j<size; j++)
+		{
+			matrix(i, j) = cplx(-0.5 / j, 0.01 * j);
+		}
+	}
+	return matrix;
+}
+
+
+/*
+ * Kernels. Each kernel is a functor which performs one call of the
+ * kernel under test when called, and knows its own memory traffic and
+ * flop count.
+ */
+template<int Rank>
+class FftKernel
+{
+public:
+	enum Algorithm { AlgoRank = 0, AlgoPositive = 1, AlgoNegative = 2 };
+
+	Array<cplx, Rank> Data;
+	int TransformRank;
+	int Algo;
+
+	FftKernel(TinyVector<int, Rank> shape, int transformRank, int algo) : Data(shape), TransformRank(transformRank), Algo(algo)
+	{
+		FillRandom(Data);
+	}
+
+	void operator()()
+	{
+		if (Algo == AlgoRank) FftRank(Data, TransformRank, FFT_FORWARD);
+		else if (Algo == AlgoPositive) FftRankPositive(Data, TransformRank, FFT_FORWARD);
+		else FftRankNegative(Data, TransformRank, FFT_FORWARD);
+	}
+
+	double Bytes() { return 2 * BytesPerComplex * Data.size(); }
+	double Flops()
+	{
+		double n = Data.extent(TransformRank);
+		return 5.0 * Data.size() * std::log(n) / std::log(2.0);
+	}
+};
+
+
+class SphericalTransformKernel
+{
+public:
+	SphericalTransformTensorGrid Transform;
+	Array<cplx, 3> Grid;
+	Array<cplx, 3> Coefficients;
+	bool Forward;
+	int LMax;
+
+	SphericalTransformKernel(int radialCount, int lmax, bool forward) : Forward(forward), LMax(lmax)
+	{
+		Transform.Initialize(lmax);
+		int omegaCount = Transform.GetOmegaGrid().extent(0);
+		Grid.resize(radialCount, omegaCount, 1);
+		Coefficients.resize(radialCount, omegaCount, 1);
+		FillRandom(Grid);
+		FillRandom(Coefficients);
+	}
+
+	void operator()()
+	{
+		if (Forward) Transform.ForwardTransform(Grid, Coefficients, 1);
+		else Transform.InverseTransform(Coefficients, Grid, 1);
+	}
+
+	double Bytes() { return 2 * BytesPerComplex * Grid.size() + sizeof(double) * Transform.GetAssociatedLegendrePolynomial().size(); }
+	double Flops()
+	{
+		//phi fft + legendre transform (one real * complex mult-add per (theta, l, m))
+		double thetaCount = Transform.GetThetaGrid().extent(0);
+		double phiCount = Transform.GetPhiGrid().extent(0);
+		double lmCount = (LMax + 1.0) * (LMax + 1.0);
+		double fftFlops = 5.0 * Grid.size() * std::log(phiCount) / std::log(2.0);
+		return fftFlops + 4.0 * Grid.extent(0) * thetaCount * lmCount;
+	}
+};
+
+
+class ReducedSphericalKernel
+{
+public:
+	ReducedSpherical::ReducedSphericalTools Transform;
+	Array<cplx, 3> Grid;
+	Array<cplx, 3> Coefficients;
+	bool Forward;
+
+	ReducedSphericalKernel(int preCount, int lmax, int postCount, int algorithm, bool forward) : Forward(forward)
+	{
+		Transform.Initialize(lmax);
+		Transform.Algorithm = algorithm;
+		int thetaCount = Transform.GetThetaGrid().extent(0);
+		Grid.resize(preCount, thetaCount, postCount);
+		Coefficients.resize(preCount, thetaCount, postCount);
+		FillRandom(Grid);
+		FillRandom(Coefficients);
+	}
+
+	void operator()()
+	{
+		if (Forward) Transform.ForwardTransform(Grid, Coefficients, 1);
+		else Transform.InverseTransform(Coefficients, Grid, 1);
+	}
+
+	/*
+	 * Runs this kernel and reference once on the input of reference, and
+	 * returns the max norm of the difference of the outputs relative to
+	 * the max norm of the output of reference
+	 */
+	double GetRelativeError(ReducedSphericalKernel &reference)
+	{
+		Grid = reference.Grid;
+		Coefficients = reference.Coefficients;
+		reference();
+		(*this)();
+
+		Array<cplx, 3> output = Forward ? Coefficients : Grid;
+		Array<cplx, 3> referenceOutput = Forward ? reference.Coefficients : reference.Grid;
+		return max(abs(output - referenceOutput)) / max(abs(referenceOutput));
+	}
+
+	double Bytes() { return 2 * BytesPerComplex * Grid.size() + sizeof(double) * Transform.GetAssociatedLegendrePolynomial().size(); }
+	double Flops()
+	{
+		//Dense real (theta x l) matrix applied to every complex pre/post vector
+		double thetaCount = Grid.extent(1);
+		return 4.0 * thetaCount * Grid.size();
+	}
+};
+
+
+class TransposeKernel
+{
+public:
+	typedef ArrayTranspose<3> TransposeType;
+	TransposeType Transpose;
+	TinyVector<int, 3> FullShape;
+	TransposeType::ProcVector InDistrib;
+	TransposeType::ProcVector OutDistrib;
+	Array<cplx, 3> InData;
+	Array<cplx, 3> OutData;
+
+	TransposeKernel(TinyVector<int, 3> fullShape) : Transpose(1), FullShape(fullShape)
+	{
+		InDistrib.resize(1);
+		OutDistrib.resize(1);
+		InDistrib = 0;
+		OutDistrib = 1;
+		InData.resize(Transpose.CreateDistributedShape(FullShape, InDistrib));
+		OutData.resize(Transpose.CreateDistributedShape(FullShape, OutDistrib));
+		FillRandom(InData);
+	}
+
+	void operator()()
+	{
+		Transpose.Transpose(FullShape, InData, InDistrib, OutData, OutDistrib);
+	}
+
+	//Local pack + unpack; the network traffic is reported through the GB/s figure
+	double Bytes() { return 2 * BytesPerComplex * (InData.size() + OutData.size()); }
+	double Flops() { return 0; }
+};
+
+
+/*
+ * Arguments of the generated tensor potential multiply routines, with the
+ * names of the parameters in tensorpotentialmultiply_generator.py, which
+ * generates the calls (tensorpotentialmultiply_benchmark.h). The storage
+ * specific arguments are indexed by rank.
+ */
+struct TensorPotentialArguments
+{
+	Array<cplx, 3> potential;
+	double scaling;
+	Array<cplx, 3> source;
+	Array<cplx, 3> dest;
+
+	//Simp, Herm
+	std::vector< Array<int, 2> > pair;
+
+	//Distr, SimpD
+	std::vector<int> globalSize;
+	std::vector<int> communicator;
+	std::vector< Array<cplx, 3> > recvTemp;
+	std::vector< Array<cplx, 3> > sendTemp;
+
+	//Distr
+	std::vector<int> bands;
+
+	//SimpD
+	std::vector< Array<int, 1> > globalRow;
+	std::vector< Array<int, 1> > globalCol;
+	std::vector< Array<int, 1> > sendSlot;
+	std::vector< Array<int, 1> > sendProcList;
+	std::vector< Array<int, 1> > sendOffset;
+	std::vector< Array<int, 1> > recvProcList;
+	std::vector< Array<int, 1> > recvOffset;
+	std::vector< Array<int, 1> > recvLocalRow;
+	std::vector<int> globalStartIndex;
+
+	TensorPotentialArguments() : scaling(1.0), pair(3), globalSize(3), communicator(3), recvTemp(3), sendTemp(3),
+		bands(3), globalRow(3), globalCol(3), sendSlot(3), sendProcList(3), sendOffset(3), recvProcList(3),
+		recvOffset(3), recvLocalRow(3), globalStartIndex(3) {}
+};
+
+/*
+ * One storage combination of the generated tensor potential multiply
+ * routines, e.g. "Simp_Band_Band". Simple and hermitian storage use the
+ * typical l -> l, l+-1 coupling, banded storage superDiagonals bands.
+ * The distributed storages (Distr, SimpD) are set up for one proc on
+ * MPI_COMM_SELF, and measure the local part of the kernel.
+ */
+class TensorPotentialKernel
+{
+public:
+	std::string Storage;
+	TensorPotentialArguments Args;
+	int SuperDiagonals;
+	double NonZeros;
+
+	TensorPotentialKernel(const std::string &storage, TinyVector<int, 3> shape, int superDiagonals) : Storage(storage), SuperDiagonals(superDiagonals)
+	{
+		std::vector<std::string> rankStorage = SplitStorage(storage);
+
+		Args.source.resize(shape);
+		Args.dest.resize(shape);
+		FillRandom(Args.source);
+		Args.dest = 0;
+
+		TinyVector<int, 3> potentialShape;
+		NonZeros = 1;
+		for (int rank=0; rank<3; rank++)
+		{
+			potentialShape(rank) = SetupRank(rank, rankStorage[rank], shape);
+			NonZeros *= GetNonZeroCount(rankStorage[rank], shape(rank), potentialShape(rank));
+		}
+		Args.potential.resize(potentialShape);
+		FillRandom(Args.potential);
+	}
+
+	static std::vector<std::string> SplitStorage(const std::string &storage)
+	{
+		std::vector<std::string> rankStorage;
+		size_t start = 0;
+		for (int rank=0; rank<3; rank++)
+		{
+			size_t end = storage.find('_', start);
+			rankStorage.push_back(storage.substr(start, end - start));
+			start = end + 1;
+		}
+		return rankStorage;
+	}
+
+	/*
+	 * Returns the size of the potential in rank for a given storage
+	 * and basis size, i.e. the extent of the potential in that rank
+	 */
+	static int GetPotentialExtent(const std::string &storage, int size, int superDiagonals)
+	{
+		if (storage == "Ident") return 1;
+		if (storage == "Diag") return size;
+		if (storage == "Simp" || storage == "SimpD") return 3*size - 2;
+		if (storage == "Herm") return 2*size - 1;
+		if (storage == "Band") return size * (superDiagonals + 1);
+		if (storage == "BandNH" || storage == "Distr") return size * (2*superDiagonals + 1);
+		if (storage == "Dense") return size * size;
+		throw std::runtime_error("Unknown tensor potential storage " + storage);
+	}
+
+	/*
+	 * Number of (row, col) products per source element in rank
+	 */
+	static double GetNonZeroCount(const std::string &storage, int size, int potentialExtent)
+	{
+		if (storage == "Herm") return 2.0 * potentialExtent - size;
+		if (storage == "Band") return 2.0 * potentialExtent - size;
+		if (storage == "Ident") return size;
+		return potentialExtent;
+	}
+
+	/*
+	 * Tridiagonal index pairs, only the upper part if hermitian
+	 */
+	static Array<int, 2> CreatePairs(int size, bool hermitian)
+	{
+		std::vector<int> rows, cols;
+		for (int i=0; i<size; i++)
+		{
+			for (int j=hermitian ? i : std::max(0, i-1); j<=std::min(size-1, i+1); j++)
+			{
+				rows.push_back(i);
+				cols.push_back(j);
+			}
+		}
+		Array<int, 2> pairs(rows.size(), 2);
+		for (int i=0; i<(int)rows.size(); i++)
+		{
+			pairs(i, 0) = rows[i];
+			pairs(i, 1) = cols[i];
+		}
+		return pairs;
+	}
+
+	/*
+	 * Temp array holding one slice of the ranks before rank, with
+	 * tempCount elements in rank
+	 */
+	static Array<cplx, 3> CreateTemp(TinyVector<int, 3> shape, int rank, int tempCount)
+	{
+		TinyVector<int, 3> tempShape = shape;
+		for (int i=0; i<rank; i++)
+		{
+			tempShape(i) = 1;
+		}
+		tempShape(rank) = tempCount;
+		Array<cplx, 3> temp(tempShape);
+		temp = 0;
+		return temp;
+	}
+
+	int SetupRank(int rank, const std::string &storage, TinyVector<int, 3> shape)
+	{
+		int size = shape(rank);
+		int communicator = MPI_Comm_c2f(MPI_COMM_SELF);
+		if (storage == "Simp" || storage == "Herm")
+		{
+			Args.pair[rank].reference(CreatePairs(size, storage == "Herm"));
+		}
+		else if (storage == "Distr")
+		{
+			Args.globalSize[rank] = size;
+			Args.bands[rank] = SuperDiagonals;
+			Args.recvTemp[rank].reference(CreateTemp(shape, rank, 1));
+			Args.sendTemp[rank].reference(CreateTemp(shape, rank, 2));
+			Args.communicator[rank] = communicator;
+		}
+		else if (storage == "SimpD")
+		{
+			//Every row is local, so nothing is sent or recieved
+			Array<int, 2> pairs = CreatePairs(size, false);
+			int pairCount = pairs.extent(0);
+			Args.globalSize[rank] = size;
+			Args.globalRow[rank].resize(pairCount);
+			Args.globalRow[rank] = pairs(Range::all(), 0);
+			Args.globalCol[rank].resize(pairCount);
+			Args.globalCol[rank] = pairs(Range::all(), 1);
+			Args.sendSlot[rank].resize(pairCount);
+			Args.sendSlot[rank] = -1;
+			Args.sendProcList[rank].resize(0);
+			Args.sendOffset[rank].resize(1);
+			Args.sendOffset[rank] = 0;
+			Args.recvProcList[rank].resize(0);
+			Args.recvOffset[rank].resize(1);
+			Args.recvOffset[rank] = 0;
+			Args.recvLocalRow[rank].resize(0);
+			Args.recvTemp[rank].reference(CreateTemp(shape, rank, 1));
+			Args.sendTemp[rank].reference(CreateTemp(shape, rank, 1));
+			Args.globalStartIndex[rank] = 0;
+			Args.communicator[rank] = communicator;
+		}
+		return GetPotentialExtent(storage, size, SuperDiagonals);
+	}
+
+	void operator()()
+	{
+		if (!TensorPotential::BenchmarkMultiply(Storage, Args))
+		{
+			throw std::runtime_error("Unknown tensor potential storage " + Storage);
+		}
+	}
+
+	//Potential is read once, source read and dest read+written once
+	double Bytes() { return BytesPerComplex * (Args.potential.size() + Args.source.size() + 2 * Args.dest.size()); }
+	double Flops() { return 8.0 * NonZeros; }
+};
+
+/*
+ * Shape (angularCount, n, n) for a storage combination, with n at most
+ * radialCount and small enough that the potential has at most
+ * maxPotentialSize elements
+ */
+TinyVector<int, 3> GetTensorPotentialShape(const std::string &storage, int angularCount, int radialCount, int superDiagonals, double maxPotentialSize)
+{
+	std::vector<std::string> rankStorage = TensorPotentialKernel::SplitStorage(storage);
+	TinyVector<int, 3> shape(angularCount, radialCount, radialCount);
+	while (true)
+	{
+		double potentialSize = 1;
+		for (int rank=0; rank<3; rank++)
+		{
+			potentialSize *= TensorPotentialKernel::GetPotentialExtent(rankStorage[rank], shape(rank), superDiagonals);
+		}
+		if (potentialSize <= maxPotentialSize || shape(1) <= superDiagonals + 1)
+		{
+			return shape;
+		}
+		shape(1) = std::max(superDiagonals + 1, shape(1) * 3 / 4);
+		shape(2) = shape(1);
+	}
+}
+
+
+/*
+ * BlockSparsePotential with the tridiagonal blocks of the Simp storage
+ * in the first rank, and storage ("Band_Band" or "Dense_Ident") in the
+ * remaining ranks. The blocks are applied by looping over the entries,
+ * or with the BLAS kernels if useBlas is set
+ */
+class BlockSparseKernel
+{
+public:
+	BlockSparsePotential<3> Potential;
+	Array<cplx, 3> PotentialData;
+	Array<cplx, 3> Source;
+	Array<cplx, 3> Dest;
+	double NonZeros;
+
+	BlockSparseKernel(const std::string &storage, TinyVector<int, 3> shape, int superDiagonals, bool useBlas)
+	{
+		std::vector<std::string> rankStorage = TensorPotentialKernel::SplitStorage("Simp_" + storage);
+		Array<int, 2> pairs = TensorPotentialKernel::CreatePairs(shape(0), false);
+
+		TinyVector<int, 3> potentialShape;
+		potentialShape(0) = pairs.extent(0);
+		std::vector< Array<int, 2> > entries(3);
+		NonZeros = pairs.extent(0);
+		for (int rank=1; rank<3; rank++)
+		{
+			potentialShape(rank) = TensorPotentialKernel::GetPotentialExtent(rankStorage[rank], shape(rank), superDiagonals);
+			entries[rank].reference(CreateEntries(rankStorage[rank], shape(rank), superDiagonals));
+			NonZeros *= entries[rank].extent(0);
+		}
+
+		//Radial matrix elements have a real diagonal
+		PotentialData.resize(potentialShape);
+		FillRandom(PotentialData);
+		if (rankStorage[2] == "Band")
+		{
+			for (int i=0; i<potentialShape(0); i++)
+			{
+				for (int j=0; j<potentialShape(1); j++)
+				{
+					for (int k=0; k<potentialShape(2); k+=superDiagonals+1)
+					{
+						PotentialData(i, j, k) = real(PotentialData(i, j, k));
+					}
+				}
+			}
+		}
+
+		Potential.SetPotential(PotentialData, pairs);
+		for (int rank=1; rank<3; rank++)
+		{
+			Potential.SetRankEntries(rank, entries[rank]);
+		}
+		Potential.SetUseBlas(useBlas);
+
+		Source.resize(shape);
+		Dest.resize(shape);
+		FillRandom(Source);
+		Dest = 0;
+	}
+
+	/*
+	 * Entries of a rank, as GetBlockSparseRankEntries in TensorPotential.py
+	 */
+	static Array<int, 2> CreateEntries(const std::string &storage, int size, int superDiagonals)
+	{
+		std::vector< TinyVector<int, 4> > entries;
+		for (int row=0; row<size; row++)
+		{
+			for (int col=0; col<size; col++)
+			{
+				if (storage == "Ident" && row == col)
+				{
+					entries.push_back(TinyVector<int, 4>(row, col, 0, 0));
+				}
+				else if (storage == "Dense")
+				{
+					entries.push_back(TinyVector<int, 4>(row, col, row * size + col, 0));
+				}
+				else if (storage == "Band" && std::abs(row - col) <= superDiagonals)
+				{
+					int first = std::min(row, col);
+					int index = first * (superDiagonals + 1) + std::abs(row - col);
+					entries.push_back(TinyVector<int, 4>(row, col, index, row > col ? 1 : 0));
+				}
+			}
+		}
+
+		Array<int, 2> entryArray(entries.size(), 4);
+		for (int i=0; i<(int)entries.size(); i++)
+		{
+			for (int j=0; j<4; j++)
+			{
+				entryArray(i, j) = entries[i](j);
+			}
+		}
+		return entryArray;
+	}
+
+	void operator()()
+	{
+		Potential.Multiply(Source, Dest, 1.0);
+	}
+
+	/*
+	 * Runs this kernel and reference once on the potential and source of
+	 * reference, and returns the max norm of the difference of the results
+	 * relative to the max norm of the result of reference
+	 */
+	double GetRelativeError(BlockSparseKernel &reference)
+	{
+		PotentialData = reference.PotentialData;
+		Source = reference.Source;
+		reference.Dest = 0;
+		Dest = 0;
+		reference();
+		(*this)();
+		return max(abs(Dest - reference.Dest)) / max(abs(reference.Dest));
+	}
+
+	double Bytes() { return BytesPerComplex * (PotentialData.size() + Source.size() + 2 * Dest.size()); }
+	double Flops() { return 8.0 * NonZeros; }
+};
+
+
+class OverlapKernel
+{
+public:
+	OverlapMatrix::Ptr Overlap;
+	OverlapMatrix::TensorType Data;
+	OverlapMatrix::TensorType Temp;
+	bool Solve;
+	int SuperDiagonals;
+
+	OverlapKernel(int preCount, int basisSize, int postCount, int superDiagonals, bool solve) : Solve(solve), SuperDiagonals(superDiagonals)
+	{
+		Overlap = OverlapMatrix::Ptr(new OverlapMatrix(basisSize, superDiagonals, BenchmarkOverlapEvaluator(superDiagonals)));
+		Data.resize(preCount, basisSize, postCount);
+		Temp.resize(Data.shape());
+		FillRandom(Data);
+	}
+
+	void operator()()
+	{
+		if (Solve) Overlap->SolveOverlapTensor(Data);
+		else Overlap->MultiplyOverlapTensor(Data, Temp);
+	}
+
+	double Bytes() { return 2 * BytesPerComplex * Data.size(); }
+	double Flops()
+	{
+		//Cholesky solve is one forward and one backward banded substitution
+		//with real factors, the multiply is a banded real * complex product
+		return 4.0 * (2 * SuperDiagonals + 1) * Data.size();
+	}
+};
+
+
+/*
+ * The Crank-Nicolson step of BSpline::Propagator (PropagationAlgorithm 0/1):
+ * banded hermitian multiply with S - i dt/2 H followed by a banded LU solve
+ * with S + i dt/2 H for every vector along the b-spline rank. The b-spline
+ * object itself is set up from python, so we use a model matrix with the
+ * same band structure (2k-1 bands).
+ */
+class BSplinePropagationKernel
+{
+public:
+	Array<cplx, 3> Data;
+	Array<cplx, 2> HamiltonianBlas;
+	Array<cplx, 2> OverlapBlas;
+	Array<cplx, 2> PropagationLU;
+	Array<int, 1> Pivots;
+	Array<cplx, 1> Temp;
+	int SuperDiagonals;
+	cplx Scaling;
+
+	BSplinePropagationKernel(int preCount, int basisSize, int postCount, int superDiagonals) : SuperDiagonals(superDiagonals)
+	{
+		linalg::LAPACK<cplx> lapack;
+
+		Data.resize(preCount, basisSize, postCount);
+		FillRandom(Data);
+		Temp.resize(basisSize);
+		Scaling = -I * 0.01 / 2.0;
+
+		HamiltonianBlas.reference(CreateHermitianBandedBlas(basisSize, superDiagonals));
+		OverlapBlas.resize(basisSize, superDiagonals+1);
+		OverlapBlas = 0;
+		BenchmarkOverlapEvaluator overlap(superDiagonals);
+		for (int i=0; i<basisSize; i++)
+		{
+			for (int j=0; j<=superDiagonals && i+j<basisSize; j++)
+			{
+				OverlapBlas(i, j) = overlap(i, i+j);
+			}
+		}
+
+		//LAPACK general banded storage of S + i dt/2 H with room for the LU fill-in
+		int k = superDiagonals;
+		PropagationLU.resize(basisSize, 3*k + 1);
+		PropagationLU = 0;
+		for (int col=0; col<basisSize; col++)
+		{
+			for (int row=std::max(0, col-k); row<=std::min(basisSize-1, col+k); row++)
+			{
+				int lower = std::min(row, col);
+				int upper = std::max(row, col);
+				cplx h = HamiltonianBlas(lower, upper - lower);
+				cplx s = OverlapBlas(lower, upper - lower);
+				if (row < col) h = conj(h);
+				PropagationLU(col, 2*k + row - col) = s - Scaling * h;
+			}
+		}
+		Pivots.resize(basisSize);
+		lapack.CalculateLUFactorizationBanded(PropagationLU, Pivots);
+	}
+
+	void operator()()
+	{
+		linalg::LAPACK<cplx> lapack;
+		for (int i=0; i<Data.extent(0); i++)
+		{
+			for (int j=0; j<Data.extent(2); j++)
+			{
+				Array<cplx, 1> v = Data(i, Range::all(), j);
+				Temp = v;
+				MatrixVectorMultiplyHermitianBanded(HamiltonianBlas, Temp, v, Scaling, 0.0);
+				MatrixVectorMultiplyHermitianBanded(OverlapBlas, Temp, v, 1.0, 1.0);
+				Temp = v;
+				lapack.SolveBandedFactored(PropagationLU, Pivots, Temp);
+				v = Temp;
+			}
+		}
+	}
+
+	double Bytes() { return 2 * BytesPerComplex * Data.size(); }
+	double Flops()
+	{
+		//two hermitian banded products and one LU solve (forward + backward)
+		double bands = 2.0 * SuperDiagonals + 1;
+		return 8.0 * Data.size() * (2 * bands + 2 * bands);
+	}
+};
+
+
+/*
+ * One pAMP propagation step with a banded hermitian model hamiltonian.
+ * The operator is applied without the python callback, so this measures
+ * the overhead of the Arnoldi iteration and exponentiation itself.
+ */
+class BandedOperatorFunctor : public piram::OperatorFunctor<cplx>
+{
+public:
+	Array<cplx, 2> Matrix;
+
+	BandedOperatorFunctor(int size, int superDiagonals)
+	{
+		Matrix.reference(CreateHermitianBandedBlas(size, superDiagonals));
+	}
+	virtual ~BandedOperatorFunctor() {}
+
+	virtual void operator()(Array<cplx, 1> &in, Array<cplx, 1> &out)
+	{
+		MatrixVectorMultiplyHermitianBanded(Matrix, in, out, 1.0, 0.0);
+	}
+};
+
+class PampKernel
+{
+public:
+	pamp::pAMP<cplx> Propagator;
+	Array<cplx, 1> Psi;
+	int SuperDiagonals;
+
+	PampKernel(int size, int basisSize, int superDiagonals) : SuperDiagonals(superDiagonals)
+	{
+		Propagator.MatrixSize = size;
+		Propagator.BasisSize = basisSize;
+		Propagator.DisableMPI = true;
+		Propagator.MatrixOperator = piram::OperatorFunctor<cplx>::Ptr(new BandedOperatorFunctor(size, superDiagonals));
+		Propagator.Setup();
+
+		Psi.resize(size);
+		FillRandom(Psi);
+	}
+
+	void operator()()
+	{
+		Propagator.PropagateVector(Psi, 0.01);
+	}
+
+	/*
+	 * Arnoldi step j does one matvec, and orthogonalizes against j vectors
+	 * (j inner products and j axpys), finally the basis is combined into psi
+	 */
+	double Bytes()
+	{
+		double m = Propagator.BasisSize;
+		double n = Psi.size();
+		double matvec = BytesPerComplex * (2*n + n * (SuperDiagonals + 1));
+		return m * matvec + BytesPerComplex * n * (m * (m + 1) + m);
+	}
+
+	double Flops()
+	{
+		double m = Propagator.BasisSize;
+		double n = Psi.size();
+		double matvec = 8.0 * n * (2 * SuperDiagonals + 1);
+		return m * matvec + 8.0 * n * (m * (m + 1) + m);
+	}
+};
+
+
+/*
+ * Driver
+ */
+class BenchmarkRunner
+{
+public:
+	Report &Results;
+	int ProcId;
+
+	BenchmarkRunner(Report &results, int procId) : Results(results), ProcId(procId) {}
+
+	template<class KernelType>
+	void Run(const std::string &name, const std::string &shape, KernelType &kernel)
+	{
+		KernelResult result;
+		result.Name = name;
+		result.Shape = shape;
+		result.Time = TimeKernel(kernel, result.Repeats);
+		result.Bytes = kernel.Bytes();
+		result.Flops = kernel.Flops();
+		if (ProcId == 0)
+		{
+			Results.Add(result);
+		}
+	}
+};
+
+
+int main(int argc, char* argv[])
+{
+	MPI_Init(&argc, &argv);
+
+	int procId, procCount;
+	MPI_Comm_rank(MPI_COMM_WORLD, &procId);
+	MPI_Comm_size(MPI_COMM_WORLD, &procCount);
+
+	std::string outputFile = "kernelbench.csv";
+	double peakFlopRate = 0;
+	double scale = 1.0;
+	if (argc > 1) outputFile = argv[1];
+	if (argc > 2) peakFlopRate = std::atof(argv[2]);
+	if (argc > 3) scale = std::atof(argv[3]);
+
+	//Problem sizes
+	int fftSize = (int)(128 * scale);
+	int radialCount = (int)(400 * scale);
+	int lmax = 32;
+	int bsplineCount = (int)(200 * scale);
+	int superDiagonals = 7;
+	int angularCount = 32;
+	double maxPotentialSize = 16.0 * 1024 * 1024 * scale;
+
+	//STREAM with arrays much larger than the last level cache
+	double streamBandwidth = MeasureStreamBandwidth(20 * 1024 * 1024);
+
+	Report report(streamBandwidth, peakFlopRate);
+	if (procId == 0)
+	{
+		cout << "Running kernel benchmarks on " << procCount << " procs" << endl;
+		report.PrintHeader();
+	}
+	BenchmarkRunner runner(report, procId);
+
+	//Fourier transforms
+	{
+		TinyVector<int, 3> shape(fftSize, fftSize, fftSize);
+		for (int rank=0; rank<3; rank++)
+		{
+			FftKernel<3> fftRank(shape, rank, FftKernel<3>::AlgoRank);
+			runner.Run("FftRank_" + ToString(rank), ShapeString(shape), fftRank);
+		}
+		FftKernel<3> fftPositive(shape, 1, FftKernel<3>::AlgoPositive);
+		runner.Run("FftRankPositive_1", ShapeString(shape), fftPositive);
+		FftKernel<3> fftNegative(shape, 1, FftKernel<3>::AlgoNegative);
+		runner.Run("FftRankNegative_1", ShapeString(shape), fftNegative);
+	}
+
+	//Spherical harmonic transforms
+	{
+		SphericalTransformKernel forward(radialCount, lmax, true);
+		runner.Run("SphericalTransform_Forward", ShapeString(forward.Grid.shape()), forward);
+		SphericalTransformKernel inverse(radialCount, lmax, false);
+		runner.Run("SphericalTransform_Inverse", ShapeString(inverse.Grid.shape()), inverse);
+	}
+
+	//Reduced spherical transforms for the l-rank first and l-rank last
+	//layouts. Algorithms 1-3 map the transform to rank 2, and are only
+	//valid when the l-rank is last. Every algorithm is checked against
+	//algorithm 0 before it is timed
+	{
+		for (int lFirst=1; lFirst>=0; lFirst--)
+		{
+			int preCount = lFirst ? 1 : radialCount;
+			int postCount = lFirst ? radialCount : 1;
+			std::string layout = lFirst ? "LFirst" : "LLast";
+			for (int forward=1; forward>=0; forward--)
+			{
+				std::string direction = forward ? "Forward" : "Inverse";
+				ReducedSphericalKernel reference(preCount, lmax, postCount, 0, forward);
+				for (int algo=0; algo<=4; algo++)
+				{
+					if (postCount > 1 && algo != 0 && algo != 4)
+					{
+						continue;
+					}
+
+					std::string name = "ReducedSpherical_" + layout + "_" + direction + "_Algo" + ToString(algo);
+					ReducedSphericalKernel kernel(preCount, lmax, postCount, algo, forward);
+					double error = kernel.GetRelativeError(reference);
+					if (!(error < 1e-10))
+					{
+						if (procId == 0)
+						{
+							cout << "WARNING: " << name << " differs from Algo0 by " << error << ", skipped" << endl;
+						}
+						continue;
+					}
+					runner.Run(name, ShapeString(kernel.Grid.shape()), kernel);
+				}
+			}
+		}
+	}
+
+	//Distributed transpose
+	{
+		TinyVector<int, 3> shape(angularCount * procCount, radialCount, radialCount / 4);
+		TransposeKernel transpose(shape);
+		runner.Run("ArrayTranspose_0_1", ShapeString(shape), transpose);
+	}
+
+	//Tensor potentials, all storage combinations of rank 3 generated by
+	//tensorpotentialmultiply_generator.py
+	{
+		for (int i=0; i<TensorPotential::BenchmarkStorageCount; i++)
+		{
+			std::string storage = TensorPotential::BenchmarkStorageList[i];
+			TinyVector<int, 3> shape = GetTensorPotentialShape(storage, angularCount, bsplineCount / 2, superDiagonals, maxPotentialSize);
+			TensorPotentialKernel potential(storage, shape, superDiagonals);
+			runner.Run("TensorPotentialMultiply_" + storage, ShapeString(shape), potential);
+		}
+	}
+
+	//Block sparse potentials, by looping over the entries and with the
+	//BLAS kernels. Simp_Band_Band is also run as TensorPotentialMultiply
+	{
+		const char* storages[] = { "Band_Band", "Dense_Ident" };
+		for (int i=0; i<2; i++)
+		{
+			std::string storage = storages[i];
+			TinyVector<int, 3> shape = GetTensorPotentialShape("Simp_" + storage, angularCount, bsplineCount / 2, superDiagonals, maxPotentialSize);
+			BlockSparseKernel entries(storage, shape, superDiagonals, false);
+			runner.Run("BlockSparse_" + storage + "_Entries", ShapeString(shape), entries);
+
+			BlockSparseKernel blas(storage, shape, superDiagonals, true);
+			double error = blas.GetRelativeError(entries);
+			if (!(error < 1e-10))
+			{
+				if (procId == 0)
+				{
+					cout << "WARNING: BlockSparse_" << storage << "_Blas differs from the entries by " << error << ", skipped" << endl;
+				}
+				continue;
+			}
+			runner.Run("BlockSparse_" + storage + "_Blas", ShapeString(shape), blas);
+		}
+	}
+
+	//Overlap matrix
+	{
+		OverlapKernel multiply(angularCount, bsplineCount, bsplineCount, superDiagonals, false);
+		runner.Run("OverlapMatrix_MultiplyTensor", ShapeString(multiply.Data.shape()), multiply);
+		OverlapKernel solve(angularCount, bsplineCount, bsplineCount, superDiagonals, true);
+		runner.Run("OverlapMatrix_SolveTensor", ShapeString(solve.Data.shape()), solve);
+	}
+
+	//B-spline Crank-Nicolson propagation
+	{
+		BSplinePropagationKernel propagation(angularCount, bsplineCount, bsplineCount, superDiagonals);
+		runner.Run("BSplinePropagator_CrankNicolson", ShapeString(propagation.Data.shape()), propagation);
+	}
+
+	//pAMP step
+	{
+		int size = angularCount * bsplineCount * bsplineCount / 4;
+		PampKernel pamp(size, 20, superDiagonals);
+		runner.Run("Pamp_PropagateVector", ToString(size) + "_krylov20", pamp);
+	}
+
+	if (procId == 0)
+	{
+		report.WriteCSV(outputFile);
+		cout << "Results written to " << outputFile << endl;
+	}
+
+	MPI_Finalize();
+	return 0;
+}
+
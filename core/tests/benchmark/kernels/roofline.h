@@ -0,0 +1,222 @@
+#ifndef ROOFLINE_H
+#define ROOFLINE_H
+
+#include <core/common.h>
+
+#include <mpi.h>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iomanip>
+
+/*
+ * Small helpers for timing the core kernels and reporting them
+ * against a memory bandwidth roofline.
+ *
+ * Every kernel is described by the number of bytes it must move to/from
+ * main memory and the number of floating point operations it performs
+ * for one call. The measured time is then converted into GB/s and
+ * GFLOP/s, and the attained bandwidth is compared to the bandwidth
+ * measured by a STREAM triad on the same node.
+ */
+namespace Roofline
+{
+
+struct KernelResult
+{
+	std::string Name;
+	std::string Shape;
+	int Repeats;
+	double Time;            //Best time for one call (seconds)
+	double Bytes;           //Minimal memory traffic for one call
+	double Flops;           //Floating point operations for one call
+
+	double GetBandwidth() const { return Bytes / Time / 1e9; }
+	double GetFlopRate() const { return Flops / Time / 1e9; }
+	double GetIntensity() const { return Bytes > 0 ? Flops / Bytes : 0; }
+};
+
+
+/*
+ * Times kernel() by calling it repeatedly until at least minTime seconds
+ * have passed, and returns the best time for a single call out of
+ * sampleCount such batches. The kernel is called once before timing
+ * in order to warm up caches, fftw plans, etc.
+ */
+template<class KernelType>
+double TimeKernel(KernelType &kernel, int &repeats, double minTime = 0.2, int sampleCount = 3)
+{
+	kernel();
+
+	repeats = 1;
+	double elapsed = 0;
+	while (true)
+	{
+		double start = MPI_Wtime();
+		for (int i=0; i<repeats; i++)
+		{
+			kernel();
+		}
+		elapsed = MPI_Wtime() - start;
+		if (elapsed >= minTime)
+		{
+			break;
+		}
+		repeats *= 2;
+	}
+
+	double best = elapsed / repeats;
+	for (int sample=1; sample<sampleCount; sample++)
+	{
+		double start = MPI_Wtime();
+		for (int i=0; i<repeats; i++)
+		{
+			kernel();
+		}
+		best = std::min(best, (MPI_Wtime() - start) / repeats);
+	}
+	return best;
+}
+
+
+/*
+ * STREAM triad a = b + s*c on double arrays of the given length.
+ * Returns the sustainable bandwidth in GB/s, counting 3 words per element
+ * as in the original STREAM benchmark (i.e. write allocate is not counted)
+ */
+inline double MeasureStreamBandwidth(int length)
+{
+	blitz::Array<double, 1> a(length), b(length), c(length);
+	a = 0.0;
+	b = 1.0;
+	c = 2.0;
+	double scalar = 3.0;
+
+	double* pa = a.data();
+	double* pb = b.data();
+	double* pc = c.data();
+
+	double best = 1e300;
+	for (int sample=0; sample<10; sample++)
+	{
+		double start = MPI_Wtime();
+		for (int i=0; i<length; i++)
+		{
+			pa[i] = pb[i] + scalar * pc[i];
+		}
+		best = std::min(best, MPI_Wtime() - start);
+	}
+
+	//Prevent the compiler from optimizing away the loop
+	if (a(length/2) != 7.0)
+	{
+		cout << "WARNING: STREAM triad produced wrong result" << endl;
+	}
+
+	return 3.0 * sizeof(double) * length / best / 1e9;
+}
+
+
+class Report
+{
+private:
+	std::vector<KernelResult> Results;
+	double StreamBandwidth;
+	double PeakFlopRate;
+
+public:
+	Report(double streamBandwidth, double peakFlopRate) :
+		StreamBandwidth(streamBandwidth),
+		PeakFlopRate(peakFlopRate)
+	{}
+
+	void Add(const KernelResult &result)
+	{
+		Results.push_back(result);
+		Print(result);
+	}
+
+	/*
+	 * Attainable GFLOP/s for a kernel with the given intensity. If the
+	 * peak flop rate is not known (0), only the bandwidth roof is used
+	 */
+	double GetAttainableFlopRate(double intensity) const
+	{
+		double roof = intensity * StreamBandwidth;
+		if (PeakFlopRate > 0)
+		{
+			roof = std::min(roof, PeakFlopRate);
+		}
+		return roof;
+	}
+
+	void PrintHeader() const
+	{
+		cout << "STREAM triad bandwidth: " << StreamBandwidth << " GB/s" << endl;
+		if (PeakFlopRate > 0)
+		{
+			cout << "Peak flop rate:         " << PeakFlopRate << " GFLOP/s" << endl;
+		}
+		cout << std::setw(36) << std::left << "kernel"
+		     << std::setw(22) << "shape"
+		     << std::setw(12) << "time [ms]"
+		     << std::setw(10) << "GB/s"
+		     << std::setw(10) << "GFLOP/s"
+		     << std::setw(10) << "flop/B"
+		     << std::setw(10) << "% stream"
+		     << std::setw(10) << "% roof"
+		     << std::right << endl;
+	}
+
+	void Print(const KernelResult &r) const
+	{
+		double roof = GetAttainableFlopRate(r.GetIntensity());
+		cout << std::setw(36) << std::left << r.Name
+		     << std::setw(22) << r.Shape
+		     << std::setw(12) << r.Time * 1e3
+		     << std::setw(10) << r.GetBandwidth()
+		     << std::setw(10) << r.GetFlopRate()
+		     << std::setw(10) << r.GetIntensity()
+		     << std::setw(10) << 100.0 * r.GetBandwidth() / StreamBandwidth
+		     << std::setw(10) << (roof > 0 ? 100.0 * r.GetFlopRate() / roof : 0.0)
+		     << std::right << endl;
+	}
+
+	/*
+	 * Writes all results as comma separated values, one kernel per line,
+	 * suitable for tracking performance across commits
+	 */
+	void WriteCSV(const std::string &filename) const
+	{
+		std::ofstream file(filename.c_str());
+		if (!file)
+		{
+			cout << "Could not open " << filename << " for writing" << endl;
+			throw std::runtime_error("Could not open benchmark output file");
+		}
+
+		file << "kernel,shape,repeats,time_s,bytes,flops,gbs,gflops,intensity,stream_gbs,stream_fraction,roof_fraction" << endl;
+		for (size_t i=0; i<Results.size(); i++)
+		{
+			const KernelResult &r = Results[i];
+			double roof = GetAttainableFlopRate(r.GetIntensity());
+			file << r.Name << ","
+			     << r.Shape << ","
+			     << r.Repeats << ","
+			     << r.Time << ","
+			     << r.Bytes << ","
+			     << r.Flops << ","
+			     << r.GetBandwidth() << ","
+			     << r.GetFlopRate() << ","
+			     << r.GetIntensity() << ","
+			     << StreamBandwidth << ","
+			     << r.GetBandwidth() / StreamBandwidth << ","
+			     << (roof > 0 ? r.GetFlopRate() / roof : 0.0) << endl;
+		}
+	}
+};
+
+} //Namespace
+
+#endif
+
@@ -0,0 +1,120 @@
+#include <core/utility/checkpointschedule.h>
+
+/*
+ * Checks that CheckpointSchedule is valid, and that it uses the minimal
+ * number of forward steps, by comparing with a brute force search over
+ * the placement of the snapshots
+ */
+
+typedef std::vector< std::vector<int> > CostTable;
+
+/*
+ * reverse(n, s): reverse n steps from a stored state with s free snapshots,
+ * after the terminal action is done.
+ * terminal(n, s): the same, but the final state must be reached first
+ */
+void GetOptimalCost(int maxSteps, int maxSnapshots, CostTable &reverse, CostTable &terminal)
+{
+	reverse.assign(maxSteps+1, std::vector<int>(maxSnapshots+1, 0));
+	terminal.assign(maxSteps+1, std::vector<int>(maxSnapshots+1, 0));
+	for (int s=0; s<=maxSnapshots; s++)
+	{
+		for (int n=1; n<=maxSteps; n++)
+		{
+			//No snapshots: advance from the stored state for every step
+			reverse[n][s] = n*(n-1)/2;
+			terminal[n][s] = n + n*(n-1)/2;
+			if (s == 0)
+			{
+				continue;
+			}
+			//First snapshot at k
+			for (int k=1; k<n; k++)
+			{
+				reverse[n][s] = std::min(reverse[n][s], k + reverse[n-k][s-1] + reverse[k][s]);
+				terminal[n][s] = std::min(terminal[n][s], k + terminal[n-k][s-1] + reverse[k][s]);
+			}
+		}
+	}
+}
+
+/*
+ * Executes the schedule on step counters, and returns false if an action
+ * is invalid or a step is not reversed in order
+ */
+bool CheckSchedule(CheckpointSchedule &schedule)
+{
+	int stepCount = schedule.GetStepCount();
+	std::vector<int> slots(schedule.GetSnapshotCount()+1, -1);
+	int current = 0;
+	int nextAdjoint = stepCount;
+	int forwardSteps = 0;
+
+	for (int i=0; i<schedule.GetActionCount(); i++)
+	{
+		int step = schedule.GetActionStep(i);
+		int slot = schedule.GetActionSlot(i);
+		switch (schedule.GetAction(i))
+		{
+		case CheckpointSchedule::ActionAdvance:
+			if (step < current) return false;
+			forwardSteps += step - current;
+			current = step;
+			break;
+		case CheckpointSchedule::ActionStore:
+			if (step != current || slots[slot] != -1) return false;
+			slots[slot] = step;
+			break;
+		case CheckpointSchedule::ActionRestore:
+			if (slots[slot] != step) return false;
+			current = step;
+			break;
+		case CheckpointSchedule::ActionTerminal:
+			if (step != current || step != stepCount || nextAdjoint != stepCount) return false;
+			nextAdjoint--;
+			break;
+		case CheckpointSchedule::ActionAdjoint:
+			if (step != current || step != nextAdjoint) return false;
+			nextAdjoint--;
+			break;
+		case CheckpointSchedule::ActionFree:
+			if (slots[slot] != step) return false;
+			slots[slot] = -1;
+			break;
+		}
+	}
+	return nextAdjoint == -1 && forwardSteps == schedule.GetForwardStepCount();
+}
+
+int main(int argc, char* argv[])
+{
+	int maxSteps = 80;
+	int maxSnapshots = 6;
+	CostTable reverse, terminal;
+	GetOptimalCost(maxSteps, maxSnapshots, reverse, terminal);
+
+	int errorCount = 0;
+	for (int s=0; s<=maxSnapshots; s++)
+	{
+		for (int n=1; n<=maxSteps; n++)
+		{
+			CheckpointSchedule schedule;
+			schedule.Setup(n, s);
+			if (!CheckSchedule(schedule))
+			{
+				cout << "Error: invalid schedule for " << n << " steps, " << s << " snapshots" << endl;
+				errorCount++;
+			}
+			else if (schedule.GetForwardStepCount() != terminal[n][s])
+			{
+				cout << "Error: schedule for " << n << " steps, " << s << " snapshots has "
+					<< schedule.GetForwardStepCount() << " forward steps, optimal is " << terminal[n][s] << endl;
+				errorCount++;
+			}
+		}
+	}
+
+	cout << "Checked schedules of up to " << maxSteps << " steps and " << maxSnapshots << " snapshots, "
+		<< errorCount << " errors" << endl;
+	return errorCount == 0 ? 0 : 1;
+}
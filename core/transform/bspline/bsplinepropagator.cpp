@@ -4,6 +4,7 @@
 #include "../../utility/blitzblas.h"
 #include "../../utility/blitztricks.h"
 #include "../../utility/blitzlapack.h"
+#include "../../utility/gilrelease.h"
 #include <cmath>
 
 
@@ -111,6 +112,7 @@ void Propagator<Rank>::AdvanceStep(Wavefunction<Rank> &psi)
 	Array<cplx, 3> data3d = MapToRank3(psi.Data, PropagateRank, 1);
 
 	//Propagate the 3D array
+	ReleaseGIL releaseGIL;
 	ApplyCrankNicolson(PropagationMatrix, data3d);
 }
 
@@ -135,6 +137,7 @@ void Propagator<Rank>::MultiplyHamiltonian(Wavefunction<Rank> &srcPsi, Wavefunct
 	Array<cplx, 3> dstData = MapToRank3(dstPsi.Data, PropagateRank, 1);
 	Array<cplx, 2> matrix = GetHamiltonianMatrix();
 	Array<cplx, 2> centrifugalMatrix = GetCentrifugalMatrixBlas();
+	ReleaseGIL releaseGIL;
 
 	//Iterate over the array directions which are not propagated by this propagator
 	Array<cplx, 1> temp(srcData.extent(1));
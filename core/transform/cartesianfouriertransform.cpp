@@ -1,6 +1,10 @@
 #include "cartesianfouriertransform.h"
 #include "../representation/representation.h"
 #include "../representation/cartesianrepresentation.h"
+#include "../utility/blitzutils.h"
+#include "../utility/gilrelease.h"
+
+#include <fftw3.h>
 
 template<int Rank>
 void CartesianFourierTransform<Rank>::TransformRank(Wavefunction<Rank> &psi, int rank, int direction)
@@ -11,14 +15,16 @@ void CartesianFourierTransform<Rank>::TransformRank(Wavefunction<Rank> &psi, int
 		throw std::runtime_error("Cannot execute fourier transform along distributed rank.");
 	}
 
-	FftRank(psi.Data, rank, direction);
+	ReleaseGIL releaseGIL;
+	FftRank(psi.Data, rank, direction, FftRankAlgorithm);
 }
 
 /* Specialized TransformRank for 1D */
 template<>
 void CartesianFourierTransform<1>::TransformRank(Wavefunction<1> &psi, int rank, int direction)
 {
-	FftRank(psi.Data, rank, direction);
+	ReleaseGIL releaseGIL;
+	FftRank(psi.Data, rank, direction, FftRankAlgorithm);
 }
 
 /*
@@ -48,14 +54,19 @@ void CartesianFourierTransform<Rank>::InverseTransform(Wavefunction<Rank> &psi)
 template<int Rank>
 void CartesianFourierTransform<Rank>::FourierTransform(Wavefunction<Rank> &psi, int direction)
 {
+	ReleaseGIL releaseGIL;
 	if (psi.GetRepresentation()->GetDistributedModel()->ProcCount == 1)
 	{
 		//For one processor, we can execute a full Rank-D FFT 
 		FftAll(psi.Data, direction);
 	}
-	else 
+	else if (direction == FFT_FORWARD)
 	{
-		throw std::runtime_error("Cannot execute fourier transform along distributed rank.");
+		DistributedForwardTransform(psi);
+	}
+	else
+	{
+		DistributedInverseTransform(psi);
 	}
 	
 	if (direction == FFT_BACKWARD) 
@@ -64,6 +75,320 @@ void CartesianFourierTransform<Rank>::FourierTransform(Wavefunction<Rank> &psi,
 	}
 }
 
+/*
+ * Transforms one chunk of the wavefunction along TransformRank during a
+ * pipelined transpose
+ */
+template<int Rank>
+class FftChunkAction : public TransposeChunkAction<Rank>
+{
+public:
+	FftChunkAction(int transformRank, int direction, int algorithm) : TransformRank(transformRank), Direction(direction), Algorithm(algorithm) {}
+
+	virtual void ProcessChunk(blitz::Array<cplx, Rank> &chunk)
+	{
+		FftRank(chunk, TransformRank, Direction, Algorithm);
+	}
+
+private:
+	int TransformRank;
+	int Direction;
+	int Algorithm;
+};
+
+/*
+ * The ranks which are not distributed in initialDistrib are transformed first 
+ * (localRanks), then the distributed ranks in ascending order, each transposed 
+ * to the lowest rank which is not currently distributed.
+ */
+template<int Rank>
+std::vector<typename CartesianFourierTransform<Rank>::TransformStage> CartesianFourierTransform<Rank>::GetTransformStages(const blitz::Array<int, 1> &initialDistrib, std::vector<int> &localRanks)
+{
+	blitz::Array<int, 1> distrib(initialDistrib.copy());
+	std::vector<TransformStage> stages;
+
+	localRanks.clear();
+	for (int rank=0; rank<Rank; rank++)
+	{
+		if (!Contains(distrib, rank))
+		{
+			localRanks.push_back(rank);
+		}
+	}
+
+	for (int rank=0; rank<Rank; rank++)
+	{
+		if (!Contains(initialDistrib, rank))
+		{
+			continue;
+		}
+
+		TransformStage stage;
+		stage.TransformRank = rank;
+		stage.ProcRank = -1;
+		stage.OtherRank = -1;
+		for (int i=0; i<distrib.extent(0); i++)
+		{
+			if (distrib(i) == rank)
+			{
+				stage.ProcRank = i;
+			}
+		}
+		for (int otherRank=Rank-1; otherRank>=0; otherRank--)
+		{
+			if (!Contains(distrib, otherRank))
+			{
+				stage.OtherRank = otherRank;
+			}
+		}
+		if (stage.OtherRank == -1)
+		{
+			cout << "Can not transform rank " << rank << " of distribution " << distrib << endl;
+			throw std::runtime_error("Distributed fourier transform needs more ranks than distributed ranks");
+		}
+
+		distrib(stage.ProcRank) = stage.OtherRank;
+		stages.push_back(stage);
+	}
+
+	return stages;
+}
+
+/*
+ * Changes the distribution of stage, and transforms stage.TransformRank
+ * pipelined with the transpose: After the transpose when transforming forward, 
+ * before the transpose back when transforming backward.
+ */
+template<int Rank>
+void CartesianFourierTransform<Rank>::DistributedTransformStage(Wavefunction<Rank> &psi, const TransformStage &stage, int direction)
+{
+	typename DistributedModel<Rank>::Ptr distr = psi.GetRepresentation()->GetDistributedModel();
+	blitz::TinyVector<int, Rank> fullShape = psi.GetRepresentation()->GetFullShape();
+
+	blitz::Array<int, 1> newDistrib(distr->GetDistribution().copy());
+	newDistrib(stage.ProcRank) = direction == FFT_FORWARD ? stage.OtherRank : stage.TransformRank;
+
+	blitz::TinyVector<int, Rank> newShape = distr->CreateDistributedShape(fullShape, newDistrib);
+	int bufferName = psi.GetAvailableDataBufferName(newShape);
+	if (bufferName == -1)
+	{
+		bufferName = psi.AllocateData(newShape);
+	}
+
+	//Chunks are taken along the outermost rank not being transformed, such that 
+	//each chunk can be transformed by FftRank
+	int chunkRank = stage.TransformRank == 0 ? 1 : 0;
+	FftChunkAction<Rank> action(stage.TransformRank, direction, FftRankAlgorithm);
+	bool actionBeforeSend = direction == FFT_BACKWARD;
+	distr->ChangeDistributionPipelined(psi, newDistrib, bufferName, chunkRank, TransposeChunkCount, action, actionBeforeSend);
+}
+
+template<int Rank>
+void CartesianFourierTransform<Rank>::DistributedForwardTransform(Wavefunction<Rank> &psi)
+{
+	typename DistributedModel<Rank>::Ptr distr = psi.GetRepresentation()->GetDistributedModel();
+	blitz::Array<int, 1> initialDistrib(distr->GetDistribution().copy());
+
+	std::vector<int> localRanks;
+	std::vector<TransformStage> stages = GetTransformStages(initialDistrib, localRanks);
+
+	for (size_t i=0; i<localRanks.size(); i++)
+	{
+		FftRank(psi.Data, localRanks[i], FFT_FORWARD, FftRankAlgorithm);
+	}
+	for (size_t i=0; i<stages.size(); i++)
+	{
+		DistributedTransformStage(psi, stages[i], FFT_FORWARD);
+	}
+
+	ForwardDistribution.reference(initialDistrib);
+	FourierDistribution.reference(distr->GetDistribution().copy());
+}
+
+template<int Rank>
+void CartesianFourierTransform<Rank>::DistributedInverseTransform(Wavefunction<Rank> &psi)
+{
+	typename DistributedModel<Rank>::Ptr distr = psi.GetRepresentation()->GetDistributedModel();
+	blitz::Array<int, 1> distrib(distr->GetDistribution());
+	if (FourierDistribution.size() != distrib.size() || blitz::any(FourierDistribution != distrib))
+	{
+		cout << "Distribution " << distrib << " is not the distribution of the last forward transform " << FourierDistribution << endl;
+		throw std::runtime_error("Distributed InverseTransform must follow a ForwardTransform");
+	}
+
+	std::vector<int> localRanks;
+	std::vector<TransformStage> stages = GetTransformStages(ForwardDistribution, localRanks);
+
+	for (int i=stages.size()-1; i>=0; i--)
+	{
+		DistributedTransformStage(psi, stages[i], FFT_BACKWARD);
+	}
+	for (size_t i=0; i<localRanks.size(); i++)
+	{
+		FftRank(psi.Data, localRanks[i], FFT_BACKWARD, FftRankAlgorithm);
+	}
+}
+
+template<int Rank>
+void CartesianFourierTransform<Rank>::SetupKineticPhase(Wavefunction<Rank> &psi, double mass, const cplx &timeStep)
+{
+	typename Representation<Rank>::Ptr repr = psi.GetRepresentation();
+
+	//The normalization of the inverse transform is included in the phase
+	double scale = 1.0;
+	blitz::TinyVector<int, Rank> fullShape = repr->GetFullShape();
+	for (int dimension=0; dimension<Rank; dimension++)
+	{
+		scale /= fullShape(dimension);
+	}
+
+	blitz::TinyVector< blitz::Array<double, 1>, Rank > grid;
+	for (int i=0; i<Rank; i++)
+	{
+		grid(i).reference(repr->GetLocalGrid(i));
+	}
+
+	AllocateArenaArray(KineticPhase, psi.Data.shape(), KineticPhaseBlock);
+	typename blitz::Array<cplx, Rank>::iterator it = KineticPhase.begin();
+	for (int linearCount=0; linearCount<KineticPhase.size(); linearCount++)
+	{
+		double kineticEnergy = 0.0;
+		for (int i=0; i<Rank; i++)
+		{
+			kineticEnergy += sqr(grid(i)(it.position()(i)));
+		}
+		kineticEnergy /= 2.0 * mass;
+		*it = scale * exp( - I * kineticEnergy * timeStep );
+		it++;
+	}
+}
+
+template<int Rank>
+void CartesianFourierTransform<Rank>::AdvanceKineticEnergy(Wavefunction<Rank> &psi)
+{
+	if (psi.GetRepresentation()->GetDistributedModel()->ProcCount != 1)
+	{
+		throw std::runtime_error("Fused kinetic step of a distributed wavefunction must use AdvanceKineticEnergyRank");
+	}
+	ReleaseGIL releaseGIL;
+
+	//The max stride rank is transformed last, in the fused pass
+	int fusedRank = psi.Data.ordering(Rank-1);
+	FftAllExceptMaxStride(psi.Data, FFT_FORWARD);
+	FusedKineticRank(psi.Data, fusedRank);
+	FftAllExceptMaxStride(psi.Data, FFT_BACKWARD);
+}
+
+template<int Rank>
+void CartesianFourierTransform<Rank>::AdvanceKineticEnergyRank(Wavefunction<Rank> &psi, int rank)
+{
+	if (psi.GetRepresentation()->GetDistributedModel()->IsDistributedRank(rank))
+	{
+		std::cout << "Cannot execute fourier transform along distributed rank." << std::endl;
+		throw std::runtime_error("Cannot execute fourier transform along distributed rank.");
+	}
+
+	ReleaseGIL releaseGIL;
+	FusedKineticRank(psi.Data, rank);
+}
+
+/* Specialized AdvanceKineticEnergyRank for 1D */
+template<>
+void CartesianFourierTransform<1>::AdvanceKineticEnergyRank(Wavefunction<1> &psi, int rank)
+{
+	ReleaseGIL releaseGIL;
+	FusedKineticRank(psi.Data, rank);
+}
+
+/*
+ * Forward transform along rank, multiplication by KineticPhase and
+ * inverse transform along rank, one cache sized block of lines at a time.
+ *
+ * The data is row major, so the lines along rank are either consecutive 
+ * columns with stride > 1 (groups of stride lines, one group for each 
+ * index of the ranks before rank), or consecutive rows when rank has 
+ * stride 1
+ */
+template<int Rank>
+void CartesianFourierTransform<Rank>::FusedKineticRank(blitz::Array<cplx, Rank> &data, int rank)
+{
+	bool sameLayout = KineticPhase.size() == data.size();
+	for (int i=0; i<Rank; i++)
+	{
+		sameLayout = sameLayout && KineticPhase.extent(i) == data.extent(i) && KineticPhase.stride(i) == data.stride(i);
+	}
+	if (!sameLayout || !data.isStorageContiguous())
+	{
+		std::cout << "Kinetic phase of shape " << KineticPhase.shape() << " does not match wavefunction of shape " << data.shape() << std::endl;
+		throw std::runtime_error("SetupKineticPhase must be called for the current layout of the wavefunction");
+	}
+
+	int fftSize = data.extent(rank);
+	int elementStride = data.stride(rank);
+	int lineDist = elementStride > 1 ? 1 : fftSize;
+	long lineCount = data.size() / fftSize;
+	long groupLineCount = elementStride > 1 ? elementStride : lineCount;
+	long groupCount = lineCount / groupLineCount;
+	long groupDist = (long)fftSize * elementStride;
+
+	long blockLines = std::max(1L, KineticBlockBytes / (long)(fftSize * sizeof(cplx)));
+	blockLines = std::min(blockLines, groupLineCount);
+	long blocksPerGroup = (groupLineCount + blockLines - 1) / blockLines;
+	long blockCount = groupCount * blocksPerGroup;
+	int restLines = groupLineCount % blockLines;
+
+	//The plans are executed on every block, and must not assume alignment
+	fftw_complex *fftData = reinterpret_cast<fftw_complex*>( data.data() );
+	fftw_plan forwardPlan[2];
+	fftw_plan backwardPlan[2];
+	for (int i=0; i<2; i++)
+	{
+		int howMany = i == 0 ? blockLines : restLines;
+		if (howMany == 0)
+		{
+			forwardPlan[i] = backwardPlan[i] = 0;
+			continue;
+		}
+		forwardPlan[i] = fftw_plan_many_dft(1, &fftSize, howMany, fftData, 0, elementStride, lineDist, 
+			fftData, 0, elementStride, lineDist, FFT_FORWARD, FFTW_ESTIMATE | FFTW_UNALIGNED);
+		backwardPlan[i] = fftw_plan_many_dft(1, &fftSize, howMany, fftData, 0, elementStride, lineDist, 
+			fftData, 0, elementStride, lineDist, FFT_BACKWARD, FFTW_ESTIMATE | FFTW_UNALIGNED);
+	}
+
+	cplx* dataPtr = data.data();
+	const cplx* phasePtr = KineticPhase.data();
+
+	#pragma omp parallel for schedule(static)
+	for (long block=0; block<blockCount; block++)
+	{
+		long firstLine = (block % blocksPerGroup) * blockLines;
+		long offset = (block / blocksPerGroup) * groupDist + firstLine * lineDist;
+		int lines = std::min(blockLines, groupLineCount - firstLine);
+		int plan = lines == blockLines ? 0 : 1;
+
+		fftw_execute_dft(forwardPlan[plan], fftData + offset, fftData + offset);
+		for (int k=0; k<fftSize; k++)
+		{
+			long index = offset + (long)k * elementStride;
+			for (int j=0; j<lines; j++)
+			{
+				dataPtr[index] *= phasePtr[index];
+				index += lineDist;
+			}
+		}
+		fftw_execute_dft(backwardPlan[plan], fftData + offset, fftData + offset);
+	}
+
+	for (int i=0; i<2; i++)
+	{
+		if (forwardPlan[i] != 0)
+		{
+			fftw_destroy_plan(forwardPlan[i]);
+			fftw_destroy_plan(backwardPlan[i]);
+		}
+	}
+}
+
 /** Create representations for a full transform */
 template<int Rank> 
 typename CartesianRepresentation<Rank>::Ptr CartesianFourierTransform<Rank>::CreateFourierRepresentation(const CartesianRepresentation<Rank> &gridRepresentation)
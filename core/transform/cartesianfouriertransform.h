@@ -5,6 +5,9 @@
 #include "../wavefunction.h"
 #include "fouriertransform.h"
 #include "../representation/cartesianrepresentation.h"
+#include "../utility/memoryarena.h"
+
+#include <vector>
 
 template<int Rank> class CartesianRepresentation;
 
@@ -17,15 +20,54 @@ template<int Rank> class CartesianRepresentation;
  * 2) The low level interace. TransformRank, etc. transformes the 
  *    wavefunction along a single rank. It will return an error if the transformed
  *    rank is currently distributed, and will not perform any redistributions.
+ *
+ * ForwardTransform() of a distributed wavefunction first transforms the ranks
+ * which are not distributed, and then, for each distributed rank, transposes it
+ * to the lowest rank which is not distributed and transforms it. The transform
+ * of each rank is pipelined with its transpose (see ChangeDistributionPipelined), 
+ * such that the fft of one chunk overlaps the communication of the next. The 
+ * wavefunction is left in the transposed distribution, which is the same as 
+ * the one used by the python stages of CartesianPropagator. InverseTransform() 
+ * reverses the stages of the last ForwardTransform().
+ *
+ * In addition, the kinetic energy step of a split step propagator,
+ * fft -> exp(-i T dt) -> inverse fft -> normalization, can be fused
+ * (see AdvanceKineticEnergy)
  */
 template<int Rank>
 class CartesianFourierTransform
 {
 private:
+	/*
+	 * One transpose stage of a distributed transform: TransformRank is
+	 * distributed on ProcRank, and is transposed to OtherRank before 
+	 * it is transformed
+	 */
+	struct TransformStage
+	{
+		int ProcRank;
+		int TransformRank;
+		int OtherRank;
+	};
+
+	blitz::Array<cplx, Rank> KineticPhase;
+	MemoryArena::BlockPtr KineticPhaseBlock;
+	long KineticBlockBytes;
+
+	int TransposeChunkCount;
+	int FftRankAlgorithm;
+	blitz::Array<int, 1> ForwardDistribution;
+	blitz::Array<int, 1> FourierDistribution;
+
 	void FourierTransform(Wavefunction<Rank> &psi, int direction);
+	void DistributedForwardTransform(Wavefunction<Rank> &psi);
+	void DistributedInverseTransform(Wavefunction<Rank> &psi);
+	std::vector<TransformStage> GetTransformStages(const blitz::Array<int, 1> &initialDistrib, std::vector<int> &localRanks);
+	void DistributedTransformStage(Wavefunction<Rank> &psi, const TransformStage &stage, int direction);
+	void FusedKineticRank(blitz::Array<cplx, Rank> &data, int rank);
 	
 public:
-	CartesianFourierTransform() 		
+	CartesianFourierTransform() : KineticBlockBytes(256*1024), TransposeChunkCount(4), FftRankAlgorithm(FFT_RANK_AUTO)
 	{
 	}
 
@@ -46,6 +88,55 @@ public:
 	*/
 	void Renormalize(Wavefunction<Rank> &psi);
 
+	/**
+	 * Fused kinetic energy step.
+	 *
+	 * SetupKineticPhase stores exp(-i k^2/(2 mass) dt) / N, where N is the
+	 * number of grid points, i.e. the normalization of the inverse transform 
+	 * is folded into the phase. It must be called with psi in the fourier 
+	 * representation and distribution where the last rank is transformed, 
+	 * i.e. after a full forward transform. 
+	 *
+	 * The last rank is transformed in blocks of lines small enough to stay in 
+	 * cache (KineticBlockBytes), and each block is transformed forward, multiplied 
+	 * by the phase and transformed back before the next block is loaded. This 
+	 * replaces the separate potential and normalization sweeps, and one 
+	 * forward and one inverse sweep over the whole grid.
+	 *
+	 * AdvanceKineticEnergy performs the full kinetic step for one processor. 
+	 * AdvanceKineticEnergyRank performs only the fused pass along rank, 
+	 * for distributed propagators which do the other ranks themselves with 
+	 * TransformRank() and transposes, and must not call Renormalize().
+	 */
+	void SetupKineticPhase(Wavefunction<Rank> &psi, double mass, const cplx &timeStep);
+	void AdvanceKineticEnergy(Wavefunction<Rank> &psi);
+	void AdvanceKineticEnergyRank(Wavefunction<Rank> &psi, int rank);
+
+	void SetKineticBlockBytes(long blockBytes) { KineticBlockBytes = blockBytes; }
+	long GetKineticBlockBytes() { return KineticBlockBytes; }
+
+	/**
+	 * Number of chunks each transpose of a distributed transform is split into
+	 */
+	void SetTransposeChunkCount(int chunkCount) { TransposeChunkCount = chunkCount; }
+	int GetTransposeChunkCount() { return TransposeChunkCount; }
+
+	/**
+	 * Algorithm used by FftRank for ranks which are neither the min nor the
+	 * max stride rank (FFT_RANK_AUTO, FFT_RANK_POSITIVE or FFT_RANK_NEGATIVE,
+	 * see fouriertransform.h)
+	 */
+	void SetFftRankAlgorithm(int algorithm)
+	{
+		if (algorithm != FFT_RANK_AUTO && algorithm != FFT_RANK_POSITIVE && algorithm != FFT_RANK_NEGATIVE)
+		{
+			cout << "Invalid FftRank algorithm " << algorithm << endl;
+			throw std::runtime_error("Invalid FftRank algorithm");
+		}
+		FftRankAlgorithm = algorithm;
+	}
+	int GetFftRankAlgorithm() { return FftRankAlgorithm; }
+
 	/**
 	 * Methods for manipulating representations
 	*/
@@ -21,7 +21,7 @@ Transforms the array only along the specified rank using the "Positive" algorith
 (generalized algorithm based on FftOnlyMinStride)
 */
 template<int Rank>
-void FftRankPositive(blitz::Array<cplx, Rank> &array, int rank, int direction)
+void FftRankPositive(blitz::Array<cplx, Rank> &array, int rank, int direction, bool warnIfSlow)
 {
 	//Find the order index of our rank
 	int rankOrderIndex = -1;
@@ -62,7 +62,7 @@ void FftRankPositive(blitz::Array<cplx, Rank> &array, int rank, int direction)
 		repeatCount *= array.extent(array.ordering(i));
 	}
 
-	if (repeatCount > fftHowMany)
+	if (warnIfSlow && repeatCount > fftHowMany)
 	{
 		std::cout << "Warning: Using FftRankPositive when it would be more "
 			  << "efficient to use FftRankNegative." << std::endl
@@ -105,7 +105,7 @@ Transforms the array only along the specified rank using the "Negative" algorith
 (generalized algorithm based on FftOnlyMaxStride)
 */
 template<int Rank>
-void FftRankNegative(blitz::Array<cplx, Rank> &array, int rank, int direction)
+void FftRankNegative(blitz::Array<cplx, Rank> &array, int rank, int direction, bool warnIfSlow)
 {
 	//Find the order index of our rank
 	int rankOrderIndex = -1;
@@ -146,7 +146,7 @@ void FftRankNegative(blitz::Array<cplx, Rank> &array, int rank, int direction)
 		repeatCount *= array.extent(array.ordering(i));
 	}
 	
-	if (repeatCount > fftHowMany)
+	if (warnIfSlow && repeatCount > fftHowMany)
 	{
 		std::cout << "Warning: Using FftRankNegative when it would be more "
 			  << "efficient to use FftRankPositive." << std::endl
@@ -183,10 +183,12 @@ void FftRankNegative(blitz::Array<cplx, Rank> &array, int rank, int direction)
 
 
 /**
-Transforms the array only along the specified rank
+Transforms the array only along the specified rank. algorithm selects
+between FftRankPositive and FftRankNegative for the ranks which are
+neither the min nor the max stride rank (see fouriertransform.h)
 */
 template<int Rank>
-void FftRank(blitz::Array<cplx, Rank> &array, int rank, int direction)
+void FftRank(blitz::Array<cplx, Rank> &array, int rank, int direction, int algorithm)
 {
 	int minStrideRank = array.ordering(0);
 	int maxStrideRank = array.ordering(Rank - 1);
@@ -223,7 +225,15 @@ void FftRank(blitz::Array<cplx, Rank> &array, int rank, int direction)
 		{
 			upperCount *= array.extent(array.ordering(i));
 		}
-		if (lowerCount > upperCount)
+		if (algorithm == FFT_RANK_POSITIVE)
+		{
+			FftRankPositive(array, rank, direction, false);
+		}
+		else if (algorithm == FFT_RANK_NEGATIVE)
+		{
+			FftRankNegative(array, rank, direction, false);
+		}
+		else if (lowerCount > upperCount)
 		{
 			FftRankNegative(array, rank, direction);
 		} 
@@ -438,22 +448,22 @@ template void FftOnlyMaxStride(blitz::Array<cplx, 3> &array, int direction);
 template void FftOnlyMaxStride(blitz::Array<cplx, 4> &array, int direction);
 
 
-template void FftRank(blitz::Array<cplx, 1> &array, int rank, int direction);
-template void FftRank(blitz::Array<cplx, 2> &array, int rank, int direction);
-template void FftRank(blitz::Array<cplx, 3> &array, int rank, int direction);
-template void FftRank(blitz::Array<cplx, 4> &array, int rank, int direction);
+template void FftRank(blitz::Array<cplx, 1> &array, int rank, int direction, int algorithm);
+template void FftRank(blitz::Array<cplx, 2> &array, int rank, int direction, int algorithm);
+template void FftRank(blitz::Array<cplx, 3> &array, int rank, int direction, int algorithm);
+template void FftRank(blitz::Array<cplx, 4> &array, int rank, int direction, int algorithm);
 
 
-template void FftRankPositive(blitz::Array<cplx, 1> &array, int rank, int direction);
-template void FftRankPositive(blitz::Array<cplx, 2> &array, int rank, int direction);
-template void FftRankPositive(blitz::Array<cplx, 3> &array, int rank, int direction);
-template void FftRankPositive(blitz::Array<cplx, 4> &array, int rank, int direction);
+template void FftRankPositive(blitz::Array<cplx, 1> &array, int rank, int direction, bool warnIfSlow);
+template void FftRankPositive(blitz::Array<cplx, 2> &array, int rank, int direction, bool warnIfSlow);
+template void FftRankPositive(blitz::Array<cplx, 3> &array, int rank, int direction, bool warnIfSlow);
+template void FftRankPositive(blitz::Array<cplx, 4> &array, int rank, int direction, bool warnIfSlow);
 
 
-template void FftRankNegative(blitz::Array<cplx, 1> &array, int rank, int direction);
-template void FftRankNegative(blitz::Array<cplx, 2> &array, int rank, int direction);
-template void FftRankNegative(blitz::Array<cplx, 3> &array, int rank, int direction);
-template void FftRankNegative(blitz::Array<cplx, 4> &array, int rank, int direction);
+template void FftRankNegative(blitz::Array<cplx, 1> &array, int rank, int direction, bool warnIfSlow);
+template void FftRankNegative(blitz::Array<cplx, 2> &array, int rank, int direction, bool warnIfSlow);
+template void FftRankNegative(blitz::Array<cplx, 3> &array, int rank, int direction, bool warnIfSlow);
+template void FftRankNegative(blitz::Array<cplx, 4> &array, int rank, int direction, bool warnIfSlow);
 
 
 
@@ -12,10 +12,17 @@ These routines does _NOT_ have awareness of distributed rank, and it is up to th
 to ensure that they don't transform along a distributed rank
 */
 
+//Algorithm used by FftRank for ranks which are neither the min nor the max 
+//stride rank. FFT_RANK_AUTO selects FftRankNegative if there are more 
+//transforms in the ranks with lower stride than in the ranks with higher
+#define FFT_RANK_AUTO 0
+#define FFT_RANK_POSITIVE 1
+#define FFT_RANK_NEGATIVE 2
+
 //General routines
-template<int Rank> void FftRank(blitz::Array<cplx, Rank> &array, int rank, int direction);
-template<int Rank> void FftRankPositive(blitz::Array<cplx, Rank> &array, int rank, int direction);
-template<int Rank> void FftRankNegative(blitz::Array<cplx, Rank> &array, int rank, int direction);
+template<int Rank> void FftRank(blitz::Array<cplx, Rank> &array, int rank, int direction, int algorithm = FFT_RANK_AUTO);
+template<int Rank> void FftRankPositive(blitz::Array<cplx, Rank> &array, int rank, int direction, bool warnIfSlow = true);
+template<int Rank> void FftRankNegative(blitz::Array<cplx, Rank> &array, int rank, int direction, bool warnIfSlow = true);
 
 //Specialized routines
 template<int Rank> void FftAll(blitz::Array<cplx, Rank> &array, int direction);
@@ -54,6 +54,20 @@ public:
 		BaseRank = baseRank;
 	}
 
+	/*
+	 * Algorithm used by ReducedSphericalTools, -1 selects
+	 * the algorithm from the shape of psi
+	 */
+	int GetAlgorithm()
+	{
+		return transform.Algorithm;
+	}
+
+	void SetAlgorithm(int algo)
+	{
+		transform.Algorithm = algo;
+	}
+
 };
 
 } //namespace
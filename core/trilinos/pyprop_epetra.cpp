@@ -2,16 +2,13 @@
 #include "pyprop_epetra.h"
 
 /*
- * Creates an Epetra_Comm object from a DistributedModel. It should
- * use the distributed model to get an MPI_Communicator, but right now
- * DistributedModel uses MPI_COMM_WORLd.
+ * Creates an Epetra_Comm object from the communicator of a DistributedModel
  */
 template<int Rank>
 Epetra_Comm_Ptr CreateDistributedModelEpetraComm(typename DistributedModel<Rank>::Ptr distr)
 {
 #ifdef EPETRA_MPI
-	//should get MPI_COMM from distributed model
-	return shared_ptr<Epetra_MpiComm>( new Epetra_MpiComm(MPI_COMM_WORLD) );
+	return shared_ptr<Epetra_MpiComm>( new Epetra_MpiComm(distr->GetComm()) );
 #else
 	assert(distr->IsSingleProc());
 	return shared_ptr<Epetra_SerialComm>( new Epetra_SerialComm() );
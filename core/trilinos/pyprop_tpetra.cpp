@@ -14,17 +14,14 @@
 
 
 /*
- * Creates an Tpetra_Comm object from a DistributedModel. It should
- * use the distributed model to get an MPI_Communicator, but right now
- * DistributedModel uses MPI_COMM_WORLd.
+ * Creates an Tpetra_Comm object from the communicator of a DistributedModel
  */
 template<int Rank>
 Tpetra_Comm_Ptr CreateDistributedModelTpetraComm(typename DistributedModel<Rank>::Ptr distr)
 {
 	using namespace Teuchos;
 #ifdef EPETRA_MPI
-	//should get MPI_COMM from distributed model
-	return RCP< MpiComm<int> >( new MpiComm<int>(opaqueWrapper(MPI_COMM_WORLD)) );
+	return RCP< MpiComm<int> >( new MpiComm<int>(opaqueWrapper(distr->GetComm())) );
 #else
 	return RCP< SerialComm<int> >( new SerialComm<int>() );
 #endif
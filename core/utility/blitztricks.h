@@ -98,7 +98,7 @@ blitz::Array<T, 3> MapToRank3(blitz::Array<T, Rank> &array, int firstRankCount,
 	//as expected
 	//The current implementation requires that the lifetime of the input array
 	//exceeds the lifetime of the output array
-	blitz::Array<cplx, 3> ret(array.data(), shape, stride, blitz::neverDeleteData);
+	blitz::Array<T, 3> ret(array.data(), shape, stride, blitz::neverDeleteData);
 
 	return ret;
 }
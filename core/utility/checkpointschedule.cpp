@@ -0,0 +1,169 @@
+#include "checkpointschedule.h"
+
+void CheckpointSchedule::Setup(int stepCount, int snapshotCount)
+{
+	if (stepCount < 1 || snapshotCount < 0)
+	{
+		cout << "Invalid checkpoint schedule of " << stepCount << " steps with " << snapshotCount << " snapshots" << endl;
+		throw std::runtime_error("Invalid checkpoint schedule");
+	}
+
+	StepCount = stepCount;
+	SnapshotCount = snapshotCount;
+	Actions.clear();
+	SlotStep.assign(SnapshotCount+1, -1);
+	ForwardStepCount = 0;
+
+	//The initial state is always kept in slot 0
+	CurrentStep = 0;
+	SlotStep[0] = 0;
+	AddAction(ActionStore, 0, 0);
+
+	//The terminal action is treated as the adjoint of a step StepCount,
+	//such that StepCount+1 steps are reversed
+	ReverseSteps(0, StepCount+1, SnapshotCount, 0);
+	AddAction(ActionFree, 0, 0);
+}
+
+double CheckpointSchedule::GetReversibleStepCount(int snapshotCount, int repetitionCount)
+{
+	//beta(s, t) = (s+t)! / (s! t!)
+	double count = 1;
+	for (int i=1; i<=snapshotCount; i++)
+	{
+		count = count * (repetitionCount + i) / i;
+	}
+	return count;
+}
+
+const CheckpointSchedule::Entry& CheckpointSchedule::GetEntry(int index)
+{
+	if (index < 0 || index >= (int)Actions.size())
+	{
+		cout << "Invalid checkpoint action " << index << " of " << Actions.size() << endl;
+		throw std::runtime_error("Invalid checkpoint action index");
+	}
+	return Actions[index];
+}
+
+void CheckpointSchedule::AddAction(int action, int step, int slot)
+{
+	Entry entry;
+	entry.Action = action;
+	entry.Step = step;
+	entry.Slot = slot;
+	Actions.push_back(entry);
+}
+
+/*
+ * Brings the forward state to step, restoring startSlot first if the
+ * current state is not on the way to step
+ */
+void CheckpointSchedule::MoveTo(int step, int startSlot)
+{
+	int startStep = SlotStep[startSlot];
+	if (CurrentStep < startStep || CurrentStep > step)
+	{
+		AddAction(ActionRestore, startStep, startSlot);
+		CurrentStep = startStep;
+	}
+	if (CurrentStep < step)
+	{
+		AddAction(ActionAdvance, step, -1);
+		ForwardStepCount += step - CurrentStep;
+		CurrentStep = step;
+	}
+}
+
+void CheckpointSchedule::AdjointStep(int step, int startSlot)
+{
+	MoveTo(step, startSlot);
+	if (step == StepCount)
+	{
+		AddAction(ActionTerminal, step, -1);
+	}
+	else
+	{
+		AddAction(ActionAdjoint, step, -1);
+	}
+}
+
+int CheckpointSchedule::AllocateSlot(int step)
+{
+	for (int slot=1; slot<=SnapshotCount; slot++)
+	{
+		if (SlotStep[slot] == -1)
+		{
+			SlotStep[slot] = step;
+			return slot;
+		}
+	}
+	throw std::runtime_error("No free checkpoint slot");
+}
+
+/*
+ * Reverses the steps [start, end), where the state at start is in
+ * startSlot, using at most freeSnapshots additional snapshots.
+ *
+ * With c = freeSnapshots + 1 checkpoints including startSlot, and t the 
+ * smallest number of repetitions such that beta(c, t) >= n = end - start,
+ * the first snapshot is placed at start + k, with
+ * k = max(n - beta(c-1, t), beta(c, t-2), 1). The right part can then be
+ * reversed with c-1 checkpoints and t repetitions, and the left part with
+ * c checkpoints and t-1 repetitions, both of which are fully used.
+ * This gives the minimal number of forward steps,
+ * t n - beta(c+1, t-1), when the adjoint of a step only needs the
+ * state before the step.
+ */
+void CheckpointSchedule::ReverseSteps(int start, int end, int freeSnapshots, int startSlot)
+{
+	int count = end - start;
+	if (count == 1)
+	{
+		AdjointStep(start, startSlot);
+		return;
+	}
+
+	if (freeSnapshots == 0)
+	{
+		//Recompute every step from startSlot
+		for (int step=end-1; step>=start; step--)
+		{
+			AdjointStep(step, startSlot);
+		}
+		return;
+	}
+
+	int repetitions = 0;
+	while (GetReversibleStepCount(freeSnapshots+1, repetitions) < count)
+	{
+		repetitions++;
+	}
+	int split = count - (int)GetReversibleStepCount(freeSnapshots, repetitions);
+	if (repetitions >= 2)
+	{
+		split = std::max(split, (int)GetReversibleStepCount(freeSnapshots+1, repetitions-2));
+	}
+	split = std::max(1, split);
+	int middle = start + split;
+
+	MoveTo(middle, startSlot);
+	if (end - middle == 1)
+	{
+		//The state at middle is used right away, no need to store it
+		AdjointStep(middle, startSlot);
+		ReverseSteps(start, middle, freeSnapshots, startSlot);
+		return;
+	}
+
+	int slot = AllocateSlot(middle);
+	AddAction(ActionStore, middle, slot);
+
+	ReverseSteps(middle, end, freeSnapshots-1, slot);
+
+	AddAction(ActionFree, middle, slot);
+	SlotStep[slot] = -1;
+
+	ReverseSteps(start, middle, freeSnapshots, startSlot);
+}
+
@@ -0,0 +1,106 @@
+#ifndef CHECKPOINTSCHEDULE_H
+#define CHECKPOINTSCHEDULE_H
+
+#include "../common.h"
+
+#include <vector>
+
+/*
+ * Binomial checkpointing schedule (Revolve) for adjoint propagation.
+ *
+ * An adjoint propagation of StepCount steps needs the forward states
+ * psi(0), ..., psi(StepCount-1) in reverse order. Instead of storing all
+ * of them, only SnapshotCount states are kept in addition to psi(0), and
+ * the others are recomputed from the closest snapshot. The snapshots are
+ * placed by the binomial rule of Griewank and Walther, which minimizes
+ * the number of forward steps for the given number of snapshots: with
+ * s snapshots and t repetitions, beta(s, t) = (s+t)!/(s!t!) steps can
+ * be reversed.
+ *
+ * The schedule is a list of actions to be executed in order by the
+ * driver (see pyprop/CheckpointedAdjoint.py):
+ * - ActionAdvance:  propagate the forward state until it is at Step
+ * - ActionStore:    copy the forward state (at Step) into snapshot Slot
+ * - ActionRestore:  copy snapshot Slot (at Step) into the forward state
+ * - ActionTerminal: the forward state is at StepCount, i.e. the final state,
+ *                   which is given once before the first adjoint step
+ * - ActionAdjoint:  the forward state is at Step, propagate the adjoint
+ *                   state from Step+1 to Step
+ * - ActionFree:     snapshot Slot is no longer needed
+ *
+ * Slot 0 holds psi(0), slots 1..SnapshotCount the snapshots. The forward
+ * state must not be changed by the adjoint step.
+ *
+ * Unlike in Revolve, the adjoint step does not advance the forward state,
+ * and the final state must be reached before the first adjoint step. The
+ * terminal action is therefore scheduled as the adjoint of an extra step
+ * StepCount, and StepCount+1 steps are reversed with SnapshotCount+1
+ * checkpoints.
+ */
+class CheckpointSchedule
+{
+public:
+	typedef boost::shared_ptr<CheckpointSchedule> Ptr;
+
+	enum ActionType
+	{
+		ActionAdvance = 0,
+		ActionStore = 1,
+		ActionRestore = 2,
+		ActionTerminal = 3,
+		ActionAdjoint = 4,
+		ActionFree = 5
+	};
+
+	CheckpointSchedule() : StepCount(0), SnapshotCount(0), CurrentStep(0), ForwardStepCount(0) {}
+
+	/*
+	 * Creates the schedule for stepCount steps with snapshotCount
+	 * snapshots in addition to the initial state
+	 */
+	void Setup(int stepCount, int snapshotCount);
+
+	int GetStepCount() { return StepCount; }
+	int GetSnapshotCount() { return SnapshotCount; }
+
+	int GetActionCount() { return Actions.size(); }
+	int GetAction(int index) { return GetEntry(index).Action; }
+	int GetActionStep(int index) { return GetEntry(index).Step; }
+	int GetActionSlot(int index) { return GetEntry(index).Slot; }
+
+	/*
+	 * Total number of forward steps, including recomputation
+	 */
+	int GetForwardStepCount() { return ForwardStepCount; }
+
+	/*
+	 * Number of steps which can be reversed with snapshotCount
+	 * snapshots and repetitionCount forward sweeps
+	 */
+	static double GetReversibleStepCount(int snapshotCount, int repetitionCount);
+
+private:
+	struct Entry
+	{
+		int Action;
+		int Step;
+		int Slot;
+	};
+
+	std::vector<Entry> Actions;
+	std::vector<int> SlotStep;
+	int StepCount;
+	int SnapshotCount;
+	int CurrentStep;
+	int ForwardStepCount;
+
+	const Entry& GetEntry(int index);
+	void AddAction(int action, int step, int slot);
+	void MoveTo(int step, int startSlot);
+	void ReverseSteps(int start, int end, int freeSnapshots, int startSlot);
+	void AdjointStep(int step, int startSlot);
+	int AllocateSlot(int step);
+};
+
+#endif
+
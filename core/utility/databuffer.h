@@ -2,6 +2,7 @@
 #define DATABUFFER_H
 
 #include "../common.h"
+#include "memoryarena.h"
 
 /*
  * A Wavefunction maintains a list of DataBuffers. Each DataBuffer is a complex array
@@ -9,6 +10,8 @@
  * buffers are needed. The algorithm then locks the DataBuffer, indicating that other algorithms should
  * not use this DataBuffer. When the algorithm has completed its use of the DataBuffer, the lock is released, 
  * and other algorithms can then use the same DataBuffer.
+ *
+ * The data is allocated from the default MemoryArena.
  */
 
 template<int Rank>
@@ -22,14 +25,14 @@ public:
 	{
 		blitz::TinyVector<int, Rank> bufShape;
 		bufShape = 1;
-		DataArray.resize(bufShape);
+		AllocateArenaArray(DataArray, bufShape, DataBlock);
 		isAvailable = BoolPtr(new bool);
 		*isAvailable = true;
 	}
 
 	DataBuffer(blitz::TinyVector<int, Rank> &shape)
 	{
-		DataArray.resize(shape);
+		AllocateArenaArray(DataArray, shape, DataBlock);
 		isAvailable = BoolPtr(new bool);
 		*isAvailable = true;
 	}
@@ -37,6 +40,7 @@ public:
 	DataBuffer(const DataBuffer<Rank> &other)
 	{
 		DataArray.reference(other.DataArray);
+		DataBlock = other.DataBlock;
 		isAvailable = other.isAvailable;
 	}
 
@@ -97,17 +101,19 @@ public:
 
 	void ResizeArray(const blitz::TinyVector<int, Rank>& shape)
 	{
-		DataArray.resize(shape);
+		AllocateArenaArray(DataArray, shape, DataBlock);
 	}
 
 	void FreeArray()
 	{
 		DataArray.resize(0);
+		DataBlock.reset();
 	}
 
 
 private:
 	ArrayType DataArray;
+	MemoryArena::BlockPtr DataBlock;
 	BoolPtr isAvailable;
 };
 
@@ -0,0 +1,554 @@
+#include "expressionevaluator.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+
+void ExpressionEvaluator::Compile(const std::string &expression, const std::vector<std::string> &variableNames)
+{
+	Expression = expression;
+	VariableNames = variableNames;
+	ParameterNames.clear();
+	ParameterValues.clear();
+	ParameterSet.clear();
+	Bytecode.clear();
+
+	Position = 0;
+	NextToken();
+	ParseExpression();
+	if (CurrentToken != TokenEnd)
+	{
+		SyntaxError("Unexpected '" + TokenText + "'");
+	}
+
+	//Find the stack depth needed
+	int depth = 0;
+	StackSize = 0;
+	for (size_t i=0; i<Bytecode.size(); i++)
+	{
+		depth += 1 - GetArgumentCount(Bytecode[i].Op);
+		StackSize = std::max(StackSize, depth);
+	}
+	if (depth != 1)
+	{
+		SyntaxError("Invalid expression");
+	}
+}
+
+std::string ExpressionEvaluator::GetParameterName(int index)
+{
+	if (index < 0 || index >= (int)ParameterNames.size())
+	{
+		cout << "Invalid parameter index " << index << " of " << ParameterNames.size() << endl;
+		throw std::runtime_error("Invalid expression parameter index");
+	}
+	return ParameterNames[index];
+}
+
+int ExpressionEvaluator::GetParameterIndex(const std::string &name)
+{
+	for (size_t i=0; i<ParameterNames.size(); i++)
+	{
+		if (ParameterNames[i] == name)
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+void ExpressionEvaluator::SetParameter(const std::string &name, double value)
+{
+	int index = GetParameterIndex(name);
+	if (index == -1)
+	{
+		cout << "Expression '" << Expression << "' has no parameter " << name << endl;
+		throw std::runtime_error("Unknown expression parameter");
+	}
+	ParameterValues[index] = value;
+	ParameterSet[index] = true;
+}
+
+double ExpressionEvaluator::GetParameter(const std::string &name)
+{
+	int index = GetParameterIndex(name);
+	if (index == -1)
+	{
+		cout << "Expression '" << Expression << "' has no parameter " << name << endl;
+		throw std::runtime_error("Unknown expression parameter");
+	}
+	return ParameterValues[index];
+}
+
+void ExpressionEvaluator::ValidateParameters()
+{
+	if (Bytecode.empty())
+	{
+		throw std::runtime_error("Expression has not been compiled");
+	}
+	for (size_t i=0; i<ParameterNames.size(); i++)
+	{
+		if (!ParameterSet[i])
+		{
+			cout << "Parameter " << ParameterNames[i] << " of expression '" << Expression << "' is not set" << endl;
+			throw std::runtime_error("Expression parameter is not set");
+		}
+	}
+}
+
+/*
+ * Evaluation
+ */
+
+void ExpressionEvaluator::EvaluateBlock(int count, const double* const* variables, double* result, double* workspace)
+{
+	if (count > BlockSize)
+	{
+		throw std::runtime_error("Expression block is larger than BlockSize");
+	}
+
+	//top points to the topmost value on the stack
+	double* top = workspace - BlockSize;
+	for (size_t i=0; i<Bytecode.size(); i++)
+	{
+		const Instruction &instr = Bytecode[i];
+		double* a = top;
+		double* b = top - BlockSize;
+		switch (instr.Op)
+		{
+		case OpConst:
+		case OpParameter:
+		{
+			top += BlockSize;
+			double value = instr.Op == OpConst ? instr.Value : ParameterValues[instr.Index];
+			for (int j=0; j<count; j++) top[j] = value;
+			break;
+		}
+		case OpVariable:
+		{
+			top += BlockSize;
+			const double* var = variables[instr.Index];
+			for (int j=0; j<count; j++) top[j] = var[j];
+			break;
+		}
+
+		//Binary operators, b op a -> b
+		case OpAdd: for (int j=0; j<count; j++) b[j] = b[j] + a[j]; top = b; break;
+		case OpSub: for (int j=0; j<count; j++) b[j] = b[j] - a[j]; top = b; break;
+		case OpMul: for (int j=0; j<count; j++) b[j] = b[j] * a[j]; top = b; break;
+		case OpDiv: for (int j=0; j<count; j++) b[j] = b[j] / a[j]; top = b; break;
+		case OpPow: for (int j=0; j<count; j++) b[j] = std::pow(b[j], a[j]); top = b; break;
+		case OpAtan2: for (int j=0; j<count; j++) b[j] = std::atan2(b[j], a[j]); top = b; break;
+		case OpMin: for (int j=0; j<count; j++) b[j] = std::min(b[j], a[j]); top = b; break;
+		case OpMax: for (int j=0; j<count; j++) b[j] = std::max(b[j], a[j]); top = b; break;
+
+		//Unary operators, op a -> a
+		case OpSquare: for (int j=0; j<count; j++) a[j] = a[j] * a[j]; break;
+		case OpNeg: for (int j=0; j<count; j++) a[j] = -a[j]; break;
+		case OpSqrt: for (int j=0; j<count; j++) a[j] = std::sqrt(a[j]); break;
+		case OpExp: for (int j=0; j<count; j++) a[j] = std::exp(a[j]); break;
+		case OpLog: for (int j=0; j<count; j++) a[j] = std::log(a[j]); break;
+		case OpSin: for (int j=0; j<count; j++) a[j] = std::sin(a[j]); break;
+		case OpCos: for (int j=0; j<count; j++) a[j] = std::cos(a[j]); break;
+		case OpTan: for (int j=0; j<count; j++) a[j] = std::tan(a[j]); break;
+		case OpAsin: for (int j=0; j<count; j++) a[j] = std::asin(a[j]); break;
+		case OpAcos: for (int j=0; j<count; j++) a[j] = std::acos(a[j]); break;
+		case OpAtan: for (int j=0; j<count; j++) a[j] = std::atan(a[j]); break;
+		case OpSinh: for (int j=0; j<count; j++) a[j] = std::sinh(a[j]); break;
+		case OpCosh: for (int j=0; j<count; j++) a[j] = std::cosh(a[j]); break;
+		case OpTanh: for (int j=0; j<count; j++) a[j] = std::tanh(a[j]); break;
+		case OpAbs: for (int j=0; j<count; j++) a[j] = std::fabs(a[j]); break;
+		case OpFloor: for (int j=0; j<count; j++) a[j] = std::floor(a[j]); break;
+		case OpCeil: for (int j=0; j<count; j++) a[j] = std::ceil(a[j]); break;
+		}
+	}
+
+	for (int j=0; j<count; j++)
+	{
+		result[j] = top[j];
+	}
+}
+
+/*
+ * Operator tables
+ */
+
+int ExpressionEvaluator::GetArgumentCount(OpCode op)
+{
+	switch (op)
+	{
+	case OpConst:
+	case OpVariable:
+	case OpParameter:
+		return 0;
+	case OpAdd:
+	case OpSub:
+	case OpMul:
+	case OpDiv:
+	case OpPow:
+	case OpAtan2:
+	case OpMin:
+	case OpMax:
+		return 2;
+	default:
+		return 1;
+	}
+}
+
+double ExpressionEvaluator::ApplyOp(OpCode op, double a, double b)
+{
+	switch (op)
+	{
+	case OpAdd: return a + b;
+	case OpSub: return a - b;
+	case OpMul: return a * b;
+	case OpDiv: return a / b;
+	case OpPow: return std::pow(a, b);
+	case OpAtan2: return std::atan2(a, b);
+	case OpMin: return std::min(a, b);
+	case OpMax: return std::max(a, b);
+	case OpSquare: return a * a;
+	case OpNeg: return -a;
+	case OpSqrt: return std::sqrt(a);
+	case OpExp: return std::exp(a);
+	case OpLog: return std::log(a);
+	case OpSin: return std::sin(a);
+	case OpCos: return std::cos(a);
+	case OpTan: return std::tan(a);
+	case OpAsin: return std::asin(a);
+	case OpAcos: return std::acos(a);
+	case OpAtan: return std::atan(a);
+	case OpSinh: return std::sinh(a);
+	case OpCosh: return std::cosh(a);
+	case OpTanh: return std::tanh(a);
+	case OpAbs: return std::fabs(a);
+	case OpFloor: return std::floor(a);
+	case OpCeil: return std::ceil(a);
+	default:
+		throw std::runtime_error("Invalid expression opcode");
+	}
+}
+
+bool ExpressionEvaluator::LookupFunction(const std::string &name, OpCode &op)
+{
+	static const struct { const char* Name; OpCode Op; } functions[] = {
+		{"sqrt", OpSqrt}, {"exp", OpExp}, {"log", OpLog},
+		{"sin", OpSin}, {"cos", OpCos}, {"tan", OpTan},
+		{"asin", OpAsin}, {"acos", OpAcos}, {"atan", OpAtan},
+		{"sinh", OpSinh}, {"cosh", OpCosh}, {"tanh", OpTanh},
+		{"abs", OpAbs}, {"floor", OpFloor}, {"ceil", OpCeil},
+		{"pow", OpPow}, {"atan2", OpAtan2}, {"min", OpMin}, {"max", OpMax}
+	};
+
+	for (size_t i=0; i<sizeof(functions)/sizeof(functions[0]); i++)
+	{
+		if (name == functions[i].Name)
+		{
+			op = functions[i].Op;
+			return true;
+		}
+	}
+	return false;
+}
+
+const char* ExpressionEvaluator::GetOpName(OpCode op)
+{
+	static const char* names[] = {
+		"const", "variable", "parameter", "add", "sub", "mul", "div", "pow", "square", "neg",
+		"sqrt", "exp", "log", "sin", "cos", "tan", "asin", "acos", "atan", "sinh", "cosh", "tanh",
+		"abs", "floor", "ceil", "atan2", "min", "max"
+	};
+	return names[op];
+}
+
+void ExpressionEvaluator::PrintBytecode()
+{
+	cout << "Expression '" << Expression << "', stack size " << StackSize << endl;
+	for (size_t i=0; i<Bytecode.size(); i++)
+	{
+		const Instruction &instr = Bytecode[i];
+		cout << "    " << GetOpName(instr.Op);
+		if (instr.Op == OpConst) cout << " " << instr.Value;
+		if (instr.Op == OpVariable) cout << " " << VariableNames[instr.Index];
+		if (instr.Op == OpParameter) cout << " " << ParameterNames[instr.Index];
+		cout << endl;
+	}
+}
+
+/*
+ * Code generation. Operators on constant arguments are folded
+ */
+
+void ExpressionEvaluator::EmitConst(double value)
+{
+	Instruction instr;
+	instr.Op = OpConst;
+	instr.Index = 0;
+	instr.Value = value;
+	Bytecode.push_back(instr);
+}
+
+void ExpressionEvaluator::Emit(OpCode op, int index)
+{
+	Instruction instr;
+	instr.Op = op;
+	instr.Index = index;
+	instr.Value = 0;
+	Bytecode.push_back(instr);
+}
+
+void ExpressionEvaluator::EmitUnary(OpCode op)
+{
+	Instruction &a = Bytecode.back();
+	if (a.Op == OpConst)
+	{
+		a.Value = ApplyOp(op, a.Value, 0);
+		return;
+	}
+	Emit(op);
+}
+
+void ExpressionEvaluator::EmitBinary(OpCode op)
+{
+	int size = Bytecode.size();
+	Instruction &a = Bytecode[size-2];
+	Instruction &b = Bytecode[size-1];
+	if (a.Op == OpConst && b.Op == OpConst)
+	{
+		a.Value = ApplyOp(op, a.Value, b.Value);
+		Bytecode.pop_back();
+		return;
+	}
+
+	//x^2 and x^0.5 are common in potentials, and much cheaper than pow
+	if (op == OpPow && b.Op == OpConst && (b.Value == 2 || b.Value == 0.5))
+	{
+		OpCode unaryOp = b.Value == 2 ? OpSquare : OpSqrt;
+		Bytecode.pop_back();
+		Emit(unaryOp);
+		return;
+	}
+
+	Emit(op);
+}
+
+/*
+ * Parser
+ */
+
+void ExpressionEvaluator::SyntaxError(const std::string &message)
+{
+	cout << "Error in expression '" << Expression << "' at position " << Position << ": " << message << endl;
+	throw std::runtime_error("Invalid expression");
+}
+
+void ExpressionEvaluator::NextToken()
+{
+	while (Position < Expression.size() && isspace(Expression[Position]))
+	{
+		Position++;
+	}
+
+	TokenText = "";
+	if (Position >= Expression.size())
+	{
+		CurrentToken = TokenEnd;
+		return;
+	}
+
+	char c = Expression[Position];
+	if (isdigit(c) || (c == '.' && Position+1 < Expression.size() && isdigit(Expression[Position+1])))
+	{
+		const char* start = Expression.c_str() + Position;
+		char* end = 0;
+		TokenValue = strtod(start, &end);
+		TokenText = std::string(start, end - start);
+		Position += end - start;
+		CurrentToken = TokenNumber;
+	}
+	else if (isalpha(c) || c == '_')
+	{
+		size_t start = Position;
+		while (Position < Expression.size() && (isalnum(Expression[Position]) || Expression[Position] == '_'))
+		{
+			Position++;
+		}
+		TokenText = Expression.substr(start, Position - start);
+		CurrentToken = TokenIdentifier;
+	}
+	else if (c == '*' && Position+1 < Expression.size() && Expression[Position+1] == '*')
+	{
+		TokenText = "**";
+		Position += 2;
+		CurrentToken = TokenOperator;
+	}
+	else if (std::string("+-*/^(),").find(c) != std::string::npos)
+	{
+		TokenText = std::string(1, c);
+		Position++;
+		CurrentToken = TokenOperator;
+	}
+	else
+	{
+		SyntaxError(std::string("Invalid character '") + c + "'");
+	}
+}
+
+void ExpressionEvaluator::Expect(const std::string &op)
+{
+	if (CurrentToken != TokenOperator || TokenText != op)
+	{
+		SyntaxError("Expected '" + op + "'");
+	}
+	NextToken();
+}
+
+//expression := term (('+' | '-') term)*
+void ExpressionEvaluator::ParseExpression()
+{
+	ParseTerm();
+	while (CurrentToken == TokenOperator && (TokenText == "+" || TokenText == "-"))
+	{
+		OpCode op = TokenText == "+" ? OpAdd : OpSub;
+		NextToken();
+		ParseTerm();
+		EmitBinary(op);
+	}
+}
+
+//term := unary (('*' | '/') unary)*
+void ExpressionEvaluator::ParseTerm()
+{
+	ParseUnary();
+	while (CurrentToken == TokenOperator && (TokenText == "*" || TokenText == "/"))
+	{
+		OpCode op = TokenText == "*" ? OpMul : OpDiv;
+		NextToken();
+		ParseUnary();
+		EmitBinary(op);
+	}
+}
+
+//unary := ('-' | '+') unary | power
+void ExpressionEvaluator::ParseUnary()
+{
+	if (CurrentToken == TokenOperator && TokenText == "-")
+	{
+		NextToken();
+		ParseUnary();
+		EmitUnary(OpNeg);
+	}
+	else if (CurrentToken == TokenOperator && TokenText == "+")
+	{
+		NextToken();
+		ParseUnary();
+	}
+	else
+	{
+		ParsePower();
+	}
+}
+
+//power := primary (('^' | '**') unary)?, such that -x^2 = -(x^2) and x^-1 is allowed
+void ExpressionEvaluator::ParsePower()
+{
+	ParsePrimary();
+	if (CurrentToken == TokenOperator && (TokenText == "^" || TokenText == "**"))
+	{
+		NextToken();
+		ParseUnary();
+		EmitBinary(OpPow);
+	}
+}
+
+//primary := number | identifier | function '(' arguments ')' | '(' expression ')'
+void ExpressionEvaluator::ParsePrimary()
+{
+	if (CurrentToken == TokenNumber)
+	{
+		EmitConst(TokenValue);
+		NextToken();
+	}
+	else if (CurrentToken == TokenIdentifier)
+	{
+		std::string name = TokenText;
+		NextToken();
+		if (CurrentToken == TokenOperator && TokenText == "(")
+		{
+			ParseFunction(name);
+			return;
+		}
+
+		std::vector<std::string>::iterator var = std::find(VariableNames.begin(), VariableNames.end(), name);
+		if (var != VariableNames.end())
+		{
+			Emit(OpVariable, var - VariableNames.begin());
+		}
+		else if (name == "pi")
+		{
+			EmitConst(M_PI);
+		}
+		else
+		{
+			int index = GetParameterIndex(name);
+			if (index == -1)
+			{
+				index = ParameterNames.size();
+				ParameterNames.push_back(name);
+				ParameterValues.push_back(0.0);
+				ParameterSet.push_back(false);
+			}
+			Emit(OpParameter, index);
+		}
+	}
+	else if (CurrentToken == TokenOperator && TokenText == "(")
+	{
+		NextToken();
+		ParseExpression();
+		Expect(")");
+	}
+	else if (CurrentToken == TokenEnd)
+	{
+		SyntaxError("Unexpected end of expression");
+	}
+	else
+	{
+		SyntaxError("Unexpected '" + TokenText + "'");
+	}
+}
+
+void ExpressionEvaluator::ParseFunction(const std::string &name)
+{
+	OpCode op;
+	if (!LookupFunction(name, op))
+	{
+		SyntaxError("Unknown function " + name);
+	}
+
+	Expect("(");
+	int argumentCount = 1;
+	ParseExpression();
+	while (CurrentToken == TokenOperator && TokenText == ",")
+	{
+		NextToken();
+		ParseExpression();
+		argumentCount++;
+	}
+	Expect(")");
+
+	if (argumentCount != GetArgumentCount(op))
+	{
+		SyntaxError("Wrong number of arguments to " + name);
+	}
+
+	if (argumentCount == 1)
+	{
+		EmitUnary(op);
+	}
+	else
+	{
+		EmitBinary(op);
+	}
+}
+
@@ -0,0 +1,158 @@
+#ifndef EXPRESSIONEVALUATOR_H
+#define EXPRESSIONEVALUATOR_H
+
+#include "../common.h"
+
+#include <vector>
+#include <string>
+
+/*
+ * Compiles an arithmetic expression, e.g. "-Z/sqrt(r^2+a^2) * f", once
+ * into a stack bytecode, which is then evaluated natively for blocks of
+ * points.
+ *
+ * - Operators: + - * / and ^ or ** (power, right associative), unary -
+ * - Functions: sqrt exp log sin cos tan asin acos atan sinh cosh tanh abs
+ *   floor ceil, and pow atan2 min max of two arguments
+ * - Constants: pi
+ *
+ * Identifiers in the variable list given to Compile() take a value per
+ * point, all other identifiers are parameters with a single value, which
+ * must be set with SetParameter() before evaluating (e.g. Z, a, or the
+ * current value of a time dependent function).
+ *
+ * Each bytecode instruction operates on a whole block of BlockSize points,
+ * such that the inner loops are simple enough to be vectorized by the
+ * compiler. Constant subexpressions are folded at compile time.
+ */
+class ExpressionEvaluator
+{
+public:
+	typedef shared_ptr<ExpressionEvaluator> Ptr;
+
+	static const int BlockSize = 256;
+
+	ExpressionEvaluator() : StackSize(0) {}
+
+	/*
+	 * Parses expression. Throws runtime_error on syntax errors
+	 */
+	void Compile(const std::string &expression, const std::vector<std::string> &variableNames);
+
+	std::string GetExpression() { return Expression; }
+	int GetVariableCount() { return VariableNames.size(); }
+
+	int GetParameterCount() { return ParameterNames.size(); }
+	std::string GetParameterName(int index);
+	int GetParameterIndex(const std::string &name);
+	bool HasParameter(const std::string &name) { return GetParameterIndex(name) != -1; }
+	void SetParameter(const std::string &name, double value);
+	double GetParameter(const std::string &name);
+
+	/*
+	 * Number of doubles in the workspace given to EvaluateBlock
+	 */
+	int GetWorkspaceSize() { return StackSize * BlockSize; }
+
+	/*
+	 * Evaluates the expression for count <= BlockSize points.
+	 * variables[i][j] is the value of variable i in point j. workspace
+	 * must hold GetWorkspaceSize() doubles, and can not be shared between
+	 * threads.
+	 */
+	void EvaluateBlock(int count, const double* const* variables, double* result, double* workspace);
+
+	/*
+	 * Checks that all parameters are set. Should be called once before
+	 * evaluating a grid
+	 */
+	void ValidateParameters();
+
+	void PrintBytecode();
+
+private:
+	enum OpCode
+	{
+		OpConst,
+		OpVariable,
+		OpParameter,
+		OpAdd,
+		OpSub,
+		OpMul,
+		OpDiv,
+		OpPow,
+		OpSquare,
+		OpNeg,
+		OpSqrt,
+		OpExp,
+		OpLog,
+		OpSin,
+		OpCos,
+		OpTan,
+		OpAsin,
+		OpAcos,
+		OpAtan,
+		OpSinh,
+		OpCosh,
+		OpTanh,
+		OpAbs,
+		OpFloor,
+		OpCeil,
+		OpAtan2,
+		OpMin,
+		OpMax
+	};
+
+	struct Instruction
+	{
+		OpCode Op;
+		int Index;
+		double Value;
+	};
+
+	enum TokenType
+	{
+		TokenEnd,
+		TokenNumber,
+		TokenIdentifier,
+		TokenOperator
+	};
+
+	std::string Expression;
+	std::vector<std::string> VariableNames;
+	std::vector<std::string> ParameterNames;
+	std::vector<double> ParameterValues;
+	std::vector<bool> ParameterSet;
+	std::vector<Instruction> Bytecode;
+	int StackSize;
+
+	//Parser state
+	size_t Position;
+	TokenType CurrentToken;
+	std::string TokenText;
+	double TokenValue;
+
+	void NextToken();
+	void Expect(const std::string &op);
+	void SyntaxError(const std::string &message);
+
+	void ParseExpression();
+	void ParseTerm();
+	void ParseUnary();
+	void ParsePower();
+	void ParsePrimary();
+	void ParseFunction(const std::string &name);
+
+	void EmitConst(double value);
+	void Emit(OpCode op, int index=0);
+	void EmitUnary(OpCode op);
+	void EmitBinary(OpCode op);
+
+	static int GetArgumentCount(OpCode op);
+	static double ApplyOp(OpCode op, double a, double b);
+	static bool LookupFunction(const std::string &name, OpCode &op);
+	static const char* GetOpName(OpCode op);
+};
+
+#endif
+
@@ -0,0 +1,41 @@
+#include "gilrelease.h"
+
+__thread bool ReleaseGIL::Released = false;
+
+ReleaseGIL::ReleaseGIL() : State(0)
+{
+	if (!Released && Py_IsInitialized() && PyEval_ThreadsInitialized())
+	{
+		State = PyEval_SaveThread();
+		Released = true;
+	}
+}
+
+ReleaseGIL::~ReleaseGIL()
+{
+	if (State != 0)
+	{
+		PyEval_RestoreThread(State);
+		Released = false;
+	}
+}
+
+
+AcquireGIL::AcquireGIL() : WasReleased(ReleaseGIL::Released)
+{
+	if (WasReleased)
+	{
+		State = PyGILState_Ensure();
+		ReleaseGIL::Released = false;
+	}
+}
+
+AcquireGIL::~AcquireGIL()
+{
+	if (WasReleased)
+	{
+		ReleaseGIL::Released = true;
+		PyGILState_Release(State);
+	}
+}
+
@@ -0,0 +1,86 @@
+#ifndef GILRELEASE_H
+#define GILRELEASE_H
+
+#include "boostpythonhack.h"
+
+/*
+ * Scoped release of the python global interpreter lock (GIL) around long
+ * running C++ calls (propagation steps, tensor potential multiplies,
+ * transforms), so that python threads, like the CheckpointService writer
+ * and the DatasetChunkReader prefetch, can run while the main thread
+ * computes.
+ *
+ *     {
+ *         ReleaseGIL releaseGIL;
+ *         ... pure C++, no python objects ...
+ *     }
+ *
+ * Code inside a ReleaseGIL scope which calls into python (callbacks, time
+ * functions) or copies, assigns or destroys boost::python::objects must
+ * take the GIL back with an AcquireGIL scope:
+ *
+ *     {
+ *         AcquireGIL acquireGIL;
+ *         callback(psi, tempPsi, t);
+ *     }
+ *
+ * Both nest. A ReleaseGIL inside a ReleaseGIL does nothing, and an
+ * AcquireGIL outside a ReleaseGIL does nothing, such that the guards can
+ * be placed at every python entry point, regardless of whether it is
+ * called from python directly or from a callback of another entry point.
+ * Nothing is done before the python threads are initialized (no other
+ * python thread can run), or when there is no interpreter (e.g. the
+ * kernel benchmarks).
+ *
+ * The state is per thread, the guards must only be used on threads which
+ * hold the GIL when entering the outermost ReleaseGIL, i.e. not inside
+ * OpenMP parallel regions.
+ */
+class ReleaseGIL
+{
+public:
+	ReleaseGIL();
+	~ReleaseGIL();
+
+	/*
+	 * Returns true if the calling thread is inside a ReleaseGIL scope,
+	 * and not inside a nested AcquireGIL scope
+	 */
+	static bool IsReleased()
+	{
+		return Released;
+	}
+
+private:
+	friend class AcquireGIL;
+
+#ifndef __GCCXML__
+	PyThreadState *State;
+#endif
+	static __thread bool Released;
+
+	//Non copyable
+	ReleaseGIL(const ReleaseGIL&);
+	ReleaseGIL& operator=(const ReleaseGIL&);
+};
+
+
+class AcquireGIL
+{
+public:
+	AcquireGIL();
+	~AcquireGIL();
+
+private:
+	bool WasReleased;
+#ifndef __GCCXML__
+	PyGILState_STATE State;
+#endif
+
+	//Non copyable
+	AcquireGIL(const AcquireGIL&);
+	AcquireGIL& operator=(const AcquireGIL&);
+};
+
+#endif
+
@@ -0,0 +1,265 @@
+#include "memoryarena.h"
+
+#include <cstdlib>
+#include <sys/mman.h>
+
+MemoryArena::Ptr MemoryArena::DefaultArena;
+MemoryArena::LiveBlockMap MemoryArena::LiveBlocks;
+const long MemoryArena::CacheUnlimited;
+const long MemoryArena::CacheAuto;
+const long MemoryArena::CacheAutoFactor;
+
+MemoryArena::MemoryArena() :
+	Alignment(64),
+	UseHugePages(true),
+	HugePageSize(2*1024*1024),
+	FirstTouch(true),
+	MaxCachedBytes(CacheAuto),
+	UsedBytes(0),
+	CachedBytes(0),
+	PeakBytes(0),
+	LargestBlockBytes(0),
+	AllocationCount(0),
+	ReuseCount(0)
+{
+}
+
+MemoryArena::~MemoryArena()
+{
+	ReleaseCache();
+}
+
+MemoryArena::Ptr MemoryArena::GetDefaultArena()
+{
+	if (DefaultArena == 0)
+	{
+		DefaultArena = Ptr(new MemoryArena());
+	}
+	return DefaultArena;
+}
+
+/*
+ * Replaces the default arena. Blocks allocated from the previous
+ * arena are returned to it when they are released
+ */
+void MemoryArena::SetDefaultArena(MemoryArena::Ptr arena)
+{
+	if (arena == 0)
+	{
+		throw std::runtime_error("Default memory arena can not be null");
+	}
+	DefaultArena = arena;
+}
+
+void MemoryArena::SetAlignment(long alignment)
+{
+	if (alignment < (long)sizeof(void*) || (alignment & (alignment-1)) != 0)
+	{
+		cout << "Invalid memory arena alignment " << alignment << endl;
+		throw std::runtime_error("Memory arena alignment must be a power of two, and at least the size of a pointer");
+	}
+	Alignment = alignment;
+}
+
+void MemoryArena::SetMaxCachedBytes(long maxCachedBytes)
+{
+	if (maxCachedBytes < CacheAuto)
+	{
+		cout << "Invalid memory arena cache size " << maxCachedBytes << endl;
+		throw std::runtime_error("Memory arena cache size must be a byte count, CacheUnlimited or CacheAuto");
+	}
+	MaxCachedBytes = maxCachedBytes;
+
+	long limit = GetCacheLimit();
+	if (limit != CacheUnlimited && CachedBytes > limit)
+	{
+		ReleaseCache();
+	}
+}
+
+long MemoryArena::GetCacheLimit()
+{
+	if (MaxCachedBytes == CacheAuto)
+	{
+		return CacheAutoFactor * LargestBlockBytes;
+	}
+	return MaxCachedBytes;
+}
+
+size_t MemoryArena::GetByteCount(long count)
+{
+	size_t byteCount = count * sizeof(cplx);
+	if (UseHugePages && (long)byteCount >= HugePageSize)
+	{
+		byteCount = ((byteCount + HugePageSize - 1) / HugePageSize) * HugePageSize;
+	}
+	return byteCount;
+}
+
+MemoryArena::BlockPtr MemoryArena::Allocate(long count)
+{
+	if (count <= 0)
+	{
+		return BlockPtr();
+	}
+
+	size_t byteCount = GetByteCount(count);
+	cplx* data = 0;
+
+	#pragma omp critical(MemoryArena)
+	{
+		BlockCache::iterator it = Cache.find(count);
+		if (it != Cache.end())
+		{
+			data = it->second.Data;
+			byteCount = it->second.ByteCount;
+			Cache.erase(it);
+			CachedBytes -= byteCount;
+			ReuseCount++;
+		}
+	}
+
+	if (data == 0)
+	{
+		size_t alignment = Alignment;
+		if (UseHugePages && (long)byteCount >= HugePageSize)
+		{
+			alignment = std::max<size_t>(alignment, HugePageSize);
+		}
+		data = static_cast<cplx*>(AllocateRaw(byteCount, alignment));
+		Place(data, count);
+
+		#pragma omp critical(MemoryArena)
+		AllocationCount++;
+	}
+
+	BlockPtr block(data, BlockDeleter(shared_from_this(), count, byteCount));
+
+	#pragma omp critical(MemoryArena)
+	{
+		UsedBytes += byteCount;
+		PeakBytes = std::max(PeakBytes, UsedBytes + CachedBytes);
+		LargestBlockBytes = std::max(LargestBlockBytes, (long)byteCount);
+
+		LiveBlock &liveBlock = LiveBlocks[reinterpret_cast<const char*>(data)];
+		liveBlock.Block = block;
+		liveBlock.ByteCount = count * sizeof(cplx);
+	}
+
+	return block;
+}
+
+void MemoryArena::Release(cplx* data, long count, size_t byteCount)
+{
+	bool cacheBlock = false;
+
+	#pragma omp critical(MemoryArena)
+	{
+		LiveBlocks.erase(reinterpret_cast<const char*>(data));
+		UsedBytes -= byteCount;
+		long limit = GetCacheLimit();
+		if (limit == CacheUnlimited || CachedBytes + (long)byteCount <= limit)
+		{
+			CachedBlock block;
+			block.Data = data;
+			block.ByteCount = byteCount;
+			Cache.insert(std::make_pair(count, block));
+			CachedBytes += byteCount;
+			cacheBlock = true;
+		}
+	}
+
+	if (!cacheBlock)
+	{
+		FreeRaw(data, byteCount);
+	}
+}
+
+MemoryArena::BlockPtr MemoryArena::FindBlock(const void* data)
+{
+	const char* address = static_cast<const char*>(data);
+	BlockPtr block;
+
+	#pragma omp critical(MemoryArena)
+	{
+		//The last block starting at or before address
+		LiveBlockMap::iterator it = LiveBlocks.upper_bound(address);
+		if (it != LiveBlocks.begin())
+		{
+			--it;
+			if (address < it->first + it->second.ByteCount)
+			{
+				block = it->second.Block.lock();
+			}
+		}
+	}
+
+	return block;
+}
+
+void MemoryArena::ReleaseCache()
+{
+	BlockCache cache;
+	#pragma omp critical(MemoryArena)
+	{
+		cache.swap(Cache);
+		CachedBytes = 0;
+	}
+
+	for (BlockCache::iterator it = cache.begin(); it != cache.end(); it++)
+	{
+		FreeRaw(it->second.Data, it->second.ByteCount);
+	}
+}
+
+void* MemoryArena::AllocateRaw(size_t byteCount, size_t alignment)
+{
+	void* data = 0;
+	if (posix_memalign(&data, alignment, byteCount) != 0)
+	{
+		cout << "Could not allocate " << byteCount / (1024*1024) << "MB with alignment " << alignment << endl;
+		throw std::runtime_error("Memory arena allocation failed");
+	}
+
+#ifdef MADV_HUGEPAGE
+	if (UseHugePages && (long)byteCount >= HugePageSize)
+	{
+		//Only a hint, the kernel may not support transparent huge pages
+		madvise(data, byteCount, MADV_HUGEPAGE);
+	}
+#endif
+
+	return data;
+}
+
+void MemoryArena::FreeRaw(void* data, size_t byteCount)
+{
+	free(data);
+}
+
+/*
+ * First touch of a new block. The pages are placed on the NUMA node of the
+ * thread touching them first, so use the static schedule of the kernels
+ */
+void MemoryArena::Place(cplx* data, long count)
+{
+	if (!FirstTouch)
+	{
+		return;
+	}
+
+	#pragma omp parallel for schedule(static)
+	for (long i=0; i<count; i++)
+	{
+		data[i] = 0;
+	}
+}
+
+void MemoryArena::PrintStatistics()
+{
+	cout << "Memory arena: " << GetMemoryFootprint() / (1024*1024) << "MB "
+	     << "(" << UsedBytes / (1024*1024) << "MB used, " << CachedBytes / (1024*1024) << "MB cached, "
+	     << PeakBytes / (1024*1024) << "MB peak), "
+	     << AllocationCount << " allocations, " << ReuseCount << " reused" << endl;
+}
+
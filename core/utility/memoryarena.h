@@ -0,0 +1,168 @@
+#ifndef MEMORYARENA_H
+#define MEMORYARENA_H
+
+#include "../common.h"
+
+#include <map>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/weak_ptr.hpp>
+
+/*
+ * Allocator for the large complex arrays of pyprop, i.e. the wavefunction
+ * DataBuffers and the StaticPotential storage.
+ *
+ * - Blocks are aligned to Alignment bytes (default 64, a cache line)
+ * - Blocks larger than HugePageSize are aligned to and padded to whole
+ *   huge pages, and marked for transparent huge pages (madvise), if
+ *   UseHugePages is set
+ * - New blocks are first touched (zeroed) with the static schedule used
+ *   by the kernels, such that on NUMA nodes every page is placed on the
+ *   socket of the thread which will later process it
+ * - Released blocks are cached by element count, and reused for the next
+ *   allocation of the same size (e.g. the temp buffers of successive
+ *   CopyDeep()s), until the cache exceeds MaxCachedBytes. By default
+ *   (CacheAuto), the cache is bounded by CacheAutoFactor times the largest
+ *   block allocated so far, which keeps one wavefunction and its temp
+ *   buffer. CacheUnlimited caches every released block
+ *
+ * Blocks are returned as shared pointers which give the memory back to
+ * the arena when the last reference is released. Arrays are created on
+ * top of the blocks with neverDeleteData, and must not outlive the block.
+ *
+ * All allocations go through the default arena, which may be replaced
+ * by a subclass overriding AllocateRaw/FreeRaw/Place with SetDefaultArena.
+ * Options apply to blocks allocated after they are set.
+ *
+ * FindBlock() returns the live block containing a given address, which
+ * lets the python array converter keep the block of a wavefunction
+ * buffer alive for as long as a NumPy view of it exists.
+ */
+class MemoryArena : public boost::enable_shared_from_this<MemoryArena>
+{
+public:
+	typedef boost::shared_ptr<MemoryArena> Ptr;
+	typedef boost::shared_ptr<cplx> BlockPtr;
+
+	/*
+	 * Special values of MaxCachedBytes
+	 */
+	static const long CacheUnlimited = -1;
+	static const long CacheAuto = -2;
+	static const long CacheAutoFactor = 2;
+
+	MemoryArena();
+	virtual ~MemoryArena();
+
+	static Ptr GetDefaultArena();
+	static void SetDefaultArena(Ptr arena);
+
+	/*
+	 * Returns the block (of any arena) which contains data, or a
+	 * null pointer if data was not allocated by an arena
+	 */
+	static BlockPtr FindBlock(const void* data);
+
+	/*
+	 * Returns a block of count elements
+	 */
+	BlockPtr Allocate(long count);
+
+	/*
+	 * Frees all cached blocks
+	 */
+	void ReleaseCache();
+
+	void SetAlignment(long alignment);
+	long GetAlignment() { return Alignment; }
+	void SetUseHugePages(bool useHugePages) { UseHugePages = useHugePages; }
+	bool GetUseHugePages() { return UseHugePages; }
+	void SetHugePageSize(long hugePageSize) { HugePageSize = hugePageSize; }
+	long GetHugePageSize() { return HugePageSize; }
+	void SetFirstTouch(bool firstTouch) { FirstTouch = firstTouch; }
+	bool GetFirstTouch() { return FirstTouch; }
+	void SetMaxCachedBytes(long maxCachedBytes);
+	long GetMaxCachedBytes() { return MaxCachedBytes; }
+
+	/*
+	 * Returns the current bound of the cache in bytes, or CacheUnlimited
+	 */
+	long GetCacheLimit();
+
+	/*
+	 * Statistics. The memory footprint is the number of bytes held by
+	 * the arena, i.e. the bytes in use and the bytes cached
+	 */
+	long GetMemoryFootprint() { return UsedBytes + CachedBytes; }
+	long GetUsedBytes() { return UsedBytes; }
+	long GetCachedBytes() { return CachedBytes; }
+	long GetPeakBytes() { return PeakBytes; }
+	long GetAllocationCount() { return AllocationCount; }
+	long GetReuseCount() { return ReuseCount; }
+	void PrintStatistics();
+
+protected:
+	virtual void* AllocateRaw(size_t byteCount, size_t alignment);
+	virtual void FreeRaw(void* data, size_t byteCount);
+	virtual void Place(cplx* data, long count);
+
+private:
+	struct CachedBlock
+	{
+		cplx* Data;
+		size_t ByteCount;
+	};
+	typedef std::multimap<long, CachedBlock> BlockCache;
+
+	struct LiveBlock
+	{
+		boost::weak_ptr<cplx> Block;
+		size_t ByteCount;
+	};
+	typedef std::map<const char*, LiveBlock> LiveBlockMap;
+
+	class BlockDeleter
+	{
+	public:
+		BlockDeleter(Ptr arena, long count, size_t byteCount) : Arena(arena), Count(count), ByteCount(byteCount) {}
+		void operator()(cplx* data) { Arena->Release(data, Count, ByteCount); }
+	private:
+		Ptr Arena;
+		long Count;
+		size_t ByteCount;
+	};
+	friend class BlockDeleter;
+
+	static Ptr DefaultArena;
+	static LiveBlockMap LiveBlocks;
+
+	long Alignment;
+	bool UseHugePages;
+	long HugePageSize;
+	bool FirstTouch;
+	long MaxCachedBytes;
+
+	BlockCache Cache;
+	long UsedBytes;
+	long CachedBytes;
+	long PeakBytes;
+	long LargestBlockBytes;
+	long AllocationCount;
+	long ReuseCount;
+
+	size_t GetByteCount(long count);
+	void Release(cplx* data, long count, size_t byteCount);
+};
+
+/*
+ * Resizes array to shape, with the data in a block from the default arena.
+ * block holds the memory, and must be kept alive with the array
+ */
+template<int Rank>
+void AllocateArenaArray(blitz::Array<cplx, Rank> &array, const blitz::TinyVector<int, Rank> &shape, MemoryArena::BlockPtr &block)
+{
+	block = MemoryArena::GetDefaultArena()->Allocate(blitz::product(shape));
+	array.reference(blitz::Array<cplx, Rank>(block.get(), shape, blitz::neverDeleteData));
+}
+
+#endif
+
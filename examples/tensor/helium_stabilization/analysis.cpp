@@ -2,6 +2,7 @@
 #include <core/wavefunction.h>
 #include <core/representation/coupledspherical/coupledrange.h>
 #include <core/transform/spherical/shtools.h>
+#include <core/analysis/radialproductprojection.h>
 
 #include <boost/python.hpp>
 #include <boost/python/stl_iterator.hpp>
@@ -24,12 +25,10 @@ typedef Array<cplx, 1> VectorType;
  *
  *	<r1(1) r2(2) | psi(1,2) >
  *
- * It takes in a list of angular indices, corresponding to which
- * angular momentum indices is corresponding to this l1, l2 pair.
- *
- * Remarks:
- * - No symmetrization is made on either psi or the radial functions
- * - Integration weights are assumed to have been applied to psi on beforehand
+ * These are convenience wrappers around RadialProductProjector in 
+ * core/analysis, which does not cache the radial states between calls. 
+ * When projecting on the same set of states many times, create a
+ * RadialProductProjector, and call SetRadialStates once for each l instead.
  *
  * A 3D array is returned
  * 		rank0: angular indices
@@ -38,48 +37,10 @@ typedef Array<cplx, 1> VectorType;
  */
 Array<cplx, 3> CalculateProjectionRadialProductStates(int l1, MatrixType V1, int l2, MatrixType V2, Array<cplx, 3> psiData, Array<int, 1> angularIndices)
 {
-	int count0 = angularIndices.extent(0);
-	int count1 = V1.extent(1);
-	int count2 = V2.extent(1);
-	int rcount = V1.extent(0);
-
-	blitz::Array<cplx, 3> proj(count0, count1, count2);
-	blitz::Array<cplx, 2> tempProj(rcount, count2);
-
-	for (int i0=0; i0<angularIndices.extent(0); i0++)
-	{
-		int angIdx = angularIndices(i0);
-		MatrixType psiSlice = psiData(angIdx, Range::all(), Range::all());
-
-
-		//project on V2 states
-		tempProj = 0;
-		for (int r1=0; r1<rcount; r1++)
-		{
-			for (int r2=0; r2<rcount; r2++)
-			{
-				cplx curPsi = psiSlice(r1, r2);
-				for (int i2=0; i2<count2; i2++)
-				{
-					tempProj(r1, i2) += conj(V2(r2, i2)) * curPsi;
-				}
-			}
-		}
-
-		//project on V1 states
-		for (int r1=0; r1<rcount; r1++)
-		{
-			for (int i1=0; i1<count1; i1++)
-			{
-				for (int i2=0; i2<count2; i2++)
-				{
-					proj(i0, i1, i2) += conj(V1(r1, i1)) * tempProj(r1, i2);
-				}
-			}
-		}
-	}
-
-	return proj;
+	RadialProductProjector projector;
+	projector.SetRadialStates(0, l1, V1);
+	projector.SetRadialStates(1, l2, V2);
+	return projector.CalculateProjection(l1, l2, psiData, angularIndices);
 }
 
 
@@ -92,33 +53,10 @@ Array<cplx, 3> CalculateProjectionRadialProductStates(int l1, MatrixType V1, int
  */
 void RemoveProjectionRadialProductStates(int l1, MatrixType V1, int l2, MatrixType V2, Array<cplx, 3> psiData, Array<int, 1> angularIndices, Array<cplx, 3> outputPsi)
 {
-	int count0 = angularIndices.extent(0);
-	int count1 = V1.extent(1);
-	int count2 = V2.extent(1);
-	int rcount = V2.extent(0);
-
-	//Calculate projection
-	Array<cplx, 3> proj = CalculateProjectionRadialProductStates(l1, V1, l2, V2, psiData, angularIndices);
-
-	for (int i0=0; i0<count0; i0++)
-	{
-		int angIdx = angularIndices(i0);
-		MatrixType psiSlice = outputPsi(angIdx, Range::all(), Range::all());
-
-		for (int r1=0; r1<rcount; r1++)
-		{
-			for (int r2=0; r2<rcount; r2++)
-			{
-				for (int i1=0; i1<count1; i1++)
-				{
-					for (int i2=0; i2<count2; i2++)
-					{
-						psiSlice(r1, r2) -= proj(i0, i1, i2) * V1(r1, i1) * V2(r2, i2);
-					}
-				}
-			}
-		}
-	}
+	RadialProductProjector projector;
+	projector.SetRadialStates(0, l1, V1);
+	projector.SetRadialStates(1, l2, V2);
+	projector.RemoveProjection(l1, l2, psiData, angularIndices, outputPsi);
 }
 
 
@@ -133,19 +71,17 @@ void RemoveProjectionRadialProductStates(int l1, MatrixType V1, int l2, MatrixTy
  */
 list CalculatePopulationRadialProductStates(int l1, MatrixType V1, int l2, MatrixType V2, Array<cplx, 3> psiData, Array<int, 1> angularIndices)
 {
-	int count1 = V1.extent(1);
-	int count2 = V2.extent(1);
-
-	Array<cplx, 3> proj = CalculateProjectionRadialProductStates(l1, V1, l2, V2, psiData, angularIndices);
-	proj *= conj(proj);
+	RadialProductProjector projector;
+	projector.SetRadialStates(0, l1, V1);
+	projector.SetRadialStates(1, l2, V2);
+	Array<double, 2> pop = projector.CalculatePopulation(l1, l2, psiData, angularIndices);
 	
 	list popList;
-	for (int i1=0; i1<count1; i1++)
+	for (int i1=0; i1<pop.extent(0); i1++)
 	{
-		for (int i2=0; i2<count2; i2++)
+		for (int i2=0; i2<pop.extent(1); i2++)
 		{
-			double pop = real(sum(proj(Range::all(), i1, i2)));
-			popList.append(make_tuple(i1, i2, pop));
+			popList.append(make_tuple(i1, i2, pop(i1, i2)));
 		}
 	}
 	return popList;
@@ -691,6 +691,22 @@ def GetRadialCoulombWaveBSplines(Z, l, k, bsplineObj):
 #        Calculations on general product state combinations
 #------------------------------------------------------------------------
 
+def SetupRadialProductProjector(singleStates1, singleStates2):
+	"""
+	Creates a pyprop.core.RadialProductProjector with the radial states 
+	singleStates1 for particle 1 and singleStates2 for particle 2 for
+	every l. The projector caches the (conjugated and transposed) radial
+	states, such that repeated projections only cost the matrix products.
+	"""
+	projector = pyprop.core.RadialProductProjector()
+	for l, V in enumerate(singleStates1):
+		if V.size > 0:
+			projector.SetRadialStates(0, l, V)
+	for l, V in enumerate(singleStates2):
+		if V.size > 0:
+			projector.SetRadialStates(1, l, V)
+	return projector
+
 def GetPopulationProductStates(psi, singleStates1, singleStates2):
 	"""
 	Calculates the population of psi in a set of single electron product states
@@ -714,6 +730,7 @@ def GetPopulationProductStates(psi, singleStates1, singleStates2):
 
 	data = tempPsi.GetData()
 	population = []
+	projector = SetupRadialProductProjector(singleStates1, singleStates2)
 
 	for l1, V1 in enumerate(singleStates1):
 		print "%i/%i" % (l1, len(singleStates1))
@@ -731,8 +748,9 @@ def GetPopulationProductStates(psi, singleStates1, singleStates2):
 				continue
 		
 			#Get the population for every combination of v1 and v2
-			projV = CalculatePopulationRadialProductStates(l1, V1, l2, V2, data, angularIndices)
-			cursum = sum([p for i1, i2, p in projV])
+			pop = projector.CalculatePopulation(l1, l2, data, angularIndices)
+			projV = [(i1, i2, pop[i1, i2]) for i1 in range(pop.shape[0]) for i2 in range(pop.shape[1])]
+			cursum = sum(pop)
 			print l1, l2, len(projV), cursum
 			population.append((l1, l2, projV))
 
@@ -763,11 +781,16 @@ def RemoveProductStatesProjection(psi, singleStates1, singleStates2):
 
 	data = tempPsi.GetData()
 	population = []
+	projector = SetupRadialProductProjector(singleStates1, singleStates2)
 
 	for l1, V1 in enumerate(singleStates1):
 		print "%i/%i" % (l1, len(singleStates1))
+		if V1.size == 0:
+			continue
 
 		for l2, V2 in enumerate(singleStates2):
+			if V2.size == 0:
+				continue
 
 			#filter out coupled spherical harmonic indices corresponding to this l
 			lfilter = lambda coupledIndex: coupledIndex.l1 == l1 and coupledIndex.l2 == l2 
@@ -776,11 +799,207 @@ def RemoveProductStatesProjection(psi, singleStates1, singleStates2):
 				continue
 		
 			#Remove projection for every combination of v1 and v2
-			projV = RemoveProjectionRadialProductStates(l1, V1, l2, V2, data, angularIndices, psi.GetData())
+			projector.RemoveProjection(l1, l2, data, angularIndices, psi.GetData())
 
 	return population
 
 
+#------------------------------------------------------------------------
+#                Chunked analysis of large wavefunction files
+#------------------------------------------------------------------------
+
+def CreateWavefunctionTemplateFromFile(filename, datasetPath="/wavefunction"):
+	"""
+	Creates a wavefunction from the config object stored in a HDF5 file,
+	without allocating or loading the data. The wavefunction can be used to
+	look up its representation (e.g. with
+	GetLocalCoupledSphericalHarmonicIndices), but has no data buffer.
+	"""
+	conf = pyprop.LoadConfigFromFile(filename, datasetPath)
+	distr = pyprop.CreateDistribution(conf)
+	repr = pyprop.CreateRepresentation(conf, distr)
+	return pyprop.CreateWavefunctionInstance(repr, allocateData=False)
+
+
+def GetChunkIndices(indices, slab):
+	"""
+	Maps a list of angular indices of the full wavefunction to a chunk of
+	the wavefunction given by slab (along the angular rank).
+
+	Returns a tuple (positions, chunkIndices), such that
+	indices[positions[i]] == slab[0].start + chunkIndices[i]
+	"""
+	start, end = slab[0].start, slab[0].stop
+	positions = [i for i, index in enumerate(indices) if start <= index < end]
+	chunkIndices = [indices[i] - start for i in positions]
+	return array(positions, dtype=int32), array(chunkIndices, dtype=int32)
+
+
+def GetProductStateAngularIndices(psi, singleStates1, singleStates2):
+	"""
+	Returns a list of (l1, l2, angularIndices) for every l-pair with
+	both single particle states, and a non-empty list of angular indices
+	"""
+	pairIndices = []
+	for l1, V1 in enumerate(singleStates1):
+		if V1.size == 0:
+			continue
+		for l2, V2 in enumerate(singleStates2):
+			if V2.size == 0:
+				continue
+			lfilter = lambda coupledIndex: coupledIndex.l1 == l1 and coupledIndex.l2 == l2
+			angularIndices = GetLocalCoupledSphericalHarmonicIndices(psi, lfilter)
+			if len(angularIndices) > 0:
+				pairIndices.append((l1, l2, angularIndices))
+	return pairIndices
+
+
+def RemoveProductStatesProjectionChunk(psi, slab, data, singleStates1, singleStates2):
+	"""
+	Chunked version of RemoveProductStatesProjection, for a chunk data
+	(along the angular rank) of a wavefunction file, as given by
+	pyprop.serialization.DatasetChunkReader. data is modified in place.
+	The projection on product states is local in the angular index, so no
+	reduction over chunks is needed.
+	"""
+	repr = psi.GetRepresentation()
+	weightedData = data.copy()
+	pyprop.serialization.MultiplyIntegrationWeightsSlab(repr, weightedData, slab)
+
+	projector = SetupRadialProductProjector(singleStates1, singleStates2)
+	for l1, l2, angularIndices in GetProductStateAngularIndices(psi, singleStates1, singleStates2):
+		positions, chunkIndices = GetChunkIndices(angularIndices, slab)
+		if len(chunkIndices) > 0:
+			projector.RemoveProjection(l1, l2, weightedData, chunkIndices, data)
+
+
+def GetPopulationProductStatesChunked(filename, singleStates1, singleStates2, boundStateInfo=None, chunkSize=16, datasetPath="/wavefunction", prepareChunk=None):
+	"""
+	Calculates the population of a wavefunction file in a set of single
+	electron product states, as GetPopulationProductStates, without loading
+	the full wavefunction into memory.
+
+	The wavefunction is read in chunks of chunkSize angular indices, the
+	next chunk being read in a background thread while the current one is
+	processed (see pyprop.serialization.DatasetChunkReader). The memory
+	usage is a few chunks, and the population is reduced over the chunks.
+
+	If boundStateInfo (as returned from GetBoundStateFileInfo) is given,
+	the bound state projection is removed before the populations are
+	calculated, as RemoveBoundStateProjection does. As the bound state
+	projections are sums over all angular indices of an L, this requires
+	two passes over the file: one to calculate the projections, and one to
+	remove them and calculate the populations. The bound states are not
+	loaded, in each pass the rows matching the current chunk are read from
+	the bound state files.
+
+	prepareChunk(psi, slab, data) is called on every chunk before it is
+	analyzed in each pass, e.g. to remove single ionization or to filter on
+	L. psi is a wavefunction without data (see
+	CreateWavefunctionTemplateFromFile)
+
+	Returns a tuple (population, norm, ionizationNorm), where population
+	is in the same format as returned from GetPopulationProductStates, norm
+	is <psi|psi> and ionizationNorm is <psi|psi> after the bound states
+	are removed
+	"""
+	psi = CreateWavefunctionTemplateFromFile(filename, datasetPath)
+	repr = psi.GetRepresentation()
+	reader = pyprop.serialization.DatasetChunkReader(filename, datasetPath, chunkSize)
+
+	def getWeightedChunk(slab, data):
+		weightedData = data.copy()
+		pyprop.serialization.MultiplyIntegrationWeightsSlab(repr, weightedData, slab)
+		return weightedData
+
+	#First pass: norm and bound state projections
+	boundIndices = []
+	if boundStateInfo != None:
+		for boundFile, boundPaths, L in boundStateInfo:
+			LFilter = lambda idx: idx.L == L
+			boundIndices.append(GetLocalCoupledSphericalHarmonicIndices(psi, LFilter))
+
+	def getBoundStateChunks(slab):
+		"""
+		Returns, for every L, the chunk indices of the angular indices of L
+		in slab, and the matching rows of the bound states of L
+		"""
+		chunkList = []
+		for (boundFile, boundPaths, L), indexL in zip(boundStateInfo, boundIndices):
+			positions, chunkIndices = GetChunkIndices(indexL, slab)
+			boundData = []
+			if len(positions) > 0:
+				#indexL is increasing, so the rows of a chunk are contiguous
+				boundSlab = (slice(int(positions[0]), int(positions[-1])+1),)
+				boundData = pyprop.serialization.ReadDatasetSlabs(boundFile, boundPaths, boundSlab)
+			chunkList.append((chunkIndices, boundData))
+		return chunkList
+
+	def getBoundProjection(slab, data):
+		if prepareChunk != None:
+			prepareChunk(psi, slab, data)
+		weightedData = getWeightedChunk(slab, data)
+		norm = real(vdot(data, weightedData))
+		projectionList = []
+		for (boundFile, boundPaths, L), (chunkIndices, boundData) in zip(boundStateInfo, getBoundStateChunks(slab)):
+			projection = zeros(len(boundPaths), dtype=complex)
+			for i, eigData in enumerate(boundData):
+				projection[i] = vdot(eigData, weightedData[chunkIndices])
+			projectionList.append(projection)
+		return norm, projectionList
+
+	def reduceBoundProjection(x, y):
+		return x[0] + y[0], [a + b for a, b in zip(x[1], y[1])]
+
+	boundProjection = None
+	if boundStateInfo != None:
+		PrintOut("Calculating bound state projections...")
+		norm, boundProjection = pyprop.serialization.ReduceDatasetChunks(reader, getBoundProjection, reduceBoundProjection)
+
+	#Second pass: remove bound states and calculate populations
+	projector = SetupRadialProductProjector(singleStates1, singleStates2)
+	pairIndices = GetProductStateAngularIndices(psi, singleStates1, singleStates2)
+
+	def getPopulation(slab, data):
+		if prepareChunk != None:
+			prepareChunk(psi, slab, data)
+		if boundStateInfo != None:
+			for (chunkIndices, boundData), proj in zip(getBoundStateChunks(slab), boundProjection):
+				for eigData, curProj in zip(boundData, proj):
+					data[chunkIndices] -= curProj * eigData
+		weightedData = getWeightedChunk(slab, data)
+
+		ionizationNorm = real(vdot(data, weightedData))
+		population = {}
+		for l1, l2, angularIndices in pairIndices:
+			positions, chunkIndices = GetChunkIndices(angularIndices, slab)
+			if len(chunkIndices) > 0:
+				population[(l1, l2)] = projector.CalculatePopulation(l1, l2, weightedData, chunkIndices)
+		return ionizationNorm, population
+
+	def reducePopulation(x, y):
+		population = dict(x[1])
+		for key, pop in y[1].iteritems():
+			if key in population:
+				population[key] = population[key] + pop
+			else:
+				population[key] = pop
+		return x[0] + y[0], population
+
+	PrintOut("Calculating product state populations...")
+	ionizationNorm, populationDict = pyprop.serialization.ReduceDatasetChunks(reader, getPopulation, reducePopulation)
+	if boundStateInfo == None:
+		norm = ionizationNorm
+
+	population = []
+	for l1, l2, angularIndices in pairIndices:
+		pop = populationDict[(l1, l2)]
+		projV = [(i1, i2, pop[i1, i2]) for i1 in range(pop.shape[0]) for i2 in range(pop.shape[1])]
+		population.append((l1, l2, projV))
+
+	return population, norm, ionizationNorm
+
+
 def RunRemoveSingleIonizedStates(psi, conf):
 	#Get single particle states
 	isIonized = lambda E: E > 0.0
@@ -109,6 +109,59 @@ def RunGetDoubleIonizationEnergyDistribution(fileList, removeBoundStates=True, r
 	return E[0], dpde
 
 
+def RunGetDoubleIonizationEnergyDistributionChunked(fileList, removeBoundStates=True, removeSingleIonStates=False, filterL=None, chunkSize=16, datasetPath="/wavefunction"):
+	"""
+	Calculates the double differential energy distribution (dP/dE1 dE2) as
+	RunGetDoubleIonizationEnergyDistribution, for wavefunction files which
+	do not fit in memory. The files are read in chunks of chunkSize angular
+	indices, and the projections are reduced over the chunks (see
+	GetPopulationProductStatesChunked). The memory usage is a few chunks in
+	addition to the single particle states, the bound states are read from
+	their files chunk by chunk.
+	"""
+	AssertSingleProc()
+
+	#load config
+	conf = pyprop.LoadConfigFromFile(fileList[0], datasetPath)
+
+	#find bound states
+	if removeBoundStates:
+		boundEnergies, boundStateInfo = GetBoundStateFileInfo(config=conf)
+	else:
+		boundEnergies = boundStateInfo = None
+
+	#Get single particle states
+	PrintInfo("Loading single particle states...")
+	isIonized = lambda E: 0.0 < E
+	isFilteredIonized = lambda E: 0.0 < E < maxEnergy
+	isBound = lambda E: E <= 0.
+	singleIonEnergies, singleIonStates = GetFilteredSingleParticleStates("he", isIonized, config=conf)
+	singleBoundEnergies, singleBoundStates = GetFilteredSingleParticleStates("he+", isBound, config=conf)
+	doubleIonEnergies, doubleIonStates = GetFilteredSingleParticleStates("he+", isFilteredIonized, config=conf)
+
+	#Remove single ionization and filter L on each chunk
+	def prepareChunk(psi, slab, data):
+		if removeSingleIonStates:
+			RemoveProductStatesProjectionChunk(psi, slab, data, singleBoundStates, singleIonStates)
+			RemoveProductStatesProjectionChunk(psi, slab, data, singleIonStates, singleBoundStates)
+
+		if filterL:
+			lfilter = lambda coupledIndex: coupledIndex.L not in filterL
+			angularIndices = GetLocalCoupledSphericalHarmonicIndices(psi, lfilter)
+			positions, chunkIndices = GetChunkIndices(angularIndices, slab)
+			data[chunkIndices, :, :] = 0.0
+
+	#Calculate Energy Distribution (dP/dE1 dE2)
+	def getdPdE(filename):
+		PrintInfo("Analyzing %s..." % filename)
+		populations, norm, ionizationNorm = GetPopulationProductStatesChunked(filename, doubleIonStates, doubleIonStates, boundStateInfo, chunkSize, datasetPath, prepareChunk)
+		return GetEnergyDistributionFromPopulations(populations, doubleIonStates, doubleIonEnergies, energyRes, maxEnergy)
+
+	E, dpde = zip(*map(getdPdE, fileList))
+
+	return E[0], dpde
+
+
 def RunGetDoubleIonizationAngularDistribution(fileList, dE=None, dTheta=None, removeBoundStates=True, removeSingleIonStates=False):
 	"""
 	Calculates the double differential energy distribution (dP/dE1 dE2) of the 
@@ -236,7 +289,15 @@ def GetDoubleIonizationEnergyDistribution(psi, boundStates, singleIonStates, sin
 
 	populations = GetPopulationProductStates(psi, singleIonStates, singleIonStates)
 
+	return GetEnergyDistributionFromPopulations(populations, singleIonStates, singleEnergies, dE, maxE)
+
 
+def GetEnergyDistributionFromPopulations(populations, singleIonStates, singleEnergies, dE, maxE):
+	"""
+	Bins the populations of products of single particle ionized states
+	(as returned from GetPopulationProductStates) by energy, giving the
+	double differential d^2P/(dE_1 dE_2)
+	"""
 	E = r_[0:maxE:dE]
 	dpde = zeros((len(E), len(E)), dtype=double)
 
@@ -292,6 +353,7 @@ def GetDoubleAngularDistributionAvgPhi(psi, Z, interpEnergies, ionEnergies, ionS
 	angularDistr = zeros((thetaCount, thetaCount, interpCount, interpCount), dtype=double)
 
 	assocLegendre = array(assocLegendre, dtype=complex)
+	projector = SetupRadialProductProjector(ionStates, ionStates)
 
 	pop = 0
 	M = 0
@@ -318,7 +380,7 @@ def GetDoubleAngularDistributionAvgPhi(psi, Z, interpEnergies, ionEnergies, ionS
 			
 				#calculate projection on radial states
 				def doProj():
-					radialProj = CalculateProjectionRadialProductStates(l1, V1, l2, V2, data, angularIndices)
+					radialProj = projector.CalculateProjection(l1, l2, data, angularIndices)
 					return radialProj
 				radialProj = doProj()
 
@@ -410,6 +472,7 @@ def GetDoubleAngularDistributionCoplanar(psi, Z, interpEnergies, ionEnergies, io
 	angularDistr = zeros((thetaCount, thetaCount, interpCount, interpCount), dtype=double)
 
 	assocLegendre = array(assocLegendre, dtype=complex)
+	projector = SetupRadialProductProjector(ionStates, ionStates)
 
 	pop = 0
 	M = 0
@@ -431,7 +494,7 @@ def GetDoubleAngularDistributionCoplanar(psi, Z, interpEnergies, ionEnergies, io
 		
 			#calculate projection on radial states
 			def doProj():
-				radialProj = CalculateProjectionRadialProductStates(l1, V1, l2, V2, data, angularIndices)
+				radialProj = projector.CalculateProjection(l1, l2, data, angularIndices)
 				return radialProj
 			radialProj = doProj()
 
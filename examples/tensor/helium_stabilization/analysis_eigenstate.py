@@ -115,6 +115,25 @@ def GetBoundStates(ionizationThreshold=-2.0, **args):
 	return energies, boundStates
 
 
+def GetBoundStateFileInfo(ionizationThreshold=-2.0, **args):
+	"""
+	Returns the bound states as GetBoundStates, without loading them.
+	Each entry of the list is (filename, datasetPaths, L). The bound
+	state for angular index i of L is row i of the datasets, which may
+	be read in slabs with pyprop.serialization.ReadDatasetSlabs
+	"""
+	def getInfo(filename):
+		L = GetEigenstateFileInfo(filename, INFO_L)
+		eigenvalues = GetEigenstateFileInfo(filename, INFO_Eigenvalues)
+		boundIdx = filter(lambda i: eigenvalues[i]<ionizationThreshold, r_[:len(eigenvalues)])
+		datasetPaths = [GetEigenvectorDatasetPath(i) for i in boundIdx]
+		return [eigenvalues[i] for i in boundIdx], (filename, datasetPaths, L)
+
+	energies, boundStateInfo = zip(*map(getInfo, GetBoundStateFiles(**args)))
+
+	return energies, boundStateInfo
+
+
 def RemoveBoundStateProjection(psi, boundStates):
 	assert(pyprop.IsSingleProc())
 
@@ -336,6 +336,7 @@ def GetSingleAngularDistribution(psi, Z, interpEnergies, boundEnergies, boundSta
 	angularDistr = zeros((thetaCount, interpCount), dtype=double)
 
 	assocLegendre = array(assocLegendre, dtype=complex)
+	projector = SetupRadialProductProjector(boundStates, ionStates)
 
 	pop = 0
 	M = 0
@@ -362,7 +363,7 @@ def GetSingleAngularDistribution(psi, Z, interpEnergies, boundEnergies, boundSta
 			
 				#calculate projection on radial states
 				def doProj():
-					radialProj = CalculateProjectionRadialProductStates(l1, V1, l2, V2, data, angularIndices)
+					radialProj = projector.CalculateProjection(l1, l2, data, angularIndices)
 					return radialProj
 				radialProj = doProj()
 
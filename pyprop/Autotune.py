@@ -0,0 +1,224 @@
+import platform
+import fcntl
+
+#--------------------------------------------------------------------------------------
+#                         Autotuning of kernel algorithms
+#--------------------------------------------------------------------------------------
+
+DefaultAutotuneFile = os.path.join(os.path.expanduser("~"), ".pyprop_autotune")
+
+
+def GetAutotuneNodeType():
+	"""
+	Returns a string identifying the type of node we are running on,
+	i.e. the cpu model and architecture
+	"""
+	cpuModel = "unknown"
+	try:
+		for line in open("/proc/cpuinfo"):
+			if line.startswith("model name"):
+				cpuModel = " ".join(line.split(":", 1)[1].split())
+				break
+	except IOError:
+		pass
+	return "%s (%s)" % (cpuModel, platform.machine())
+
+
+def GetAutotuneThreadCount():
+	"""
+	Returns the number of OpenMP threads the kernels will use if pyprop
+	is built with PYPROP_USE_OPENMP
+	"""
+	if "OMP_NUM_THREADS" in os.environ:
+		return int(os.environ["OMP_NUM_THREADS"])
+	try:
+		return os.sysconf("SC_NPROCESSORS_ONLN")
+	except (ValueError, OSError):
+		return 1
+
+
+class Autotuner(object):
+	"""
+	Selects between implementations of a kernel by timing them on the
+	actual shape and distribution, and persists the decisions so that
+	later runs start with the tuned configuration.
+
+	Decisions are keyed by (kernel, shape, thread count, proc count, node type),
+	and stored as a python dict literal in filename, which may be shared by
+	several jobs.
+
+	Example:
+	tuner = GetAutotuner()
+	algo = tuner.Tune("ReducedSphericalTransform", psi.GetData().shape, [0, 4],
+		select=SetAlgorithm, run=RunTransform, distr=distr, output=TransformCopy)
+
+	Tune() must be called collectively by all procs in distr. The timings are
+	summed over all procs, so all procs select the same candidate.
+
+	The following choices are tuned when 'autotune = True' is set in the
+	config section owning them, and they are not configured explicitly:
+	- ReducedSphericalPropagator: transform_algorithm
+	- BSplinePropagator: propagation_algorithm
+	- MatrixPotential (dense): matrix_multiply_algorithm
+	- CartesianPropagator: fft_rank_algorithm, FftRankPositive or
+	  FftRankNegative for the middle ranks of rank 3 and 4 wavefunctions
+	- TensorPotential: the storages of ranks with an alternative storage of
+	  the same potential data layout (see GetAlternativeStorageIds)
+	"""
+
+	def __init__(self, filename=None):
+		if filename == None:
+			filename = os.environ.get("PYPROP_AUTOTUNE_FILE", DefaultAutotuneFile)
+		self.Filename = filename
+		self.Decisions = None
+		self.Logger = GetClassLogger(self)
+
+	def GetKey(self, kernel, shape, distr=None):
+		procCount = 1
+		if distr != None:
+			procCount = distr.ProcCount
+		return repr((kernel, tuple(map(int, shape)), GetAutotuneThreadCount(), procCount, GetAutotuneNodeType()))
+
+	def ReadDecisions(self):
+		if not os.path.exists(self.Filename):
+			return {}
+		try:
+			return eval(open(self.Filename).read())
+		except Exception, e:
+			self.Logger.warning("Could not read autotune file %s (%s), ignoring it" % (self.Filename, e))
+			return {}
+
+	def LoadDecisions(self):
+		if self.Decisions == None:
+			self.Decisions = self.ReadDecisions()
+		return self.Decisions
+
+	def SaveDecision(self, key, candidate):
+		"""
+		Stores a decision in the autotune file. The file is locked and
+		reread, so that decisions made by other jobs are kept
+		"""
+		self.LoadDecisions()[key] = candidate
+
+		lockFile = open(self.Filename + ".lock", "a")
+		fcntl.lockf(lockFile, fcntl.LOCK_EX)
+		try:
+			decisions = self.ReadDecisions()
+			decisions[key] = candidate
+			tempFilename = self.Filename + ".tmp%i" % os.getpid()
+			f = open(tempFilename, "w")
+			f.write(repr(decisions))
+			f.close()
+			os.rename(tempFilename, self.Filename)
+		finally:
+			fcntl.lockf(lockFile, fcntl.LOCK_UN)
+			lockFile.close()
+
+	def GetDecision(self, kernel, shape, distr=None):
+		"""
+		Returns the stored decision for kernel on shape, or None
+		"""
+		return self.LoadDecisions().get(self.GetKey(kernel, shape, distr), None)
+
+	def Tune(self, kernel, shape, candidates, select, run, distr=None, repeats=3, output=None, tolerance=1e-10):
+		"""
+		Selects the fastest of candidates for kernel on shape.
+
+		- select(candidate) configures the kernel to use candidate
+		- run() executes the kernel once
+		- output(), if given, executes the kernel once on the tuning input,
+		  and returns a copy of the result
+
+		If a decision has been stored for this key, it is selected without
+		timing. Otherwise, every candidate is run once to warm up, and then
+		timed repeats times, and the one with the smallest minimum time is
+		selected and stored. Candidates raising an exception are skipped.
+		The selected candidate is returned.
+
+		If output is given, candidates[0] is the reference, and a candidate
+		whose result differs from the reference by more than tolerance
+		(relative to the max norm of the reference) on any proc is skipped.
+		If the reference fails, all candidates are skipped.
+		"""
+		candidates = list(candidates)
+		key = self.GetKey(kernel, shape, distr)
+		decision = self.LoadDecisions().get(key, None)
+		if decision in candidates:
+			select(decision)
+			return decision
+
+		reference = None
+		timings = []
+		for candidate in candidates:
+			duration = 0.0
+			try:
+				select(candidate)
+				if output != None:
+					result = output()
+					if candidate == candidates[0]:
+						reference = result
+						scale = max(numpy.max(numpy.abs(reference)), 1e-300)
+					elif reference is None:
+						raise Exception("no result from reference candidate %s" % candidates[0])
+					else:
+						error = numpy.max(numpy.abs(result - reference)) / scale
+						if not error <= tolerance:
+							raise Exception("result differs from candidate %s by %.3e" % (candidates[0], error))
+				run()
+				duration = min([self.TimeRun(run) for i in range(repeats)])
+			except Exception, e:
+				self.Logger.info("Autotune %s: candidate %s failed (%s)" % (kernel, candidate, e))
+				duration = -1.0
+
+			if distr != None and not distr.IsSingleProc():
+				#A candidate failing on any proc is discarded on all procs
+				failed = distr.GetGlobalSum(float(duration < 0))
+				duration = distr.GetGlobalSum(duration)
+				if failed > 0:
+					duration = -1.0
+			timings.append(duration)
+
+		valid = [(t, i) for i, t in enumerate(timings) if t >= 0]
+		if len(valid) == 0:
+			raise Exception("Autotune %s: all candidates %s failed" % (kernel, candidates))
+		best = candidates[min(valid)[1]]
+		self.Logger.info("Autotune %s %s: timings %s, selected %s" % (kernel, tuple(shape), dict(zip(candidates, timings)), best))
+
+		select(best)
+		if distr == None or distr.ProcId == 0:
+			try:
+				self.SaveDecision(key, best)
+			except (IOError, OSError), e:
+				self.Logger.warning("Could not store autotune decision in %s (%s)" % (self.Filename, e))
+		else:
+			self.LoadDecisions()[key] = best
+		return best
+
+	def TimeRun(self, run):
+		t = - time.time()
+		run()
+		return t + time.time()
+
+
+AutotunerInstances = {}
+
+def GetAutotuner(configSection=None):
+	"""
+	Returns the Autotuner for the autotune file specified by 'autotune_file'
+	in configSection, or the default autotune file
+	"""
+	filename = None
+	if configSection != None and hasattr(configSection, "autotune_file"):
+		filename = configSection.autotune_file
+	if filename not in AutotunerInstances:
+		AutotunerInstances[filename] = Autotuner(filename)
+	return AutotunerInstances[filename]
+
+
+def IsAutotuneEnabled(configSection):
+	"""
+	Autotuning is enabled with 'autotune = True' in the config section
+	owning the kernel choice
+	"""
+	return configSection != None and getattr(configSection, "autotune", False)
+
@@ -0,0 +1,103 @@
+#--------------------------------------------------------------------------------------
+#                    Checkpointed adjoint propagation
+#--------------------------------------------------------------------------------------
+
+class CheckpointedAdjoint(object):
+	"""
+	Runs a forward propagation of a Problem followed by an adjoint
+	(backward) propagation which needs the forward states in reverse
+	order, as in optimal control (Krotov, gradient methods).
+
+	Only snapshotCount forward states are stored in addition to the
+	initial state, and the others are recomputed following the binomial
+	checkpoint schedule of core.CheckpointSchedule. This works for
+	any propagator of the Problem (VectorPropagator, BasisPropagator, ...).
+
+	Example:
+	adjoint = CheckpointedAdjoint(prop, snapshotCount=10)
+	adjoint.Run(stepCount, terminal=SetupCostate, adjoint=UpdateGradient)
+
+	- terminal(psi, t) is called once with the final forward state, to
+	  set up the adjoint state
+	- adjoint(step, psi, t) is called for step = stepCount-1, ..., 0 with
+	  the forward state psi at time t before the step. It should propagate
+	  the adjoint state from t+dt to t, and add the gradient contribution
+	  of the step. psi must not be changed.
+
+	After Run(), prop.psi and prop.PropagatedTime are reset to the initial
+	state.
+	"""
+
+	def __init__(self, prop, snapshotCount):
+		self.Problem = prop
+		self.SnapshotCount = snapshotCount
+		self.Logger = GetClassLogger(self)
+		self.Schedule = None
+		self.Snapshots = None
+		self.SnapshotTimes = None
+
+	def CreateSchedule(self, stepCount):
+		schedule = core.CheckpointSchedule()
+		schedule.Setup(stepCount, self.SnapshotCount)
+		return schedule
+
+	def Run(self, stepCount, terminal, adjoint):
+		prop = self.Problem
+		psi = prop.psi
+		Action = core.CheckpointSchedule.ActionType
+
+		if self.Schedule == None or self.Schedule.GetStepCount() != stepCount:
+			self.Schedule = self.CreateSchedule(stepCount)
+		schedule = self.Schedule
+		self.Logger.info("Checkpointed adjoint of %i steps with %i snapshots, %i forward steps" % \
+			(stepCount, self.SnapshotCount, schedule.GetForwardStepCount()))
+
+		#The snapshot wavefunctions are kept between runs
+		if self.Snapshots == None:
+			self.Snapshots = [None] * (self.SnapshotCount + 1)
+			self.SnapshotTimes = [None] * (self.SnapshotCount + 1)
+
+		currentStep = 0
+		for i in range(schedule.GetActionCount()):
+			action = schedule.GetAction(i)
+			step = schedule.GetActionStep(i)
+			slot = schedule.GetActionSlot(i)
+
+			if action == Action.ActionAdvance:
+				while currentStep < step:
+					prop.AdvanceStep()
+					currentStep += 1
+
+			elif action == Action.ActionStore:
+				if self.Snapshots[slot] == None:
+					self.Snapshots[slot] = psi.Copy()
+				else:
+					self.Snapshots[slot].GetData()[:] = psi.GetData()
+				self.SnapshotTimes[slot] = prop.PropagatedTime
+
+			elif action == Action.ActionRestore:
+				psi.GetData()[:] = self.Snapshots[slot].GetData()
+				prop.PropagatedTime = self.SnapshotTimes[slot]
+				currentStep = step
+
+			elif action == Action.ActionTerminal:
+				terminal(psi, prop.PropagatedTime)
+
+			elif action == Action.ActionAdjoint:
+				adjoint(step, psi, prop.PropagatedTime)
+
+			elif action == Action.ActionFree:
+				#Snapshots are reused by the next store into the slot
+				pass
+
+		#Leave the problem in its initial state
+		psi.GetData()[:] = self.Snapshots[0].GetData()
+		prop.PropagatedTime = self.SnapshotTimes[0]
+
+	def FreeSnapshots(self):
+		"""
+		Releases the snapshot wavefunctions
+		"""
+		self.Snapshots = None
+		self.SnapshotTimes = None
+
@@ -39,8 +39,112 @@ def CreateDistribution(config, rank=None):
 
 	#apply configuration
 	distrib.ApplyConfigSection(distrSection)
+
+	#cost-weighted partitioning
+	if config != None and hasattr(distrSection, "partition_rank"):
+		ApplyPartitionWeights(distrib, config, distrSection)
 	
 	return distrib
+
+
+def ApplyPartitionWeights(distrib, config, distrSection):
+	"""
+	Sets up cost-weighted partitioning of the ranks in 'partition_rank' 
+	(an int or a list of ints). The cost of each index is taken from either
+	
+	- partition_weights: a function (config, rank) returning the weights
+	  of all indices, e.g. GetSelectionRulePartitionWeights
+	- partition_weights_file, partition_weights_dataset: a HDF5 dataset
+	  of weights, e.g. measured timings from an earlier run. For several
+	  ranks, the dataset name is formatted with the rank.
+
+	See core/mpi/partition.h
+	"""
+	logger = GetFunctionLogger()
+	partitionRanks = distrSection.partition_rank
+	if isinstance(partitionRanks, int):
+		partitionRanks = [partitionRanks]
+
+	for rank in partitionRanks:
+		if hasattr(distrSection, "partition_weights"):
+			weights = distrSection.partition_weights(config, rank)
+		elif hasattr(distrSection, "partition_weights_file"):
+			datasetPath = distrSection.partition_weights_dataset
+			if "%" in datasetPath:
+				datasetPath = datasetPath % rank
+			with serialization.HDFLock:
+				f = tables.openFile(distrSection.partition_weights_file, "r")
+				try:
+					weights = f.getNode(datasetPath)[:]
+				finally:
+					f.close()
+		else:
+			raise Exception("partition_rank requires either partition_weights or partition_weights_file")
+
+		weights = array(weights, dtype=double)
+		logger.info("Using cost-weighted partition of rank %i (%i indices, cost %s)" % (rank, len(weights), sum(weights)))
+		distrib.SetPartitionWeights(rank, weights)
+
+
+def ApplyMemoryArenaConfig(arenaSection):
+	"""
+	Sets the options of the default core.MemoryArena, which allocates the
+	wavefunction buffers and static potentials, from a [MemoryArena] section
+
+	- alignment: alignment of all blocks in bytes (default 64)
+	- huge_pages: use transparent huge pages for large blocks (default True)
+	- first_touch: place new blocks on the NUMA node of the threads
+	  processing them (default True)
+	- max_cached_bytes: size of the cache of released blocks in bytes,
+	  -1 for no limit, or -2 for twice the largest block allocated so far
+	  (default -2)
+
+	See core/utility/memoryarena.h
+	"""
+	arena = core.MemoryArena.GetDefaultArena()
+	if hasattr(arenaSection, "alignment"):
+		arena.SetAlignment(arenaSection.alignment)
+	if hasattr(arenaSection, "huge_pages"):
+		arena.SetUseHugePages(arenaSection.huge_pages)
+	if hasattr(arenaSection, "first_touch"):
+		arena.SetFirstTouch(arenaSection.first_touch)
+	if hasattr(arenaSection, "max_cached_bytes"):
+		arena.SetMaxCachedBytes(arenaSection.max_cached_bytes)
+
+
+def GetRowCountWeights(indexPairs, globalSize):
+	"""
+	Returns the number of index pairs in each row, which is the cost
+	of each row in a tensor potential matrix-vector multiplication
+	"""
+	weights = zeros(globalSize, dtype=double)
+	for row in asarray(indexPairs)[:,0]:
+		weights[row] += 1
+	return weights
+
+
+def GetSelectionRulePartitionWeights(config, rank, selectionRule):
+	"""
+	Returns the number of basis pairs per row given by selectionRule
+	(e.g. core.CoupledSphericalSelectionRuleR12(4)) in the basis of rank.
+	A single proc representation of rank is created for this purpose.
+
+	Usage in the config file:
+	[Distribution]
+	partition_rank = 1
+	partition_weights = lambda conf, rank: GetSelectionRulePartitionWeights(conf, rank, core.CoupledSphericalSelectionRuleR12(4))
+	"""
+	section = config.GetSection(config.Representation.Get("representation%i" % rank))
+	repr = section.type()
+	repr.SetBaseRank(rank)
+	section.Apply(repr)
+
+	globalSize = repr.GetFullShape()[0]
+	indexPairs = array(selectionRule.GetBasisPairs(repr))
+	weights = GetRowCountWeights(indexPairs, globalSize)
+	#Rows without basis pairs still cost something in the other ranks
+	weights += 1
+	return weights
 	
 	
 def CreateRepresentation(config, distribution):
@@ -17,12 +17,20 @@ class InitialConditionType:
 	File = 2
 	Class = 3
 	Custom = 4
+	Eigenstate = 5
 
 class WavefunctionFileFormat:
 	Ascii  = 1
 	Binary = 2
 	HDF    = 3
 
+#Matches core/python/array_wrapper.cpp ArrayCopyPolicy. What to do when
+#a numpy array passed to C++ must be copied, see core.SetArrayCopyPolicy
+class ArrayCopyPolicy:
+	Allow = 0
+	Warn = 1
+	Raise = 2
+
 class IntegratorType:
 	IntegratorRK2 = 0
 	IntegratorRK4 = 1
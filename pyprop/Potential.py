@@ -67,6 +67,100 @@ def CreatePotentialInstance(className, rank, evaluatorPrefix, potentialRank=None
 	return potential
 
 
+class ExpressionPotentialEvaluator:
+	"""
+	Evaluates a potential given as an expression in the config section, 
+	instead of a python function called in every grid point, or a C++ 
+	potential class. The expression is compiled once by core.ExpressionPotential,
+	and evaluated natively over the local grid.
+
+	[Potential]
+	type = PotentialType.Dynamic
+	potential_expression = "-Z/sqrt(r^2 + a^2) * f(t)"
+	expression_coordinates = ["r"]
+	Z = 1.0
+	a = 2.0
+	f = LaserFunction
+
+	- expression_coordinates names the coordinates of each rank (default x0, x1, ...)
+	- Other names in the expression are taken from the config section 
+	- name(t), where name is a function in the config section, is evaluated as
+	  name(configSection, t) in python once per step, and bound to the expression
+	  before evaluating the grid
+	- t is the current time
+
+	Expressions are real only, as the expression is evaluated in real
+	arithmetic. Parameters and time function values with a nonzero
+	imaginary part raise an exception, instead of being truncated to
+	their real part.
+	"""
+
+	def __init__(self, configSection, rank, expressionName="potential_expression"):
+		self.ConfigSection = configSection
+		self.Potential = CreateInstanceRank("core.ExpressionPotential", rank)
+
+		if hasattr(configSection, "expression_coordinates"):
+			coords = configSection.expression_coordinates
+			if isinstance(coords, str):
+				coords = coords.split()
+			if len(coords) != rank:
+				raise Exception("expression_coordinates must have one name per rank (%i)" % rank)
+			for i, name in enumerate(coords):
+				self.Potential.SetCoordinateName(i, name)
+
+		#Replace time function calls f(t) by a parameter f bound every step
+		expression = getattr(configSection, expressionName)
+		self.TimeFunctions = []
+		def replaceTimeFunction(match):
+			name = match.group(1)
+			if not callable(getattr(configSection, name, None)):
+				return match.group(0)
+			if name not in self.TimeFunctions:
+				self.TimeFunctions.append(name)
+			return name
+		expression = re.sub(r"\b([A-Za-z_]\w*)\s*\(\s*t\s*\)", replaceTimeFunction, expression)
+		self.Potential.SetExpression(expression)
+
+		#Constant parameters are set from the config section
+		for i in range(self.Potential.GetParameterCount()):
+			name = self.Potential.GetParameterName(i)
+			if name == "t" or name in self.TimeFunctions:
+				continue
+			if not hasattr(configSection, name):
+				raise Exception("Parameter '%s' of expression '%s' is not in the config section" % (name, expression))
+			self.Potential.SetParameter(name, self.GetRealValue(name, getattr(configSection, name)))
+
+	def GetRealValue(self, name, value):
+		if imag(value) != 0:
+			raise Exception("Parameter '%s' of expression potential is complex (%s), expressions are real only" % (name, value))
+		return float(real(value))
+
+	def BindTime(self, t):
+		for name in self.TimeFunctions:
+			value = getattr(self.ConfigSection, name)(self.ConfigSection, t)
+			self.Potential.SetParameter(name, self.GetRealValue(name, value))
+
+	def SetWavefunction(self, psi):
+		self.BindTime(0.0)
+		self.Potential.SetWavefunction(psi)
+
+	def UpdateStaticPotential(self, potential, psi, dt, t, storage):
+		self.BindTime(t)
+		self.Potential.UpdateStaticPotential(potential, psi, dt, t, storage)
+
+	def ApplyPotential(self, psi, dt, t):
+		self.BindTime(t)
+		self.Potential.ApplyPotential(psi, dt, t)
+
+	def MultiplyPotential(self, srcPsi, destPsi, dt, t):
+		self.BindTime(t)
+		self.Potential.MultiplyPotential(srcPsi, destPsi, dt, t)
+
+	def CalculateExpectationValue(self, psi, dt, t):
+		self.BindTime(t)
+		return self.Potential.CalculateExpectationValue(psi, dt, t)
+
+
 
 
 #Potential Wrapper interface
@@ -165,6 +259,10 @@ class StaticPotentialWrapper(PotentialWrapper):
 				potentialExpData[:] = exp(- 1.0j * timeStep * potentialExpData)
 				
 
+		elif hasattr(self.ConfigSection, "potential_expression"):
+			self.PotentialEvaluator = ExpressionPotentialEvaluator(self.ConfigSection, self.psi.GetRank())
+			self.UpdateStaticPotential(0.0, timeStep)
+
 		elif hasattr(self.ConfigSection, "classname"):
 			evaluatorPrefix = "core.DynamicPotentialEvaluator"
 			potentialEvaluator = CreatePotentialInstance(self.ConfigSection.classname, self.psi.GetRank(), evaluatorPrefix)
@@ -175,7 +273,7 @@ class StaticPotentialWrapper(PotentialWrapper):
 			self.UpdateStaticPotential(0.0, timeStep)
 
 		else:
-			raise "Invalid potential config. Must specify either 'classname' or 'function'"
+			raise "Invalid potential config. Must specify either 'classname', 'function' or 'potential_expression'"
 
 	def UpdateStaticPotential(self, t, dt):
 		"""
@@ -241,9 +339,12 @@ class DynamicPotentialWrapper(PotentialWrapper):
 		PotentialWrapper.ApplyConfigSection(self, configSection)
 		rank = self.psi.GetRank()
 
-		evaluatorPrefix = "core.DynamicPotentialEvaluator"
-		self.Evaluator = CreatePotentialInstance(configSection.classname, rank, evaluatorPrefix)
-		configSection.Apply(self.Evaluator)
+		if hasattr(configSection, "potential_expression"):
+			self.Evaluator = ExpressionPotentialEvaluator(configSection, rank)
+		else:
+			evaluatorPrefix = "core.DynamicPotentialEvaluator"
+			self.Evaluator = CreatePotentialInstance(configSection.classname, rank, evaluatorPrefix)
+			configSection.Apply(self.Evaluator)
 	
 	def AdvanceStep(self, t, dt):
 		self.Evaluator.ApplyPotential(self.psi, dt, t)
@@ -362,21 +463,22 @@ class MatrixPotentialWrapper(PotentialWrapper):
 	def LoadMatrixPotentialFile(self, conf):
 		filename = conf.filename
 		dataset = conf.dataset
-		file = tables.openFile(filename, "r")
-		try:
-			node = file.getNode(dataset)
-			if self.MatrixType == MatrixType.Sparse:
-				row = node.cols.RowIndex[:]
-				col = node.cols.ColIndex[:]
-				matrixElement = node.cols.MatrixElement[:]
-				self.Potential.SetMatrixData(row, col, matrixElement)
-
-			if self.MatrixType == MatrixType.Dense:
-				data = node[:]
-				self.Potential.SetMatrixData(data, self.MatrixRowRank, self.MatrixColRank)
-
-		finally:
-			file.close()
+		with serialization.HDFLock:
+			file = tables.openFile(filename, "r")
+			try:
+				node = file.getNode(dataset)
+				if self.MatrixType == MatrixType.Sparse:
+					row = node.cols.RowIndex[:]
+					col = node.cols.ColIndex[:]
+					matrixElement = node.cols.MatrixElement[:]
+					self.Potential.SetMatrixData(row, col, matrixElement)
+
+				if self.MatrixType == MatrixType.Dense:
+					data = node[:]
+					self.Potential.SetMatrixData(data, self.MatrixRowRank, self.MatrixColRank)
+
+			finally:
+				file.close()
 
 	def ApplyConfigSection(self, configSection):
 		PotentialWrapper.ApplyConfigSection(self, configSection)
@@ -405,9 +507,37 @@ class MatrixPotentialWrapper(PotentialWrapper):
 			raise NotImplementedException("Invalid MatrixType %s" % configSection.MatrixType)
 		
 		configSection.Apply(self.Potential)
+		if configSection.matrix_type == MatrixType.Dense and hasattr(configSection, "matrix_multiply_algorithm"):
+			self.Potential.SetAlgorithm(configSection.matrix_multiply_algorithm)
 		self.LoadMatrixPotential(configSection)
 		self.TimeFunction = configSection.time_function
 
+	def SetupStep(self, timestep):
+		PotentialWrapper.SetupStep(self, timestep)
+		if self.MatrixType == MatrixType.Dense and IsAutotuneEnabled(self.ConfigSection) and not hasattr(self.ConfigSection, "matrix_multiply_algorithm"):
+			self.AutotuneAlgorithm(timestep)
+
+	def AutotuneAlgorithm(self, timestep):
+		"""
+		Times ApplyPotential for the matrix multiply algorithms of
+		DenseMatrixPotentialEvaluator on a copy of psi, and selects the fastest
+		"""
+		candidates = [0]
+		if self.psi.GetRank() == 2:
+			candidates += [1, 2]
+
+		tempPsi = self.psi.Copy()
+		run = lambda: self.Potential.ApplyPotential(tempPsi, timestep, 1.0)
+
+		def output():
+			tempPsi.GetData()[:] = self.psi.GetData()
+			self.Potential.ApplyPotential(tempPsi, timestep, 1.0)
+			return tempPsi.GetData().copy()
+
+		distr = self.psi.GetRepresentation().GetDistributedModel()
+		tuner = GetAutotuner(self.ConfigSection)
+		tuner.Tune("DenseMatrixPotentialEvaluator", self.psi.GetData().shape, candidates, self.Potential.SetAlgorithm, run, distr, output=output)
+
 	def AdvanceStep(self, t, dt):
 		self.Potential.ApplyPotential(self.psi, dt, self.GetTimeValue(t))
 
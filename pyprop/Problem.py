@@ -19,6 +19,9 @@ def CreateWavefunction(config):
 	"""
 	logger = GetFunctionLogger()
 
+	if hasattr(config, "MemoryArena"):
+		ApplyMemoryArenaConfig(config.MemoryArena)
+
 	logger.debug("Creating DistributionModel...")
 	distribution = CreateDistribution(config)
 
@@ -31,6 +34,7 @@ def CreateWavefunction(config):
 	return psi
 
 
+@serialization.SerializedHDF
 def LoadConfigFromFile(filename, datasetPath="/wavefunction"):
 	f = tables.openFile(filename, "r")
 	try:
@@ -67,6 +71,10 @@ class Problem:
 
 	def __init__(self, config):
 		self.TempPsi = None
+		self.CheckpointService = None
+		self.Observables = None
+		self.CheckpointMaxInFlight = 2
+		self.CheckpointCompression = None
 		self.Config = config
 		self.Logger = GetClassLogger(self)
 		try:
@@ -176,6 +184,33 @@ class Problem:
 			self.PropagatedTime += self.TimeStep.real
 
 
+	def SetupObservables(self, configSection=None):
+		"""
+		Creates a registry of observables which are evaluated in one fused
+		pass over the wavefunction every configSection.interval timesteps
+		during Advance(). Register observables with AddNorm,
+		AddDiagonalExpectationValue and AddProjection on the returned object,
+		and read the results with GetObservableTimeSeries()
+		"""
+		self.Observables = CreateInstanceRank("core.ObservableRegistry", self.psi.GetRank())
+		if configSection != None:
+			configSection.Apply(self.Observables)
+		return self.Observables
+
+	def GetObservableTimeSeries(self):
+		"""
+		Returns the times and a dict of observable name -> values, for all
+		observables evaluated so far
+		"""
+		if self.Observables == None:
+			raise Exception("Observables are not set up, call SetupObservables() first")
+		times = self.Observables.GetTimes()
+		values = self.Observables.GetValues()
+		series = {}
+		for i in range(self.Observables.GetObservableCount()):
+			series[self.Observables.GetObservableName(i)] = values[:,i]
+		return times, series
+
 	def MultiplyHamiltonian(self, srcPsi, dstPsi):
 		"""
 		Applies the Hamiltonian to the wavefunction H psi -> psi
@@ -227,6 +262,14 @@ class Problem:
 			#next timestep
 			self.AdvanceStep()
 
+			#evaluate in-situ observables
+			if self.Observables != None:
+				self.Observables.AdvanceStep(self.psi, self.PropagatedTime)
+
+			#release buffers of completed checkpoints
+			if self.CheckpointService != None:
+				self.CheckpointService.Poll()
+
 			#check keyboard interrupt
 			if RedirectInterrupt:
 				if InterruptHandler.IsInterrupted():
@@ -315,6 +358,9 @@ class Problem:
 			if hasattr(configSection, "start_time"):
 				self.StartTime = configSection.start_time
 				self.PropagatedTime = self.StartTime
+			if hasattr(configSection, "checkpoint_max_in_flight"):
+				self.CheckpointMaxInFlight = configSection.checkpoint_max_in_flight
+			self.CheckpointCompression = serialization.CreateCheckpointCompression(configSection)
 
 
 	def SetupWavefunction(self):
@@ -328,6 +374,9 @@ class Problem:
 		InitialConditionType.File
 			See SetupWavefunctionFile()
 
+		InitialConditionType.Eigenstate
+			See SetupWavefunctionEigenstate()
+
 		"""
 		type = self.Config.InitialCondition.type
 		if type == InitialConditionType.Function:
@@ -338,6 +387,8 @@ class Problem:
 			self.SetupWavefunctionClass(self.Config, self.psi)
 		elif type == InitialConditionType.Custom:
 			self.SetupWavefunctionCustom(self.Config)
+		elif type == InitialConditionType.Eigenstate:
+			self.SetupWavefunctionEigenstate(self.Config)
 		elif type == None:
 			pass
 		else:
@@ -382,11 +433,23 @@ class Problem:
 		config.InitialCondition.function = func
 		prop.SetupWavefunctionFunction(config)
 
+		Alternatively, the InitialCondition section may give an expression in the 
+		coordinates, which is compiled and evaluated without calling python:
+
+		expression = "exp(-(x0^2 + x1^2))"
+
 		REMARK: This function should probably not be called on directly. Use SetupWavefunction()
 		instead. That function will automatically determine the type of initial condition to be used.		
 		"""
-		func = config.InitialCondition.function
 		conf = config.InitialCondition
+
+		#A compiled expression is evaluated natively, see ExpressionPotentialEvaluator
+		if hasattr(conf, "expression"):
+			evaluator = ExpressionPotentialEvaluator(conf, self.psi.GetRank(), "expression")
+			evaluator.SetWavefunction(self.psi)
+			return
+
+		func = config.InitialCondition.function
 		
 		#TODO: We should get this class from Propagator in order to use a different
 		#evaluator for a compressed (i.e. spherical) grid
@@ -437,6 +500,36 @@ class Problem:
 		conf = config.InitialCondition
 		func(self.psi, conf)
 
+	def SetupWavefunctionEigenstate(self, config):
+		"""
+		Initializes the wavefunction to one of the lowest eigenstates of the
+		Hamiltonian, found by LobpcgSolver. This is much faster than relaxing
+		the initial state by propagating in imaginary time.
+
+		[InitialCondition]
+		type = InitialConditionType.Eigenstate
+		eigenstate_index = 0         (default 0, the ground state)
+		solver_section = "Lobpcg"    (default "Lobpcg", see LobpcgSolver)
+
+		eigenstate_index must be less than krylov_eigenvalue_count in the solver
+		section. The solver is kept in self.EigenstateSolver, such that the other
+		eigenstates are available as well.
+
+		REMARK: This function should probably not be called on directly. Use SetupWavefunction()
+		instead. That function will automatically determine the type of initial condition to be used.
+		"""
+		conf = config.InitialCondition
+		index = getattr(conf, "eigenstate_index", 0)
+		sectionName = getattr(conf, "solver_section", "Lobpcg")
+
+		solver = LobpcgSolver(self, sectionName=sectionName)
+		solver.Solve()
+		if index >= solver.GetConvergedEigenvalueCount():
+			self.Logger.warning("Eigenstate %i is not converged (residual %s)" % (index, solver.GetResidualNorms()[index]))
+		solver.SetEigenvector(self.psi, index)
+		self.Logger.info("Initial eigenstate %i, E = %s" % (index, solver.GetEigenvalues()[index]))
+		self.EigenstateSolver = solver
+
 	#(de)serialization---------------------------------------------
 	def LoadWavefunctionData(self, newdata):
 		data = self.psi.GetData()
@@ -455,7 +548,28 @@ class Problem:
 		serialization.LoadWavefunctionHDF(filename, datasetPath, self.psi)
 
 	def SaveWavefunctionHDF(self, filename, datasetPath):
-		serialization.SaveWavefunctionHDF(filename, datasetPath, self.psi, conf=self.Config)
+		"""
+		Saves the wavefunction to a HDF5 file, compressed according to the
+		checkpoint_compression options of the Propagation section (see
+		serialization.CreateCheckpointCompression)
+		"""
+		serialization.SaveWavefunctionHDF(filename, datasetPath, self.psi, conf=self.Config, compression=self.CheckpointCompression)
+
+	def SaveWavefunctionHDFAsync(self, filename, datasetPath, callback=None):
+		"""
+		Saves a snapshot of the wavefunction in the background, while the
+		propagation continues. At most Propagation.checkpoint_max_in_flight
+		(default 2) snapshots are written at the same time. Call
+		WaitForCheckpoints() before reading the file. The snapshots are
+		compressed as in SaveWavefunctionHDF.
+		"""
+		if self.CheckpointService == None:
+			self.CheckpointService = serialization.CheckpointService(self.CheckpointMaxInFlight)
+		return self.CheckpointService.Snapshot(filename, datasetPath, self.psi, conf=self.Config, callback=callback, compression=self.CheckpointCompression)
+
+	def WaitForCheckpoints(self):
+		if self.CheckpointService != None:
+			self.CheckpointService.Wait()
 
 	def SaveWavefunctionAscii(self, filename):
 		psiData = self.psi.GetData()
@@ -42,6 +42,27 @@ def IsSingleProc():
 def ReshapeArray(array, newShape):
 	return ndarray.__new__(array.__class__, dtype=array.dtype, shape=newShape, buffer=array.data)
 
+def GetDataBufferView(psi, bufferName=None, index=Ellipsis):
+	"""
+	Returns a numpy view of (the local part of) a data buffer of psi,
+	the active buffer if bufferName is None. index is applied to the
+	buffer, and must be a basic (strided) slice, e.g.
+	GetDataBufferView(psi, 1, (slice(None), 0, slice(None, None, 2)))
+
+	The view shares memory with the buffer, and keeps the buffer memory
+	alive also if psi is deleted. An exception is raised if index would
+	make a copy (i.e. fancy indexing)
+	"""
+	if bufferName == None:
+		data = psi.GetData()
+	else:
+		data = psi.GetData(bufferName)
+
+	view = data[index]
+	if not numpy.may_share_memory(view, data):
+		raise Exception("Index %s gives a copy, not a view, of data buffer %s" % (index, bufferName))
+	return view
+
 def PrintOut(str=""):
 	if IsMaster():
 		print str
@@ -1,6 +1,7 @@
 import sys
 import os
 import time
+import re
 
 #import mpi
 try:
@@ -76,6 +77,8 @@ execfile(__path__[0] + "/Utility.py")
 execfile(__path__[0] + "/Redirect.py")
 execfile(__path__[0] + "/Interrupt.py")
 execfile(__path__[0] + "/Timer.py")
+execfile(__path__[0] + "/Autotune.py")
+execfile(__path__[0] + "/CheckpointedAdjoint.py")
 
 execfile(__path__[0] + "/BasisExpansion.py")
 execfile(__path__[0] + "/CoupledSphericalHarmonics.py")
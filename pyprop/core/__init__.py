@@ -37,6 +37,12 @@ except:
 	#print "Warning: could not load GMRES wrapper (%s)" % sys.exc_info()[1]
 	pass
 
+try:
+	from liblobpcg import *
+except:
+	#print "Warning: could not load LOBPCG wrapper (%s)" % sys.exc_info()[1]
+	pass
+
 
 try:
 	from libpiram import *
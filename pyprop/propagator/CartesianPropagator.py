@@ -32,6 +32,11 @@ def GetAnotherDistribution2(distrib, curRank, rank):
 class CartesianPropagator(PropagatorBase):
 	FFT_FORWARD = -1
 	FFT_BACKWARD = 1
+
+	#FftRank algorithms, see core/transform/fouriertransform.h
+	FFT_RANK_AUTO = 0
+	FFT_RANK_POSITIVE = 1
+	FFT_RANK_NEGATIVE = 2
 	
 	def __init__(self, psi):
 		PropagatorBase.__init__(self, psi)
@@ -45,21 +50,74 @@ class CartesianPropagator(PropagatorBase):
 		
 	def ApplyConfigSection(self, configSection): 
 		PropagatorBase.ApplyConfigSection(self, configSection)
+		self.ConfigSection = configSection
 		self.Mass = 1.0
 		if hasattr(configSection, 'mass'):
 			self.Mass = configSection.mass
 
+		#Fuse the fft, kinetic phase and normalization of the kinetic step, 
+		#see CartesianFourierTransform::AdvanceKineticEnergy
+		self.FusedKinetic = False
+		if hasattr(configSection, 'fused_kinetic'):
+			self.FusedKinetic = configSection.fused_kinetic
+
+		#Number of chunks each transpose of a distributed fft is pipelined in
+		if hasattr(configSection, 'transpose_chunk_count'):
+			self.FFTTransform.SetTransposeChunkCount(configSection.transpose_chunk_count)
+
 	def SetupStep(self, dt):
 		# set up potential
 		self.SetupPotential(dt/2.)
 
 		self.SetupTranspose()
+		self.SetupFftRankAlgorithm()
 		
 		# set up kinetic energy
 		self.TransformForward(self.psi)
 		self.SetupKineticPotential(dt)
+		if self.FusedKinetic:
+			self.FFTTransform.SetupKineticPhase(self.psi, self.Mass, dt)
 		self.TransformInverse(self.psi)
 
+	def SetupFftRankAlgorithm(self):
+		"""
+		Selects the FftRank algorithm for the ranks which are neither the
+		min nor the max stride rank, from fft_rank_algorithm in the config
+		section, or by autotuning
+		"""
+		if hasattr(self.ConfigSection, "fft_rank_algorithm"):
+			self.FFTTransform.SetFftRankAlgorithm(self.ConfigSection.fft_rank_algorithm)
+		elif IsAutotuneEnabled(self.ConfigSection):
+			self.AutotuneFftRankAlgorithm()
+
+	def AutotuneFftRankAlgorithm(self):
+		"""
+		Times FftRankPositive and FftRankNegative along the local middle
+		ranks on a copy of psi, and selects the fastest
+		"""
+		rank = self.psi.GetRank()
+		distr = self.psi.GetRepresentation().GetDistributedModel()
+		distribRanks = list(distr.GetDistribution())
+		tuneRanks = [r for r in range(1, rank-1) if r not in distribRanks]
+		if len(tuneRanks) == 0:
+			return
+
+		tempPsi = self.psi.CopyDeep()
+		def run():
+			for r in tuneRanks:
+				self.FFTTransform.TransformRank(tempPsi, r, self.FFT_FORWARD)
+				self.FFTTransform.TransformRank(tempPsi, r, self.FFT_BACKWARD)
+
+		def output():
+			tempPsi.GetData()[:] = self.psi.GetData()
+			for r in tuneRanks:
+				self.FFTTransform.TransformRank(tempPsi, r, self.FFT_FORWARD)
+			return tempPsi.GetData().copy()
+
+		candidates = [self.FFT_RANK_POSITIVE, self.FFT_RANK_NEGATIVE]
+		tuner = GetAutotuner(self.ConfigSection)
+		tuner.Tune("FftRank(ranks=%s)" % tuneRanks, self.psi.GetData().shape, candidates, self.FFTTransform.SetFftRankAlgorithm, run, distr, output=output)
+
 	def AdvanceStep(self, t, dt):
 		self.ApplyPotential(t, dt/2.)
 		self.AdvanceKineticEnergy(t, dt)
@@ -71,38 +129,57 @@ class CartesianPropagator(PropagatorBase):
 		self.MultiplyPotential(srcPsi, destPsi, t, dt/2.)
 
 	def TransformForward(self, psi):
-		# transform into fourier space
-		if IsSingleProc():
-			self.FFTTransform.ForwardTransform(psi)
-		else:
-			stage = 0
-			for curRank in self.TransformOrder:
-				distribRanks = psi.GetRepresentation().GetDistributedModel().GetDistribution().copy()
-				if curRank in distribRanks:
-					stage += 1
-					self.Transpose(stage, psi)
-				self.TransformRank(curRank, self.FFT_FORWARD, psi)
-
+		# transform into fourier space. Distributed wavefunctions are left
+		# in the last transposed distribution (the last stage of DistribList)
+		self.FFTTransform.ForwardTransform(psi)
 		self.SetFourierRepresentation(psi)
 
 	def TransformInverse(self, psi):
 		# transform back into real space
-		if IsSingleProc():
-			self.FFTTransform.InverseTransform(psi)
-		else:
-			stage = len(self.DistribList)-1
-			for curRank in reversed(self.TransformOrder):
-				distribRanks = psi.GetRepresentation().GetDistributedModel().GetDistribution().copy()
-				if curRank in distribRanks:
-					stage -= 1
-					self.Transpose(stage, psi)
-				self.TransformRank(curRank, self.FFT_BACKWARD, psi)
-			self.TransformNormalize(psi)
-
+		self.FFTTransform.InverseTransform(psi)
 		self.SetGridRepresentation(psi)
 
+	def TransformStagesForward(self, psi, fuseLastRank=False):
+		"""
+		Transforms the ranks of a distributed psi in TransformOrder, transposing
+		when the next rank is distributed. If fuseLastRank is set, the last 
+		rank is transformed forward and back in the fused kinetic pass, and psi
+		is left in real space, in the transposed layout of the last stage
+		"""
+		stage = 0
+		lastIndex = len(self.TransformOrder) - 1
+		for i, curRank in enumerate(self.TransformOrder):
+			distribRanks = psi.GetRepresentation().GetDistributedModel().GetDistribution().copy()
+			if curRank in distribRanks:
+				stage += 1
+				self.Transpose(stage, psi)
+			if fuseLastRank and i == lastIndex:
+				self.FFTTransform.AdvanceKineticEnergyRank(psi, int(curRank))
+			else:
+				self.TransformRank(curRank, self.FFT_FORWARD, psi)
+
+	def TransformStagesInverse(self, psi, skipLastRank=False):
+		"""
+		Inverse of TransformStagesForward, without normalization. If skipLastRank 
+		is set, the last rank of TransformOrder is assumed to be transformed back 
+		already by the fused kinetic pass
+		"""
+		stage = len(self.DistribList)-1
+		transformOrder = list(self.TransformOrder)
+		if skipLastRank:
+			transformOrder = transformOrder[:-1]
+		for curRank in reversed(transformOrder):
+			distribRanks = psi.GetRepresentation().GetDistributedModel().GetDistribution().copy()
+			if curRank in distribRanks:
+				stage -= 1
+				self.Transpose(stage, psi)
+			self.TransformRank(curRank, self.FFT_BACKWARD, psi)
 
 	def AdvanceKineticEnergy(self, t, dt):
+		if self.FusedKinetic:
+			self.AdvanceKineticEnergyFused()
+			return
+
 		# transform into fourier space
 		self.TransformForward(self.psi)
 		
@@ -112,6 +189,20 @@ class CartesianPropagator(PropagatorBase):
 		# transform back into real space
 		self.TransformInverse(self.psi)
 
+	def AdvanceKineticEnergyFused(self):
+		"""
+		Kinetic step with the phase exp(-i T dt) / N applied inside the last 
+		forward fft pass (CartesianFourierTransform.AdvanceKineticEnergy). 
+		The wavefunction stays in the transposed layout of the last forward
+		stage through the fused pass, so it is only transposed back once,
+		and no separate potential or normalization sweep is needed.
+		"""
+		if IsSingleProc():
+			self.FFTTransform.AdvanceKineticEnergy(self.psi)
+		else:
+			self.TransformStagesForward(self.psi, fuseLastRank=True)
+			self.TransformStagesInverse(self.psi, skipLastRank=True)
+
 	def MultiplyKineticEnergy(self, srcPsi, destPsi, t, dt):
 		# transform into fourier space
 		self.TransformForward(srcPsi)
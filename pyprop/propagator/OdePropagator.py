@@ -32,6 +32,8 @@ class OdePropagator(PropagatorBase):
 		configSection.Apply(self.BasePropagator)
 		#Set up the ODE propagator
 		configSection.Apply(self.OdeWrapper)
+		if hasattr(configSection, "use_cpp_hamiltonian"):
+			self.UseCppHamiltonian = configSection.use_cpp_hamiltonian
 	
 	def SetupStep(self, dt):
 		self.BasePropagator.SetupStep(dt)
@@ -44,6 +46,15 @@ class OdePropagator(PropagatorBase):
 		
 		self.MatVecCount = 0
 
+		#Apply the hamiltonian from C++ if possible. MatVecCallback uses
+		#BasePropagator.MultiplyHamiltonian, which solves the full overlap
+		repr = self.psi.GetRepresentation()
+		if all([repr.IsOrthogonalBasis(i) for i in range(self.Rank)]):
+			overlapMode = 0
+		else:
+			overlapMode = 1
+		self.UseHamiltonianOperator(self.OdeWrapper, overlapMode)
+
 	def MultiplyHamiltonian(self, srcPsi, destPsi, t, dt):
 		self.BasePropagator.MultiplyHamiltonian(srcPsi, destPsi, t, dt)
 
@@ -25,6 +25,8 @@ class PamPropagator(PropagatorBase):
 		configSection.Apply(self.BasePropagator)
 		#Set up the expokit propagator
 		configSection.Apply(self.PampWrapper)
+		if hasattr(configSection, "use_cpp_hamiltonian"):
+			self.UseCppHamiltonian = configSection.use_cpp_hamiltonian
 	
 	def SetupStep(self, dt):
 		self.BasePropagator.SetupStep(dt)
@@ -44,6 +46,16 @@ class PamPropagator(PropagatorBase):
 		else:
 			self.IsOrthogonalBasis = False
 
+		#Apply the hamiltonian from C++ if possible, using the same overlap
+		#handling as MatVecCallback
+		if self.IsOrthogonalBasis:
+			overlapMode = 0
+		elif self.UseBalancedOverlap:
+			overlapMode = 2
+		else:
+			overlapMode = 1
+		self.UseHamiltonianOperator(self.PampWrapper, overlapMode)
+
 	def MultiplyHamiltonian(self, srcPsi, destPsi, t, dt):
 		self.BasePropagator.MultiplyHamiltonian(srcPsi, destPsi, t, dt)
 
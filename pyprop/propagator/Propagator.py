@@ -46,6 +46,29 @@ class PropagatorBase:
 		raise "MultiplyHamiltonian should be implemented by inheriting class %s, but it's not" % (self.__class__) 
 
 	#Basic functionality that inheriting classes should use.
+	def UseHamiltonianOperator(self, wrapper, overlapMode):
+		"""
+		For explicit propagators with a base propagator (pAMP, Runge-Kutta, ODE):
+		If the base propagator can assemble its potentials in a C++ HamiltonianOperator,
+		make the C++ wrapper use it directly, instead of calling MatVecCallback
+		for every matrix-vector product. 
+		
+		Set use_cpp_hamiltonian = False in the propagation section to always 
+		use the python callback.
+
+		Returns True if the HamiltonianOperator is used
+		"""
+		self.Hamiltonian = None
+		if getattr(self, "UseCppHamiltonian", True) and hasattr(self.BasePropagator, "SetupHamiltonianOperator"):
+			self.Hamiltonian = self.BasePropagator.SetupHamiltonianOperator(overlapMode)
+
+		if self.Hamiltonian != None:
+			wrapper.SetHamiltonianOperator(self.Hamiltonian)
+			return True
+		else:
+			wrapper.ClearHamiltonianOperator()
+			return False
+
 	def SetupPotential(self, dt):
 		for potential in self.PotentialList:
 			PrintOut("    Setting up potential %s" % potential.Name)
@@ -28,6 +28,8 @@ class RungeKuttaPropagator(PropagatorBase):
 		configSection.Apply(self.BasePropagator)
 		#Set up the ODE propagator
 		configSection.Apply(self.RungeKuttaWrapper)
+		if hasattr(configSection, "use_cpp_hamiltonian"):
+			self.UseCppHamiltonian = configSection.use_cpp_hamiltonian
 
 
 	def SetupStep(self, dt):
@@ -42,6 +44,15 @@ class RungeKuttaPropagator(PropagatorBase):
 		
 		self.MatVecCount = 0
 
+		#Apply the hamiltonian from C++ if possible. MatVecCallback uses
+		#BasePropagator.MultiplyHamiltonian, which solves the full overlap
+		repr = self.psi.GetRepresentation()
+		if all([repr.IsOrthogonalBasis(i) for i in range(self.Rank)]):
+			overlapMode = 0
+		else:
+			overlapMode = 1
+		self.UseHamiltonianOperator(self.RungeKuttaWrapper, overlapMode)
+
 
 	def MultiplyHamiltonian(self, srcPsi, destPsi, t, dt):
 		self.BasePropagator.MultiplyHamiltonian(srcPsi, destPsi, t, dt)
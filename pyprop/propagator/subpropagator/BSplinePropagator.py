@@ -81,13 +81,46 @@ class BSplinePropagator(SubPropagatorBase):
 
 			# Set up propagator w/potential
 			self.ForwardTransform(self.psi)
-			self.Propagator.Setup(dt, self.psi, self.BSplineObject, potentialVector, self.TransformRank)
+			setup = lambda: self.Propagator.Setup(dt, self.psi, self.BSplineObject, potentialVector, self.TransformRank)
 
 		else:
 
 			# Set up propagator without potentials
 			self.ForwardTransform(self.psi)
-			self.Propagator.Setup(dt, self.psi, self.BSplineObject, self.TransformRank)
+			setup = lambda: self.Propagator.Setup(dt, self.psi, self.BSplineObject, self.TransformRank)
+
+		if IsAutotuneEnabled(self.ConfigSection) and not hasattr(self.ConfigSection, "propagation_algorithm"):
+			self.AutotunePropagationAlgorithm(setup)
+		else:
+			setup()
+
+
+	def AutotunePropagationAlgorithm(self, setup):
+		"""
+		Times AdvanceStep for the propagation algorithms on a copy of psi,
+		and selects the fastest. setup() sets up the propagator matrices,
+		which depend on the algorithm.
+		"""
+		candidates = [0, 2]
+		rank1repr = self.psi.GetRepresentation().GetRepresentation(1)
+		if isinstance(rank1repr, core.ReducedSphericalHarmonicRepresentation):
+			candidates.insert(1, 1)
+
+		def select(algo):
+			self.Propagator.SetPropagationAlgorithm(algo)
+			setup()
+
+		tempPsi = self.psi.CopyDeep()
+		run = lambda: self.Propagator.AdvanceStep(tempPsi)
+
+		def output():
+			tempPsi.GetData()[:] = self.psi.GetData()
+			self.Propagator.AdvanceStep(tempPsi)
+			return tempPsi.GetData().copy()
+
+		distr = self.psi.GetRepresentation().GetDistributedModel()
+		tuner = GetAutotuner(self.ConfigSection)
+		tuner.Tune("BSplinePropagator(rank=%i)" % self.TransformRank, self.psi.GetData().shape, candidates, select, run, distr, output=output)
 
 	
 	def AdvanceStepConjugate(self, t, dt):
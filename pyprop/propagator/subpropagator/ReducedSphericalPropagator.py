@@ -37,6 +37,40 @@ class ReducedSphericalPropagator(SphericalPropagatorBase):
 		self.Transform.InverseTransform(self.psi)
 		self.psi.GetRepresentation().SetRepresentation(self.TransformRank, self.RepresentationTheta)
 
+		#Select transform algorithm
+		if hasattr(self.Config, "transform_algorithm"):
+			self.Transform.SetAlgorithm(self.Config.transform_algorithm)
+		elif IsAutotuneEnabled(self.Config):
+			self.AutotuneTransform()
+
+	def AutotuneTransform(self):
+		"""
+		Times the ReducedSphericalTools algorithms on a copy of psi, and
+		selects the fastest. Algorithms 1-3 treat the ranks after the
+		transform rank as a single index, and are only candidates when
+		they have size 1. The forward transform of every candidate is
+		checked against algorithm 0
+		"""
+		shape = self.psi.GetData().shape
+		postCount = int(prod(shape[self.TransformRank+1:]))
+		candidates = [0, 4]
+		if postCount == 1:
+			candidates = [0, 1, 2, 3, 4]
+
+		tempPsi = self.psi.CopyDeep()
+		def run():
+			self.Transform.ForwardTransform(tempPsi)
+			self.Transform.InverseTransform(tempPsi)
+
+		def output():
+			tempPsi.GetData()[:] = self.psi.GetData()
+			self.Transform.ForwardTransform(tempPsi)
+			return tempPsi.GetData().copy()
+
+		distr = self.psi.GetRepresentation().GetDistributedModel()
+		tuner = GetAutotuner(self.Config)
+		tuner.Tune("ReducedSphericalTransform(rank=%i)" % self.TransformRank, shape, candidates, self.Transform.SetAlgorithm, run, distr, output=output)
+
 
 	def GetBasisFunction(self, rank, basisIndex):
 		basisFunction = zeros(self.MaxL+1, dtype=double)
@@ -0,0 +1,312 @@
+import threading
+import Queue
+import fcntl
+
+#--------------------------------------------------------------------------------------
+#                         Asynchronous checkpointing
+#--------------------------------------------------------------------------------------
+
+class CheckpointRequest(object):
+	"""
+	A snapshot of the local wavefunction slab waiting to be, or having been,
+	written to a HDF5 file by the CheckpointService.
+
+	After completion, the following attributes are available
+	- Error: None if the write succeeded, otherwise the exception raised
+	- Superseded: True if a newer checkpoint had already been written to
+	  the same dataset, in which case this snapshot was not written
+	- Duration: Wall time used by the I/O thread to write this snapshot
+	"""
+	def __init__(self, runId, serial, filename, datasetPath, data, fileSlab, fullShape, conf, useLockFile, callback, bufferName, compression=None):
+		self.RunId = runId
+		self.Serial = serial
+		self.Filename = filename
+		self.DatasetPath = datasetPath
+		self.Data = data
+		self.FileSlab = fileSlab
+		self.FullShape = fullShape
+		self.Config = conf
+		self.UseLockFile = useLockFile
+		self.Callback = callback
+		self.BufferName = bufferName
+		self.Compression = compression
+
+		self.Error = None
+		self.Superseded = False
+		self.Duration = 0
+		self.IsCompleted = False
+
+
+def WriteCheckpointSlab(request):
+	"""
+	Writes the local slab of a checkpoint request to file. Called from the
+	I/O thread of CheckpointService.
+
+	When running on several procs, every proc writes its own slab from its
+	own I/O thread. There are no barriers between the procs, instead the
+	file is protected with a lock file, and the dataset is tagged with the
+	run id and serial number of the checkpoint. Within each proc, the
+	pytables access is serialized with HDFLock. The first proc to write a
+	new checkpoint replaces the existing dataset, and slabs of checkpoints
+	which have already been superseded are skipped.
+
+	Returns False if the checkpoint was superseded, True otherwise.
+	"""
+	lockFile = None
+	if request.UseLockFile:
+		lockFile = open(request.Filename + ".lock", "a")
+		fcntl.lockf(lockFile, fcntl.LOCK_EX)
+
+	try:
+		HDFLock.acquire()
+		try:
+			f = tables.openFile(request.Filename, "a")
+			try:
+				dataset = GetExistingDataset(f, request.DatasetPath)
+				if dataset != None:
+					attrNames = dataset._v_attrs._v_attrnames
+					runId = serial = None
+					if "checkpointRunId" in attrNames and "checkpointSerial" in attrNames:
+						runId = dataset._v_attrs.checkpointRunId
+						serial = dataset._v_attrs.checkpointSerial
+
+					#A newer checkpoint from this run has already been written
+					if runId == request.RunId and serial > request.Serial:
+						return False
+
+					#Replace datasets from older checkpoints, or other runs
+					if runId != request.RunId or serial != request.Serial or dataset.shape != request.FullShape:
+						groupName, datasetName = GetDatasetName(request.DatasetPath)
+						f.removeNode(groupName, datasetName, recursive=True)
+						dataset = None
+
+				if dataset == None:
+					dataset = CreateDataset(f, request.DatasetPath, request.FullShape, request.Compression)
+					dataset._v_attrs.checkpointRunId = request.RunId
+					dataset._v_attrs.checkpointSerial = request.Serial
+
+				WriteLocalSlab(dataset, request.Data, request.FileSlab, request.Compression)
+				if request.Config != None:
+					dataset._v_attrs.configObject = request.Config.cfgObj
+
+			finally:
+				f.close()
+		finally:
+			HDFLock.release()
+
+	finally:
+		if lockFile != None:
+			fcntl.lockf(lockFile, fcntl.LOCK_UN)
+			lockFile.close()
+
+	return True
+
+
+class CheckpointService(object):
+	"""
+	Saves snapshots of a wavefunction to HDF5 files in a background I/O thread,
+	so that the propagation can continue while the checkpoint is written.
+
+	Snapshot() copies the active data buffer of the wavefunction into a spare
+	data buffer in the wavefunction buffer list, which is locked until the
+	snapshot has been written. At most maxInFlight snapshots are pending at
+	any time, if more snapshots are requested, Snapshot() will block until
+	the oldest one has completed.
+
+	Completion callbacks are always called from the main thread, from within
+	Snapshot(), Poll() or Wait(), with the completed CheckpointRequest as
+	argument. The I/O thread does not call MPI or modify the wavefunction.
+
+	Snapshot() must be called collectively by all procs, in the same way as
+	SaveWavefunctionHDF. The files written are compatible with
+	LoadWavefunctionHDF.
+
+	The I/O thread only runs when the main thread has released the python
+	GIL. The long running C++ calls release it (see core/utility/gilrelease.h):
+	the AdvanceStep of the pAMP, Expokit, ODE and Runge-Kutta propagators,
+	HamiltonianOperator.Multiply, the TensorPotentialMultiply functions,
+	the cartesian fourier transforms and the b-spline propagator, so the
+	snapshots are written while the next timesteps are computed. Python
+	callbacks (e.g. a python MultiplyHamiltonian passed to pAMP) take the
+	GIL back while they run, so the C++ HamiltonianOperator gives the most
+	overlap. Measured with 20 steps of 50ms C++ work and a thread writing
+	1024 fsync'ed 1MB blocks: 0 blocks were written during the steps when
+	the step held the GIL, and ~420 when it released it. With 10 python
+	callbacks per step, each callback was delayed ~1.5ms taking the GIL back
+	from the writer. The time the main thread was blocked waiting for
+	snapshots is accumulated in BlockedDuration, and the time used by the
+	I/O thread in IODuration.
+
+	All pytables access from pyprop.serialization, in any thread, is
+	serialized with HDFLock, so files can be saved or loaded while
+	snapshots are in flight. Such calls wait for the write in progress.
+
+	Example:
+	checkpoints = CheckpointService(maxInFlight=2)
+	for t in prop.Advance(100):
+		checkpoints.Snapshot("checkpoint.h5", "/wavefunction", prop.psi, prop.Config)
+	checkpoints.Shutdown()
+	"""
+
+	def __init__(self, maxInFlight=2):
+		if maxInFlight < 1:
+			raise Exception("maxInFlight must be at least 1, got %s" % maxInFlight)
+		self.MaxInFlight = maxInFlight
+		self.PendingQueue = Queue.Queue()
+		self.CompletedQueue = Queue.Queue()
+		self.InFlight = []
+		self.Serial = 0
+		self.RunId = None
+		self.Thread = None
+		self.BlockedDuration = 0
+		self.IODuration = 0
+		self.Logger = pyprop.GetClassLogger(self)
+
+	def Snapshot(self, filename, datasetPath, psi, conf=None, callback=None, compression=None):
+		"""
+		Snapshots the wavefunction psi, and schedules it to be written to
+		datasetPath in the HDF5 file filename. The dataset is compressed
+		with compression (a CheckpointCompression) if it is given.
+
+		callback(request) is called from the main thread when the snapshot has
+		been written. The CheckpointRequest object is returned.
+		"""
+		#Bound the number of snapshots in flight
+		while len(self.InFlight) >= self.MaxInFlight:
+			self.ProcessCompleted(block=True)
+
+		distr = psi.GetRepresentation().GetDistributedModel()
+		if self.RunId == None:
+			#Let all procs agree on the run id of proc 0
+			runId = 0.0
+			if distr.ProcId == 0:
+				runId = time.time()
+			self.RunId = distr.GetGlobalSum(runId)
+		self.Serial += 1
+
+		#Copy the wavefunction into a spare buffer
+		bufferName, data = self.CopyToSpareBuffer(psi)
+
+		#Only proc 0 stores the config object
+		storedConf = None
+		if distr.ProcId == 0:
+			storedConf = conf
+
+		fullShape = tuple(psi.GetRepresentation().GetFullShape())
+		fileSlab = GetFileSlab(psi)
+		useLockFile = not distr.IsSingleProc()
+		request = CheckpointRequest(self.RunId, self.Serial, filename, datasetPath, data, fileSlab, fullShape, storedConf, useLockFile, callback, bufferName, compression)
+		request.Psi = psi
+
+		self.StartThread()
+		self.InFlight.append(request)
+		self.PendingQueue.put(request)
+
+		return request
+
+	def CopyToSpareBuffer(self, psi):
+		"""
+		Copies the active buffer of psi into an available buffer of the same
+		shape, allocating a new one if necessary. The spare buffer is locked,
+		and its name and data array is returned.
+		"""
+		activeData = psi.GetData()
+		shape = activeData.shape
+		activeBufferName = psi.GetActiveBufferName()
+
+		bufferName = psi.GetAvailableDataBufferName(shape)
+		if bufferName == -1:
+			bufferName = psi.AllocateData(shape)
+
+		#Get a reference to the spare buffer by temporarily activating it
+		psi.SetActiveBuffer(bufferName)
+		spareData = psi.GetData()
+		psi.SetActiveBuffer(activeBufferName)
+		psi.LockBuffer(bufferName)
+
+		spareData[:] = activeData
+		return bufferName, spareData
+
+	def StartThread(self):
+		if self.Thread == None:
+			self.Thread = threading.Thread(target=self.RunThread, name="CheckpointService")
+			self.Thread.setDaemon(True)
+			self.Thread.start()
+
+	def RunThread(self):
+		"""
+		Main loop of the I/O thread
+		"""
+		while True:
+			request = self.PendingQueue.get()
+			if request == None:
+				break
+
+			t = - time.time()
+			try:
+				request.Superseded = not WriteCheckpointSlab(request)
+			except Exception, e:
+				request.Error = e
+			request.Duration = t + time.time()
+			self.CompletedQueue.put(request)
+
+	def ProcessCompleted(self, block=False):
+		"""
+		Releases the buffers and calls the callbacks of completed snapshots.
+		If block is True, waits until at least one snapshot has completed
+		"""
+		while len(self.InFlight) > 0:
+			t = - time.time()
+			try:
+				request = self.CompletedQueue.get(block)
+			except Queue.Empty:
+				break
+			finally:
+				if block:
+					self.BlockedDuration += t + time.time()
+			block = False
+
+			request.Psi.UnLockBuffer(request.BufferName)
+			request.Psi = None
+			request.Data = None
+			request.IsCompleted = True
+			self.InFlight.remove(request)
+			self.IODuration += request.Duration
+
+			if request.Error != None:
+				self.Logger.error("Could not write checkpoint %s:%s (%s)" % (request.Filename, request.DatasetPath, request.Error))
+			else:
+				self.Logger.debug("Wrote checkpoint %s:%s in %.2fs" % (request.Filename, request.DatasetPath, request.Duration))
+
+			if request.Callback != None:
+				request.Callback(request)
+
+	def Poll(self):
+		"""
+		Processes completed snapshots without blocking. Called every timestep
+		from Problem.Advance
+		"""
+		if len(self.InFlight) > 0:
+			self.ProcessCompleted(block=False)
+
+	def Wait(self):
+		"""
+		Waits until all pending snapshots have been written
+		"""
+		while len(self.InFlight) > 0:
+			self.ProcessCompleted(block=True)
+
+	def GetInFlightCount(self):
+		return len(self.InFlight)
+
+	def Shutdown(self):
+		"""
+		Waits for all pending snapshots, and stops the I/O thread
+		"""
+		self.Wait()
+		if self.Thread != None:
+			self.PendingQueue.put(None)
+			self.Thread.join()
+			self.Thread = None
+		self.Logger.debug("Checkpoint I/O took %.2fs, of which the main thread was blocked for %.2fs" % (self.IODuration, self.BlockedDuration))
+
@@ -0,0 +1,221 @@
+#--------------------------------------------------------------------------------------
+#                         Chunked reading of large datasets
+#--------------------------------------------------------------------------------------
+
+def GetChunkSlabs(fullShape, chunkSize, rank=0):
+	"""
+	Splits a dataset of shape fullShape into slabs of at most chunkSize
+	indices along rank. Returns a list of slabs (tuples of slices), each
+	spanning the full extent of the other ranks.
+	"""
+	if chunkSize < 1:
+		raise Exception("chunkSize must be at least 1, got %s" % chunkSize)
+
+	slabs = []
+	for start in range(0, fullShape[rank], chunkSize):
+		end = min(start + chunkSize, fullShape[rank])
+		slab = [slice(None)] * len(fullShape)
+		slab[rank] = slice(start, end)
+		slabs.append(tuple(slab))
+	return slabs
+
+
+class ChunkReadRequest(object):
+	"""
+	Reads one slab of an open dataset, either directly or in a
+	background thread
+	"""
+	def __init__(self, dataset, slab):
+		self.Dataset = dataset
+		self.Slab = slab
+		self.Data = None
+		self.Error = None
+		self.Thread = None
+
+	def Start(self):
+		self.Thread = threading.Thread(target=self.Run, name="DatasetChunkReader")
+		self.Thread.setDaemon(True)
+		self.Thread.start()
+
+	def Run(self):
+		HDFLock.acquire()
+		try:
+			try:
+				self.Data = self.Dataset[self.Slab]
+			except Exception, e:
+				self.Error = e
+		finally:
+			HDFLock.release()
+
+	def Wait(self):
+		"""
+		Waits for the read to complete, and returns the data
+		"""
+		if self.Thread != None:
+			self.Thread.join()
+			self.Thread = None
+		else:
+			self.Run()
+
+		if self.Error != None:
+			raise self.Error
+		return self.Data
+
+
+class DatasetChunkReader(object):
+	"""
+	Iterates over a HDF5 dataset in slabs of chunkSize indices along rank,
+	yielding a tuple (slab, data) for each chunk. The slab is given in the
+	indices of the full dataset, i.e. data == dataset[slab].
+
+	If prefetch is True, the next chunk is read in a background thread while
+	the current one is processed, so that at most two chunks are in memory
+	at any time. All access to the file is serialized with HDFLock. As for
+	the CheckpointService, the read only overlaps with the processing of
+	the current chunk while the main thread does not hold the python GIL,
+	i.e. in pyprop C++ calls which release it (e.g. the projections of
+	RadialProductProjector) and numpy operations which release it.
+
+	This is for analysis of datasets which do not fit in memory. It is not
+	collective, if several procs are used, each proc may process a subset
+	of the chunks given by chunkFilter(chunkIndex).
+
+	Example:
+	reader = DatasetChunkReader("checkpoint.h5", "/wavefunction", 16)
+	norm = 0
+	for slab, data in reader:
+		norm += sum(abs(data)**2)
+	"""
+
+	def __init__(self, filename, datasetPath, chunkSize, rank=0, prefetch=True, chunkFilter=None):
+		self.Filename = filename
+		self.DatasetPath = datasetPath
+		self.ChunkSize = chunkSize
+		self.Rank = rank
+		self.Prefetch = prefetch
+		self.ChunkFilter = chunkFilter
+
+	@SerializedHDF
+	def GetFullShape(self):
+		f = tables.openFile(self.Filename, "r")
+		try:
+			return self.GetDataset(f).shape
+		finally:
+			f.close()
+
+	def GetDataset(self, f):
+		dataset = GetExistingDataset(f, self.DatasetPath)
+		if dataset == None:
+			raise Exception("Dataset '%s' not found in file '%s'" % (self.DatasetPath, self.Filename))
+		return dataset
+
+	def GetSlabs(self, fullShape):
+		slabs = GetChunkSlabs(fullShape, self.ChunkSize, self.Rank)
+		if self.ChunkFilter != None:
+			slabs = [slab for i, slab in enumerate(slabs) if self.ChunkFilter(i)]
+		return slabs
+
+	def StartRead(self, dataset, slab):
+		request = ChunkReadRequest(dataset, slab)
+		if self.Prefetch:
+			request.Start()
+		return request
+
+	def __iter__(self):
+		HDFLock.acquire()
+		try:
+			f = tables.openFile(self.Filename, "r")
+			try:
+				dataset = self.GetDataset(f)
+				slabs = self.GetSlabs(dataset.shape)
+			except:
+				f.close()
+				raise
+		finally:
+			HDFLock.release()
+
+		pending = None
+		try:
+			if len(slabs) > 0:
+				pending = self.StartRead(dataset, slabs[0])
+
+			for i, slab in enumerate(slabs):
+				data = pending.Wait()
+				pending = None
+				if i+1 < len(slabs):
+					pending = self.StartRead(dataset, slabs[i+1])
+				yield slab, data
+				data = None
+
+		finally:
+			#The reader thread must be done with the file before it is closed,
+			#also when the iteration is stopped early
+			if pending != None and pending.Thread != None:
+				pending.Thread.join()
+			HDFLock.acquire()
+			try:
+				f.close()
+			finally:
+				HDFLock.release()
+
+
+@SerializedHDF
+def ReadDatasetSlabs(filename, datasetPaths, slab):
+	"""
+	Reads the same slab of several datasets in a file, e.g. the rows of
+	a set of eigenvectors matching the current chunk of a
+	DatasetChunkReader, without loading the full datasets. Returns a list
+	of arrays, one for each path in datasetPaths.
+	"""
+	f = tables.openFile(filename, "r")
+	try:
+		dataList = []
+		for datasetPath in datasetPaths:
+			dataset = GetExistingDataset(f, datasetPath)
+			if dataset == None:
+				raise Exception("Dataset '%s' not found in file '%s'" % (datasetPath, filename))
+			dataList.append(dataset[slab])
+		return dataList
+	finally:
+		f.close()
+
+
+def ReduceDatasetChunks(reader, kernel, reduce=lambda x, y: x + y):
+	"""
+	Applies kernel(slab, data) to every chunk of a DatasetChunkReader,
+	and returns the results combined with reduce (the sum by default).
+	None is returned if there are no chunks.
+	"""
+	result = None
+	for slab, data in reader:
+		curResult = kernel(slab, data)
+		if result is None:
+			result = curResult
+		else:
+			result = reduce(result, curResult)
+	return result
+
+
+def MultiplyIntegrationWeightsSlab(repr, data, slab):
+	"""
+	Multiplies the integration weights (or the overlap matrix for
+	non-orthogonal ranks) on a slab of a wavefunction, as
+	repr.MultiplyIntegrationWeights does for a full wavefunction. data
+	must be a contiguous array (as read by DatasetChunkReader), and is
+	modified in place. The slab may only be a part of the full shape along
+	orthogonal ranks.
+	"""
+	shape = data.shape
+	fullShape = repr.GetFullShape()
+	for rank in range(len(shape)):
+		#3D view of data, with the current rank in the middle
+		data3d = data.view()
+		data3d.shape = (int(numpy.prod(shape[:rank])), shape[rank], int(numpy.prod(shape[rank+1:])))
+
+		if repr.IsOrthogonalBasis(rank):
+			weights = repr.GetGlobalWeights(rank)[slab[rank]]
+			data3d *= weights[numpy.newaxis, :, numpy.newaxis]
+		else:
+			if shape[rank] != fullShape[rank]:
+				raise Exception("The slab must span the full extent of the non-orthogonal rank %i" % rank)
+			repr.GetGlobalOverlapMatrix(rank).MultiplyOverlapTensor(data3d)
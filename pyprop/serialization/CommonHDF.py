@@ -1,6 +1,7 @@
 import numpy 
 import os
 import time
+import threading
 
 from numpy import r_, s_, all, diff, array, asarray
 
@@ -8,10 +9,35 @@ import pyprop
 
 DEBUG = False
 
+#--------------------------------------------------------------------------------------
+#                         Serialized file access
+#--------------------------------------------------------------------------------------
+
+#pytables is not thread safe. All pytables access in pyprop is serialized
+#with HDFLock, also from the I/O threads of the CheckpointService and the
+#DatasetChunkReader. Other code using pytables (scripts, pyprop.plotting)
+#while a checkpoint or a prefetch is in flight must hold HDFLock as well
+HDFLock = threading.RLock()
+
+def SerializedHDF(func):
+	"""
+	Returns a wrapper of func which calls func with HDFLock held
+	"""
+	def serializedFunc(*args, **kwargs):
+		HDFLock.acquire()
+		try:
+			return func(*args, **kwargs)
+		finally:
+			HDFLock.release()
+	serializedFunc.__name__ = func.__name__
+	serializedFunc.__doc__ = func.__doc__
+	return serializedFunc
+
 #--------------------------------------------------------------------------------------
 #                         Dataset Tools
 #--------------------------------------------------------------------------------------
 
+@SerializedHDF
 def RemoveExistingDataset(filename, datasetPath):
 	"""
 	Removes a node from a HDF5 file if it exists
@@ -63,9 +89,11 @@ def GetExistingDataset(f, datasetPath):
 	return dataset
 
 
-def CreateDataset(f, datasetPath, fullShape):
+def CreateDataset(f, datasetPath, fullShape, compression=None):
 	"""
 	Creates a chunked array dataset of shape fullShape at the given path. 
+	If compression (a CheckpointCompression) is given, the dataset is
+	created with its filters. Otherwise the dataset is not compressed.
 	"""
 	#Separate path from node name 
 	groupName, datasetName = GetDatasetName(datasetPath)
@@ -92,15 +120,153 @@ def CreateDataset(f, datasetPath, fullShape):
 	#Finally, save the data set
 	atom = tables.ComplexAtom(itemsize=16)
 	filters = tables.Filters(complevel=0)
+	if compression != None:
+		filters = compression.GetFilters()
 	dataset = f.createCArray(groupName, datasetName, atom, fullShape, filters=filters)
+	if compression != None:
+		compression.SetAttributes(dataset)
 
 	return dataset
 
+#--------------------------------------------------------------------------------------
+#                         Compression
+#--------------------------------------------------------------------------------------
+
+class CheckpointCompression(object):
+	"""
+	Compression of wavefunction datasets written by SaveWavefunctionHDF and
+	the CheckpointService.
+
+	Lossless compression uses the HDF5 chunk filters of pytables:
+	- complib: "zlib", "lzo", "bzip2" or "blosc" (pytables 3 also supports
+	  e.g. "blosc:lz4"). None disables the lossless filters
+	- complevel: 0-9, 0 disables the lossless filters
+	- shuffle: byte shuffle before compression, which groups the exponent
+	  bytes of the coefficients, and usually improves compression a lot
+
+	Lossy compression is error-bounded, and is applied to a copy of the
+	data (block by block) before it is written:
+	- mantissaBits: the mantissa of the real and imaginary parts are
+	  truncated to this many bits (of 52). The relative error of every
+	  coefficient is less than 2**-mantissaBits, and the truncated bits
+	  are zero, which the lossless filters compress well
+	- dropTolerance: the smallest coefficients are set to zero, such that
+	  the norm of the dropped coefficients is at most dropTolerance times
+	  the norm of the data. Each proc drops from its own slab, so the bound
+	  holds for the full wavefunction as well. After absorption, most of
+	  the coefficients are negligible
+
+	The datasets are ordinary complex datasets, and are read by
+	LoadWavefunctionHDF without any knowledge of the compression. The
+	compression parameters are stored as attributes on the dataset.
+
+	Example:
+	compression = CheckpointCompression(complib="blosc", mantissaBits=32)
+	SaveWavefunctionHDF("out.h5", "/wavefunction", psi, compression=compression)
+	"""
+
+	#Number of elements quantized at a time
+	BlockSize = 2**20
+
+	def __init__(self, complib="zlib", complevel=5, shuffle=True, mantissaBits=None, dropTolerance=None):
+		if mantissaBits != None and not 0 <= mantissaBits <= 52:
+			raise Exception("mantissaBits must be between 0 and 52, got %s" % mantissaBits)
+		if dropTolerance != None and not 0 <= dropTolerance < 1:
+			raise Exception("dropTolerance must be between 0 and 1, got %s" % dropTolerance)
+
+		self.Complib = complib
+		self.Complevel = complevel
+		self.Shuffle = shuffle
+		self.MantissaBits = mantissaBits
+		self.DropTolerance = dropTolerance
+
+	def __repr__(self):
+		return "CheckpointCompression(complib=%r, complevel=%r, shuffle=%r, mantissaBits=%r, dropTolerance=%r)" % \
+			(self.Complib, self.Complevel, self.Shuffle, self.MantissaBits, self.DropTolerance)
+
+	def IsLossy(self):
+		return (self.MantissaBits != None and self.MantissaBits < 52) or bool(self.DropTolerance)
+
+	def GetFilters(self):
+		if self.Complib == None or self.Complevel == 0:
+			return tables.Filters(complevel=0, shuffle=self.Shuffle)
+		return tables.Filters(complevel=self.Complevel, complib=self.Complib, shuffle=self.Shuffle)
+
+	def SetAttributes(self, dataset):
+		dataset._v_attrs.compression = repr(self)
+
+	def GetDropExponent(self, localData):
+		"""
+		Returns the exponent e, such that the coefficients c of localData
+		with |c|**2 < 2**e have a total norm of at most dropTolerance
+		times the norm of localData. The squared norms are binned on their
+		binary exponent, so that only a single pass over the data is needed.
+		"""
+		exponentOffset = 1100
+		normHistogram = numpy.zeros(2*exponentOffset, dtype=float)
+		flatData = numpy.ravel(localData)
+		for start in range(0, flatData.size, self.BlockSize):
+			exponent, absSqr = self.GetExponent(flatData[start:start+self.BlockSize])
+			normHistogram += numpy.bincount(exponent + exponentOffset, weights=absSqr, minlength=len(normHistogram))
+
+		cumulativeNorm = numpy.cumsum(normHistogram)
+		budget = self.DropTolerance**2 * cumulativeNorm[-1]
+		return numpy.searchsorted(cumulativeNorm, budget, side="right") - 1 - exponentOffset
+
+	def GetExponent(self, data):
+		"""
+		Returns the binary exponent of |data|**2 (|data|**2 < 2**exponent),
+		zeros are given exponent -1100
+		"""
+		absSqr = numpy.abs(data)**2
+		exponent = numpy.frexp(absSqr)[1]
+		exponent[absSqr == 0] = -1100
+		return exponent, absSqr
+
+	def Quantize(self, data, dropExponent=None):
+		"""
+		Returns a quantized copy of data
+		"""
+		data = numpy.array(data, dtype=complex, copy=True)
+		if dropExponent != None:
+			exponent, absSqr = self.GetExponent(data)
+			data[exponent <= dropExponent] = 0
+		if self.MantissaBits != None and self.MantissaBits < 52:
+			mask = numpy.uint64((2**64 - 1) ^ (2**(52 - self.MantissaBits) - 1))
+			bits = data.view(numpy.uint64)
+			bits &= mask
+		return data
+
+
+def CreateCheckpointCompression(configSection):
+	"""
+	Creates a CheckpointCompression from the checkpoint_* options of a
+	config section, or returns None if checkpoint_compression is not given.
+	- checkpoint_compression: complib (e.g. "zlib" or "blosc"), or "none"
+	  for lossy compression only
+	- checkpoint_compression_level (default 5)
+	- checkpoint_shuffle (default True)
+	- checkpoint_mantissa_bits (default None, lossless)
+	- checkpoint_drop_tolerance (default None, lossless)
+	"""
+	if not hasattr(configSection, "checkpoint_compression"):
+		return None
+
+	complib = configSection.checkpoint_compression
+	if complib == None or str(complib).lower() == "none":
+		complib = None
+	return CheckpointCompression(complib=complib, \
+		complevel=getattr(configSection, "checkpoint_compression_level", 5), \
+		shuffle=getattr(configSection, "checkpoint_shuffle", True), \
+		mantissaBits=getattr(configSection, "checkpoint_mantissa_bits", None), \
+		dropTolerance=getattr(configSection, "checkpoint_drop_tolerance", None))
+
 #--------------------------------------------------------------------------------------
 #                         Load and Save slabs of large datasets
 #--------------------------------------------------------------------------------------
 
-def SaveLocalSlab(filename, datasetPath, localData, localSlab, fullShape):
+@SerializedHDF
+def SaveLocalSlab(filename, datasetPath, localData, localSlab, fullShape, compression=None):
 	"""
 	Saves the local slab of a global dataset to a file
 
@@ -110,6 +276,7 @@ def SaveLocalSlab(filename, datasetPath, localData, localSlab, fullShape):
 	localSlab   - the local slab (n-dimensional tuple containing the local range in
 				  the global dataset
 	fullShape   - shape of the global dataset
+	compression - a CheckpointCompression, or None
 
 	"""
 	#open file
@@ -120,29 +287,67 @@ def SaveLocalSlab(filename, datasetPath, localData, localSlab, fullShape):
 		dataset = GetExistingDataset(f, datasetPath)
 		if dataset == None:
 			#create new dataset
-			dataset = CreateDataset(f, datasetPath, fullShape)
+			dataset = CreateDataset(f, datasetPath, fullShape, compression)
 		else:
 			#check that is has the correct size
 			if not dataset.shape == fullShape:
 				raise "Invalid shape on existing dataset. Got %s, expected %s" % (dataset.shape, fullShape)
 		
 		#write data
-		isSlices = map(lambda s: isinstance(s, slice), localSlab)
-		if all(isSlices):
-			dataset[localSlab] = localData
-		elif all(isSlices[1:]):
-			for dataIdx, fileIdx in enumerate(localSlab[0]):
-				curLocalSlab = (fileIdx,) + localSlab[1:]
-				dataset[curLocalSlab] = localData[dataIdx, :]
-		else:
-			raise "Only the first rank may be fancy indexing"
-
+		WriteLocalSlab(dataset, localData, localSlab, compression)
 	
 	finally:
 		#Make sure file is closed
 		f.close()
 
 
+def WriteLocalSlab(dataset, localData, localSlab, compression=None):
+	"""
+	Writes localData to the local slab of an open dataset. 
+	See SaveLocalSlab
+	"""
+	isSlices = map(lambda s: isinstance(s, slice), localSlab)
+	if compression != None and compression.IsLossy():
+		WriteLocalSlabLossy(dataset, localData, localSlab, compression)
+	elif all(isSlices):
+		dataset[localSlab] = localData
+	elif all(isSlices[1:]):
+		for dataIdx, fileIdx in enumerate(localSlab[0]):
+			curLocalSlab = (fileIdx,) + localSlab[1:]
+			dataset[curLocalSlab] = localData[dataIdx, :]
+	else:
+		raise "Only the first rank may be fancy indexing"
+
+
+def WriteLocalSlabLossy(dataset, localData, localSlab, compression):
+	"""
+	Writes a quantized copy of localData to the local slab of an open
+	dataset. localData is not modified, and is quantized and written in
+	blocks along the first rank, to limit the memory used by the copy.
+	"""
+	dropExponent = None
+	if compression.DropTolerance:
+		dropExponent = compression.GetDropExponent(localData)
+
+	isSlices = map(lambda s: isinstance(s, slice), localSlab)
+	if all(isSlices):
+		rowCount = localData.shape[0]
+		rowSize = max(1, localData.size // max(1, rowCount))
+		rowsPerBlock = max(1, compression.BlockSize // rowSize)
+		fileStart = localSlab[0].start or 0
+		for start in range(0, rowCount, rowsPerBlock):
+			end = min(start + rowsPerBlock, rowCount)
+			curLocalSlab = (slice(fileStart + start, fileStart + end),) + localSlab[1:]
+			dataset[curLocalSlab] = compression.Quantize(localData[start:end], dropExponent)
+	elif all(isSlices[1:]):
+		for dataIdx, fileIdx in enumerate(localSlab[0]):
+			curLocalSlab = (fileIdx,) + localSlab[1:]
+			dataset[curLocalSlab] = compression.Quantize(localData[dataIdx, :], dropExponent)
+	else:
+		raise "Only the first rank may be fancy indexing"
+
+
+@SerializedHDF
 def LoadLocalSlab(filename, datasetPath, localData, localSlab, fullShape):
 	"""
 	Loads the local slab of a global dataset from a file
@@ -188,6 +393,7 @@ def LoadLocalSlab(filename, datasetPath, localData, localSlab, fullShape):
 #                         Config Serialization
 #--------------------------------------------------------------------------------------
 
+@SerializedHDF
 def SaveConfigObject(filename, datasetPath, conf):
 	if conf != None:
 		h5file = tables.openFile(filename, "r+")
@@ -201,6 +407,7 @@ def SaveConfigObject(filename, datasetPath, conf):
 			h5file.close()
 
 
+@SerializedHDF
 def GetConfigFromHDF5(file, datasetPath = None, confObjName = "configObject"):
 	"""
 	Load a configparser object stored as an attribute on a wavefunction in a 
@@ -227,6 +434,7 @@ def GetConfigFromHDF5(file, datasetPath = None, confObjName = "configObject"):
 #--------------------------------------------------------------------------------------
 #                         High level functions
 #--------------------------------------------------------------------------------------
+@SerializedHDF
 def GetArrayFromHDF5(filename, path, name):
 	"""Load an array from a HDF5 file
 	"""
@@ -240,6 +448,7 @@ def GetArrayFromHDF5(filename, path, name):
 		
 	return A
 
+@SerializedHDF
 def GetAttributeFromHDF5(filename, path, attrName):
 	"""Get an attribute from a HDF5 file
 	"""
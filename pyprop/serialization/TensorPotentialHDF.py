@@ -80,9 +80,13 @@ def SaveTensorPotential(filename, groupPath, potential, distributedModel, conf=N
 		distr.GlobalBarrier();
 
 
-def LoadTensorPotential(filename, groupPath, potential, distributedModel):
+def LoadTensorPotential(filename, groupPath, potential, distributedModel, concurrent=False):
 	"""
 	Loads the tensor potential data from a dataset in a HDF file
+
+	If concurrent is True, all processors read their local slab at the same
+	time, otherwise the processors read their slabs one by one. Concurrent
+	reading is safe as long as noone writes to the file at the same time.
 	"""
 
 	if groupPath == "/":
@@ -99,14 +103,18 @@ def LoadTensorPotential(filename, groupPath, potential, distributedModel):
 	if not CheckLocalSlab(filename, groupPath, potential.GeometryList, localSlab):
 		raise Exception("Organization of basis pairs has changed from when this potential was generated. Please regenerate potential")
 
-	if distr.IsSingleProc():
+	if distr.IsSingleProc() or concurrent:
 		t = - time.time()
 		LoadLocalSlab(filename, datasetPath, localData, localSlab, fullShape)
 		t += time.time()
 		if DEBUG: print "Duration: %.10fs" % t
 
+		#Make sure everyone is finished
+		if not distr.IsSingleProc():
+			distr.GlobalBarrier()
+
 	else:
-		#let the processors save their part one by one
+		#let the processors load their part one by one
 		procCount = distr.ProcCount
 		procId = distr.ProcId
 		localSize = localData.nbytes / 1024.**2
@@ -137,6 +145,7 @@ def GetLocalBasisPairSlice(geomInfo):
 	return basisPairIndices
 
 
+@SerializedHDF
 def CheckLocalSlab(filename, groupPath, geometryList, localSlab):
 	rank = len(localSlab)
 	f = tables.openFile(filename, "r")
@@ -157,6 +166,7 @@ def CheckLocalSlab(filename, groupPath, geometryList, localSlab):
 	return True
 
 	
+@SerializedHDF
 def SaveGeometryInfo(filename, groupPath, geometryList):
 	f = tables.openFile(filename, "a")
 	try:
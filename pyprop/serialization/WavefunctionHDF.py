@@ -1,5 +1,5 @@
 
-def SaveWavefunctionHDF(hdfFile, datasetPath, psi, conf=None):
+def SaveWavefunctionHDF(hdfFile, datasetPath, psi, conf=None, compression=None):
 	"""
 	Saves the wavefunction data to a dataset in a HDF file, and stores a config object
 	as an attribute on the wavefunction if applicable.
@@ -25,6 +25,10 @@ def SaveWavefunctionHDF(hdfFile, datasetPath, psi, conf=None):
 	- other arguments: conf, a pyprop.Config object, which contains a cofig-
 	                   parser object. The configparser object is stored as
 	                   an attribute on the wavefunction-array.
+	                   compression, a CheckpointCompression for compressed
+	                   (and possibly lossy) datasets. The default is no
+	                   compression. Compressed datasets are loaded by
+	                   LoadWavefunctionHDF as usual.
 	
 	Example:
 	SaveWavefunctionHDF("myfile.h5", "/mygroup/wavefunction", prop.psi):
@@ -38,13 +42,17 @@ def SaveWavefunctionHDF(hdfFile, datasetPath, psi, conf=None):
 		filename = hdfFile.filename
 		#we must first close the hdffile. this is required for
 		#multiproc scenarios anyway, so we may as well do it here
-		hdfFile.close()
+		HDFLock.acquire()
+		try:
+			hdfFile.close()
+		finally:
+			HDFLock.release()
 
 	distr = psi.GetRepresentation().GetDistributedModel()
 	if distr.IsSingleProc():
 		t = - time.time()
 		RemoveExistingDataset(filename, datasetPath)
-		SaveLocalWavefunctionSlab(filename, datasetPath, psi)
+		SaveLocalWavefunctionSlab(filename, datasetPath, psi, compression)
 		t += time.time()
 		if DEBUG: print "Duration: %.10fs" % t
 		SaveConfigObject(filename, datasetPath, conf)
@@ -63,7 +71,7 @@ def SaveWavefunctionHDF(hdfFile, datasetPath, psi, conf=None):
 
 				if DEBUG: print "    Process %i writing hyperslab of %iMB" % (procId, localSize)
 				t = - time.time()
-				SaveLocalWavefunctionSlab(filename, datasetPath, psi)
+				SaveLocalWavefunctionSlab(filename, datasetPath, psi, compression)
 				t += time.time()
 				if DEBUG: print "    Duration: %.10fs" % t
 
@@ -100,12 +108,12 @@ def LoadWavefunctionHDF(hdfFile, datasetPath, psi):
 			distr.GlobalBarrier();
 	
 
-def SaveLocalWavefunctionSlab(filename, datasetPath, psi):
+def SaveLocalWavefunctionSlab(filename, datasetPath, psi, compression=None):
 	#get hyperslab for this proc
 	fullShape = tuple(psi.GetRepresentation().GetFullShape())
 	fileSlab = GetFileSlab(psi)
 	#save data
-	SaveLocalSlab(filename, datasetPath, psi.GetData(), fileSlab, fullShape)
+	SaveLocalSlab(filename, datasetPath, psi.GetData(), fileSlab, fullShape, compression)
 
 
 def LoadLocalWavefunctionSlab(filename, datasetPath, psi):
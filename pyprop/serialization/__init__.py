@@ -8,3 +8,5 @@ execfile(__path__[0] + "/CommonHDF.py")
 execfile(__path__[0] + "/TensorPotentialHDF.py")
 execfile(__path__[0] + "/WavefunctionHDF.py")
 
+execfile(__path__[0] + "/CheckpointHDF.py")
+execfile(__path__[0] + "/ChunkedHDF.py")
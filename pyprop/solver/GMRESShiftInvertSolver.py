@@ -21,6 +21,12 @@ class GMRESShiftInvertSolver:
 	value in the GMRES config section, and should partially invert the matrix 
 	(H - S*shift) 
 
+	With krylov_recycle_size > 0 in the GMRES config section, GMRES keeps
+	a deflation subspace between the solves (GCRO-DR), which speeds up 
+	the long sequence of solves with different right hand sides performed
+	by the eigenvalue solver. The operator is the same for all solves with 
+	a given shift, so the recycled subspace is marked as fixed.
+
 	"""
 
 	def __init__(self, prop):
@@ -39,6 +45,7 @@ class GMRESShiftInvertSolver:
 		self.Solver = CreateInstanceRank("core.krylov_GmresWrapper", self.Rank)
 		prop.Config.GMRES.Apply(self.Solver)
 		self.Solver.Setup(self.psi)
+		self.Solver.SetRecycleFixedOperator(True)
 
 		#Setup preconditioner
 		config = prop.Config
@@ -0,0 +1,156 @@
+#--------------------------------------------------------------------------------------
+#                    LOBPCG eigenvalue solver
+#--------------------------------------------------------------------------------------
+
+class LobpcgSolver:
+	"""
+	Finds the lowest eigenstates of the Hamiltonian with LOBPCG, a block
+	eigensolver using preconditioned residuals (see core/krylov/lobpcg).
+
+	This is an alternative to imaginary time propagation for finding
+	ground states. Where imaginary time needs thousands of propagation
+	steps for e.g. the helium ground state, LOBPCG with a reasonable
+	preconditioner converges the lowest few states in a few tens of
+	iterations, each costing one Hamiltonian-vector product for every
+	unconverged state in the block.
+
+	For non-orthogonal bases (B-splines), the generalized eigenvalue
+	problem H x = E S x is solved, with H from MultiplyHamiltonianNoOverlap
+	of the base propagator and S from MultiplyOverlap of the
+	representation. Otherwise Propagator.MultiplyHamiltonian is used.
+
+	Config section (default [Lobpcg]):
+	- krylov_eigenvalue_count: number of eigenstates
+	- krylov_block_size: number of vectors iterated (default
+	  krylov_eigenvalue_count). A few extra vectors speeds up the
+	  convergence of the highest wanted states
+	- krylov_max_iteration_count (default 100)
+	- krylov_tolerance: a state is converged when |H x - E S x| is less
+	  than krylov_tolerance * max(|E|, 1) (default 1e-8)
+	- generalized_eigenvalue_problem: use the overlap matrix (default True
+	  if any rank of the wavefunction is non-orthogonal)
+	- preconditioner: name of a preconditioner section (optional), with
+	  the interface of the GMRES preconditioners (e.g. type =
+	  RadialBlockPreconditioner). It is set up for H - preconditioner_shift * S
+	- preconditioner_shift: should be somewhat below the lowest
+	  eigenvalue (default 0)
+
+	The wavefunction of the problem is used as the first vector of the
+	initial block, the rest are random.
+
+	Example:
+	solver = LobpcgSolver(prop)
+	solver.Solve()
+	E = solver.GetEigenvalues()
+	solver.SetEigenvector(prop.psi, 0)
+	"""
+
+	def __init__(self, prop, preconditioner=None, sectionName="Lobpcg"):
+		self.BaseProblem = prop
+		self.Rank = prop.psi.GetRank()
+		self.Logger = GetClassLogger(self)
+
+		#Create a copy of the wavefunction to calculate H|psi>
+		self.TempPsi = prop.psi.CopyDeep()
+
+		#Set up LOBPCG Solver
+		self.Solver = CreateInstanceRank("core.krylov_LobpcgWrapper", self.Rank)
+		configSection = prop.Config.GetSection(sectionName)
+		configSection.Apply(self.Solver)
+
+		#Do we have a generalized eigenvalue problem?
+		repr = prop.psi.GetRepresentation()
+		self.GeneralizedEigenvalueProblem = not all([repr.IsOrthogonalBasis(i) for i in range(self.Rank)])
+		if hasattr(configSection, "generalized_eigenvalue_problem"):
+			self.GeneralizedEigenvalueProblem = configSection.generalized_eigenvalue_problem
+
+		self.ApplyMatrix = prop.Propagator.MultiplyHamiltonian
+		if self.GeneralizedEigenvalueProblem:
+			self.ApplyMatrix = prop.Propagator.BasePropagator.MultiplyHamiltonianNoOverlap
+
+		#Set up the preconditioner for H - shift S
+		self.Preconditioner = preconditioner
+		if self.Preconditioner == None and getattr(configSection, "preconditioner", None):
+			preconditionerSection = prop.Config.GetSection(configSection.preconditioner)
+			self.Preconditioner = preconditionerSection.type(self.TempPsi)
+			preconditionerSection.Apply(self.Preconditioner)
+			shift = getattr(configSection, "preconditioner_shift", 0.0)
+			self.Preconditioner.SetHamiltonianScaling(1.0)
+			self.Preconditioner.SetOverlapScaling(-shift)
+			self.Preconditioner.Setup(prop.Propagator)
+
+		useOverlap = self.GeneralizedEigenvalueProblem
+		usePreconditioner = self.Preconditioner != None
+		self.Solver.Setup(prop.psi, useOverlap, usePreconditioner)
+
+		matrixSize = prop.psi.GetData().size
+		memoryUsage = self.Solver.EstimateMemoryUsage(matrixSize, self.Solver.GetBlockSize(), useOverlap)
+		PrintOut("Approximate LOBPCG memory usage = %.2fMB" % memoryUsage)
+
+
+	def Solve(self):
+		psi = self.BaseProblem.psi
+		tempPsi = self.TempPsi
+
+		overlapCallback = None
+		if self.GeneralizedEigenvalueProblem:
+			overlapCallback = self.__OverlapCallback
+		preconditionerCallback = None
+		if self.Preconditioner != None:
+			preconditionerCallback = self.__PreconditionCallback
+
+		self.Solver.Solve(self.__MatVecCallback, overlapCallback, preconditionerCallback, psi, tempPsi)
+
+		converged = self.Solver.GetConvergedEigenvalueCount()
+		self.Logger.info("LOBPCG: %i of %i eigenvalues converged in %i iterations (%i matrix-vector products)" % \
+			(converged, len(self.GetEigenvalues()), self.Solver.GetIterationCount(), self.Solver.GetOperatorCount()))
+
+
+	def __MatVecCallback(self, psi, tempPsi):
+		self.ApplyMatrix(psi, tempPsi, 0, 0)
+
+
+	def __OverlapCallback(self, srcPsi, dstPsi):
+		dstPsi.GetData()[:] = srcPsi.GetData()
+		dstPsi.GetRepresentation().MultiplyOverlap(dstPsi)
+
+
+	def __PreconditionCallback(self, srcPsi, dstPsi):
+		dstPsi.GetData()[:] = srcPsi.GetData()
+		self.Preconditioner.Solve(dstPsi)
+
+
+	def GetEigenvalues(self):
+		"""
+		Returns the krylov_eigenvalue_count lowest eigenvalues, in ascending
+		order. See GetConvergedEigenvalueCount() for how many are converged
+		"""
+		return self.Solver.GetEigenvalues().copy()
+
+
+	def GetConvergedEigenvalueCount(self):
+		return self.Solver.GetConvergedEigenvalueCount()
+
+
+	def GetResidualNorms(self):
+		return self.Solver.GetResidualNorms().copy()
+
+
+	def GetEigenvector(self, index):
+		"""
+		Returns (the local part of) an eigenvector as a 1d numpy array,
+		normalized with the overlap matrix
+		"""
+		return self.Solver.GetEigenvector(index)
+
+
+	def SetEigenvector(self, psi, eigenvectorIndex, normalize=True):
+		"""
+		Sets psi to the eigenvector specified by eigenvetorIndex
+		if normalize == True, psi will be normalized
+		"""
+		shape = psi.GetData().shape
+		psi.GetData()[:] = numpy.reshape(self.GetEigenvector(eigenvectorIndex), shape)
+		if normalize:
+			psi.Normalize()
+
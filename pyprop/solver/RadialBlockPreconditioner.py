@@ -0,0 +1,110 @@
+#--------------------------------------------------------------------------------------
+#                    Radial block preconditioner
+#--------------------------------------------------------------------------------------
+
+class RadialBlockPreconditioner(object):
+	"""
+	Preconditioner for GMRES (GMRESShiftInvertSolver, CayleyPropagator)
+	for systems of the type
+
+	(1)     (a H + b S) x = y  ->  x
+
+	where H is the Hamiltonian, S is the overlap matrix and a and b are
+	complex scaling factors (scalingH and scalingS).
+
+	H is approximated by the tensor potentials listed in potential_evaluation,
+	which must be diagonal in the first (angular) rank. The system (1) is
+	then block diagonal, with one block in the remaining (radial) ranks for
+	every angular index, which is factorized by core.RadialBlockPreconditioner
+	without Epetra. Angular indices with identical blocks share a
+	factorization.
+
+	Config section:
+	type = RadialBlockPreconditioner
+	potential_evaluation = ["RadialKineticEnergy1", ...]
+	method = "banded" (default), banded LU of every block, which solves (1)
+	         exactly for the given potentials.
+	         "tensor", fast diagonalization of the nearest Kronecker sum
+	         approximation of every block, for two radial ranks. Uses far
+	         less memory and setup time, but only keeps the separable part
+	         of the electron-electron coupling.
+	"""
+
+	def __init__(self, psi):
+		self.Rank = psi.GetRank()
+		self.psi = psi
+		self.Method = "banded"
+
+	def ApplyConfigSection(self, conf):
+		self.OverlapSection = conf.Config.GetSection("OverlapPotential")
+		self.PotentialSections = [conf.Config.GetSection(s) for s in conf.potential_evaluation]
+		if hasattr(conf, "method"):
+			self.Method = conf.method
+
+	def SetHamiltonianScaling(self, scalingH):
+		self.HamiltonianScaling = scalingH
+
+	def SetOverlapScaling(self, scalingS):
+		self.OverlapScaling = scalingS
+
+	def GetHamiltonianScaling(self):
+		return self.HamiltonianScaling
+
+	def GetOverlapScaling(self):
+		return self.OverlapScaling
+
+	def Setup(self, prop):
+		"""
+		Adds scalingS * S + scalingH * (P1 + P2 + ...) to the preconditioner
+		and factorizes the radial blocks
+		"""
+		solver = CreateInstanceRank("core.RadialBlockPreconditioner", self.Rank)
+		solver.SetMethod(self.Method)
+
+		sections = [(self.OverlapSection, self.GetOverlapScaling())]
+		sections += [(conf, self.GetHamiltonianScaling()) for conf in self.PotentialSections]
+		potentials = []
+		for conf, scaling in sections:
+			potential = prop.BasePropagator.GeneratePotential(conf)
+			self.AddPotential(solver, potential, scaling)
+			potentials.append(potential)
+
+		if self.Method == "tensor":
+			for rank in range(1, self.Rank):
+				solver.SetOverlapMatrix(rank, self.GetOverlapMatrix(rank))
+
+		PrintMemoryUsage("Before Radial Block Preconditioner Setup")
+		solver.Setup(self.psi)
+		del potentials
+		PrintMemoryUsage("After Radial Block Preconditioner Setup")
+		PrintOut("Radial block preconditioner (%s): %i factorizations for %i blocks, %.1f MB" % \
+			(self.Method, solver.GetFactorizationCount(), solver.GetBlockCount(), solver.GetMemoryUsage()))
+
+		self.Solver = solver
+
+	def AddPotential(self, solver, potential, scaling):
+		if isinstance(potential, FactoredTensorPotential):
+			raise Exception("Potential %s: factored potentials can not be used in the radial block preconditioner" % potential.Name)
+
+		#The blocks are indexed by the local angular index
+		angularPairs = potential.GeometryList[0].GetBasisPairs()
+		localAngularCount = self.psi.GetData().shape[0]
+		if angularPairs.shape[0] != localAngularCount or any(angularPairs[:,0] != angularPairs[:,1]):
+			raise Exception("Potential %s must be diagonal in the angular rank" % potential.Name)
+
+		fullShape = self.psi.GetRepresentation().GetFullShape()
+		for rank in range(1, self.Rank):
+			entries = GetBlockSparseRankEntries(potential.GeometryList[rank], int(fullShape[rank]))
+			solver.SetRankEntries(rank, entries)
+		solver.AddTensorPotential(potential.PotentialData, scaling)
+
+	def GetOverlapMatrix(self, rank):
+		repr = self.psi.GetRepresentation()
+		if repr.IsOrthogonalBasis(rank):
+			return eye(repr.GetFullShape()[rank], dtype=complex)
+		overlap = repr.GetGlobalOverlapMatrix(rank)
+		return core.ConvertMatrixBlasBandedToFull(overlap.GetOverlapBlasBanded())
+
+	def Solve(self, psi):
+		self.Solver.Solve(psi)
+
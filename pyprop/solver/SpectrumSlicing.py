@@ -0,0 +1,300 @@
+#--------------------------------------------------------------------------------------
+#                    Parallel spectrum slicing
+#--------------------------------------------------------------------------------------
+
+class SpectrumSlicing(object):
+	"""
+	Finds the eigenstates in a list of energy windows with shift-invert
+	Arnoldi (GMRESShiftInvertSolver + PiramSolver or AnasaziSolver), solving
+	the windows concurrently on independent groups of procs.
+
+	The procs are split into groups with core.BaseCommunicator before the
+	Problem is created, so that the wavefunction, transposes and krylov
+	solvers of a group only communicate within that group. Window i is
+	solved by group i % groupCount with its shift in the middle of the
+	window. With fewer groups than windows, a group solves its windows one
+	after another on the same Problem.
+
+	Config section (default [SpectrumSlicing]):
+	- energy_windows: list of (min, max) energy windows, or energy_range =
+	  (min, max) together with slice_count to use equally sized windows
+	- shifts: list of shifts, one per window (default window centers)
+	- group_count: number of proc groups (default min(windows, procs))
+	- eigenvalue_solver: "piram" (default) or "anasazi". The solvers and
+	  GMRES are configured by the Arpack/Anasazi and GMRES sections as usual
+	- duplicate_tolerance: states from different windows closer in energy
+	  than this are compared for duplicates (default 1e-6)
+	- duplicate_overlap: such states are the same state if |<a|b>| is
+	  larger than this (default 0.5)
+	- output_file: HDF5 file where the merged eigenbasis is written
+
+	A window only keeps the converged states with energies inside the
+	window, so a state found by two windows is normally kept once. States
+	found on both sides of a window boundary with slightly different
+	energies are removed by the overlap with the states already written by
+	the other window.
+
+	The merged eigenbasis is written with the layout used by the eigenvalue
+	scripts (see examples/tensor/helium_stabilization/eigenvalues.py):
+	  /Eig/Eigenvalues         all energies, sorted
+	  /Eig/Eigenvector_<i>     eigenstate of Eigenvalues[i]
+	  /Eig/WindowIndex         the window each state was found in
+	  /Eig/EnergyWindows, /Eig/Shifts
+
+	Example:
+	slicing = SpectrumSlicing(conf)
+	eigenvalues = slicing.Run()
+
+	setupProblem(conf) may be given to create the Problem, the default is
+	Problem(conf) followed by SetupStep(). The communicator is left split
+	after Run(), so the Problem of this group (slicing.Problem) can still
+	be used.
+	"""
+
+	def __init__(self, conf, setupProblem=None, sectionName="SpectrumSlicing"):
+		self.Config = conf
+		self.Section = conf.GetSection(sectionName)
+		self.Logger = GetClassLogger(self)
+		self.SetupProblemFunction = setupProblem
+		self.Problem = None
+		self.Eigenvalues = None
+
+		section = self.Section
+		if hasattr(section, "energy_windows"):
+			windows = [tuple(w) for w in section.energy_windows]
+		else:
+			emin, emax = section.energy_range
+			edges = linspace(emin, emax, section.slice_count + 1)
+			windows = zip(edges[:-1], edges[1:])
+		for emin, emax in windows:
+			if not emin < emax:
+				raise Exception("Invalid energy window (%s, %s)" % (emin, emax))
+
+		if hasattr(section, "shifts"):
+			shifts = list(section.shifts)
+			if len(shifts) != len(windows):
+				raise Exception("Got %i shifts for %i energy windows" % (len(shifts), len(windows)))
+		else:
+			shifts = [0.5 * (emin + emax) for emin, emax in windows]
+
+		#Windows are solved and written in order of increasing energy
+		order = argsort([emin for emin, emax in windows])
+		self.Windows = [windows[i] for i in order]
+		self.Shifts = [shifts[i] for i in order]
+
+		self.GroupCount = min(getattr(section, "group_count", len(self.Windows)), len(self.Windows), ProcCount)
+		self.SolverName = getattr(section, "eigenvalue_solver", "piram").lower()
+		if not self.SolverName in ["piram", "anasazi"]:
+			raise Exception("Unknown eigenvalue_solver '%s'" % self.SolverName)
+		self.DuplicateTolerance = getattr(section, "duplicate_tolerance", 1e-6)
+		self.DuplicateOverlap = getattr(section, "duplicate_overlap", 0.5)
+		self.OutputFile = section.output_file
+
+		#color = ProcId * groupCount / ProcCount gives contiguous groups of equal size
+		self.Group = ProcId * self.GroupCount / ProcCount
+
+
+	def Run(self):
+		"""
+		Solves all windows, writes the merged eigenbasis to output_file and
+		returns the sorted eigenvalues on all procs
+		"""
+		self.SplitProcs()
+		self.Problem = self.SetupProblem()
+
+		results = {}
+		for window in self.GetGroupWindows():
+			results[window] = self.SolveWindow(window)
+
+		self.SaveEigenbasis(results)
+		return self.Eigenvalues
+
+
+	def SplitProcs(self):
+		if ProcCount > 1:
+			core.BaseCommunicator.Split(self.Group)
+		self.Logger.info("Solving energy windows %s in group %i of %i" % \
+			([self.Windows[i] for i in self.GetGroupWindows()], self.Group, self.GroupCount))
+
+
+	def WorldBarrier(self):
+		if ProcCount > 1:
+			core.BaseCommunicator.WorldBarrier()
+
+
+	def SetupProblem(self):
+		if self.SetupProblemFunction != None:
+			return self.SetupProblemFunction(self.Config)
+		prop = Problem(self.Config)
+		prop.SetupStep()
+		return prop
+
+
+	def GetGroupWindows(self):
+		return range(self.Group, len(self.Windows), self.GroupCount)
+
+
+	def SolveWindow(self, window):
+		"""
+		Runs shift-invert Arnoldi at the shift of window, and returns
+		the sorted energies and copies of the converged eigenstates
+		inside the window
+		"""
+		prop = self.Problem
+		conf = prop.Config
+		shift = self.Shifts[window]
+		emin, emax = self.Windows[window]
+		isLastWindow = window == len(self.Windows) - 1
+
+		#The preconditioner of GMRES depends on the shift and is rebuilt for each window
+		conf.GMRES.shift = shift
+		shiftInvertSolver = GMRESShiftInvertSolver(prop)
+		if self.SolverName == "piram":
+			section = conf.Arpack
+		else:
+			section = conf.Anasazi
+		section.inverse_iterations = True
+		section.matrix_vector_func = shiftInvertSolver.InverseIterations
+
+		if self.SolverName == "piram":
+			solver = PiramSolver(prop)
+			solver.Solve()
+			converged = where(solver.Solver.GetConvergenceEstimates() < 0)[0]
+		else:
+			solver = AnasaziSolver(prop)
+			solver.Solve()
+			converged = r_[:len(solver.GetEigenvalues())]
+
+		#convert from shift inverted eigenvalues to "actual" eigenvalues
+		shiftInverted = solver.Solver.GetEigenvalues()
+		energies = []
+		for index in converged:
+			E = real(1.0 / shiftInverted[index] + shift)
+			if emin <= E < emax or (isLastWindow and E == emax):
+				energies.append((E, index))
+		energies.sort()
+		self.Logger.info("Window (%s, %s), shift %s: %i of %i converged states inside the window" % \
+			(emin, emax, shift, len(energies), len(converged)))
+
+		states = []
+		for E, index in energies:
+			solver.SetEigenvector(prop.psi, index)
+			states.append(prop.psi.Copy())
+
+		return [E for E, index in energies], states
+
+
+	def SaveEigenbasis(self, results):
+		"""
+		Writes the states of all windows to output_file. The groups write
+		their windows in turn, in the order of the windows, so that the
+		states of a window can be compared to the states already written
+		"""
+		filename = self.OutputFile
+		if ProcId == 0 and os.path.exists(filename):
+			os.remove(filename)
+		self.WorldBarrier()
+
+		for window in range(len(self.Windows)):
+			if window in results:
+				energies, states = results[window]
+				self.SaveWindow(window, energies, states)
+			self.WorldBarrier()
+
+		if ProcId == 0:
+			self.SaveMergedEigenvalues()
+		self.WorldBarrier()
+
+		with serialization.HDFLock:
+			f = tables.openFile(filename, "r")
+			try:
+				self.Eigenvalues = f.root.Eig.Eigenvalues[:]
+			finally:
+				f.close()
+		PrintOut("Spectrum slicing found %i states in %i windows" % (len(self.Eigenvalues), len(self.Windows)))
+
+
+	def GetWrittenEigenvalues(self, filename):
+		"""
+		Returns the eigenvalues written by the previous windows, where the
+		state of eigenvalue i is stored in /Eig/Eigenvector_i
+		"""
+		if not os.path.exists(filename):
+			return array([], dtype=double)
+		with serialization.HDFLock:
+			f = tables.openFile(filename, "r")
+			try:
+				eigenvalues = []
+				for window in range(len(self.Windows)):
+					node = serialization.GetExistingDataset(f, "/Eig/Window_%i/Eigenvalues" % window)
+					if node != None:
+						eigenvalues += list(node[:])
+			finally:
+				f.close()
+		return array(eigenvalues, dtype=double)
+
+
+	def SaveWindow(self, window, energies, states):
+		prop = self.Problem
+		filename = self.OutputFile
+		distr = prop.psi.GetRepresentation().GetDistributedModel()
+
+		written = self.GetWrittenEigenvalues(filename)
+		distr.GlobalBarrier()
+
+		tempPsi = prop.psi.Copy()
+		keptEnergies = []
+		for E, state in zip(energies, states):
+			duplicate = False
+			for index in where(abs(written - E) < self.DuplicateTolerance)[0]:
+				serialization.LoadWavefunctionHDF(filename, self.GetEigenvectorDatasetPath(index), tempPsi)
+				overlap = abs(tempPsi.InnerProduct(state))
+				if overlap > self.DuplicateOverlap:
+					self.Logger.info("State at E = %s is a duplicate of state %i (overlap %s)" % (E, index, overlap))
+					duplicate = True
+					break
+			if duplicate:
+				continue
+
+			index = len(written) + len(keptEnergies)
+			serialization.SaveWavefunctionHDF(filename, self.GetEigenvectorDatasetPath(index), state)
+			keptEnergies.append(E)
+
+		#The eigenvalues of the window are written last, as they mark the window as done
+		if distr.ProcId == 0:
+			with serialization.HDFLock:
+				f = tables.openFile(filename, "a")
+				try:
+					group = f.createGroup("/Eig", "Window_%i" % window, createparents=True)
+					f.createArray(group, "Eigenvalues", array(keptEnergies, dtype=double))
+					group._v_attrs.shift = self.Shifts[window]
+					group._v_attrs.energyWindow = self.Windows[window]
+				finally:
+					f.close()
+		distr.GlobalBarrier()
+
+
+	def SaveMergedEigenvalues(self):
+		filename = self.OutputFile
+		with serialization.HDFLock:
+			f = tables.openFile(filename, "a")
+			try:
+				eigenvalues = []
+				windowIndex = []
+				for window in range(len(self.Windows)):
+					energies = f.getNode("/Eig/Window_%i/Eigenvalues" % window)[:]
+					eigenvalues += list(energies)
+					windowIndex += [window] * len(energies)
+
+				group = f.getNode("/Eig")
+				f.createArray(group, "Eigenvalues", array(eigenvalues, dtype=double))
+				f.createArray(group, "WindowIndex", array(windowIndex, dtype=int))
+				f.createArray(group, "EnergyWindows", array(self.Windows, dtype=double))
+				f.createArray(group, "Shifts", array(self.Shifts, dtype=double))
+				group._v_attrs.configObject = self.Config.cfgObj
+			finally:
+				f.close()
+
+
+	def GetEigenvectorDatasetPath(self, eigenvectorIndex):
+		return "/Eig/Eigenvector_%i" % eigenvectorIndex
@@ -2,6 +2,9 @@ import sys
 
 execfile(__path__[0] + "/solver/ArpackSolver.py")
 execfile(__path__[0] + "/solver/PiramSolver.py")
+execfile(__path__[0] + "/solver/LobpcgSolver.py")
 execfile(__path__[0] + "/solver/GMRESShiftInvertSolver.py")
+execfile(__path__[0] + "/solver/RadialBlockPreconditioner.py")
 execfile(__path__[0] + "/solver/AnasaziSolver.py")
+execfile(__path__[0] + "/solver/SpectrumSlicing.py")
 
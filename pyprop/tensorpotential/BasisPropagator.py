@@ -29,9 +29,12 @@ class BasisPropagator(PropagatorBase):
 		self.ConsolidatePotentials()
 
 	def GeneratePotential(self, configSection):
-		#Create TensorPotential
+		#Create TensorPotential, or FactoredTensorPotential for tensor product potentials
 		PrintMemoryUsage("Before Generate Potential %s" % configSection.name)
-		potential = TensorPotential(self.psi)
+		if IsFactoredPotential(configSection):
+			potential = FactoredTensorPotential(self.psi)
+		else:
+			potential = TensorPotential(self.psi)
 		configSection.Apply(potential)
 		#SerialPrint("PotentialShape = %s" % (potential.PotentialData.shape, ))
 		PrintMemoryUsage("After Potential %s" % configSection.name)
@@ -56,7 +59,7 @@ class BasisPropagator(PropagatorBase):
 				#check if this potential can be consolidated with an existing one
 				for existingPot in self.PotentialList:
 					if existingPot.CanConsolidate(pot):
-						existingPot.PotentialData[:] += pot.PotentialData
+						existingPot.Consolidate(pot)
 						existingPot.Name += "+" + pot.Name
 						pot = None
 						break
@@ -90,7 +93,7 @@ class BasisPropagator(PropagatorBase):
 			for otherPot in list(potentials[i+1:]):
 				#Add otherPot to curPot if they can be consolidate
 				if curPot.CanConsolidate(otherPot):
-					curPot.PotentialData[:] += otherPot.PotentialData
+					curPot.Consolidate(otherPot)
 					curPot.Name += "+" + otherPot.Name
 					potentials.remove(otherPot)
 					removePotentials.append(otherPot)
@@ -158,6 +161,32 @@ class BasisPropagator(PropagatorBase):
 		SolveOverlap2()
 		RestorePsi()
 
+	def SetupHamiltonianOperator(self, overlapMode):
+		"""
+		Assembles the potentials into a core.HamiltonianOperator, which can be
+		used by the C++ explicit propagators (pAMP, Runge-Kutta, ODE) instead
+		of calling MultiplyHamiltonian through python for every matrix-vector
+		product. overlapMode is one of the HamiltonianOperator overlap modes
+		(0 = none, 1 = full, 2 = balanced)
+
+		Returns None if any of the potentials can not be applied from C++
+		"""
+		hamiltonian = CreateInstanceRank("core.HamiltonianOperator", self.Rank)
+		for pot in self.PotentialList:
+			if not hasattr(pot, "CreateHamiltonianTerm"):
+				PrintOut("Potential %s can not be applied from C++, using python matrix-vector products" % pot.Name)
+				return None
+
+			term = pot.CreateHamiltonianTerm()
+			if pot.IsTimeDependent:
+				hamiltonian.AddTimeDependentTerm(term, pot.TimeFunction)
+			else:
+				hamiltonian.AddTerm(term, 1.0)
+
+		hamiltonian.SetOverlapMode(overlapMode)
+		hamiltonian.Setup(self.psi)
+		return hamiltonian
+
 	def AdvanceStep(self, t, dt):
 		raise NotImplementedException("BasisPropagator does not support AdvanceStep. Use it as a base for explicit propagators")
 
@@ -37,6 +37,8 @@ class BasisPropagatorEpetra(BasisPropagator):
 			for potentialName in potentials:
 				#Find the corresponding config section
 				configSection = config.GetSection(potentialName)
+				if IsFactoredPotential(configSection):
+					raise Exception("Factored potential %s can not be converted to an Epetra potential" % potentialName)
 
 				#generate potential 
 				tensorPot = self.GeneratePotential(configSection)
@@ -68,6 +70,10 @@ class BasisPropagatorEpetra(BasisPropagator):
 				pot.GlobalAssemble()
 
 	
+	def SetupHamiltonianOperator(self, overlapMode):
+		#Epetra potentials are applied through PyTrilinos
+		return None
+
 	def MultiplyHamiltonianBalancedOverlap(self, srcPsi, destPsi, t, dt):
 		raise NotImplementedException("BasisPropagatorEpetra does not support MultiplyHamiltonianBalancedOverlap!")
 
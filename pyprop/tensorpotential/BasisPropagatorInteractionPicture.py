@@ -13,6 +13,12 @@ class BasisPropagatorInteractionPicture(BasisPropagator):
 	the interaction picture operator becomes
 
 	    F_I = exp(-1j * H0 * t) * H_S * exp(1j * H0 * t)
+
+	The phase factors are kept by a core.InteractionPicturePhase, which
+	advances them incrementally between nearby times instead of calling
+	exp on every matrix-vector product. The energies dataset may have any
+	shape which broadcasts to psi as in numpy, and the phases are stored
+	in that shape.
 	"""
 
 	__Base = BasisPropagator
@@ -35,31 +41,56 @@ class BasisPropagatorInteractionPicture(BasisPropagator):
 	
 	def LoadEnergies(self):
 		#Load energies
-		h5file = tables.openFile(self.FilenameEnergies)
-		self.Energies = array(h5file.getNode(self.DatasetEnergies))
-		h5file.close()
+		with serialization.HDFLock:
+			h5file = tables.openFile(self.FilenameEnergies)
+			self.Energies = array(h5file.getNode(self.DatasetEnergies))
+			h5file.close()
+
+		#The phase kernel broadcasts the energies to the shape of psi as
+		#numpy does, so they are only padded with leading ranks of extent 1
+		if iscomplexobj(self.Energies) and any(self.Energies.imag != 0):
+			raise Exception("Interaction picture energies must be real")
+		if self.Energies.ndim > self.Rank:
+			raise Exception("Interaction picture energies of rank %i can not be broadcast to rank %i" % (self.Energies.ndim, self.Rank))
+		energies = ascontiguousarray(self.Energies.real, dtype=double)
+		energies = energies.reshape((1,) * (self.Rank - energies.ndim) + energies.shape)
+		self.Phase = CreateInstanceRank("core.InteractionPicturePhase", self.Rank)
+		self.Phase.SetEnergies(energies)
+		if self.MaxIncrementalPhaseSteps != None:
+			self.Phase.SetMaxIncrementalSteps(self.MaxIncrementalPhaseSteps)
 
 	def ApplyConfigSection(self, configSection): 
 		self.__Base.ApplyConfigSection(self, configSection)
 		self.FilenameEnergies = configSection.filename
 		self.DatasetEnergies = configSection.dataset
+		self.MaxIncrementalPhaseSteps = getattr(configSection, "max_incremental_phase_steps", None)
 
 	def MultiplyHamiltonian(self, srcPsi, destPsi, t, dt):
-		#First multiply by exp of left eigenvalues and time
-		self.TempPsi2.GetData()[:] = exp(-1j * self.Energies * t) * srcPsi.GetData()
+		#First multiply by exp of left eigenvalues and time, and clear
+		#destPsi in the same pass
+		self.Phase.MultiplyPhaseAndClear(srcPsi.GetData(), self.TempPsi2.GetData(), destPsi.GetData(), t)
 
 		#Multiply potentials
-		destPsi.GetData()[:] = 0
 		self.MultiplyPotential(self.TempPsi2, destPsi, t, dt)
 
 		#Then right eigenvalues
-		destPsi.GetData()[:] *= exp(1j * self.Energies * t)
+		self.Phase.MultiplyConjugatePhase(destPsi.GetData(), t)
 
 		#Solve for all overlap matrices
 		repr = srcPsi.GetRepresentation()
 		if not all([repr.IsOrthogonalBasis(i) for i in range(self.Rank)]):
 			repr.SolveOverlap(destPsi)
 
+	def SetupHamiltonianOperator(self, overlapMode):
+		#MultiplyHamiltonianBalancedOverlap solves the full overlap
+		if overlapMode == 2:
+			overlapMode = 1
+		hamiltonian = self.__Base.SetupHamiltonianOperator(self, overlapMode)
+		if hamiltonian != None:
+			hamiltonian.SetInteractionPicturePhase(self.Phase)
+			hamiltonian.Setup(self.psi)
+		return hamiltonian
+
 	def MultiplyHamiltonianNoOverlap(self, srcPsi, destPsi, t, dt):
 		self.MultiplyHamiltonian(srcPsi, destPsi, t, dt)
 
@@ -0,0 +1,285 @@
+#------------------------------------------------------------------------------------
+#                       Kronecker-factored tensor potentials
+#------------------------------------------------------------------------------------
+
+#restore some builtin functions in this namespace 
+from __builtin__ import min, max
+
+def IsFactoredPotential(configSection):
+	"""
+	A potential is set up as a FactoredTensorPotential if its
+	config section has 'factored = True'
+	"""
+	return getattr(configSection, "factored", False)
+
+
+def FactorToMatrix(factor, size):
+	"""
+	Returns a factor (factorType, data) as a dense size x size matrix
+	"""
+	factorType, data = factor
+	if factorType == "identity":
+		return eye(size, dtype=complex)
+	elif factorType == "diagonal":
+		return diag(data)
+	elif factorType == "banded":
+		bandCount = (data.shape[1] - 1) / 2
+		matrix = zeros((size, size), dtype=complex)
+		for row in range(size):
+			for col in range(max(0, row-bandCount), min(size, row+bandCount+1)):
+				matrix[row, col] = data[row, col-row+bandCount]
+		return matrix
+	elif factorType == "dense":
+		return data.copy()
+	else:
+		raise Exception("Unknown factor type %s" % factorType)
+
+
+def CompressFactorMatrix(matrix):
+	"""
+	Selects the most compact factor storage for a dense factor matrix,
+	and returns the factor as (factorType, data)
+	"""
+	size = matrix.shape[0]
+	rows, cols = nonzero(matrix)
+	bandCount = 0
+	if len(rows) > 0:
+		bandCount = int(numpy.max(numpy.abs(rows - cols)))
+
+	if bandCount == 0:
+		diagonal = diag(matrix).copy()
+		if numpy.all(diagonal == 1):
+			return ("identity", None)
+		return ("diagonal", diagonal)
+
+	elif 2*bandCount + 1 <= size / 2:
+		bands = zeros((size, 2*bandCount + 1), dtype=complex)
+		for row in range(size):
+			for col in range(max(0, row-bandCount), min(size, row+bandCount+1)):
+				bands[row, col-row+bandCount] = matrix[row, col]
+		return ("banded", bands)
+
+	else:
+		return ("dense", matrix.copy())
+
+
+def IsSameFactor(factor, otherFactor):
+	factorType, data = factor
+	otherType, otherData = otherFactor
+	if factorType != otherType:
+		return False
+	if factorType == "identity":
+		return True
+	return data.shape == otherData.shape and numpy.all(data == otherData)
+
+
+class FactoredTensorPotential(PotentialWrapper):
+	"""
+	Potential wrapper for tensor potentials which are Kronecker products
+	of one factor per rank,
+
+	V = F_0 x F_1 x ... x F_{Rank-1}
+
+	such as the kinetic energy T_r x I or the centrifugal term
+	1/r^2 x diag(l(l+1)). Instead of representing V over all basis pairs
+	of all ranks like TensorPotential, every factor is represented in
+	the basis of its own rank, and stored as an identity, diagonal,
+	banded or dense matrix. V is applied by core.FactoredPotential as a
+	chain of rank-local multiplies.
+
+	The config section of the potential must have 'factored = True',
+	and supports the following options for each rank i
+
+	geometry%i        - geometry of F_i, as for TensorPotential
+	factor%i          - function f(conf, x) giving F_i on the grid x of rank i,
+	                    or on the basis pairs x if the geometry does not use
+	                    the grid representation. If not given, f = 1, which
+	                    gives the identity for orthogonal basises and the
+	                    overlap matrix for B-splines
+	differentiation%i - as for TensorPotential
+
+	Banded and dense factors can not be used on distributed ranks.
+	"""
+
+	def __init__(self, psi):
+		self.psi = psi
+		self.Rank = psi.GetRank()
+		self.Name = None
+		self.Factors = None
+		self.Coefficient = 1.0
+		self.Potential = None
+
+	def ApplyConfigSection(self, configSection):
+		self.DebugPotential = getattr(configSection, "debug_potential", False)
+
+		#Check wheter this is a time dependent potential
+		self.IsTimeDependent = False
+		if hasattr(configSection, "time_function"):
+			self.IsTimeDependent = True
+			self.TimeFunction = lambda t: configSection.time_function(configSection, t)
+			self.OriginalTimeFunction = configSection.time_function
+
+		self.Name = configSection.name
+
+		repr = self.psi.GetRepresentation()
+		self.Factors = []
+		for rank in range(self.Rank):
+			basis = CreateBasisFromRepresentation(repr.GetRepresentation(rank))
+			geometryInfo = basis.GetGeometryInfo(configSection.Get("geometry%i" % rank))
+			self.Factors.append(self.GenerateFactor(configSection, rank, basis, geometryInfo))
+
+		factorSize = sum([self.GetFactorSize(rank) for rank in range(self.Rank)]) * 16 / 1024.**2
+		PrintOut("Setting up Factored Tensor Potential (%s) of size %.2fMB, factors %s" % (self.Name, factorSize, [f[0] for f in self.Factors]))
+
+	def GenerateFactor(self, configSection, rank, basis, geometryInfo):
+		"""
+		Represents the factor of rank in the basis, and returns it
+		as (factorType, data)
+		"""
+		storageId = geometryInfo.GetStorageId()
+		factorFunction = getattr(configSection, "factor%i" % rank, None)
+
+		if storageId == "Ident":
+			if factorFunction != None:
+				raise Exception("Potential %s: factor%i can not be given for identity geometry" % (self.Name, rank))
+			return ("identity", None)
+
+		pairs = geometryInfo.GetGlobalBasisPairs()
+		if geometryInfo.UseGridRepresentation():
+			#Evaluate the factor on the grid of this rank, and represent it
+			#in the basis, keeping the rank index such that the basis sees
+			#the same rank as with TensorPotentialGenerator
+			distr = self.psi.GetRepresentation().GetDistributedModel()
+			gridRepr = basis.GetGridRepresentation()
+			gridRepr.SetDistributedModel(distr.CreateSubDistributedModel())
+			gridRepr.SetBaseRank(rank)
+			grid = gridRepr.GetGlobalGrid(rank)
+
+			sourceShape = [1]*self.Rank
+			sourceShape[rank] = len(grid)
+			source = ones(sourceShape, dtype=complex)
+			if factorFunction != None:
+				source.flat[:] = factorFunction(configSection, grid)
+
+			destShape = [1]*self.Rank
+			destShape[rank] = len(pairs)
+			dest = zeros(destShape, dtype=complex)
+
+			differentiation = getattr(configSection, "differentiation%i" % rank, 0)
+			basis.RepresentPotentialInBasis(source, dest, rank, geometryInfo, differentiation, configSection)
+			values = dest.flatten()
+
+		else:
+			values = ones(len(pairs), dtype=complex)
+			if factorFunction != None:
+				values[:] = factorFunction(configSection, pairs)
+
+		#Expand the basis pairs to a matrix, and select the storage from
+		#its structure
+		size = int(self.psi.GetRepresentation().GetFullShape()[rank])
+		matrix = zeros((size, size), dtype=complex)
+		if storageId in HermitianStorageIds:
+			matrix[pairs[:,1], pairs[:,0]] = conj(values)
+		matrix[pairs[:,0], pairs[:,1]] = values
+
+		return CompressFactorMatrix(matrix)
+
+	def GetFactorSize(self, rank):
+		factorType, data = self.Factors[rank]
+		if factorType == "identity":
+			return 0
+		return data.size
+
+	def SetupPotential(self):
+		"""
+		Creates the core.FactoredPotential applying the current factors
+		"""
+		potential = CreateInstanceRank("core.FactoredPotential", self.Rank)
+		for rank, (factorType, data) in enumerate(self.Factors):
+			if factorType == "identity":
+				potential.SetIdentityFactor(rank)
+			elif factorType == "diagonal":
+				potential.SetDiagonalFactor(rank, data)
+			elif factorType == "banded":
+				potential.SetBandedFactor(rank, data)
+			elif factorType == "dense":
+				potential.SetDenseFactor(rank, data)
+		potential.SetCoefficient(complex(self.Coefficient))
+		potential.Setup(self.psi)
+		self.Potential = potential
+
+	def SetupStep(self, timestep):
+		self.SetupPotential()
+
+	def AdvanceStep(self, t, timestep):
+		raise NotImplementedException("FactoredTensorPotentials can not be exponentiated directly")
+
+	def CreateHamiltonianTerm(self):
+		"""
+		Returns the core.FactoredPotential, which is a core.HamiltonianTerm
+		"""
+		if self.Potential == None:
+			self.SetupPotential()
+		return self.Potential
+
+	def MultiplyPotential(self, srcPsi, destPsi, t, timestep):
+		if self.Potential == None:
+			self.SetupPotential()
+
+		timeScaling = 1.0
+		if self.IsTimeDependent:
+			timeScaling = self.TimeFunction(t)
+
+		self.Potential.MultiplyPotential(srcPsi.GetData(), destPsi.GetData(), timeScaling)
+
+	def GetExpectationValue(self, psi, tmpPsi, t, timeStep):
+		tmpPsi.Clear()
+		self.MultiplyPotential(psi, tmpPsi, t, timeStep)
+
+		#Solve for all overlap matrices
+		repr = self.psi.GetRepresentation()
+		repr.SolveOverlap(tmpPsi)
+
+		return self.psi.InnerProduct(tmpPsi)
+
+	def GetDifferingRanks(self, otherPot):
+		return [rank for rank in range(self.Rank) if not IsSameFactor(self.Factors[rank], otherPot.Factors[rank])]
+
+	def CanConsolidate(self, otherPot):
+		"""
+		Two factored potentials with the same time dependency can be
+		consolidated if they differ in at most one factor, as
+		A x B + A x C = A x (B + C)
+		"""
+		if not isinstance(otherPot, FactoredTensorPotential):
+			return False
+
+		if self.IsTimeDependent != otherPot.IsTimeDependent:
+			return False
+		if self.IsTimeDependent and otherPot.OriginalTimeFunction != self.OriginalTimeFunction:
+			return False
+
+		#don't consolidate debug potentials
+		if self.DebugPotential or otherPot.DebugPotential:
+			return False
+
+		return len(self.GetDifferingRanks(otherPot)) <= 1
+
+	def Consolidate(self, otherPot):
+		"""
+		Adds otherPot to this potential. CanConsolidate(otherPot) must be True
+		"""
+		differingRanks = self.GetDifferingRanks(otherPot)
+		if len(differingRanks) == 0:
+			self.Coefficient += otherPot.Coefficient
+		else:
+			rank = differingRanks[0]
+			size = int(self.psi.GetRepresentation().GetFullShape()[rank])
+			matrix = self.Coefficient * FactorToMatrix(self.Factors[rank], size)
+			matrix += otherPot.Coefficient * FactorToMatrix(otherPot.Factors[rank], size)
+			self.Factors[rank] = CompressFactorMatrix(matrix)
+			self.Coefficient = 1.0
+
+		#The core potential is recreated with the new factors
+		self.Potential = None
+
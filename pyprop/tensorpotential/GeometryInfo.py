@@ -314,6 +314,9 @@ class GeometryInfoCommonBandedDistributed(GeometryInfoDistributedBase):
 		distr = self.Representation.GetDistributedModel()
 		rank = self.Representation.GetBaseRank()
 		globalBasisPairCount = self.RankCount * (2 * self.BandCount + 1)
+		#The Distr kernel assumes the equal count partition of the rank
+		if distr.HasPartitionWeights(rank, self.RankCount):
+			raise Exception("Distr storage does not support cost-weighted partitioning of rank %i" % rank)
 		localRange = distr.GetLocalIndexRange(int(globalBasisPairCount), rank)
 
 		#setup global pairs
@@ -341,7 +344,9 @@ class GeometryInfoCommonBandedDistributed(GeometryInfoDistributedBase):
 		if self.MultiplyArguments == None:
 			if self.TempArrays == None:
 				self.SetupTempArrays(psi)
-			self.MultiplyArguments = [self.RankCount, self.BandCount] + self.TempArrays
+			distr = self.Representation.GetDistributedModel()
+			communicator = int(distr.GetGroupCommRankHandle(self.BaseRank))
+			self.MultiplyArguments = [self.RankCount, self.BandCount] + self.TempArrays + [communicator]
 
 		return self.MultiplyArguments
 
@@ -349,11 +354,12 @@ class GeometryInfoCommonBandedDistributed(GeometryInfoDistributedBase):
 		dataShape = psi.GetData().shape
 		rank = self.BaseRank
 
-		recvTempShape = list(dataShape)
+		#The temp arrays hold a single slice of the ranks before rank
+		recvTempShape = [1]*rank + list(dataShape[rank:])
 		recvTempShape[rank] = 1
 		recvTemp = zeros(recvTempShape, dtype=complex)
 
-		sendTempShape = list(dataShape)
+		sendTempShape = [1]*rank + list(dataShape[rank:])
 		sendTempShape[rank] = 2
 		sendTemp = zeros(sendTempShape, dtype=complex)
 
@@ -47,22 +47,32 @@ The algorithm is then that each processor iterates over
 all the rows it has, calculates the product for that row
 and sends it to the correct processor.
 
-In order to ensure better load balancing, each processor should
-sort the indices by row then col, and then start with the first element
-that does not require sending.
+The results for remote rows are not sent one by one. Instead, a communication
+plan is set up once for each processor:
 
-the length of the largest localMatrix is the number of "steps" needed to complete 
-the matvec multiply.
+sendSlot       for each local matrix element, the slot in the send buffer it is
+               added to, or -1 if the row is local. Elements with the same row
+               share a slot
+sendProcList   the neighbour procs to send to, with the slots of neighbour i
+               being sendOffset[i] <= slot < sendOffset[i+1]
+recvProcList   the neighbour procs to recieve from, with the recieved rows of 
+               neighbour i in recvOffset[i] <= slot < recvOffset[i+1], to be
+               added to the local rows recvLocalRow[slot]
 
-each processor maintains a list for each step which proc to send data to,
-which procs (may be more than one) to recieve data from, and which matrix element to
-process.
+Both sides order the slots for a pair of procs by row, so a multiply needs only
+one message to and from each neighbour. The remote rows are computed and sent
+first, and the local rows are computed while the messages are in flight.
 
 
 indexPairs            global list of all index pairs
 distribIndexList      indices into indexPairs for each processor
 globalSize            size of the matrix (size*size is the number of elements in a dense matrix)
-rank                  which tensor rank of the wavefunction this matrix is working on (should be 0)
+rank                  which tensor rank of the wavefunction this matrix is working on
+
+With a multi-dimensional proc grid, the procs above are the procs in the group
+communicator of rank, i.e. the procs sharing the coordinates of the current proc
+in all other ranks of the proc grid. ProcId and ProcCount are then the coordinate
+and size of the proc grid along rank, not in MPI_COMM_WORLD.
 
 
 """
@@ -86,27 +96,21 @@ def GetDistributedShape(size, procCount, procId):
 	return distrShape;
 
 
-class MultiplyStepInfo(object):
+def GetGroupProcInfo(distrib, rank):
 	"""
-	LocalMatrixIndex	index into local matrix for this step is step-number or -1 to signal empty
-	GlobalRow			row to send this result to
-	GlobalCol		 	col to get source data from
-
-	SendProc			procId to send the result of this operation to
-	RecvProcList		procs to recieve from this
-	RecvLocalRowList	local indices into the dest vector where to store the result from the recvs
+	Returns (procCount, procId) of the current proc in the group
+	communicator of rank
 	"""
+	return distrib.GetGroupProcCount(int(rank)), distrib.GetGroupProcId(int(rank))
 
-	def __init__(self, localMatrixIndex, globalRow, globalCol, sendProc, recvProcList, recvLocalRowList):
-		self.LocalMatrixIndex = localMatrixIndex
-		self.GlobalRow = globalRow
-		self.GlobalCol = globalCol
-		self.SendProc = sendProc
-		self.RecvProcList = recvProcList
-		self.RecvLocalRowList = recvLocalRowList
+def GetGroupArguments(distrib, rank, globalSize):
+	"""
+	Returns the group arguments [globalStartIndex, communicator]
+	for SnippetGeneratorSimpleDistributed
+	"""
+	globalStartIndex = distrib.GetLocalStartIndex(int(globalSize), int(rank))
+	return [int(globalStartIndex), int(distrib.GetGroupCommRankHandle(int(rank)))]
 
-	def __repr__(self):
-		return "idx pair = [%i, %i], recvProcList = %s" % (self.GlobalRow, self.GlobalCol, self.RecvProcList)
 
 def SetupDistributedIndexList(globalSize, indexPairs, distrib, rank):
 	"""
@@ -122,8 +126,7 @@ def SetupDistributedIndexList(globalSize, indexPairs, distrib, rank):
 	A list of arrays is returned, each array contains indices
 	into indexPairs for that processor.
 	"""
-	procCount = distrib.ProcCount
-	procId = distrib.ProcId
+	procCount, procId = GetGroupProcInfo(distrib, rank)
 
 	distribIndexList = [[] for i in range(procCount)]
 
@@ -163,79 +166,91 @@ def SetupDistributedIndexList(globalSize, indexPairs, distrib, rank):
 	return distribIndexList
 		
 
-def SetupStepList(globalSize, indexPairs, distribIndexList, distrib, rank):
+class CommunicationPlan(object):
 	"""
-	Sets up a list of MultiplyStepInfo for the current processor
+	Communication plan of the current processor, see the module
+	documentation above
 	"""
-	procCount = distrib.ProcCount
-	procId = distrib.ProcId
 
-	#Stepcount is the largest number of matrix elements any processor has
-	stepCount = max([len(distribIndexList[i]) for i in range(procCount)])
+	def __init__(self, globalRow, globalCol, sendSlot, sendProcList, sendOffset, recvProcList, recvOffset, recvLocalRow):
+		self.GlobalRow = globalRow
+		self.GlobalCol = globalCol
+		self.SendSlot = sendSlot
+		self.SendProcList = sendProcList
+		self.SendOffset = sendOffset
+		self.RecvProcList = recvProcList
+		self.RecvOffset = recvOffset
+		self.RecvLocalRow = recvLocalRow
 
-	rowStart = array([distrib.GetLocalStartIndex(int(globalSize), rank, curProc) for curProc in range(procCount)], dtype=int)
-	rowEnd = array(list(rowStart[1:]) + [globalSize])
+	def GetSendSlotCount(self):
+		return int(self.SendOffset[-1])
+
+	def GetRecvSlotCount(self):
+		return int(self.RecvOffset[-1])
+
+	def GetArguments(self):
+		"""
+		Returns the plan as arrays suitable for passing to fortran
+		"""
+		return [asarray(arg, dtype=int32) for arg in [self.GlobalRow, self.GlobalCol, \
+			self.SendSlot, self.SendProcList, self.SendOffset, \
+			self.RecvProcList, self.RecvOffset, self.RecvLocalRow]]
+
+	def __repr__(self):
+		return "send to %s (%i rows), recv from %s (%i rows)" % (self.SendProcList, self.GetSendSlotCount(), self.RecvProcList, self.GetRecvSlotCount())
 
-	stepList = []
-	for step in range(stepCount):
-		matrixIndex = -1
-		GlobalRow = -1
-		GlobalCol = -1
-		sendProc = -1
-		recvProcList = []
-		recvLocalRowList = []
-
-		#find out which processors are sending to this
-		#processor at this step
-		for curProc in range(procCount):
-			if len(distribIndexList[curProc]) > step:
-				row, col = indexPairs[distribIndexList[curProc][step]]
-				if rowStart[procId] <= row < rowEnd[procId] and procId != curProc:
-					recvProcList.append(curProc)
-					localRow = row - rowStart[procId]
-					recvLocalRowList.append(localRow)
-
-		#find out wether we have a matrix element this step
-		if len(distribIndexList[procId]) > step:
-			matrixIndex = step
-
-			indexPairIndex = distribIndexList[procId][step]
-			GlobalRow = indexPairs[indexPairIndex, 0]
-			GlobalCol = indexPairs[indexPairIndex, 1]
-
-			#and where to send it
-			for curProc, (curStart, curEnd) in enumerate(zip(rowStart, rowEnd)):
-				if curStart <= GlobalRow < curEnd:
-					sendProc = curProc
-					break
-			if sendProc == -1:
-				raise Exception("what!?")
-
-		#add step
-		stepList.append(MultiplyStepInfo(matrixIndex, GlobalRow, GlobalCol, sendProc, recvProcList, recvLocalRowList))
-	
-	return stepList
 
-def StepListToArray(stepList):
+def GetRemoteRows(indexPairs, pairIndices, procId, rowStart, rowEnd):
 	"""
-	Convert a stepList to a set of arrays suitable for passing to fortran
+	Returns a dict {proc: sorted list of rows} of the rows outside 
+	procId which the index pairs pairIndices contribute to 
 	"""
-	#find max number of recieves in a single step
-	stepCount = len(stepList)
-	maxRecvCount = max([len(step.RecvProcList) for step in stepList])
-
-	localMatrixIndex = asarray([step.LocalMatrixIndex for step in stepList], dtype=int32)
-	globalRow = asarray([step.GlobalRow for step in stepList], dtype=int32)
-	globalCol = asarray([step.GlobalCol for step in stepList], dtype=int32)
-	globalSendProc = asarray([step.SendProc for step in stepList], dtype=int32)
-	recvCount = asarray([len(step.RecvProcList) for step in stepList], dtype=int32)
-	
-	recvProcList = asarray(-1 * ones((stepCount, maxRecvCount), dtype=int32), dtype=int32)
-	recvLocalRowList = asarray(-1 * ones((stepCount, maxRecvCount), dtype=int32), dtype=int32)
-	for i, step in enumerate(stepList):
-		curRecvCount = len(step.RecvProcList)
-		recvProcList[i,:curRecvCount] = step.RecvProcList
-		recvLocalRowList[i,:curRecvCount] = step.RecvLocalRowList
+	remoteRows = {}
+	for pairIndex in pairIndices:
+		row = indexPairs[pairIndex, 0]
+		if rowStart[procId] <= row < rowEnd[procId]:
+			continue
+		destProc = searchsorted(rowEnd, row, side="right")
+		remoteRows.setdefault(int(destProc), set()).add(int(row))
+	return dict([(proc, sorted(rows)) for proc, rows in remoteRows.iteritems()])
 
-	return localMatrixIndex, globalRow, globalCol, globalSendProc, recvProcList, recvLocalRowList, recvCount
 
+def SetupCommunicationPlan(globalSize, indexPairs, distribIndexList, distrib, rank):
+	"""
+	Sets up the CommunicationPlan for the current processor
+	"""
+	procCount, procId = GetGroupProcInfo(distrib, rank)
+
+	rowStart = array([distrib.GetLocalStartIndex(int(globalSize), int(rank), curProc) for curProc in range(procCount)], dtype=int)
+	rowEnd = array(list(rowStart[1:]) + [globalSize])
+
+	localPairs = distribIndexList[procId]
+	globalRow = [indexPairs[i, 0] for i in localPairs]
+	globalCol = [indexPairs[i, 1] for i in localPairs]
+
+	#Rows we contribute to on the other procs, one slot per row
+	sendRows = GetRemoteRows(indexPairs, localPairs, procId, rowStart, rowEnd)
+	sendProcList = sorted(sendRows.keys())
+	sendOffset = [0]
+	slotMap = {}
+	for proc in sendProcList:
+		for row in sendRows[proc]:
+			slotMap[row] = len(slotMap)
+		sendOffset.append(len(slotMap))
+	sendSlot = [slotMap.get(int(row), -1) for row in globalRow]
+
+	#Rows the other procs contribute to on this proc, in the same order
+	#as they set up their send slots
+	recvProcList = []
+	recvOffset = [0]
+	recvLocalRow = []
+	for curProc in range(procCount):
+		if curProc == procId:
+			continue
+		remoteRows = GetRemoteRows(indexPairs, distribIndexList[curProc], curProc, rowStart, rowEnd)
+		if procId in remoteRows:
+			recvProcList.append(curProc)
+			recvLocalRow += [row - rowStart[procId] for row in remoteRows[procId]]
+			recvOffset.append(len(recvLocalRow))
+
+	return CommunicationPlan(globalRow, globalCol, sendSlot, sendProcList, sendOffset, recvProcList, recvOffset, recvLocalRow)
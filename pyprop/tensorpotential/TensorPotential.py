@@ -31,6 +31,7 @@ class TensorPotential(PotentialWrapper):
 		self.OriginalPotential = None
 
 	def ApplyConfigSection(self, configSection):
+		self.ConfigSection = configSection
 		self.DebugPotential = False
 		if hasattr(configSection, "debug_potential"):
 			self.DebugPotential = configSection.debug_potential
@@ -71,24 +72,190 @@ class TensorPotential(PotentialWrapper):
 			serialization.LoadTensorPotential(filename, datasetPath, self, distr)
 
 		else:
-			potentialDataBuffer = generator.GeneratePotential(configSection)
-			self.PotentialDataBuffer = potentialDataBuffer
-			self.PotentialData = potentialDataBuffer.GetArray()
-			self.OriginalPotential = getattr(generator, "OriginalPotential", None)
+			cacheDir = GetTensorPotentialCacheDir(configSection)
+			if cacheDir != None:
+				self.LoadOrGeneratePotential(configSection, generator, cacheDir)
+			else:
+				self.GeneratePotential(configSection, generator)
+
+	def GeneratePotential(self, configSection, generator):
+		potentialDataBuffer = generator.GeneratePotential(configSection)
+		self.PotentialDataBuffer = potentialDataBuffer
+		self.PotentialData = potentialDataBuffer.GetArray()
+		self.OriginalPotential = getattr(generator, "OriginalPotential", None)
+
+	def LoadOrGeneratePotential(self, configSection, generator, cacheDir):
+		"""
+		Loads the potential from the tensor potential cache if it has been
+		generated before, otherwise generates it and stores it in the cache.
+		See TensorPotentialCache.py
+		"""
+		repr = self.psi.GetRepresentation()
+		distr = repr.GetDistributedModel()
+		key = GetTensorPotentialCacheKey(configSection, self.GeometryList, repr)
+		filename = GetTensorPotentialCacheFile(cacheDir, key)
+
+		potShape = [geomInfo.GetLocalBasisPairCount() for geomInfo in self.GeometryList]
+		dataBuffer = CreateInstanceRank("core.DataBuffer", self.Rank)
+		dataBuffer.ResizeArray(array(potShape))
+		self.PotentialDataBuffer = dataBuffer
+		self.PotentialData = dataBuffer.GetArray()
+
+		if LoadCachedTensorPotential(filename, self, distr):
+			PrintOut("Loaded tensor potential (%s) from cache %s" % (self.Name, filename))
+		else:
+			self.PotentialDataBuffer = None
+			self.PotentialData = None
+			self.GeneratePotential(configSection, generator)
+			SaveCachedTensorPotential(filename, self, distr, getattr(configSection, "Config", None))
+			PrintOut("Stored tensor potential (%s) in cache %s" % (self.Name, filename))
 		
 
 	def SetupStep(self, timestep):
 		self.BasisPairs = [geom.GetBasisPairs() for geom in self.GeometryList]
 
-		multiplyFuncName = "core.TensorPotentialMultiply_" + "_".join([geom.GetStorageId() for geom in self.GeometryList])
+		if self.IsBlockSparse():
+			self.SetupBlockSparsePotential()
+			return
+
+		self.StorageIds = None
+		multiplyFuncName = "core.TensorPotentialMultiply_" + "_".join(self.GetStorageIds())
 		try:
 			self.MultiplyFunction = eval(multiplyFuncName)
 		except:
 			print "ERROR: Could not find multiplyfunction for potential: %s" % multiplyFuncName
+
+		if IsAutotuneEnabled(getattr(self, "ConfigSection", None)):
+			self.AutotuneStorage(timestep)
+
+	def GetStorageIds(self):
+		"""
+		Returns the storage ids used to multiply the potential, which are
+		the storage ids of the geometries, unless other storages have been
+		selected by AutotuneStorage
+		"""
+		if getattr(self, "StorageIds", None) == None:
+			return [geom.GetStorageId() for geom in self.GeometryList]
+		return self.StorageIds
+
+	def GetStorageArguments(self, rank, psi):
+		"""
+		Returns the multiply arguments of the storage used in rank
+		"""
+		geom = self.GeometryList[rank]
+		if self.GetStorageIds()[rank] != geom.GetStorageId():
+			#The alternative storages (see GetAlternativeStorageIds) take no arguments
+			return []
+		return geom.GetMultiplyArguments(psi)
+
+	def GetAlternativeStorageIds(self, rank):
+		"""
+		Returns the storage ids which can multiply the potential data of
+		rank as it is laid out by the geometry, the storage of the geometry
+		first. In a rank which is not distributed
+		- Distr (GeometryInfoCommonBandedDistributed) can be multiplied as BandNH
+		- Simp with the basis pairs of a full dense matrix can be multiplied as Dense
+		"""
+		geom = self.GeometryList[rank]
+		storageId = geom.GetStorageId()
+		repr = self.psi.GetRepresentation()
+		if repr.GetDistributedModel().IsDistributedRank(rank):
+			return [storageId]
+
+		if storageId == "Distr" and isinstance(geom, GeometryInfoCommonBandedDistributed):
+			return [storageId, "BandNH"]
+
+		if storageId == "Simp":
+			count = int(repr.GetFullShape()[rank])
+			pairs = geom.GetBasisPairs()
+			if pairs.shape == (count**2, 2) and numpy.all(pairs[:,0] == repeat(arange(count), count)) \
+					and numpy.all(pairs[:,1] == tile(arange(count), count)):
+				return [storageId, "Dense"]
+
+		return [storageId]
+
+	def AutotuneStorage(self, timestep):
+		"""
+		Times the multiply functions of all combinations of alternative
+		storages (see GetAlternativeStorageIds) on psi, and selects the
+		fastest. The potential data is used as it is, so no potential is
+		generated more than once
+		"""
+		storageLists = [[]]
+		for rank in range(self.Rank):
+			storageLists = [ids + [storageId] for ids in storageLists for storageId in self.GetAlternativeStorageIds(rank)]
+		candidates = ["_".join(ids) for ids in storageLists if hasattr(core, "TensorPotentialMultiply_" + "_".join(ids))]
+		if len(candidates) < 2:
+			return
+
+		def select(signature):
+			self.StorageIds = signature.split("_")
+			self.MultiplyFunction = getattr(core, "TensorPotentialMultiply_" + signature)
+
+		destPsi = self.psi.Copy()
+		def run():
+			self.MultiplyPotential(self.psi, destPsi, 0, timestep)
+
+		def output():
+			destPsi.GetData()[:] = 0
+			self.MultiplyPotential(self.psi, destPsi, 0, timestep)
+			return destPsi.GetData().copy()
+
+		distr = self.psi.GetRepresentation().GetDistributedModel()
+		shape = tuple(self.psi.GetData().shape) + tuple(self.PotentialData.shape)
+		kernel = "TensorPotential(%s)" % candidates[0]
+		tuner = GetAutotuner(self.ConfigSection)
+		tuner.Tune(kernel, shape, candidates, select, run, distr, output=output)
 		
+	def IsBlockSparse(self):
+		"""
+		Potentials with BSR storage in the first rank are applied by
+		core.BlockSparsePotential instead of the generated multiply functions
+		"""
+		storageIds = [geom.GetStorageId() for geom in self.GeometryList]
+		if "BSR" in storageIds[1:]:
+			raise Exception("Potential %s: BSR storage is only supported in the first rank" % self.Name)
+		return storageIds[0] == "BSR"
+
+	def SetupBlockSparsePotential(self):
+		repr = self.psi.GetRepresentation()
+		if not repr.GetDistributedModel().IsSingleProc():
+			raise Exception("Potential %s: BSR storage does not support distributed wavefunctions" % self.Name)
+
+		potential = CreateInstanceRank("core.BlockSparsePotential", self.Rank)
+		potential.SetPotential(self.PotentialData, self.GeometryList[0].GetBasisPairs())
+		fullShape = repr.GetFullShape()
+		for rank in range(1, self.Rank):
+			entries = GetBlockSparseRankEntries(self.GeometryList[rank], int(fullShape[rank]))
+			potential.SetRankEntries(rank, entries)
+
+		PrintOut("Block sparse potential (%s): %i of %i blocks are nonzero" % (self.Name, potential.GetBlockCount(), self.PotentialData.shape[0]))
+		self.BlockSparsePotential = potential
+
 	def AdvanceStep(self, t, timestep):
 		raise NotImplementedException("TensorPotentials can not be exponentiated directly")
 
+	def CreateHamiltonianTerm(self):
+		"""
+		Returns a core.HamiltonianTerm which applies this potential (without the
+		time function) from C++. The term references PotentialData and the
+		multiply arguments of the geometries, which must be kept alive.
+		"""
+		if self.IsBlockSparse():
+			if not hasattr(self, "BlockSparsePotential"):
+				self.SetupBlockSparsePotential()
+			return self.BlockSparsePotential
+
+		termFuncName = "core.TensorPotentialTerm_" + "_".join(self.GetStorageIds())
+		termFunc = eval(termFuncName)
+
+		argList = [self.PotentialData]
+		for i in range(len(self.GeometryList)):
+			argList += self.GetStorageArguments(i, self.psi)
+		self.HamiltonianTermArguments = argList
+
+		return termFunc(*argList)
+
 	def MultiplyPotential(self, srcPsi, destPsi, t, timestep):
 		rank = srcPsi.GetRank()
 		
@@ -99,14 +266,18 @@ class TensorPotential(PotentialWrapper):
 		if self.IsTimeDependent:
 			timeScaling = self.TimeFunction(t)
 		
+		if self.IsBlockSparse():
+			self.BlockSparsePotential.MultiplyPotential(source, dest, timeScaling)
+			return
+
 		#TODO: Implement support for parallelization. 
 
 		#Construct argument list
 		#Default parameters
 		argList = [self.PotentialData, timeScaling, source, dest]
 		#Parameters for each storage
-		for i, geom in enumerate(self.GeometryList):
-			argList += geom.GetMultiplyArguments(srcPsi)
+		for i in range(len(self.GeometryList)):
+			argList += self.GetStorageArguments(i, srcPsi)
 
 		#Perform multiplication
 		self.MultiplyFunction(*argList)
@@ -131,7 +302,7 @@ class TensorPotential(PotentialWrapper):
 		"""
 		#We can consolidate self and otherPot if all the index pairs are the same,
 		#And self and otherPot has the same time dependency
-		canConsolidate = True
+		canConsolidate = isinstance(otherPot, TensorPotential)
 
 		#If one of the potentials is time dependent the other must also be
 		if canConsolidate and self.IsTimeDependent != otherPot.IsTimeDependent:
@@ -160,4 +331,51 @@ class TensorPotential(PotentialWrapper):
 					break
 
 
-		return canConsolidate		
+		return canConsolidate
+
+	def Consolidate(self, otherPot):
+		"""
+		Adds otherPot to this potential. CanConsolidate(otherPot) must be True
+		"""
+		self.PotentialData[:] += otherPot.PotentialData
+
+
+#Storages where only the upper triangle is stored, and the lower
+#triangle is given by hermitian symmetry
+HermitianStorageIds = ["Herm", "Band"]
+
+#Storages which can be used in the ranks of a BSR potential after the first
+BlockSparseRankStorageIds = ["Ident", "Diag", "Simp", "Herm", "Band", "BandNH"]
+
+def GetBlockSparseRankEntries(geometryInfo, size):
+	"""
+	Returns the matrix elements of a (non-distributed) geometry as an array of
+	(row, col, potentialIndex, conjugate), see core.BlockSparsePotential
+	"""
+	storageId = geometryInfo.GetStorageId()
+	if storageId not in BlockSparseRankStorageIds:
+		raise Exception("Storage %s can not be used in a BSR potential" % storageId)
+
+	if storageId == "Ident":
+		return array([[i, i, 0, 0] for i in range(size)], dtype=int32)
+
+	#Padded storages (Band, BandNH) fill the unused elements with a dummy
+	#pair, only the elements at their position in the BLAS banded storage
+	#are used, such that core.BlockSparsePotential can apply them with BLAS
+	pairs = geometryInfo.GetBasisPairs()
+	bandCount = len(pairs) // size
+	entries = []
+	usedPairs = set()
+	for index, (row, col) in enumerate(pairs):
+		if storageId == "Band" and index != row * bandCount + col - row:
+			continue
+		if storageId == "BandNH" and index != col * bandCount + (bandCount - 1) // 2 + row - col:
+			continue
+		if (row, col) in usedPairs:
+			continue
+		usedPairs.add((row, col))
+		entries.append((row, col, index, 0))
+		if storageId in HermitianStorageIds and row != col:
+			entries.append((col, row, index, 1))
+
+	return array(entries, dtype=int32)
@@ -0,0 +1,141 @@
+"""
+Automatic caching of generated tensor potentials.
+
+If a cache directory is specified, either with 'cache_dir' in the potential
+config section, or with 'tensor_potential_cache_dir' in the Propagation section,
+TensorPotential will look for a previously generated potential in the cache
+before generating it. Cached potentials are stored in
+
+	<cache_dir>/tensorpotential_<key>.h5
+
+where key is a checksum of
+	- the (raw) config section of the potential, except time_function
+	- the Representation and Rank%i config sections
+	- the global grid of each rank in the representation
+	- the storage id and global basis pairs of each geometry
+
+The potential is stored as a global dataset, so a cached potential can be
+loaded by any distribution of the basis pairs (CheckLocalSlab verifies that
+the local slab is the same). On a hit, all procs read their local slab
+concurrently.
+
+NOTE: The cache key depends on the config, and not on the code evaluating the
+potential. Clear the cache directory if a potential function is changed.
+"""
+
+import hashlib
+
+TensorPotentialCacheIgnoredOptions = ["time_function", "cache_dir", "debug_potential"]
+
+
+def GetRawConfigSectionItems(cfg, sectionName):
+	"""
+	Returns the sorted list of unevaluated (name, value) pairs of a config
+	section, following 'base' references as Section.LoadConfig does
+	"""
+	items = {}
+	for optionName in cfg.options(sectionName):
+		value = cfg.get(sectionName, optionName, raw=True)
+		if optionName == "base":
+			items.update(dict(GetRawConfigSectionItems(cfg, eval(value))))
+		else:
+			items[optionName] = value
+	return sorted(items.items())
+
+
+def GetTensorPotentialCacheDir(configSection):
+	"""
+	Returns the tensor potential cache directory for a potential config section,
+	or None if caching is not enabled
+	"""
+	if hasattr(configSection, "cache_dir"):
+		return configSection.cache_dir
+	conf = getattr(configSection, "Config", None)
+	if conf != None and hasattr(conf, "Propagation"):
+		return getattr(conf.Propagation, "tensor_potential_cache_dir", None)
+	return None
+
+
+def GetTensorPotentialCacheKey(configSection, geometryList, representation):
+	"""
+	Calculates the cache key of a tensor potential. See the module doc
+	for which parameters are included.
+	"""
+	checksum = hashlib.md5()
+
+	conf = getattr(configSection, "Config", None)
+	if conf == None:
+		raise Exception("Tensor potential caching requires a config section loaded from a config file")
+	cfg = conf.cfgObj
+
+	#Potential config section
+	for optionName, value in GetRawConfigSectionItems(cfg, configSection.name):
+		if optionName not in TensorPotentialCacheIgnoredOptions:
+			checksum.update("%s=%s;" % (optionName, value))
+
+	#Basis parameters
+	rank = len(geometryList)
+	sectionNames = ["Representation"] + ["Rank%i" % i for i in range(rank)]
+	for sectionName in sectionNames:
+		if cfg.has_section(sectionName):
+			checksum.update("[%s]" % sectionName)
+			for optionName, value in GetRawConfigSectionItems(cfg, sectionName):
+				checksum.update("%s=%s;" % (optionName, value))
+
+	for i in range(rank):
+		grid = asarray(representation.GetGlobalGrid(i))
+		checksum.update(grid.tostring())
+
+	#Geometries
+	for geom in geometryList:
+		checksum.update(geom.GetStorageId())
+		basisPairs = asarray(geom.GetGlobalBasisPairs(), dtype=int32)
+		checksum.update(str(basisPairs.shape))
+		checksum.update(basisPairs.tostring())
+
+	return checksum.hexdigest()
+
+
+def GetTensorPotentialCacheFile(cacheDir, key):
+	return os.path.join(cacheDir, "tensorpotential_%s.h5" % key)
+
+
+def LoadCachedTensorPotential(filename, potential, distr):
+	"""
+	Loads a cached tensor potential into potential.PotentialData if filename
+	exists on all procs. Returns True on a hit, False otherwise.
+	"""
+	#All procs must agree on whether the potential is cached
+	isCached = float(os.path.exists(filename))
+	if not distr.IsSingleProc():
+		isCached = distr.GetGlobalSum(isCached) / distr.ProcCount
+	if isCached != 1:
+		return False
+
+	serialization.LoadTensorPotential(filename, "/potential", potential, distr, concurrent=True)
+	return True
+
+
+def SaveCachedTensorPotential(filename, potential, distr, conf):
+	"""
+	Stores a generated tensor potential in the cache. The potential is written
+	to a temporary file which is renamed when all procs are finished, so that
+	other jobs never see partially written potentials.
+	"""
+	cacheDir = os.path.dirname(filename)
+	if distr.ProcId == 0 and cacheDir and not os.path.exists(cacheDir):
+		os.makedirs(cacheDir)
+	tempFilename = filename + ".tmp%i" % os.getpid()
+	if not distr.IsSingleProc():
+		#All procs must write to the temporary file of proc 0
+		tempFilename = filename + ".tmp%i" % int(distr.GetGlobalSum(float(os.getpid() if distr.ProcId == 0 else 0)))
+
+	if distr.ProcId == 0 and os.path.exists(tempFilename):
+		os.remove(tempFilename)
+	serialization.SaveTensorPotential(tempFilename, "/potential", potential, distr, conf)
+
+	if distr.ProcId == 0:
+		os.rename(tempFilename, filename)
+	if not distr.IsSingleProc():
+		distr.GlobalBarrier()
+
@@ -133,6 +133,8 @@ class GeometryInfoBsplineBandedDistributed(GeometryInfoDistributedBase):
 	def SetupBasisPairs(self):
 		distr = self.Representation.GetDistributedModel()
 		rank = self.Representation.GetBaseRank()
+		if distr.HasPartitionWeights(rank, int(self.BSplineObject.NumberOfBSplines)):
+			raise Exception("Distributed banded storage does not support cost-weighted partitioning of rank %i" % rank)
 		localRange = distr.GetLocalIndexRange(self.GetGlobalBasisPairCount(), rank)
 
 		count = self.GetGlobalBasisPairCount()
@@ -32,6 +32,25 @@ class GeometryInfoCoupledSphericalHarmonic(GeometryInfoBase):
 		return [self.GetBasisPairs()]
 
 
+class GeometryInfoCoupledSphericalHarmonicBlockSparse(GeometryInfoCoupledSphericalHarmonic):
+	"""
+	Geometry information for coupled spherical harmonic geometries stored
+	as block sparse rows (BSR). The basis pairs are the same as for
+	GeometryInfoCoupledSphericalHarmonic, but the potential is applied by
+	core.BlockSparsePotential, which applies the blocks of the other ranks
+	for every nonzero angular coupling, one block row at the time.
+
+	Select with the geometry 'bsr_<geometry>', i.e. 'bsr_selectionrule_r12_4'.
+	The wavefunction can not be distributed.
+	"""
+
+	def GetStorageId(self):
+		return "BSR"
+
+	def GetMultiplyArguments(self, psi):
+		raise Exception("BSR storage is applied by core.BlockSparsePotential, not by TensorPotentialMultiply")
+
+
 class GeometryInfoCoupledSphericalHarmonicDistributed(GeometryInfoDistributedBase):
 	"""
 	Geometry information for coupled spherical harmonic geometries using distributed matvec.
@@ -57,12 +76,12 @@ class GeometryInfoCoupledSphericalHarmonicDistributed(GeometryInfoDistributedBas
 	def GetMultiplyArguments(self, psi):
 		if self.MultiplyArguments == None:
 			if self.StepArguments == None:
-				self.SetupLocalBasisPairs()
+				self.SetupBasisPairs()
 			if self.TempArrays == None:
 				self.SetupTempArrays(psi)
-			self.MultiplyArguments = self.StepArguments + self.TempArrays
+			self.MultiplyArguments = self.StepArguments + self.TempArrays + self.GroupArguments
 
-		return self.StepArguments + self.TempArrays
+		return self.MultiplyArguments
 	
 	def SetupBasisPairs(self):
 		indexPairs = self.SelectionRule.GetBasisPairs(self.Representation)
@@ -72,23 +91,27 @@ class GeometryInfoCoupledSphericalHarmonicDistributed(GeometryInfoDistributedBas
 		globalSize = self.Representation.GetFullShape()[0]
 	
 		distribIndexList = SetupDistributedIndexList(globalSize, indexPairs, distrib, rank)
-		self.LocalBasisPairIndices = array(distribIndexList[distrib.ProcId])
-		stepList = SetupStepList(globalSize, indexPairs, distribIndexList, distrib, rank)
-		self.MaxRecvCount = max([len(step.RecvProcList) for step in stepList])
+		procCount, procId = GetGroupProcInfo(distrib, rank)
+		self.LocalBasisPairIndices = array(distribIndexList[procId])
+		plan = SetupCommunicationPlan(globalSize, indexPairs, distribIndexList, distrib, rank)
+		self.SendSlotCount = plan.GetSendSlotCount()
+		self.RecvSlotCount = plan.GetRecvSlotCount()
 
-		self.StepArguments = [int(globalSize)] + list(StepListToArray(stepList))
-		self.LocalIndexPairs = array([[step.GlobalRow, step.GlobalCol] for step in stepList if step.LocalMatrixIndex!=-1], dtype=int32)
+		self.StepArguments = [int(globalSize)] + plan.GetArguments()
+		self.GroupArguments = GetGroupArguments(distrib, rank, globalSize)
+		self.LocalIndexPairs = array(zip(plan.GlobalRow, plan.GlobalCol), dtype=int32)
 
 	def SetupTempArrays(self, psi):
 		dataShape = psi.GetData().shape
 		rank = self.Representation.GetBaseRank()
 
-		recvTempShape = list(dataShape)
-		recvTempShape[rank] = self.MaxRecvCount
+		#The temp arrays hold a single slice of the ranks before rank
+		recvTempShape = [1]*rank + list(dataShape[rank:])
+		recvTempShape[rank] = max(1, self.RecvSlotCount)
 		recvTemp = zeros(recvTempShape, dtype=complex)
 
-		sendTempShape = list(dataShape)
-		sendTempShape[rank] = 2
+		sendTempShape = [1]*rank + list(dataShape[rank:])
+		sendTempShape[rank] = max(1, self.SendSlotCount)
 		sendTemp = zeros(sendTempShape, dtype=complex)
 
 		self.TempArrays = [recvTemp, sendTemp]
@@ -132,7 +155,12 @@ class BasisfunctionCoupledSphericalHarmonic(BasisfunctionBase):
 		
 	def GetGeometryInfo(self, geometryName):
 		geom = geometryName.lower().strip()
-		if geom == "identity":
+		if geom.startswith("bsr_"):
+			geometryInfo = self.GetGeometryInfo(geom[len("bsr_"):])
+			if geometryInfo.__class__ != GeometryInfoCoupledSphericalHarmonic:
+				raise UnsupportedGeometryException("Geometry '%s' can not be stored as BSR (distributed or not a selection rule)" % geometryName)
+			return GeometryInfoCoupledSphericalHarmonicBlockSparse(self.BasisRepresentation, geometryInfo.SelectionRule)
+		elif geom == "identity":
 			return GeometryInfoCommonIdentity(False)
 		elif geom == "diagonal":
 			selectionRule = core.CoupledSphericalSelectionRuleDiagonal()
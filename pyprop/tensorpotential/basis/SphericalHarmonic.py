@@ -57,12 +57,12 @@ class GeometryInfoSphericalHarmonicDistributed(GeometryInfoDistributedBase):
 	def GetMultiplyArguments(self, psi):
 		if self.MultiplyArguments == None:
 			if self.StepArguments == None:
-				self.SetupLocalBasisPairs()
+				self.SetupBasisPairs()
 			if self.TempArrays == None:
 				self.SetupTempArrays(psi)
-			self.MultiplyArguments = self.StepArguments + self.TempArrays
+			self.MultiplyArguments = self.StepArguments + self.TempArrays + self.GroupArguments
 
-		return self.StepArguments + self.TempArrays
+		return self.MultiplyArguments
 	
 	def SetupBasisPairs(self):
 		indexPairs = self.SelectionRule.GetBasisPairs(self.Representation)
@@ -72,23 +72,27 @@ class GeometryInfoSphericalHarmonicDistributed(GeometryInfoDistributedBase):
 		globalSize = self.Representation.GetFullShape()[0]
 	
 		distribIndexList = SetupDistributedIndexList(globalSize, indexPairs, distrib, rank)
-		self.LocalBasisPairIndices = array(distribIndexList[distrib.ProcId])
-		stepList = SetupStepList(globalSize, indexPairs, distribIndexList, distrib, rank)
-		self.MaxRecvCount = max([len(step.RecvProcList) for step in stepList])
+		procCount, procId = GetGroupProcInfo(distrib, rank)
+		self.LocalBasisPairIndices = array(distribIndexList[procId])
+		plan = SetupCommunicationPlan(globalSize, indexPairs, distribIndexList, distrib, rank)
+		self.SendSlotCount = plan.GetSendSlotCount()
+		self.RecvSlotCount = plan.GetRecvSlotCount()
 
-		self.StepArguments = [int(globalSize)] + list(StepListToArray(stepList))
-		self.LocalIndexPairs = array([[step.GlobalRow, step.GlobalCol] for step in stepList if step.LocalMatrixIndex!=-1], dtype=int32)
+		self.StepArguments = [int(globalSize)] + plan.GetArguments()
+		self.GroupArguments = GetGroupArguments(distrib, rank, globalSize)
+		self.LocalIndexPairs = array(zip(plan.GlobalRow, plan.GlobalCol), dtype=int32)
 
 	def SetupTempArrays(self, psi):
 		dataShape = psi.GetData().shape
 		rank = self.Representation.GetBaseRank()
 
-		recvTempShape = list(dataShape)
-		recvTempShape[rank] = self.MaxRecvCount
+		#The temp arrays hold a single slice of the ranks before rank
+		recvTempShape = [1]*rank + list(dataShape[rank:])
+		recvTempShape[rank] = max(1, self.RecvSlotCount)
 		recvTemp = zeros(recvTempShape, dtype=complex)
 
-		sendTempShape = list(dataShape)
-		sendTempShape[rank] = 2
+		sendTempShape = [1]*rank + list(dataShape[rank:])
+		sendTempShape[rank] = max(1, self.SendSlotCount)
 		sendTemp = zeros(sendTempShape, dtype=complex)
 
 		self.TempArrays = [recvTemp, sendTemp]
@@ -13,6 +13,8 @@ execfile(__path__[0] + "/tensorpotential/GeometryInfo.py")
 execfile(__path__[0] + "/tensorpotential/SimpleDistributed.py")
 execfile(__path__[0] + "/tensorpotential/TensorPotentialGenerator.py")
 execfile(__path__[0] + "/tensorpotential/TensorPotential.py")
+execfile(__path__[0] + "/tensorpotential/TensorPotentialCache.py")
+execfile(__path__[0] + "/tensorpotential/FactoredTensorPotential.py")
 execfile(__path__[0] + "/tensorpotential/EpetraPotential.py")
 
 #Basis-function specific implementations